@@ -837,9 +837,6 @@ CRealControlSocket::CRealControlSocket(CFileZillaEnginePrivate *pEngine)
 
 	m_pBackend = new CSocketBackend(this, m_pSocket, m_pEngine->GetRateLimiter());
 	m_pProxyBackend = 0;
-
-	m_pSendBuffer = 0;
-	m_nSendBufferLen = 0;
 }
 
 CRealControlSocket::~CRealControlSocket()
@@ -856,13 +853,9 @@ CRealControlSocket::~CRealControlSocket()
 bool CRealControlSocket::Send(const char *buffer, int len)
 {
 	SetWait(true);
-	if (m_pSendBuffer) {
-		char *tmp = m_pSendBuffer;
-		m_pSendBuffer = new char[m_nSendBufferLen + len];
-		memcpy(m_pSendBuffer, tmp, m_nSendBufferLen);
-		memcpy(m_pSendBuffer + m_nSendBufferLen, buffer, len);
-		m_nSendBufferLen += len;
-		delete [] tmp;
+	if (!m_sendQueue.empty()) {
+		// Preserve ordering, remainder gets sent once the socket becomes writable
+		m_sendQueue.Append(buffer, len);
 	}
 	else {
 		int error;
@@ -880,11 +873,8 @@ bool CRealControlSocket::Send(const char *buffer, int len)
 		if (written)
 			SetActive(CFileZillaEngine::send);
 
-		if (written < len) {
-			m_nSendBufferLen = len - written;
-			m_pSendBuffer = new char[m_nSendBufferLen];
-			memcpy(m_pSendBuffer, buffer, len - written);
-		}
+		if (written < len)
+			m_sendQueue.Append(buffer + written, len - written);
 	}
 
 	return true;
@@ -945,42 +935,22 @@ void CRealControlSocket::OnReceive()
 
 void CRealControlSocket::OnSend()
 {
-	if (m_pSendBuffer)
+	if (!m_sendQueue.empty())
 	{
-		if (!m_nSendBufferLen)
-		{
-			delete [] m_pSendBuffer;
-			m_pSendBuffer = 0;
-			return;
-		}
-
 		int error;
-		int written = m_pBackend->Write(m_pSendBuffer, m_nSendBufferLen, error);
+		int written = m_sendQueue.Flush(*m_pBackend, error);
 		if (written < 0)
 		{
-			if (error != EAGAIN)
-			{
-				LogMessage(MessageType::Error, _("Could not write to socket: %s"), CSocket::GetErrorDescription(error));
-				if (GetCurrentCommandId() != Command::connect)
-					LogMessage(MessageType::Error, _("Disconnected from server"));
-				DoClose();
-			}
+			LogMessage(MessageType::Error, _("Could not write to socket: %s"), CSocket::GetErrorDescription(error));
+			if (GetCurrentCommandId() != Command::connect)
+				LogMessage(MessageType::Error, _("Disconnected from server"));
+			DoClose();
 			return;
 		}
 
 		if (written) {
 			SetActive(CFileZillaEngine::send);
 		}
-
-		if (written == m_nSendBufferLen) {
-			m_nSendBufferLen = 0;
-			delete [] m_pSendBuffer;
-			m_pSendBuffer = 0;
-		}
-		else {
-			memmove(m_pSendBuffer, m_pSendBuffer + written, m_nSendBufferLen - written);
-			m_nSendBufferLen -= written;
-		}
 	}
 }
 
@@ -1080,12 +1050,7 @@ void CRealControlSocket::ResetSocket()
 {
 	m_pSocket->Close();
 
-	if (m_pSendBuffer)
-	{
-		delete [] m_pSendBuffer;
-		m_pSendBuffer = 0;
-		m_nSendBufferLen = 0;
-	}
+	m_sendQueue.clear();
 
 	if (m_pProxyBackend)
 	{
@@ -4,6 +4,7 @@
 #include "socket.h"
 #include "logging_private.h"
 #include "backend.h"
+#include "sendqueue.h"
 
 class COpData
 {
@@ -289,8 +290,7 @@ protected:
 	CBackend* m_pBackend;
 	CProxySocket* m_pProxyBackend;
 
-	char *m_pSendBuffer;
-	int m_nSendBufferLen;
+	CSendQueue m_sendQueue;
 };
 
 #endif
@@ -42,6 +42,7 @@ CRawTransferOpData::CRawTransferOpData()
 	, bPasv(true)
 	, bTriedPasv()
 	, bTriedActive()
+	, blockMode()
 	, port()
 {
 }
@@ -59,6 +60,8 @@ CFtpFileTransferOpData::CFtpFileTransferOpData(bool is_download, const wxString&
 {
 	pIOThread = 0;
 	fileDidExist = true;
+	hashAlgorithm = HashAlgorithm::none;
+	hashNeedsOpts = false;
 }
 
 CFtpFileTransferOpData::~CFtpFileTransferOpData()
@@ -83,13 +86,16 @@ enum filetransferStates
 	filetransfer_transfer,
 	filetransfer_waittransfer,
 	filetransfer_waitresumetest,
-	filetransfer_mfmt
+	filetransfer_mfmt,
+	filetransfer_hashopts,
+	filetransfer_hash
 };
 
 enum rawtransferStates
 {
 	rawtransfer_init = 0,
 	rawtransfer_type,
+	rawtransfer_mode,
 	rawtransfer_port_pasv,
 	rawtransfer_rest,
 	rawtransfer_transfer,
@@ -207,6 +213,8 @@ CFtpControlSocket::~CFtpControlSocket()
 	m_pSocket->SetSynchronousReadCallback(0);
 
 	DoClose();
+
+	delete m_pIdleTransferSocket;
 }
 
 void CFtpControlSocket::OnReceive()
@@ -317,6 +325,16 @@ void CFtpControlSocket::ParseLine(wxString line)
 				CServerCapabilities::SetCapability(*m_pCurrentServer, rest_stream, yes);
 			else if (up == _T(" EPSV"))
 				CServerCapabilities::SetCapability(*m_pCurrentServer, epsv_command, yes);
+			else if (up.Left(6) == _T(" HASH "))
+				CServerCapabilities::SetCapability(*m_pCurrentServer, hash_command, yes, line.Mid(6));
+			else if (up == _T(" XSHA256"))
+				CServerCapabilities::SetCapability(*m_pCurrentServer, xsha256_command, yes);
+			else if (up == _T(" XSHA1"))
+				CServerCapabilities::SetCapability(*m_pCurrentServer, xsha1_command, yes);
+			else if (up == _T(" XMD5"))
+				CServerCapabilities::SetCapability(*m_pCurrentServer, xmd5_command, yes);
+			else if (up == _T(" XCRC"))
+				CServerCapabilities::SetCapability(*m_pCurrentServer, xcrc_command, yes);
 		}
 		else if (pData->opState == LOGON_WELCOME) {
 			if (!pData->gotFirstWelcomeLine) {
@@ -1374,8 +1392,7 @@ int CFtpControlSocket::ListSubcommandResult(int prevResult)
 			}
 		}
 
-		delete m_pTransferSocket;
-		m_pTransferSocket = new CTransferSocket(m_pEngine, this, TransferMode::list);
+		CreateTransferSocket(TransferMode::list, *pData);
 
 		// Assume that a server supporting UTF-8 does not send EBCDIC listings.
 		listingEncoding::type encoding = listingEncoding::unknown;
@@ -1428,8 +1445,7 @@ int CFtpControlSocket::ListSubcommandResult(int prevResult)
 					// Reset status
 					pData->transferEndReason = TransferEndReason::successful;
 					pData->tranferCommandSent = false;
-					delete m_pTransferSocket;
-					m_pTransferSocket = new CTransferSocket(m_pEngine, this, TransferMode::list);
+					CreateTransferSocket(TransferMode::list, *pData);
 					pData->m_pDirectoryListingParser->Reset();
 					m_pTransferSocket->m_pDirectoryListingParser = pData->m_pDirectoryListingParser;
 
@@ -1495,8 +1511,7 @@ int CFtpControlSocket::ListSubcommandResult(int prevResult)
 						// Reset status
 						pData->transferEndReason = TransferEndReason::successful;
 						pData->tranferCommandSent = false;
-						delete m_pTransferSocket;
-						m_pTransferSocket = new CTransferSocket(m_pEngine, this, TransferMode::list);
+						CreateTransferSocket(TransferMode::list, *pData);
 						pData->m_pDirectoryListingParser->Reset();
 						m_pTransferSocket->m_pDirectoryListingParser = pData->m_pDirectoryListingParser;
 
@@ -1726,7 +1741,20 @@ int CFtpControlSocket::ResetOperation(int nErrorCode)
 
 	CTransferSocket* pTransferSocket = m_pTransferSocket;
 	m_pTransferSocket = 0;
-	delete pTransferSocket;
+	if (pTransferSocket && nErrorCode == FZ_REPLY_OK && pTransferSocket->CanReuse() &&
+		m_pCurOpData && m_pCurOpData->opId == Command::rawtransfer)
+	{
+		// Keep the data connection open for the next block mode transfer
+		pTransferSocket->Detach();
+		delete m_pIdleTransferSocket;
+		m_pIdleTransferSocket = pTransferSocket;
+	}
+	else
+		delete pTransferSocket;
+	if ((nErrorCode & FZ_REPLY_DISCONNECTED) == FZ_REPLY_DISCONNECTED) {
+		delete m_pIdleTransferSocket;
+		m_pIdleTransferSocket = 0;
+	}
 	delete m_pIPResolver;
 	m_pIPResolver = 0;
 
@@ -2226,6 +2254,42 @@ int CFtpControlSocket::FileTransfer(const wxString localFile, const CServerPath
 	return ParseSubcommandResult(FZ_REPLY_OK);
 }
 
+namespace {
+// Extracts the hex digest from replies to HASH, XSHA256 and the like.
+// HASH replies are of the form "SHA-256 0-49 <digest> <filename>", the
+// others usually just contain the digest.
+wxString ExtractDigest(wxString const& reply, unsigned int digestLength)
+{
+	wxStringTokenizer tokens(reply, _T(" "), wxTOKEN_STRTOK);
+	while (tokens.HasMoreTokens()) {
+		wxString token = tokens.GetNextToken();
+		if (token.empty() || token.size() > digestLength)
+			continue;
+
+		bool hex = true;
+		for (auto const& c : token) {
+			if (!wxIsxdigit(c)) {
+				hex = false;
+				break;
+			}
+		}
+		if (!hex)
+			continue;
+
+		// Some servers omit leading zeros of CRC32 values
+		if (token.size() < digestLength) {
+			if (digestLength != 8)
+				continue;
+			token.Pad(digestLength - token.size(), '0', false);
+		}
+
+		return token.Lower();
+	}
+
+	return wxString();
+}
+}
+
 int CFtpControlSocket::FileTransferParseResponse()
 {
 	LogMessage(MessageType::Debug_Verbose, _T("FileTransferParseResponse()"));
@@ -2316,6 +2380,36 @@ int CFtpControlSocket::FileTransferParseResponse()
 	case filetransfer_mfmt:
 		ResetOperation(FZ_REPLY_OK);
 		return FZ_REPLY_OK;
+	case filetransfer_hashopts:
+		if (code == 2) {
+			m_hashOptsAlgorithm = pData->hashAlgorithm;
+			pData->opState = filetransfer_hash;
+		}
+		else {
+			LogMessage(MessageType::Debug_Info, _T("Server does not support selecting the hash algorithm"));
+			CServerCapabilities::SetCapability(*m_pCurrentServer, hash_command, no);
+			return FileTransferFinish(FZ_REPLY_OK);
+		}
+		break;
+	case filetransfer_hash:
+		if (code != 2) {
+			LogMessage(MessageType::Status, _("Server could not calculate checksum, file not verified"));
+			return FileTransferFinish(FZ_REPLY_OK);
+		}
+		else {
+			wxString const remoteHash = ExtractDigest(m_Response.Mid(4), CHash::GetDigestLength(pData->hashAlgorithm));
+			if (remoteHash.empty()) {
+				LogMessage(MessageType::Debug_Warning, _T("Could not parse checksum reply"));
+				return FileTransferFinish(FZ_REPLY_OK);
+			}
+			if (remoteHash != pData->localHash) {
+				LogMessage(MessageType::Error, _("%s checksum mismatch, the transferred file is corrupt. Local: %s, server: %s"), CHash::GetName(pData->hashAlgorithm), pData->localHash, remoteHash);
+				ResetOperation(FZ_REPLY_ERROR);
+				return FZ_REPLY_ERROR;
+			}
+			LogMessage(MessageType::Status, _("%s checksum verified"), CHash::GetName(pData->hashAlgorithm));
+			return FileTransferFinish(FZ_REPLY_OK);
+		}
 	default:
 		LogMessage(__TFILE__, __LINE__, this, MessageType::Debug_Warning, _T("Unknown op state"));
 		error = true;
@@ -2458,28 +2552,15 @@ int CFtpControlSocket::FileTransferSubcommandResult(int prevResult)
 	}
 	else if (pData->opState == filetransfer_waittransfer)
 	{
-		if (prevResult == FZ_REPLY_OK && m_pEngine->GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS))
-		{
-			if (!pData->download &&
-				CServerCapabilities::GetCapability(*m_pCurrentServer, mfmt_command) == yes)
-			{
-				CDateTime mtime = CLocalFileSystem::GetModificationTime(pData->localFile);
-				if (mtime.IsValid()) {
-					pData->fileTime = mtime;
-					pData->opState = filetransfer_mfmt;
-					return SendNextCommand();
-				}
-			}
-			else if (pData->download && pData->fileTime.IsValid())
-			{
-				delete pData->pIOThread;
-				pData->pIOThread = 0;
-				if (!CLocalFileSystem::SetModificationTime(pData->localFile, pData->fileTime))
-					LogMessage(__TFILE__, __LINE__, this, MessageType::Debug_Warning, _T("Could not set modification time"));
+		if (prevResult == FZ_REPLY_OK && pData->hashAlgorithm != HashAlgorithm::none && pData->pIOThread) {
+			pData->localHash = pData->pIOThread->GetHash();
+			if (!pData->localHash.empty()) {
+				pData->opState = pData->hashNeedsOpts ? filetransfer_hashopts : filetransfer_hash;
+				return SendNextCommand();
 			}
 		}
-		ResetOperation(prevResult);
-		return prevResult;
+
+		return FileTransferFinish(prevResult);
 	}
 	else if (pData->opState == filetransfer_waitresumetest) {
 		if (prevResult != FZ_REPLY_OK) {
@@ -2511,6 +2592,102 @@ int CFtpControlSocket::FileTransferSubcommandResult(int prevResult)
 	return SendNextCommand();
 }
 
+void CFtpControlSocket::SelectVerificationHash(CFtpFileTransferOpData& data)
+{
+	data.hashAlgorithm = HashAlgorithm::none;
+	data.hashNeedsOpts = false;
+
+	if (!m_pEngine->GetOptions().GetOptionVal(OPTION_FTP_VERIFY_HASH))
+		return;
+
+	wxString algorithms;
+	if (CServerCapabilities::GetCapability(*m_pCurrentServer, hash_command, &algorithms) == yes) {
+		// Prefer the currently selected algorithm unless it is weak, saves sending OPTS HASH
+		HashAlgorithm selected = HashAlgorithm::none;
+		HashAlgorithm best = HashAlgorithm::none;
+
+		wxStringTokenizer tokens(algorithms, _T(";"), wxTOKEN_STRTOK);
+		while (tokens.HasMoreTokens()) {
+			wxString name = tokens.GetNextToken();
+			name.Trim(true);
+			name.Trim(false);
+
+			bool const current = !name.empty() && name.Last() == '*';
+			if (current)
+				name.RemoveLast();
+
+			HashAlgorithm const algorithm = CHash::GetAlgorithm(name);
+			if (algorithm == HashAlgorithm::none)
+				continue;
+
+			if (current)
+				selected = algorithm;
+			if (algorithm > best)
+				best = algorithm;
+		}
+
+		if (m_hashOptsAlgorithm != HashAlgorithm::none)
+			selected = m_hashOptsAlgorithm;
+
+		if (selected >= HashAlgorithm::sha1 || (selected != HashAlgorithm::none && selected == best))
+			data.hashAlgorithm = selected;
+		else if (best != HashAlgorithm::none) {
+			data.hashAlgorithm = best;
+			data.hashNeedsOpts = true;
+		}
+
+		if (data.hashAlgorithm != HashAlgorithm::none) {
+			data.hashCommand = _T("HASH");
+			return;
+		}
+	}
+
+	if (CServerCapabilities::GetCapability(*m_pCurrentServer, xsha256_command) == yes) {
+		data.hashAlgorithm = HashAlgorithm::sha256;
+		data.hashCommand = _T("XSHA256");
+	}
+	else if (CServerCapabilities::GetCapability(*m_pCurrentServer, xsha1_command) == yes) {
+		data.hashAlgorithm = HashAlgorithm::sha1;
+		data.hashCommand = _T("XSHA1");
+	}
+	else if (CServerCapabilities::GetCapability(*m_pCurrentServer, xmd5_command) == yes) {
+		data.hashAlgorithm = HashAlgorithm::md5;
+		data.hashCommand = _T("XMD5");
+	}
+	else if (CServerCapabilities::GetCapability(*m_pCurrentServer, xcrc_command) == yes) {
+		data.hashAlgorithm = HashAlgorithm::crc32;
+		data.hashCommand = _T("XCRC");
+	}
+}
+
+int CFtpControlSocket::FileTransferFinish(int prevResult)
+{
+	CFtpFileTransferOpData *pData = static_cast<CFtpFileTransferOpData *>(m_pCurOpData);
+
+	if (prevResult == FZ_REPLY_OK && m_pEngine->GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS))
+	{
+		if (!pData->download &&
+			CServerCapabilities::GetCapability(*m_pCurrentServer, mfmt_command) == yes)
+		{
+			CDateTime mtime = CLocalFileSystem::GetModificationTime(pData->localFile);
+			if (mtime.IsValid()) {
+				pData->fileTime = mtime;
+				pData->opState = filetransfer_mfmt;
+				return SendNextCommand();
+			}
+		}
+		else if (pData->download && pData->fileTime.IsValid())
+		{
+			delete pData->pIOThread;
+			pData->pIOThread = 0;
+			if (!CLocalFileSystem::SetModificationTime(pData->localFile, pData->fileTime))
+				LogMessage(__TFILE__, __LINE__, this, MessageType::Debug_Warning, _T("Could not set modification time"));
+		}
+	}
+	ResetOperation(prevResult);
+	return prevResult;
+}
+
 int CFtpControlSocket::FileTransferSend()
 {
 	LogMessage(MessageType::Debug_Verbose, _T("FileTransferSend()"));
@@ -2545,6 +2722,9 @@ int CFtpControlSocket::FileTransferSend()
 		}
 
 		{
+			// Only complete files can be verified
+			bool partial = false;
+
 			std::unique_ptr<CFile> pFile = make_unique<CFile>();
 			if (pData->download) {
 				// Be quiet
@@ -2602,6 +2782,7 @@ int CFtpControlSocket::FileTransferSend()
 					pData->resumeOffset = pData->localFileSize;
 				else
 					pData->resumeOffset = 0;
+				partial = startOffset != 0;
 
 				m_pEngine->transfer_status_.Init(pData->remoteFileSize, startOffset, false);
 
@@ -2677,8 +2858,15 @@ int CFtpControlSocket::FileTransferSend()
 
 				wxFileOffset len = pFile->Length();
 				m_pEngine->transfer_status_.Init(len, startOffset, false);
+				partial = startOffset != 0;
 			}
+
+			pData->hashAlgorithm = HashAlgorithm::none;
+			if (!partial && pData->binary)
+				SelectVerificationHash(*pData);
+
 			pData->pIOThread = new CIOThread;
+			pData->pIOThread->SetHashAlgorithm(pData->hashAlgorithm);
 			if (!pData->pIOThread->Create(std::move(pFile), !pData->download, pData->binary)) {
 				// CIOThread will delete pFile
 				delete pData->pIOThread;
@@ -2689,7 +2877,7 @@ int CFtpControlSocket::FileTransferSend()
 			}
 		}
 
-		m_pTransferSocket = new CTransferSocket(m_pEngine, this, pData->download ? TransferMode::download : TransferMode::upload);
+		CreateTransferSocket(pData->download ? TransferMode::download : TransferMode::upload, *pData);
 		m_pTransferSocket->m_binaryMode = pData->transferSettings.binary;
 
 		if (pData->download)
@@ -2718,6 +2906,12 @@ int CFtpControlSocket::FileTransferSend()
 
 			break;
 		}
+	case filetransfer_hashopts:
+		cmd = _T("OPTS HASH ") + CHash::GetName(pData->hashAlgorithm);
+		break;
+	case filetransfer_hash:
+		cmd = pData->hashCommand + _T(" ") + pData->remotePath.FormatFilename(pData->remoteFile, !pData->tryAbsolutePath);
+		break;
 	default:
 		LogMessage(MessageType::Debug_Warning, _T("Unhandled opState: %d"), pData->opState);
 		ResetOperation(FZ_REPLY_ERROR);
@@ -2951,7 +3145,12 @@ int CFtpControlSocket::RawCommandSend()
 	m_pEngine->GetPathCache().InvalidateServer(*m_pCurrentServer);
 	m_CurrentPath.clear();
 
+	// The command might have changed the mode or the data connection the
+	// server expects, e.g. MODE S or REIN
 	m_lastTypeBinary = -1;
+	m_blockMode = -1;
+	delete m_pIdleTransferSocket;
+	m_pIdleTransferSocket = 0;
 
 	CRawCommandOpData *pData = static_cast<CRawCommandOpData *>(m_pCurOpData);
 
@@ -3945,15 +4144,56 @@ int CFtpControlSocket::Transfer(const wxString& cmd, CFtpTransferOpData* oldData
 		}
 	}
 
-	if ((pData->pOldData->binary && m_lastTypeBinary == 1) ||
-		(!pData->pOldData->binary && m_lastTypeBinary == 0))
-		pData->opState = rawtransfer_port_pasv;
-	else
-		pData->opState = rawtransfer_type;
+	if (m_pTransferSocket)
+		pData->blockMode = m_pTransferSocket->BlockMode();
+
+	SetTransferState(*pData, rawtransfer_type);
 
 	return SendNextCommand();
 }
 
+void CFtpControlSocket::SetTransferState(CRawTransferOpData& data, int state)
+{
+	if (state == rawtransfer_type) {
+		if ((data.pOldData->binary && m_lastTypeBinary == 1) ||
+			(!data.pOldData->binary && m_lastTypeBinary == 0))
+			state = rawtransfer_mode;
+	}
+	if (state == rawtransfer_mode && (data.blockMode ? 1 : 0) == m_blockMode)
+		state = rawtransfer_port_pasv;
+	if (state == rawtransfer_port_pasv && m_pTransferSocket && m_pTransferSocket->Reused())
+		state = rawtransfer_rest;
+	if (state == rawtransfer_rest && data.pOldData->resumeOffset <= 0 && !m_sentRestartOffset)
+		state = rawtransfer_transfer;
+
+	data.opState = state;
+}
+
+void CFtpControlSocket::CreateTransferSocket(TransferMode transferMode, CFtpTransferOpData const& data)
+{
+	delete m_pTransferSocket;
+	m_pTransferSocket = 0;
+
+	// Restarting at an offset works differently in block mode, only use it for complete transfers
+	bool const blockMode = transferMode != TransferMode::resumetest && data.resumeOffset == 0 &&
+		m_pEngine->GetOptions().GetOptionVal(OPTION_FTP_BLOCKMODE) != 0 &&
+		CServerCapabilities::GetCapability(*m_pCurrentServer, mode_b_command) != no;
+
+	if (blockMode && m_pIdleTransferSocket && m_pIdleTransferSocket->CanReuse()) {
+		LogMessage(MessageType::Debug_Info, _T("Reusing open data connection"));
+		m_pTransferSocket = m_pIdleTransferSocket;
+		m_pIdleTransferSocket = 0;
+		m_pTransferSocket->Reuse(transferMode);
+	}
+	else {
+		delete m_pIdleTransferSocket;
+		m_pIdleTransferSocket = 0;
+
+		m_pTransferSocket = new CTransferSocket(m_pEngine, this, transferMode);
+		m_pTransferSocket->SetBlockMode(blockMode);
+	}
+}
+
 int CFtpControlSocket::TransferParseResponse()
 {
 	LogMessage(MessageType::Debug_Verbose, _T("CFtpControlSocket::TransferParseResponse()"));
@@ -3982,10 +4222,29 @@ int CFtpControlSocket::TransferParseResponse()
 			error = true;
 		else
 		{
-			pData->opState = rawtransfer_port_pasv;
 			m_lastTypeBinary = pData->pOldData->binary ? 1 : 0;
+			SetTransferState(*pData, rawtransfer_mode);
 		}
 		break;
+	case rawtransfer_mode:
+		if (code != 2 && code != 3) {
+			if (!pData->blockMode) {
+				error = true;
+				break;
+			}
+
+			LogMessage(MessageType::Debug_Info, _T("Server does not support block mode"));
+			CServerCapabilities::SetCapability(*m_pCurrentServer, mode_b_command, no);
+			pData->blockMode = false;
+			m_pTransferSocket->SetBlockMode(false);
+		}
+		else {
+			m_blockMode = pData->blockMode ? 1 : 0;
+			if (pData->blockMode)
+				CServerCapabilities::SetCapability(*m_pCurrentServer, mode_b_command, yes);
+		}
+		SetTransferState(*pData, rawtransfer_port_pasv);
+		break;
 	case rawtransfer_port_pasv:
 		if (code != 2 && code != 3)
 		{
@@ -4023,10 +4282,7 @@ int CFtpControlSocket::TransferParseResponse()
 				break;
 			}
 		}
-		if (pData->pOldData->resumeOffset > 0 || m_sentRestartOffset)
-			pData->opState = rawtransfer_rest;
-		else
-			pData->opState = rawtransfer_transfer;
+		SetTransferState(*pData, rawtransfer_rest);
 		break;
 	case rawtransfer_rest:
 		if (pData->pOldData->resumeOffset == 0)
@@ -4131,6 +4387,13 @@ int CFtpControlSocket::TransferSend()
 			cmd = _T("TYPE A");
 		measureRTT = true;
 		break;
+	case rawtransfer_mode:
+		if (pData->blockMode)
+			cmd = _T("MODE B");
+		else
+			cmd = _T("MODE S");
+		measureRTT = true;
+		break;
 	case rawtransfer_port_pasv:
 		if (pData->bPasv) {
 			cmd = GetPassiveCommand(*pData);
@@ -4173,7 +4436,7 @@ int CFtpControlSocket::TransferSend()
 		measureRTT = true;
 		break;
 	case rawtransfer_transfer:
-		if (pData->bPasv)
+		if (pData->bPasv && !m_pTransferSocket->Reused())
 		{
 			if (!m_pTransferSocket->SetupPassiveTransfer(pData->host, pData->port))
 			{
@@ -4257,7 +4520,7 @@ int CFtpControlSocket::FileTransferTestResumeCapability()
 					pData->opState = filetransfer_waitresumetest;
 					pData->resumeOffset = pData->remoteFileSize - 1;
 
-					m_pTransferSocket = new CTransferSocket(m_pEngine, this, TransferMode::resumetest);
+					CreateTransferSocket(TransferMode::resumetest, *pData);
 
 					return Transfer(_T("RETR ") + pData->remotePath.FormatFilename(pData->remoteFile, !pData->tryAbsolutePath), pData);
 				}
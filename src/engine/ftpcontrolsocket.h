@@ -4,6 +4,7 @@
 #include "logging_private.h"
 #include "ControlSocket.h"
 #include "externalipresolver.h"
+#include "hash.h"
 #include "rtt.h"
 
 #define RECVBUFFERSIZE 4096
@@ -13,6 +14,7 @@ class CTransferSocket;
 class CFtpTransferOpData;
 class CRawTransferOpData;
 class CTlsSocket;
+enum class TransferMode;
 
 class CFtpControlSocket : public CRealControlSocket
 {
@@ -48,6 +50,12 @@ protected:
 	int FileTransferSend();
 	int FileTransferTestResumeCapability();
 
+	// Last steps after the file has been transferred and verified
+	int FileTransferFinish(int prevResult);
+
+	// Selects algorithm and command used to verify the transferred file
+	void SelectVerificationHash(CFtpFileTransferOpData& data);
+
 	virtual int RawCommand(const wxString& command);
 	int RawCommandSend();
 	int RawCommandParseResponse();
@@ -80,6 +88,14 @@ protected:
 	virtual int TransferParseResponse();
 	virtual int TransferSend();
 
+	// Creates m_pTransferSocket for the next transfer, reusing the
+	// open block mode data connection if possible.
+	void CreateTransferSocket(TransferMode transferMode, CFtpTransferOpData const& data);
+
+	// Sets the op state to the first of the remaining transfer setup
+	// steps starting at the given state that is actually needed.
+	void SetTransferState(CRawTransferOpData& data, int state);
+
 	virtual void OnConnect();
 	virtual void OnReceive();
 
@@ -125,6 +141,16 @@ protected:
 
 	CTransferSocket *m_pTransferSocket;
 
+	// Open data connection of the last block mode transfer
+	CTransferSocket *m_pIdleTransferSocket{};
+
+	// 1 if the server is in block mode (MODE B), 0 if in stream mode, -1 if
+	// unknown, e.g. after a raw command
+	int m_blockMode{};
+
+	// Algorithm selected using OPTS HASH
+	HashAlgorithm m_hashOptsAlgorithm{HashAlgorithm::none};
+
 	// Some servers keep track of the offset specified by REST between sessions
 	// So we always sent a REST 0 for a normal transfer following a restarted one
 	bool m_sentRestartOffset;
@@ -179,6 +205,12 @@ public:
 
 	CIOThread *pIOThread;
 	bool fileDidExist;
+
+	// Used to verify the transferred file
+	HashAlgorithm hashAlgorithm;
+	wxString hashCommand;
+	bool hashNeedsOpts;
+	wxString localHash;
 };
 
 class CRawTransferOpData : public COpData
@@ -193,6 +225,8 @@ public:
 	bool bTriedPasv;
 	bool bTriedActive;
 
+	bool blockMode;
+
 	wxString host;
 	int port;
 };
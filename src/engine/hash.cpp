@@ -0,0 +1,187 @@
+#include <filezilla.h>
+#include "hash.h"
+
+#include <gnutls/crypto.h>
+
+namespace {
+gnutls_digest_algorithm_t GetDigestAlgorithm(HashAlgorithm algorithm)
+{
+	switch (algorithm)
+	{
+	case HashAlgorithm::md5:
+		return GNUTLS_DIG_MD5;
+	case HashAlgorithm::sha1:
+		return GNUTLS_DIG_SHA1;
+	case HashAlgorithm::sha256:
+		return GNUTLS_DIG_SHA256;
+	case HashAlgorithm::sha512:
+		return GNUTLS_DIG_SHA512;
+	default:
+		return GNUTLS_DIG_UNKNOWN;
+	}
+}
+
+// Lookup tables for slicing-by-8 CRC-32 (ISO-HDLC, as used by zlib and XCRC).
+// Processes 8 bytes per iteration using table lookups.
+struct crc32_tables
+{
+	crc32_tables()
+	{
+		for (wxUint32 i = 0; i < 256; ++i) {
+			wxUint32 c = i;
+			for (int j = 0; j < 8; ++j) {
+				c = (c & 1) ? ((c >> 1) ^ 0xedb88320u) : (c >> 1);
+			}
+			t[0][i] = c;
+		}
+		for (int i = 0; i < 256; ++i) {
+			for (int k = 1; k < 8; ++k) {
+				t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+			}
+		}
+	}
+
+	wxUint32 t[8][256];
+};
+
+crc32_tables const& GetCrc32Tables()
+{
+	static crc32_tables const tables;
+	return tables;
+}
+}
+
+CHash::CHash(HashAlgorithm algorithm)
+	: algorithm_(algorithm)
+{
+	if (algorithm_ == HashAlgorithm::crc32) {
+		GetCrc32Tables();
+	}
+	else if (algorithm_ != HashAlgorithm::none) {
+		gnutls_hash_hd_t hd{};
+		if (gnutls_hash_init(&hd, GetDigestAlgorithm(algorithm_)) == 0) {
+			hash_ = hd;
+		}
+	}
+}
+
+CHash::~CHash()
+{
+	if (hash_) {
+		gnutls_hash_deinit(hash_, 0);
+	}
+}
+
+void CHash::Update(char const* data, unsigned int len)
+{
+	wxASSERT(!finalized_);
+	if (finalized_ || !len) {
+		return;
+	}
+
+	if (algorithm_ == HashAlgorithm::crc32) {
+		UpdateCrc32(reinterpret_cast<unsigned char const*>(data), len);
+	}
+	else if (hash_) {
+		gnutls_hash(hash_, data, len);
+	}
+}
+
+void CHash::UpdateCrc32(unsigned char const* p, unsigned int len)
+{
+	auto const& t = GetCrc32Tables().t;
+
+	wxUint32 crc = ~crc_;
+	while (len >= 8) {
+		wxUint32 const lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<wxUint32>(p[3]) << 24));
+		wxUint32 const hi = p[4] | (p[5] << 8) | (p[6] << 16) | (static_cast<wxUint32>(p[7]) << 24);
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+			t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	}
+	crc_ = ~crc;
+}
+
+wxString CHash::Finalize()
+{
+	if (finalized_) {
+		return digest_;
+	}
+	finalized_ = true;
+
+	if (algorithm_ == HashAlgorithm::crc32) {
+		digest_ = wxString::Format(_T("%08x"), crc_);
+	}
+	else if (hash_) {
+		unsigned char digest[64];
+		wxASSERT(gnutls_hash_get_len(GetDigestAlgorithm(algorithm_)) <= sizeof(digest));
+		gnutls_hash_deinit(hash_, digest);
+		hash_ = 0;
+
+		unsigned int const len = GetDigestLength(algorithm_) / 2;
+		for (unsigned int i = 0; i < len; ++i) {
+			digest_ += wxString::Format(_T("%02x"), digest[i]);
+		}
+	}
+
+	return digest_;
+}
+
+unsigned int CHash::GetDigestLength(HashAlgorithm algorithm)
+{
+	switch (algorithm)
+	{
+	case HashAlgorithm::crc32:
+		return 8;
+	case HashAlgorithm::md5:
+		return 32;
+	case HashAlgorithm::sha1:
+		return 40;
+	case HashAlgorithm::sha256:
+		return 64;
+	case HashAlgorithm::sha512:
+		return 128;
+	default:
+		return 0;
+	}
+}
+
+wxString CHash::GetName(HashAlgorithm algorithm)
+{
+	switch (algorithm)
+	{
+	case HashAlgorithm::crc32:
+		return _T("CRC32");
+	case HashAlgorithm::md5:
+		return _T("MD5");
+	case HashAlgorithm::sha1:
+		return _T("SHA-1");
+	case HashAlgorithm::sha256:
+		return _T("SHA-256");
+	case HashAlgorithm::sha512:
+		return _T("SHA-512");
+	default:
+		return wxString();
+	}
+}
+
+HashAlgorithm CHash::GetAlgorithm(wxString const& name)
+{
+	wxString const up = name.Upper();
+	if (up == _T("CRC32"))
+		return HashAlgorithm::crc32;
+	else if (up == _T("MD5"))
+		return HashAlgorithm::md5;
+	else if (up == _T("SHA-1"))
+		return HashAlgorithm::sha1;
+	else if (up == _T("SHA-256"))
+		return HashAlgorithm::sha256;
+	else if (up == _T("SHA-512"))
+		return HashAlgorithm::sha512;
+
+	return HashAlgorithm::none;
+}
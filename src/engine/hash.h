@@ -0,0 +1,56 @@
+#ifndef FZ_HASH_HEADER
+#define FZ_HASH_HEADER
+
+// Incremental hashing of file data, used to verify transferred files
+// against the checksums reported by the server.
+
+enum class HashAlgorithm
+{
+	// Ordered by preference
+	none,
+	crc32,
+	md5,
+	sha1,
+	sha256,
+	sha512
+};
+
+struct hash_hd_st;
+
+class CHash final
+{
+public:
+	explicit CHash(HashAlgorithm algorithm);
+	~CHash();
+
+	CHash(CHash const&) = delete;
+	CHash& operator=(CHash const&) = delete;
+
+	HashAlgorithm GetAlgorithm() const { return algorithm_; }
+
+	void Update(char const* data, unsigned int len);
+
+	// Returns the digest as lowercase hex string.
+	// No further data can be added afterwards.
+	wxString Finalize();
+
+	// Length of the hex encoded digest
+	static unsigned int GetDigestLength(HashAlgorithm algorithm);
+
+	// Names as used by the HASH command, e.g. SHA-256
+	static wxString GetName(HashAlgorithm algorithm);
+	static HashAlgorithm GetAlgorithm(wxString const& name);
+
+protected:
+	void UpdateCrc32(unsigned char const* data, unsigned int len);
+
+	HashAlgorithm const algorithm_;
+
+	hash_hd_st* hash_{};
+	wxUint32 crc_{};
+
+	bool finalized_{};
+	wxString digest_;
+};
+
+#endif
@@ -79,6 +79,8 @@ wxThread::ExitCode CIOThread::Entry()
 	if (m_read) {
 		while (m_running) {
 			int len = ReadFromFile(m_buffers[m_curThreadBuf], BUFFERSIZE);
+			if (m_hash && len > 0)
+				m_hash->Update(m_buffers[m_curThreadBuf], len);
 
 			scoped_lock l(m_mutex);
 
@@ -335,6 +337,9 @@ bool CIOThread::WriteToFile(char* pBuffer, int len)
 #ifdef SIMULATE_IO
 	return true;
 #endif
+	if (m_hash)
+		m_hash->Update(pBuffer, len);
+
 	// In binary mode, no conversion has to be done.
 	// Also, under Windows the native newline format is already identical
 	// to the newline format of the FTP protocol
@@ -401,3 +406,22 @@ wxString CIOThread::GetError()
 	scoped_lock locker(m_mutex);
 	return m_error_description;
 }
+
+void CIOThread::SetHashAlgorithm(HashAlgorithm algorithm)
+{
+	wxASSERT(!m_running);
+	if (algorithm != HashAlgorithm::none)
+		m_hash = make_unique<CHash>(algorithm);
+	else
+		m_hash.reset();
+}
+
+wxString CIOThread::GetHash()
+{
+	Destroy();
+
+	if (!m_hash || m_error)
+		return wxString();
+
+	return m_hash->Finalize();
+}
@@ -3,6 +3,7 @@
 
 #include <wx/file.h>
 #include "event_loop.h"
+#include "hash.h"
 
 #define BUFFERCOUNT 5
 #define BUFFERSIZE 128*1024
@@ -55,6 +56,14 @@ public:
 
 	wxString GetError();
 
+	// Hashes the file data as it passes through the thread.
+	// Call before Create.
+	void SetHashAlgorithm(HashAlgorithm algorithm);
+
+	// Returns the hash of all data read or written. Waits for the
+	// thread to finish, only call after the transfer is complete.
+	wxString GetHash();
+
 protected:
 	void Close();
 
@@ -90,6 +99,8 @@ protected:
 
 	wxString m_error_description;
 
+	std::unique_ptr<CHash> m_hash;
+
 #ifdef SIMULATE_IO
 	wxFileOffset size_;
 #endif
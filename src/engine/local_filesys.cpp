@@ -7,6 +7,10 @@
 #include <wx/filename.h>
 #include <wx/msgdlg.h>
 
+#ifndef __WXMSW__
+#include <fcntl.h>
+#endif
+
 #ifdef __WXMSW__
 const wxChar CLocalFileSystem::path_separator = '\\';
 #else
@@ -298,10 +302,21 @@ enum CLocalFileSystem::local_fileType CLocalFileSystem::GetFileInfo(const wxStri
 }
 
 #ifndef __WXMSW__
-enum CLocalFileSystem::local_fileType CLocalFileSystem::GetFileInfo(const char* path, bool &isLink, wxLongLong* size, CDateTime* modificationTime, int *mode)
+namespace {
+int stat_file(int fd, const char* path, struct stat& buf, bool follow_links)
+{
+#if HAVE_FSTATAT
+	if (fd != -1)
+		return fstatat(fd, path, &buf, follow_links ? 0 : AT_SYMLINK_NOFOLLOW);
+#endif
+	return follow_links ? stat(path, &buf) : lstat(path, &buf);
+}
+}
+
+enum CLocalFileSystem::local_fileType CLocalFileSystem::GetFileInfo(const char* path, bool &isLink, wxLongLong* size, CDateTime* modificationTime, int *mode, int fd)
 {
 	struct stat buf;
-	int result = lstat(path, &buf);
+	int result = stat_file(fd, path, buf, false);
 	if (result)
 	{
 		isLink = false;
@@ -318,7 +333,7 @@ enum CLocalFileSystem::local_fileType CLocalFileSystem::GetFileInfo(const char*
 	if (S_ISLNK(buf.st_mode))
 	{
 		isLink = true;
-		int result = stat(path, &buf);
+		int result = stat_file(fd, path, buf, true);
 		if (result)
 		{
 			if (size)
@@ -506,9 +521,7 @@ bool CLocalFileSystem::GetNextFile(wxString& name)
 			if (entry->d_type == DT_LNK)
 			{
 				bool wasLink;
-				AllocPathBuffer(entry->d_name);
-				strcpy(m_file_part, entry->d_name);
-				if (GetFileInfo(m_raw_path, wasLink, 0, 0, 0) != dir)
+				if (GetEntryInfo(entry->d_name, wasLink, 0, 0, 0) != dir)
 					continue;
 			}
 			else if (entry->d_type != DT_DIR)
@@ -516,9 +529,7 @@ bool CLocalFileSystem::GetNextFile(wxString& name)
 #else
 			// Solaris doesn't have d_type
 			bool wasLink;
-			AllocPathBuffer(entry->d_name);
-			strcpy(m_file_part, entry->d_name);
-			if (GetFileInfo(m_raw_path, wasLink, 0, 0, 0) != dir)
+			if (GetEntryInfo(entry->d_name, wasLink, 0, 0, 0) != dir)
 				continue;
 #endif
 		}
@@ -633,9 +644,7 @@ bool CLocalFileSystem::GetNextFile(wxString& name, bool &isLink, bool &is_dir, w
 		{
 			if (entry->d_type == DT_LNK)
 			{
-				AllocPathBuffer(entry->d_name);
-				strcpy(m_file_part, entry->d_name);
-				enum local_fileType type = GetFileInfo(m_raw_path, isLink, size, modificationTime, mode);
+				enum local_fileType type = GetEntryInfo(entry->d_name, isLink, size, modificationTime, mode);
 				if (type != dir)
 					continue;
 
@@ -648,9 +657,7 @@ bool CLocalFileSystem::GetNextFile(wxString& name, bool &isLink, bool &is_dir, w
 		}
 #endif
 
-		AllocPathBuffer(entry->d_name);
-		strcpy(m_file_part, entry->d_name);
-		enum local_fileType type = GetFileInfo(m_raw_path, isLink, size, modificationTime, mode);
+		enum local_fileType type = GetEntryInfo(entry->d_name, isLink, size, modificationTime, mode);
 
 		if (type == unknown) // Happens for example in case of permission denied
 		{
@@ -682,6 +689,19 @@ bool CLocalFileSystem::GetNextFile(wxString& name, bool &isLink, bool &is_dir, w
 }
 
 #ifndef __WXMSW__
+enum CLocalFileSystem::local_fileType CLocalFileSystem::GetEntryInfo(const char* name, bool &isLink, wxLongLong* size, CDateTime* modificationTime, int* mode)
+{
+#if HAVE_FSTATAT
+	// Stat relative to the directory, saves the kernel from resolving the
+	// full path again for every entry.
+	return GetFileInfo(name, isLink, size, modificationTime, mode, dirfd(m_dir));
+#else
+	AllocPathBuffer(name);
+	strcpy(m_file_part, name);
+	return GetFileInfo(m_raw_path, isLink, size, modificationTime, mode);
+#endif
+}
+
 void CLocalFileSystem::AllocPathBuffer(const char* file)
 {
 	int len = strlen(file);
@@ -0,0 +1,72 @@
+#include <filezilla.h>
+
+#include "backend.h"
+#include "sendqueue.h"
+
+CSendQueue::chunk CSendQueue::GetChunk()
+{
+	chunk c;
+	if (spare_.data)
+		c.data = std::move(spare_.data);
+	else
+		c.data.reset(new char[chunk_size]);
+	return c;
+}
+
+void CSendQueue::Append(char const* data, unsigned int len)
+{
+	size_ += len;
+
+	while (len) {
+		if (chunks_.empty() || chunks_.back().end == chunk_size)
+			chunks_.push_back(GetChunk());
+
+		chunk & c = chunks_.back();
+		unsigned int const n = std::min(len, chunk_size - c.end);
+		memcpy(c.data.get() + c.end, data, n);
+		c.end += n;
+		data += n;
+		len -= n;
+	}
+}
+
+int CSendQueue::Flush(CBackend& backend, int& error)
+{
+	error = 0;
+
+	int total = 0;
+	while (!chunks_.empty()) {
+		chunk & c = chunks_.front();
+
+		unsigned int const len = c.end - c.begin;
+		int written = backend.Write(c.data.get() + c.begin, len, error);
+		if (written < 0) {
+			if (error != EAGAIN)
+				return -1;
+			error = 0;
+			break;
+		}
+
+		total += written;
+		size_ -= written;
+		c.begin += written;
+		if (c.begin != c.end) {
+			// Partial write, socket buffer is full. Wait for next write event.
+			break;
+		}
+
+		if (!spare_.data)
+			spare_.data = std::move(c.data);
+		chunks_.pop_front();
+	}
+
+	return total;
+}
+
+void CSendQueue::clear()
+{
+	if (!spare_.data && !chunks_.empty())
+		spare_.data = std::move(chunks_.front().data);
+	chunks_.clear();
+	size_ = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef FZ_SENDQUEUE_HEADER
+#define FZ_SENDQUEUE_HEADER
+
+#include <deque>
+#include <memory>
+
+/*
+Queue of outgoing data for sockets that may not accept everything at once.
+
+Data is stored in fixed-size chunks. Appending never moves data that is
+already queued and consuming never shifts the remaining data, so the cost
+of queuing is linear in the amount of data regardless of how many partial
+writes happen. Drained chunks are kept for reuse.
+*/
+
+class CBackend;
+class CSendQueue final
+{
+public:
+	CSendQueue() = default;
+
+	CSendQueue(CSendQueue const&) = delete;
+	CSendQueue& operator=(CSendQueue const&) = delete;
+
+	bool empty() const { return size_ == 0; }
+	unsigned int size() const { return size_; }
+
+	void Append(char const* data, unsigned int len);
+
+	// Writes as much of the queued data as the backend accepts.
+	// Returns the number of bytes written or -1 on error, with error set.
+	// EAGAIN is not treated as error.
+	int Flush(CBackend& backend, int& error);
+
+	void clear();
+
+private:
+	struct chunk final
+	{
+		std::unique_ptr<char[]> data;
+		unsigned int begin{};
+		unsigned int end{};
+	};
+
+	static unsigned int const chunk_size = 16 * 1024;
+
+	chunk GetChunk();
+
+	std::deque<chunk> chunks_;
+	chunk spare_;
+
+	unsigned int size_{};
+};
+
+#endif
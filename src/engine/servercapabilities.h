@@ -29,6 +29,12 @@ enum capabilityNames
 	list_hidden_support, // LIST -a command
 	rest_stream, // supports REST+STOR in addition to APPE
 	epsv_command,
+	mode_b_command, // Block mode (MODE B), allows reusing data connections
+	hash_command, // HASH command, list of algorithms as option
+	xsha256_command,
+	xsha1_command,
+	xmd5_command,
+	xcrc_command,
 
 	// FTPS and HTTPS
 	tls_resume, // Does the server support resuming of TLS sessions?
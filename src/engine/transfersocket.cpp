@@ -9,6 +9,16 @@
 #include "proxy.h"
 #include "servercapabilities.h"
 
+#include <algorithm>
+
+namespace {
+// Block mode descriptor codes, see RFC 959
+unsigned char const block_eof = 64;
+unsigned char const block_restart_marker = 16;
+
+int const max_block_size = 0xffff;
+}
+
 CTransferSocket::CTransferSocket(CFileZillaEnginePrivate *pEngine, CFtpControlSocket *pControlSocket, TransferMode transferMode)
 : CEventHandler(pEngine->socket_event_dispatcher_.event_loop_)
 , CSocketEventHandler(pEngine->socket_event_dispatcher_)
@@ -51,6 +61,15 @@ CTransferSocket::~CTransferSocket()
 		m_transferEndReason = TransferEndReason::successful;
 	ResetSocket();
 
+	Detach();
+}
+
+void CTransferSocket::Detach()
+{
+	if (m_detached)
+		return;
+	m_detached = true;
+
 	if (m_pControlSocket) {
 		if (m_transferMode == TransferMode::upload || m_transferMode == TransferMode::download) {
 			CFtpFileTransferOpData *pData = static_cast<CFtpFileTransferOpData *>(static_cast<CRawTransferOpData *>(m_pControlSocket->m_pCurOpData)->pOldData);
@@ -63,6 +82,44 @@ CTransferSocket::~CTransferSocket()
 	}
 }
 
+bool CTransferSocket::CanReuse()
+{
+	if (!m_blockMode || m_transferEndReason != TransferEndReason::successful)
+		return false;
+
+	if (m_onCloseCalled || !m_pSocket || !m_pBackend)
+		return false;
+
+	return m_pSocket->GetState() == CSocket::connected;
+}
+
+void CTransferSocket::Reuse(TransferMode transferMode)
+{
+	m_transferMode = transferMode;
+	m_transferEndReason = TransferEndReason::none;
+
+	m_pDirectoryListingParser = 0;
+	m_pTransferBuffer = 0;
+	m_transferBufferLen = 0;
+	m_madeProgress = 0;
+	m_shutdown = false;
+
+	m_bActive = false;
+	m_reused = true;
+	m_detached = false;
+
+	m_blockHeaderPos = 0;
+	m_blockRemaining = 0;
+	m_blockDescriptor = 0;
+	m_blockEof = false;
+	m_blockEofPending = false;
+
+	// The socket is connected already and might not signal again,
+	// so start reading or writing as soon as the transfer gets active.
+	m_postponedReceive = true;
+	m_postponedSend = true;
+}
+
 void CTransferSocket::ResetSocket()
 {
 	delete m_pProxyBackend;
@@ -268,7 +325,7 @@ void CTransferSocket::OnReceive()
 		{
 			char *pBuffer = new char[4096];
 			int error;
-			int numread = m_pBackend->Read(pBuffer, 4096, error);
+			int numread = ReadData(pBuffer, 4096, error);
 			if (numread < 0)
 			{
 				delete [] pBuffer;
@@ -277,7 +334,7 @@ void CTransferSocket::OnReceive()
 					TransferEnd(TransferEndReason::transfer_failure);
 				}
 				else if (m_onCloseCalled && !m_pBackend->IsWaiting(CRateLimiter::inbound))
-					TransferEnd(TransferEndReason::successful);
+					TransferEnd(m_blockMode ? TransferEndReason::transfer_failure : TransferEndReason::successful);
 				return;
 			}
 
@@ -312,7 +369,7 @@ void CTransferSocket::OnReceive()
 				return;
 
 			int error;
-			int numread = m_pBackend->Read(m_pTransferBuffer, m_transferBufferLen, error);
+			int numread = ReadData(m_pTransferBuffer, m_transferBufferLen, error);
 			if (numread < 0)
 			{
 				if (error != EAGAIN) {
@@ -320,7 +377,7 @@ void CTransferSocket::OnReceive()
 					TransferEnd(TransferEndReason::transfer_failure);
 				}
 				else if (m_onCloseCalled && !m_pBackend->IsWaiting(CRateLimiter::inbound))
-					TransferEnd(TransferEndReason::successful);
+					TransferEnd(m_blockMode ? TransferEndReason::transfer_failure : TransferEndReason::successful);
 				return;
 			}
 
@@ -420,7 +477,7 @@ void CTransferSocket::OnSend()
 		if (!CheckGetNextReadBuffer())
 			return;
 
-		written = m_pBackend->Write(m_pTransferBuffer, m_transferBufferLen, error);
+		written = WriteData(m_pTransferBuffer, m_transferBufferLen, error);
 		if (written <= 0)
 			break;
 
@@ -518,6 +575,12 @@ void CTransferSocket::OnClose(int error)
 			return;
 		}
 	}
+	if (m_blockMode) {
+		// In block mode the end of file is marked explicitly
+		m_pControlSocket->LogMessage(MessageType::Error, _("Transfer connection closed before the end of the file"));
+		TransferEnd(TransferEndReason::transfer_failure);
+		return;
+	}
 	TransferEnd(TransferEndReason::successful);
 }
 
@@ -587,7 +650,13 @@ void CTransferSocket::TransferEnd(TransferEndReason reason)
 		return;
 	m_transferEndReason = reason;
 
-	ResetSocket();
+	if (m_blockMode && reason == TransferEndReason::successful) {
+		// Keep the connection open for the next transfer. Socket events
+		// get postponed until then.
+		m_bActive = false;
+	}
+	else
+		ResetSocket();
 
 	m_pEngine->SendEvent<CFileZillaEngineEvent>(engineTransferEnd);
 }
@@ -680,6 +749,11 @@ bool CTransferSocket::CheckGetNextWriteBuffer()
 
 bool CTransferSocket::CheckGetNextReadBuffer()
 {
+	if (m_blockEofPending) {
+		SendBlockEof();
+		return false;
+	}
+
 	CFtpFileTransferOpData *pData = static_cast<CFtpFileTransferOpData *>(static_cast<CRawTransferOpData *>(m_pControlSocket->m_pCurOpData)->pOldData);
 	if (!m_transferBufferLen) {
 		int res = pData->pIOThread->GetNextReadBuffer(&m_pTransferBuffer);
@@ -693,6 +767,11 @@ bool CTransferSocket::CheckGetNextReadBuffer()
 		}
 		else if (res == IO_Success)
 		{
+			if (m_blockMode) {
+				SendBlockEof();
+				return false;
+			}
+
 			if (m_pTlsSocket)
 			{
 				m_shutdown = true;
@@ -824,3 +903,116 @@ void CTransferSocket::operator()(CEventBase const& ev)
 {
 	Dispatch<CIOThreadEvent>(ev, this, &CTransferSocket::OnIOThreadEvent);
 }
+
+int CTransferSocket::ReadData(char *buffer, int len, int& error)
+{
+	if (!m_blockMode)
+		return m_pBackend->Read(buffer, len, error);
+
+	int numread;
+	for (;;) {
+		if (!m_blockRemaining) {
+			if (m_blockEof)
+				return 0;
+
+			// Read next block header
+			numread = m_pBackend->Read(m_blockHeader + m_blockHeaderPos, 3 - m_blockHeaderPos, error);
+			if (numread <= 0)
+				break;
+
+			m_blockHeaderPos += numread;
+			if (m_blockHeaderPos < 3)
+				continue;
+
+			m_blockHeaderPos = 0;
+			m_blockDescriptor = m_blockHeader[0];
+			m_blockRemaining = (static_cast<int>(m_blockHeader[1]) << 8) | m_blockHeader[2];
+			if (!m_blockRemaining && (m_blockDescriptor & block_eof))
+				m_blockEof = true;
+			continue;
+		}
+
+		if (m_blockDescriptor & block_restart_marker) {
+			// Restart markers are not part of the file data
+			char marker[256];
+			numread = m_pBackend->Read(marker, std::min(m_blockRemaining, static_cast<int>(sizeof(marker))), error);
+			if (numread <= 0)
+				break;
+			m_blockRemaining -= numread;
+			continue;
+		}
+
+		numread = m_pBackend->Read(buffer, std::min(len, m_blockRemaining), error);
+		if (numread <= 0)
+			break;
+
+		m_blockRemaining -= numread;
+		if (!m_blockRemaining && (m_blockDescriptor & block_eof))
+			m_blockEof = true;
+
+		return numread;
+	}
+
+	if (!numread) {
+		// Connection got closed without receiving the EOF block
+		error = ECONNABORTED;
+		return -1;
+	}
+
+	return numread;
+}
+
+int CTransferSocket::WriteData(char const* buffer, int len, int& error)
+{
+	if (!m_blockMode)
+		return m_pBackend->Write(buffer, len, error);
+
+	if (!m_blockRemaining) {
+		// Start next block
+		m_blockRemaining = std::min(len, max_block_size);
+		m_blockHeader[0] = 0;
+		m_blockHeader[1] = (m_blockRemaining >> 8) & 0xff;
+		m_blockHeader[2] = m_blockRemaining & 0xff;
+		m_blockHeaderPos = 0;
+	}
+
+	while (m_blockHeaderPos < 3) {
+		int written = m_pBackend->Write(m_blockHeader + m_blockHeaderPos, 3 - m_blockHeaderPos, error);
+		if (written <= 0)
+			return written;
+		m_blockHeaderPos += written;
+	}
+
+	int written = m_pBackend->Write(buffer, std::min(len, m_blockRemaining), error);
+	if (written > 0)
+		m_blockRemaining -= written;
+
+	return written;
+}
+
+void CTransferSocket::SendBlockEof()
+{
+	if (!m_blockEofPending) {
+		m_blockEofPending = true;
+		m_blockHeader[0] = block_eof;
+		m_blockHeader[1] = 0;
+		m_blockHeader[2] = 0;
+		m_blockHeaderPos = 0;
+	}
+
+	while (m_blockHeaderPos < 3) {
+		int error;
+		int written = m_pBackend->Write(m_blockHeader + m_blockHeaderPos, 3 - m_blockHeaderPos, error);
+		if (written <= 0) {
+			if (written < 0 && error != EAGAIN) {
+				m_pControlSocket->LogMessage(MessageType::Error, _T("Could not write to transfer socket: %s"), CSocket::GetErrorDescription(error));
+				TransferEnd(TransferEndReason::transfer_failure);
+			}
+			return;
+		}
+		m_blockHeaderPos += written;
+	}
+
+	m_blockEofPending = false;
+	TransferEnd(TransferEndReason::successful);
+}
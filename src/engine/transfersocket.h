@@ -30,6 +30,24 @@ public:
 
 	void SetActive();
 
+	// In block mode (MODE B) the end of a transfer is marked by an EOF block
+	// instead of closing the connection, so that the data connection can be
+	// used again for the next transfer.
+	void SetBlockMode(bool blockMode) { m_blockMode = blockMode; }
+	bool BlockMode() const { return m_blockMode; }
+
+	// Returns true if the data connection is still open after a successful
+	// block mode transfer.
+	bool CanReuse();
+
+	// Prepares an open data connection for the next transfer.
+	void Reuse(TransferMode transferMode);
+	bool Reused() const { return m_reused; }
+
+	// Releases the IO thread of the current file transfer. Has to be called
+	// before the transfer's operation data goes away if the socket is kept.
+	void Detach();
+
 	CDirectoryListingParser *m_pDirectoryListingParser;
 
 	bool m_binaryMode;
@@ -61,6 +79,12 @@ protected:
 
 	void SetSocketBufferSizes(CSocket* pSocket);
 
+	// Block mode framing. Both behave like the corresponding CBackend
+	// functions. At the end of the file, ReadData returns 0.
+	int ReadData(char *buffer, int len, int& error);
+	int WriteData(char const* buffer, int len, int& error);
+	void SendBlockEof();
+
 	virtual void operator()(CEventBase const& ev);
 	void OnIOThreadEvent();
 
@@ -100,6 +124,18 @@ protected:
 	// Initially 0, 2 if made progress
 	// On uploads, 1 after first WSAE_WOULDBLOCK
 	int m_madeProgress;
+
+	bool m_blockMode{};
+	bool m_reused{};
+	bool m_detached{};
+
+	// State of the current block in block mode
+	unsigned char m_blockHeader[3];
+	int m_blockHeaderPos{};
+	int m_blockRemaining{};
+	unsigned char m_blockDescriptor{};
+	bool m_blockEof{};
+	bool m_blockEofPending{};
 };
 
 #endif
@@ -57,7 +57,11 @@ protected:
 #endif
 
 #ifndef __WXMSW__
-	static enum local_fileType GetFileInfo(const char* path, bool &isLink, wxLongLong* size, CDateTime* modificationTime, int* mode);
+	// If fd is a directory descriptor, path may be relative to that directory
+	static enum local_fileType GetFileInfo(const char* path, bool &isLink, wxLongLong* size, CDateTime* modificationTime, int* mode, int fd = -1);
+
+	// Stats an entry of the directory currently being enumerated
+	enum local_fileType GetEntryInfo(const char* name, bool &isLink, wxLongLong* size, CDateTime* modificationTime, int* mode);
 	void AllocPathBuffer(const char* file);  // Ensures m_raw_path is large enough to hold path and filename
 #endif
 
@@ -74,6 +74,12 @@ enum engineOptions
 	OPTION_SIZE_USETHOUSANDSEP,
 	OPTION_SIZE_DECIMALPLACES,
 
+	OPTION_FTP_BLOCKMODE,		// Use block mode (MODE B) if supported by the server,
+								// keeps data connections open between transfers
+
+	OPTION_FTP_VERIFY_HASH,		// Compare checksum of transferred files with the one
+								// reported by the server using HASH, XSHA256 and the like
+
 	OPTIONS_ENGINE_NUM
 };
 
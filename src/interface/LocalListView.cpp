@@ -23,6 +23,169 @@
 #include "filelist_statusbar.h"
 #include "sizeformatting.h"
 #include "timeformatting.h"
+#include "local_listing_cache.h"
+#include <mutex.h>
+
+DECLARE_EVENT_TYPE(fzEVT_LOCALDIR_READ, -1)
+DEFINE_EVENT_TYPE(fzEVT_LOCALDIR_READ)
+
+// Reads a local directory in the background. The entries are handed to the
+// list in batches, so that it can show them before all of them got read.
+//
+// Neither stopping nor deleting the reader waits for its thread, which might
+// be stuck on an unresponsive network drive. The thread is detached and keeps
+// the state it shares with the reader alive by itself. Once the reader is
+// gone, it doesn't send any more events.
+class CLocalDirReader final
+{
+public:
+	CLocalDirReader(wxEvtHandler& handler, CLocalPath const& path)
+		: m_shared(std::make_shared<shared>())
+	{
+		m_shared->handler = &handler;
+		m_shared->owner = this;
+
+		worker* thread = new worker(m_shared, path);
+		if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR) {
+			delete thread;
+
+			std::vector<CLocalFileData> none;
+			m_shared->HandOver(none, false, true);
+		}
+	}
+
+	~CLocalDirReader()
+	{
+		scoped_lock l(m_shared->sync);
+		m_shared->stop = true;
+		m_shared->handler = 0;
+	}
+
+	CLocalDirReader(CLocalDirReader const&) = delete;
+	CLocalDirReader& operator=(CLocalDirReader const&) = delete;
+
+	// Does not wait for the thread to exit, it still sends one last event
+	// once done.
+	void Stop()
+	{
+		scoped_lock l(m_shared->sync);
+		m_shared->stop = true;
+	}
+
+	// Moves the entries read since the last call into entries. Returns true
+	// once the directory has been read completely, or could not be read.
+	bool GetEntries(std::vector<CLocalFileData>& entries, bool& encodingError)
+	{
+		scoped_lock l(m_shared->sync);
+		entries.clear();
+		entries.swap(m_shared->entries);
+		m_shared->notified = false;
+
+		encodingError = m_shared->encodingError;
+		m_shared->encodingError = false;
+
+		return m_shared->done;
+	}
+
+private:
+	// First entries get handed over after this long, later ones in
+	// batches at most this often
+	static int const handoverInterval = 100;
+
+	struct shared
+	{
+		bool Stopped()
+		{
+			scoped_lock l(sync);
+			return stop;
+		}
+
+		void HandOver(std::vector<CLocalFileData>& batch, bool batchEncodingError, bool batchDone)
+		{
+			scoped_lock l(sync);
+			if (entries.empty())
+				entries.swap(batch);
+			else
+				entries.insert(entries.end(), batch.begin(), batch.end());
+			batch.clear();
+
+			done = batchDone;
+			encodingError |= batchEncodingError;
+
+			// One pending event at a time, the list takes everything read so far
+			if (handler && !notified && (!entries.empty() || done || encodingError)) {
+				notified = true;
+				wxCommandEvent* evt = new wxCommandEvent(fzEVT_LOCALDIR_READ);
+				evt->SetClientData(owner);
+				handler->QueueEvent(evt);
+			}
+		}
+
+		mutex sync{false};
+
+		// Cleared once the reader is gone
+		wxEvtHandler* handler{};
+		CLocalDirReader* owner{};
+
+		std::vector<CLocalFileData> entries;
+		bool notified{};
+		bool done{};
+		bool encodingError{};
+		bool stop{};
+	};
+
+	class worker final : public wxThread
+	{
+	public:
+		worker(std::shared_ptr<shared> const& s, CLocalPath const& path)
+			: wxThread(wxTHREAD_DETACHED)
+			, m_shared(s)
+			, m_path(path)
+		{}
+
+	protected:
+		virtual ExitCode Entry()
+		{
+			CLocalFileSystem fs;
+			if (!fs.BeginFindFiles(m_path.GetPath(), false)) {
+				m_shared->HandOver(m_batch, false, true);
+				return 0;
+			}
+
+			wxLongLong lastHandover = wxGetLocalTimeMillis();
+			CLocalFileData data;
+			bool wasLink;
+			while (!m_shared->Stopped() && fs.GetNextFile(data.name, wasLink, data.dir, &data.size, &data.time, &data.attributes)) {
+				if (data.name.empty()) {
+					m_encodingErrorPending = true;
+					continue;
+				}
+				m_batch.push_back(data);
+
+				// Looking at the clock for each entry would be wasteful
+				if (!(m_batch.size() % 64)) {
+					wxLongLong const now = wxGetLocalTimeMillis();
+					if ((now - lastHandover).GetValue() >= handoverInterval) {
+						m_shared->HandOver(m_batch, m_encodingErrorPending, false);
+						m_encodingErrorPending = false;
+						lastHandover = now;
+					}
+				}
+			}
+
+			m_shared->HandOver(m_batch, m_encodingErrorPending, true);
+			return 0;
+		}
+
+		std::shared_ptr<shared> const m_shared;
+		CLocalPath const m_path;
+
+		std::vector<CLocalFileData> m_batch;
+		bool m_encodingErrorPending{};
+	};
+
+	std::shared_ptr<shared> const m_shared;
+};
 
 class CLocalListViewDropTarget : public CScrollableDropTarget<wxListCtrlEx>
 {
@@ -256,6 +419,7 @@ BEGIN_EVENT_TABLE(CLocalListView, CFileListCtrl<CLocalFileData>)
 	EVT_COMMAND(-1, fzEVT_VOLUMEENUMERATED, CLocalListView::OnVolumesEnumerated)
 #endif
 	EVT_MENU(XRCID("ID_CONTEXT_REFRESH"), CLocalListView::OnMenuRefresh)
+	EVT_COMMAND(wxID_ANY, fzEVT_LOCALDIR_READ, CLocalListView::OnDirRead)
 END_EVENT_TABLE()
 
 CLocalListView::CLocalListView(wxWindow* pParent, CState *pState, CQueueView *pQueue)
@@ -297,6 +461,9 @@ CLocalListView::~CLocalListView()
 	wxString str = wxString::Format(_T("%d %d"), m_sortDirection, m_sortColumn);
 	COptions::Get()->SetOption(OPTION_LOCALFILELIST_SORTORDER, str);
 
+	StopReading();
+	m_stoppedDirReaders.clear();
+
 #ifdef __WXMSW__
 	delete m_pVolumeEnumeratorThread;
 #endif
@@ -306,10 +473,14 @@ bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 {
 	CancelLabelEdit();
 
+	// Whatever is still being read is out of date
+	StopReading();
+
 	wxString focused;
 	std::list<wxString> selectedNames;
 	bool ensureVisible = false;
-	if (m_dir != dirname)
+	bool const refresh = m_dir == dirname;
+	if (!refresh)
 	{
 		ResetSearchPrefix();
 
@@ -326,19 +497,91 @@ bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 			EnsureVisible(0);
 		m_dir = dirname;
 	}
-	else
+
+#ifdef __WXMSW__
+	bool const drives = m_dir.GetPath() == _T("\\");
+	bool shares = false;
+	if (m_dir.GetPath().Left(2) == _T("\\\\"))
 	{
-		// Remember which items were selected
-		selectedNames = RememberSelectedItems(focused);
+		int pos = m_dir.GetPath().Mid(2).Find('\\');
+		shares = pos == -1 || pos + 3 == (int)m_dir.GetPath().Len();
+	}
+	if (!drives && !shares)
+#endif
+	{
+		CLocalListingCache* const cache = CLocalListingCache::Get();
+
+		// Refreshing always reads the directory again
+		std::vector<CLocalFileData> entries;
+		if (!refresh && cache && cache->Lookup(m_dir, entries)) {
+			BeginListing();
+			std::vector<unsigned int> const added = AddEntries(entries);
+			m_indexMapping.insert(m_indexMapping.end(), added.begin(), added.end());
+			FinishListing(std::list<wxString>(), focused, ensureVisible);
+
+			return true;
+		}
+
+		if (cache)
+			cache->BeginRead(m_dir);
+
+		// A different directory gets shown while being read. When refreshing,
+		// the old entries stay until all new ones have been read.
+		m_dirReader.reset(new CLocalDirReader(*this, m_dir));
+		m_progressiveDisplay = !refresh;
+		if (refresh)
+			return true;
+
+		m_readFocused = focused;
+		m_readEnsureVisible = ensureVisible;
+
+		BeginListing();
+		FinishListing(std::list<wxString>(), wxString(), false);
+
+		return true;
 	}
 
+#ifdef __WXMSW__
+	if (refresh)
+		selectedNames = RememberSelectedItems(focused);
+
+	BeginListing();
+	if (drives)
+		DisplayDrives();
+	else
+		DisplayShares(m_dir.GetPath());
+	FinishListing(selectedNames, focused, ensureVisible);
+
+	return true;
+#endif
+}
+
+void CLocalListView::StopReading()
+{
+	if (!m_dirReader)
+		return;
+
+	// Its thread might be stuck, e.g. on an unresponsive network drive.
+	// Don't wait for it, the reader gets deleted after its last event.
+	m_dirReader->Stop();
+	m_stoppedDirReaders.push_back(std::move(m_dirReader));
+
+	CLocalListingCache* const cache = CLocalListingCache::Get();
+	if (cache)
+		cache->CancelRead(m_dir);
+
+	m_readEntries.clear();
+	m_refreshWhileReading.clear();
+}
+
+void CLocalListView::BeginListing()
+{
 	if (m_pFilelistStatusBar)
 		m_pFilelistStatusBar->UnselectAll();
 
-	const int oldItemCount = m_indexMapping.size();
-
 	m_fileData.clear();
 	m_indexMapping.clear();
+	m_sortKeys.clear();
 
 	m_hasParent = m_dir.HasLogicalParent();
 
@@ -351,70 +594,44 @@ bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 		m_indexMapping.push_back(0);
 	}
 
-#ifdef __WXMSW__
-	if (m_dir.GetPath() == _T("\\")) {
-		DisplayDrives();
-	}
-	else if (m_dir.GetPath().Left(2) == _T("\\\\"))
-	{
-		int pos = m_dir.GetPath().Mid(2).Find('\\');
-		if (pos != -1 && pos + 3 != (int)m_dir.GetPath().Len())
-			goto regular_dir;
-
-		// UNC path without shares
-		DisplayShares(m_dir.GetPath());
-	}
-	else
-#endif
-	{
-#ifdef __WXMSW__
-regular_dir:
-#endif
-		CFilterManager filter;
-		CLocalFileSystem local_filesystem;
-
-		if (!local_filesystem.BeginFindFiles(m_dir.GetPath(), false)) {
-			SetItemCount(1);
-			return false;
-		}
+	if (m_pFilelistStatusBar)
+		m_pFilelistStatusBar->SetDirectoryContents(0, 0, 0, 0, 0);
+}
 
-		wxLongLong totalSize;
-		int unknown_sizes = 0;
-		int totalFileCount = 0;
-		int totalDirCount = 0;
-		int hidden = 0;
+std::vector<unsigned int> CLocalListView::AddEntries(std::vector<CLocalFileData>& entries)
+{
+	CFilterManager filter;
 
-		int num = m_fileData.size();
-		CLocalFileData data;
-		bool wasLink;
-		while (local_filesystem.GetNextFile(data.name, wasLink, data.dir, &data.size, &data.time, &data.attributes)) {
-			if (data.name.empty()) {
-				wxGetApp().DisplayEncodingWarning();
-				continue;
-			}
+	std::vector<unsigned int> added;
+	added.reserve(entries.size());
 
-			m_fileData.push_back(data);
-			if (!filter.FilenameFiltered(data.name, m_dir.GetPath(), data.dir, data.size, true, data.attributes, data.time)) {
+	m_fileData.reserve(m_fileData.size() + entries.size());
+	for (auto& data : entries) {
+		if (!filter.FilenameFiltered(data.name, m_dir.GetPath(), data.dir, data.size, true, data.attributes, data.time)) {
+			if (m_pFilelistStatusBar) {
 				if (data.dir)
-					totalDirCount++;
-				else {
-					if (data.size != -1)
-						totalSize += data.size;
-					else
-						unknown_sizes++;
-					totalFileCount++;
-				}
-				m_indexMapping.push_back(num);
+					m_pFilelistStatusBar->AddDirectory();
+				else
+					m_pFilelistStatusBar->AddFile(data.size);
 			}
-			else
-				hidden++;
-			num++;
+			if (!data.dir)
+				QueueIconLookup(m_dir.GetPath() + data.name, true);
+			added.push_back(m_fileData.size());
 		}
-
-		if (m_pFilelistStatusBar)
-			m_pFilelistStatusBar->SetDirectoryContents(totalFileCount, totalDirCount, totalSize, unknown_sizes, hidden);
+		m_fileData.push_back(std::move(data));
 	}
+	entries.clear();
+
+	StartResolvingIcons();
+
+	if (m_pFilelistStatusBar)
+		m_pFilelistStatusBar->SetHidden(m_fileData.size() - m_indexMapping.size() - added.size());
 
+	return added;
+}
+
+void CLocalListView::FinishListing(std::list<wxString> const& selectedNames, wxString const& focused, bool ensureVisible)
+{
 	if (m_dropTarget != -1) {
 		CLocalFileData* data = GetData(m_dropTarget);
 		if (!data || !data->dir) {
@@ -424,7 +641,7 @@ regular_dir:
 	}
 
 	const int count = m_indexMapping.size();
-	if (oldItemCount != count)
+	if (GetItemCount() != count)
 		SetItemCount(count);
 
 	SortList(-1, -1, false);
@@ -437,8 +654,68 @@ regular_dir:
 	ReselectItems(selectedNames, focused, ensureVisible);
 
 	RefreshListOnly();
+}
 
-	return true;
+void CLocalListView::OnDirRead(wxCommandEvent& event)
+{
+	CLocalDirReader* reader = static_cast<CLocalDirReader*>(event.GetClientData());
+	if (reader != m_dirReader.get()) {
+		for (auto it = m_stoppedDirReaders.begin(); it != m_stoppedDirReaders.end(); ++it) {
+			if (it->get() == reader) {
+				std::vector<CLocalFileData> entries;
+				bool encodingError;
+				if ((*it)->GetEntries(entries, encodingError))
+					m_stoppedDirReaders.erase(it);
+				break;
+			}
+		}
+		return;
+	}
+
+	std::vector<CLocalFileData> entries;
+	bool encodingError;
+	bool const done = reader->GetEntries(entries, encodingError);
+	if (encodingError)
+		wxGetApp().DisplayEncodingWarning();
+
+	if (m_progressiveDisplay) {
+		CancelLabelEdit();
+		InsertSorted(AddEntries(entries));
+	}
+	else
+		m_readEntries.insert(m_readEntries.end(), std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()));
+
+	if (!done)
+		return;
+
+	m_dirReader.reset();
+
+	if (m_progressiveDisplay) {
+		// Unless the user already focused something else
+		if (GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED) == -1)
+			ReselectItems(std::list<wxString>(), m_readFocused, m_readEnsureVisible);
+		RefreshListOnly(false);
+	}
+	else {
+		wxString focused;
+		std::list<wxString> selectedNames = RememberSelectedItems(focused);
+
+		BeginListing();
+		std::vector<unsigned int> const added = AddEntries(m_readEntries);
+		m_indexMapping.insert(m_indexMapping.end(), added.begin(), added.end());
+		FinishListing(selectedNames, focused, false);
+	}
+	m_readEntries.clear();
+
+	CLocalListingCache* const cache = CLocalListingCache::Get();
+	if (cache)
+		cache->Store(m_dir, std::vector<CLocalFileData>(m_fileData.begin() + (m_hasParent ? 1 : 0), m_fileData.end()));
+
+	// Files that changed while reading
+	std::list<wxString> refresh;
+	refresh.swap(m_refreshWhileReading);
+	for (auto const& file : refresh)
+		RefreshFile(file);
 }
 
 // See comment to OnGetItemText
@@ -465,7 +742,16 @@ int CLocalListView::OnGetItemImage(long item) const
 			CLocalFileSystem::GetFileInfo(path, isSymLink, NULL, NULL, NULL);
 		}
 
-		icon = pThis->GetIconIndex(data->dir ? iconType::dir : iconType::file, path, true, isSymLink);
+		if (data->dir)
+			icon = pThis->GetIconIndex(iconType::dir, path, true, isSymLink);
+		else
+		{
+			bool placeholder;
+			int const fileIcon = pThis->GetFileIconIndex(path, true, isSymLink, placeholder);
+			if (placeholder)
+				return fileIcon;
+			icon = fileIcon;
+		}
 	}
 	return icon;
 }
@@ -1325,12 +1611,26 @@ void CLocalListView::OnBeginDrag(wxListEvent& event)
 
 void CLocalListView::RefreshFile(const wxString& file)
 {
+	if (m_dirReader) {
+		// Gets applied once the directory has been read
+		m_refreshWhileReading.push_back(file);
+		return;
+	}
+
 	CLocalFileData data;
 
 	bool wasLink;
 	enum CLocalFileSystem::local_fileType type = CLocalFileSystem::GetFileInfo(m_dir.GetPath() + file, wasLink, &data.size, &data.time, &data.attributes);
-	if (type == CLocalFileSystem::unknown)
+	if (type == CLocalFileSystem::unknown) {
+		// Gone
+		for (unsigned int i = m_hasParent ? 1 : 0; i < m_fileData.size(); ++i) {
+			if (m_fileData[i].name == file && m_fileData[i].comparison_flags != fill) {
+				RemoveFile(i);
+				break;
+			}
+		}
 		return;
+	}
 
 	data.name = file;
 	data.dir = type == CLocalFileSystem::dir;
@@ -1463,6 +1763,94 @@ void CLocalListView::RefreshFile(const wxString& file)
 	}
 }
 
+void CLocalListView::RemoveFile(unsigned int index)
+{
+	CancelLabelEdit();
+
+	wxString focused;
+	std::list<wxString> selectedNames;
+	if (IsComparing())
+	{
+		wxASSERT(!m_originalIndexMapping.empty());
+		selectedNames = RememberSelectedItems(focused);
+		m_indexMapping.clear();
+		m_originalIndexMapping.swap(m_indexMapping);
+	}
+
+	CLocalFileData const& data = m_fileData[index];
+
+	int item = -1;
+	for (unsigned int i = 0; i < m_indexMapping.size(); ++i)
+	{
+		if (m_indexMapping[i] == index)
+			item = i;
+		else if (m_indexMapping[i] > index)
+			--m_indexMapping[i];
+	}
+
+	if (item != -1)
+	{
+		if (m_pFilelistStatusBar)
+		{
+			if (!IsComparing() && GetItemState(item, wxLIST_STATE_SELECTED))
+			{
+				if (data.dir)
+					m_pFilelistStatusBar->UnselectDirectory();
+				else
+					m_pFilelistStatusBar->UnselectFile(data.size);
+			}
+			if (data.dir)
+				m_pFilelistStatusBar->RemoveDirectory();
+			else
+				m_pFilelistStatusBar->RemoveFile(data.size);
+		}
+		m_indexMapping.erase(m_indexMapping.begin() + item);
+	}
+
+	m_fileData.erase(m_fileData.begin() + index);
+	m_sortKeys.erase(index);
+
+	if (m_pFilelistStatusBar)
+	{
+		int hidden = m_fileData.size() - m_indexMapping.size();
+		if (!m_fileData.empty() && m_fileData.back().comparison_flags == fill)
+			--hidden;
+		m_pFilelistStatusBar->SetHidden(hidden);
+	}
+
+	if (!IsComparing())
+	{
+		// Filtered files are not shown anyway
+		if (item == -1)
+			return;
+
+		if (m_dropTarget >= item)
+			m_dropTarget = -1;
+
+		// Move selections, the last item is gone already
+		int prevState = 0;
+		for (int i = m_indexMapping.size(); i >= item; i--)
+		{
+			int state = GetItemState(i, wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED);
+			if (state != prevState)
+			{
+				SetItemState(i, prevState, wxLIST_STATE_FOCUSED);
+				SetSelection(i, (prevState & wxLIST_STATE_SELECTED) != 0);
+				prevState = state;
+			}
+		}
+		SetItemCount(m_indexMapping.size());
+		RefreshListOnly();
+	}
+	else
+	{
+		RefreshComparison();
+		if (m_pFilelistStatusBar)
+			m_pFilelistStatusBar->UnselectAll();
+		ReselectItems(selectedNames, focused);
+	}
+}
+
 wxListItemAttr* CLocalListView::OnGetItemAttr(long item) const
 {
 	CLocalListView *pThis = const_cast<CLocalListView *>(this);
@@ -1554,6 +1942,12 @@ void CLocalListView::FinishComparison()
 
 bool CLocalListView::CanStartComparison(wxString* pError)
 {
+	if (m_dirReader && m_progressiveDisplay) {
+		if (pError)
+			*pError = _("Cannot compare directories, the local directory is still being read.");
+		return false;
+	}
+
 	return true;
 }
 
@@ -24,6 +24,8 @@ public:
 	bool is_dir() const { return dir; }
 };
 
+class CLocalDirReader;
+
 class CLocalListView : public CFileListCtrl<CLocalFileData>, CStateEventHandler
 {
 	friend class CLocalListViewDropTarget;
@@ -38,6 +40,27 @@ protected:
 	bool DisplayDir(CLocalPath const& dirname);
 	void ApplyCurrentFilter();
 
+	// Directories are read in the background
+	void StopReading();
+	void BeginListing();
+	std::vector<unsigned int> AddEntries(std::vector<CLocalFileData>& entries);
+	void FinishListing(std::list<wxString> const& selectedNames, wxString const& focused, bool ensureVisible);
+
+	std::unique_ptr<CLocalDirReader> m_dirReader;
+
+	// Readers that got stopped before they were done, deleted after their
+	// last event
+	std::list<std::unique_ptr<CLocalDirReader>> m_stoppedDirReaders;
+
+	// When changing directories, entries get shown as they are read.
+	// Otherwise they are collected and replace the old entries at once.
+	bool m_progressiveDisplay{};
+	std::vector<CLocalFileData> m_readEntries;
+	wxString m_readFocused;
+	bool m_readEnsureVisible{};
+
+	std::list<wxString> m_refreshWhileReading;
+
 	// Declared const due to design error in wxWidgets.
 	// Won't be fixed since a fix would break backwards compatibility
 	// Both functions use a const_cast<CLocalListView *>(this) and modify
@@ -76,6 +99,7 @@ protected:
 	virtual CSortComparisonObject GetSortComparisonObject();
 
 	void RefreshFile(const wxString& file);
+	void RemoveFile(unsigned int index);
 
 	virtual void OnNavigationEvent(bool forward);
 
@@ -107,6 +131,7 @@ protected:
 	CVolumeDescriptionEnumeratorThread* m_pVolumeEnumeratorThread;
 #endif
 	void OnMenuRefresh(wxCommandEvent& event);
+	void OnDirRead(wxCommandEvent& event);
 };
 
 #endif
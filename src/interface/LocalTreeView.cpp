@@ -8,6 +8,7 @@
 #include "dndobjects.h"
 #include "inputdialog.h"
 #include "local_filesys.h"
+#include "local_listing_cache.h"
 #include "dragdropmanager.h"
 #include "drop_target_ex.h"
 #include "Options.h"
@@ -426,38 +427,69 @@ bool CLocalTreeView::DisplayDrives(wxTreeItemId parent)
 
 #endif
 
-void CLocalTreeView::DisplayDir(wxTreeItemId parent, const wxString& dirname, const wxString& knownSubdir /*=_T("")*/)
+bool CLocalTreeView::ReadSubdirs(const wxString& dirname, std::vector<CLocalFileData>& subdirs)
 {
+	CLocalListingCache* const cache = CLocalListingCache::Get();
+	if (cache && cache->Lookup(CLocalPath(dirname), subdirs))
+	{
+		subdirs.erase(std::remove_if(subdirs.begin(), subdirs.end(), [](CLocalFileData const& data) { return !data.dir; }), subdirs.end());
+		return true;
+	}
+
 	CLocalFileSystem local_filesystem;
 
 	{
 		wxLogNull log;
 		if (!local_filesystem.BeginFindFiles(dirname, true))
+			return false;
+	}
+
+	CLocalFileData data;
+	data.size = -1;
+	bool wasLink;
+	while (local_filesystem.GetNextFile(data.name, wasLink, data.dir, 0, &data.time, &data.attributes))
+	{
+		wxASSERT(data.dir);
+		if (data.name.empty())
 		{
-			if (!knownSubdir.empty())
-			{
-				wxTreeItemId item = GetSubdir(parent, knownSubdir);
-				if (item != wxTreeItemId())
-					return;
+			wxGetApp().DisplayEncodingWarning();
+			continue;
+		}
 
-				const wxString fullName = dirname + knownSubdir;
-				item = AppendItem(parent, knownSubdir, GetIconIndex(iconType::dir, fullName),
+		subdirs.push_back(data);
+	}
+
+	return true;
+}
+
+void CLocalTreeView::DisplayDir(wxTreeItemId parent, const wxString& dirname, const wxString& knownSubdir /*=_T("")*/)
+{
+	std::vector<CLocalFileData> subdirs;
+	if (!ReadSubdirs(dirname, subdirs))
+	{
+		if (!knownSubdir.empty())
+		{
+			wxTreeItemId item = GetSubdir(parent, knownSubdir);
+			if (item != wxTreeItemId())
+				return;
+
+			const wxString fullName = dirname + knownSubdir;
+			item = AppendItem(parent, knownSubdir, GetIconIndex(iconType::dir, fullName),
 #ifdef __WXMSW__
-						-1
+					-1
 #else
-						GetIconIndex(iconType::opened_dir, fullName)
+					GetIconIndex(iconType::opened_dir, fullName)
 #endif
-					);
-				CheckSubdirStatus(item, fullName);
-			}
-			else
-			{
-				m_setSelection = true;
-				DeleteChildren(parent);
-				m_setSelection = false;
-			}
-			return;
+				);
+			CheckSubdirStatus(item, fullName);
+		}
+		else
+		{
+			m_setSelection = true;
+			DeleteChildren(parent);
+			m_setSelection = false;
 		}
+		return;
 	}
 
 	wxASSERT(parent);
@@ -469,21 +501,10 @@ void CLocalTreeView::DisplayDir(wxTreeItemId parent, const wxString& dirname, co
 
 	bool matchedKnown = false;
 
-	wxString file;
-	bool wasLink;
-	int attributes;
-	bool is_dir;
 	const wxLongLong size(-1);
-	CDateTime date;
-	while (local_filesystem.GetNextFile(file, wasLink, is_dir, 0, &date, &attributes))
+	for (auto const& data : subdirs)
 	{
-		wxASSERT(is_dir);
-		if (file.empty())
-		{
-			wxGetApp().DisplayEncodingWarning();
-			continue;
-		}
-
+		wxString const& file = data.name;
 		wxString fullName = dirname + file;
 #ifdef __WXMSW__
 		if (file.CmpNoCase(knownSubdir))
@@ -491,7 +512,7 @@ void CLocalTreeView::DisplayDir(wxTreeItemId parent, const wxString& dirname, co
 		if (file != knownSubdir)
 #endif
 		{
-			if (filter.FilenameFiltered(file, dirname, true, size, true, attributes, date))
+			if (filter.FilenameFiltered(file, dirname, true, size, true, data.attributes, data.time))
 				continue;
 		}
 		else
@@ -531,6 +552,18 @@ wxString CLocalTreeView::HasSubdir(const wxString& dirname)
 
 	CFilterManager filter;
 
+	std::vector<CLocalFileData> entries;
+	CLocalListingCache* const cache = CLocalListingCache::Get();
+	if (cache && cache->Lookup(CLocalPath(dirname), entries))
+	{
+		for (auto const& data : entries)
+		{
+			if (data.dir && !filter.FilenameFiltered(data.name, dirname, true, wxLongLong(-1), true, data.attributes, data.time))
+				return data.name;
+		}
+		return wxString();
+	}
+
 	CLocalFileSystem local_filesystem;
 	if (!local_filesystem.BeginFindFiles(dirname, true))
 		return wxString();
@@ -7,6 +7,7 @@
 #include "treectrlex.h"
 
 class CQueueView;
+class CLocalFileData;
 
 #ifdef __WXMSW__
 class CVolumeDescriptionEnumeratorThread;
@@ -49,6 +50,7 @@ protected:
 
 	wxTreeItemId GetNearestParent(wxString& localDir);
 	wxTreeItemId GetSubdir(wxTreeItemId parent, const wxString& subDir);
+	bool ReadSubdirs(const wxString& dirname, std::vector<CLocalFileData>& subdirs);
 	void DisplayDir(wxTreeItemId parent, const wxString& dirname, const wxString& knownSubdir = _T(""));
 	wxString HasSubdir(const wxString& dirname);
 	wxTreeItemId MakeSubdirs(wxTreeItemId parent, wxString dirname, wxString subDir);
@@ -44,6 +44,8 @@
 #include "bookmarks_dialog.h"
 #include "search.h"
 #include "power_management.h"
+#include "local_listing_cache.h"
+#include "remote_search_index.h"
 #include "welcome_dialog.h"
 #include "context_control.h"
 #include "speedlimits_dialog.h"
@@ -295,6 +297,9 @@ CMainFrame::CMainFrame()
 
 	CPowerManagement::Create(this);
 
+	CLocalListingCache::Create();
+	CRemoteSearchIndex::Create();
+
 	// It's important that the context control gets created before our own state handler
 	// so that contextchange events can be processed in the right order.
 	m_pContextControl = new CContextControl(this);
@@ -469,6 +474,8 @@ CMainFrame::~CMainFrame()
 	delete m_pStateEventHandler;
 
 	CContextManager::Get()->DestroyAllStates();
+	CLocalListingCache::Destroy();
+	CRemoteSearchIndex::Destroy();
 	delete m_pAsyncRequestQueue;
 #if FZ_MANUALUPDATECHECK
 	delete m_pUpdater;
@@ -641,6 +648,24 @@ void CMainFrame::OnMenuHandler(wxCommandEvent &event)
 		if (dlg.ShowModal() == wxID_OK)
 			wxMessageBoxEx(ListTlsCiphers(dlg.GetValue()), _T("Ciphers"));
 	}
+	else if (event.GetId() == XRCID("ID_BENCHMARK_FILTERS")) {
+		CState* pState = CContextManager::Get()->GetCurrentContext();
+		std::shared_ptr<CDirectoryListing> pListing = pState ? pState->GetRemoteDir() : std::shared_ptr<CDirectoryListing>();
+		if (!pListing) {
+			wxBell();
+			return;
+		}
+
+		wxString result;
+		{
+			wxBusyCursor busy;
+			CFilterManager filters;
+			result = filters.BenchmarkFilters(*pListing);
+		}
+		if (result.empty())
+			result = _T("No active remote filters or no entries to check them against.");
+		wxMessageBoxEx(result, _T("Benchmark filters"));
+	}
 	else if (event.GetId() == XRCID("ID_CLEARCACHE_LAYOUT")) {
 		CWrapEngine::ClearCache();
 	}
@@ -943,6 +968,10 @@ void CMainFrame::OnEngineEvent(wxFzEvent &event)
 						pListing->m_firstListTime = CMonotonicTime::Now();
 					}
 
+					const CServer* pServer = pState->GetServer();
+					if (pServer && CRemoteSearchIndex::Get())
+						CRemoteSearchIndex::Get()->Add(*pServer, *pListing);
+
 					pState->SetRemoteDir(pListing, listingNotification.Modified());
 				}
 			}
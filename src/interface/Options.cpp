@@ -106,6 +106,8 @@ static const t_Option options[OPTIONS_NUM] =
 	{ "Size format", number, _T("0"), normal },
 	{ "Size thousands separator", number, _T("1"), normal },
 	{ "Size decimal places", number, _T("1"), normal },
+	{ "FTP Block mode", number, _T("0"), normal },
+	{ "FTP Verify hash", number, _T("0"), normal },
 
 	// Interface settings
 	{ "Number of Transfers", number, _T("2"), normal },
@@ -188,6 +190,10 @@ static const t_Option options[OPTIONS_NUM] =
 	{ "Strip VMS revisions", number, _T("0"), normal },
 	{ "Show Site Manager on startup", number, _T("0"), normal },
 	{ "Prompt password change", number, _T("0"), normal },
+	{ "Prefetch connections", number, _T("0"), normal },
+	{ "Transfer policy", number, _T("0"), normal },
+	{ "Warm connections", number, _T("0"), normal },
+	{ "Idle disconnect timeout", number, _T("60"), normal },
 
 	// Default/internal options
 	{ "Config Location", string, _T(""), default_only },
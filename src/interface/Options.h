@@ -89,6 +89,10 @@ enum interfaceOptions
 	OPTION_STRIP_VMS_REVISION,
 	OPTION_INTERFACE_SITEMANAGER_ON_STARTUP,
 	OPTION_PROMPTPASSWORDSAVE,
+	OPTION_PREFETCH_CONNECTIONS,
+	OPTION_TRANSFER_POLICY,
+	OPTION_WARM_CONNECTIONS,
+	OPTION_IDLE_DISCONNECT_TIMEOUT,
 
 	// Default/internal options
 	OPTION_DEFAULT_SETTINGSDIR, // guaranteed to be (back)slash-terminated
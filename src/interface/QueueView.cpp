@@ -5,6 +5,7 @@
 #include "StatusView.h"
 #include "statuslinectrl.h"
 #include "xmlfunctions.h"
+#include "xml_stream.h"
 #include "filezillaapp.h"
 #include "ipcmutex.h"
 #include "state.h"
@@ -23,6 +24,7 @@
 #include <wx/sound.h>
 #include "local_filesys.h"
 #include "statusbar.h"
+#include "sizeformatting.h"
 #include "recursive_operation.h"
 #include "auto_ascii_files.h"
 #include "dragdropmanager.h"
@@ -209,6 +211,10 @@ EVT_COMMAND(wxID_ANY, fzEVT_GRANTEXCLUSIVEENGINEACCESS, CQueueView::OnExclusiveE
 EVT_SIZE(CQueueView::OnSize)
 END_EVENT_TABLE()
 
+// Scans the local directories of an upload. Directories are handed out to
+// a few threads, each of which lists a whole directory at once and passes
+// it on as a single batch. Filtering and queueing of the found files as
+// well as descending into subdirectories is done by the GUI thread.
 class CFolderProcessingThread final : public wxThread
 {
 	struct t_internalDirPair
@@ -216,17 +222,31 @@ class CFolderProcessingThread final : public wxThread
 		CLocalPath localPath;
 		CServerPath remotePath;
 	};
+
+	class CWorker final : public wxThread
+	{
+	public:
+		CWorker(CFolderProcessingThread& owner)
+			: wxThread(wxTHREAD_JOINABLE)
+			, m_owner(owner)
+		{}
+
+	protected:
+		ExitCode Entry()
+		{
+			m_owner.Scan();
+			return 0;
+		}
+
+		CFolderProcessingThread& m_owner;
+	};
+
 public:
 	CFolderProcessingThread(CQueueView* pOwner, CFolderScanItem* pFolderItem)
 		: wxThread(wxTHREAD_JOINABLE), m_condition(m_sync) {
 		m_pOwner = pOwner;
 		m_pFolderItem = pFolderItem;
 
-		m_didSendEvent = false;
-		m_threadWaiting = false;
-		m_throttleWait = false;
-		m_processing_entries = false;
-
 		t_internalDirPair* pair = new t_internalDirPair;
 		pair->localPath = pFolderItem->GetLocalPath();
 		pair->remotePath = pFolderItem->GetRemotePath();
@@ -250,10 +270,8 @@ public:
 		m_didSendEvent = false;
 		m_processing_entries = true;
 
-		if (m_throttleWait) {
-			m_throttleWait = false;
-			m_condition.Signal();
-		}
+		// Wake up throttled workers
+		m_condition.Broadcast();
 	}
 
 	class t_dirPair : public CFolderProcessingEntry
@@ -280,25 +298,17 @@ public:
 
 		m_dirsToCheck.push_back(pair);
 
-		if (m_threadWaiting) {
-			m_threadWaiting = false;
-			m_condition.Signal();
-		}
+		m_condition.Broadcast();
 	}
 
 	void CheckFinished()
 	{
-		m_sync.Lock();
+		wxMutexLocker locker(m_sync);
 		wxASSERT(m_processing_entries);
 
 		m_processing_entries = false;
 
-		if (m_threadWaiting && (!m_dirsToCheck.empty() || m_entryList.empty())) {
-			m_threadWaiting = false;
-			m_condition.Signal();
-		}
-
-		m_sync.Unlock();
+		m_condition.Broadcast();
 	}
 
 	CFolderScanItem* GetFolderScanItem()
@@ -308,120 +318,141 @@ public:
 
 protected:
 
-	void AddEntry(CFolderProcessingEntry* entry)
+	// Don't let the workers get too far ahead of the GUI thread
+	static size_t const max_pending_entries = 10000;
+
+	ExitCode Entry()
 	{
-		m_sync.Lock();
-		m_entryList.push_back(entry);
+#ifdef __WXDEBUG__
+		wxMutexGuiEnter();
+		wxASSERT(m_pFolderItem->GetTopLevelItem() && m_pFolderItem->GetTopLevelItem()->GetType() == QueueItemType::Server);
+		wxMutexGuiLeave();
+#endif
+
+		wxASSERT(!m_pFolderItem->Download());
 
-		// Wait if there are more than 100 items to queue,
-		// don't send notification if there are less than 10.
-		// This reduces overhead
-		bool send;
+		int const threads = std::min(4, std::max(1, wxThread::GetCPUCount()));
 
-		if (m_didSendEvent) {
-			send = false;
-			if (m_entryList.size() >= 100) {
-				m_throttleWait = true;
-				m_condition.Wait();
+		std::vector<CWorker*> workers;
+		for (int i = 1; i < threads; ++i) {
+			CWorker* worker = new CWorker(*this);
+			if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR) {
+				delete worker;
+				break;
 			}
+			workers.push_back(worker);
 		}
-		else if (m_entryList.size() < 20)
-			send = false;
-		else
-			send = true;
 
-		if (send)
-			m_didSendEvent = true;
+		Scan();
 
+		m_sync.Lock();
+		m_quit = true;
+		m_condition.Broadcast();
 		m_sync.Unlock();
 
-		if (send) {
-			// We send the notification after leaving the critical section, else we
-			// could get into a deadlock. wxWidgets event system does internal
-			// locking.
-			m_pOwner->QueueEvent(new wxCommandEvent(fzEVT_FOLDERTHREAD_FILES, wxID_ANY));
+		for (auto worker : workers) {
+			worker->Wait(wxTHREAD_WAIT_BLOCK);
+			delete worker;
 		}
+
+		m_pOwner->QueueEvent(new wxCommandEvent(fzEVT_FOLDERTHREAD_COMPLETE, wxID_ANY));
+		return 0;
 	}
 
-	ExitCode Entry()
+	bool Stopping()
 	{
-#ifdef __WXDEBUG__
-		wxMutexGuiEnter();
-		wxASSERT(m_pFolderItem->GetTopLevelItem() && m_pFolderItem->GetTopLevelItem()->GetType() == QueueItemType::Server);
-		wxMutexGuiLeave();
-#endif
+		if (!m_quit && (m_pFolderItem->m_remove || (wxThread::This() == this && TestDestroy())))
+			m_quit = true;
 
-		wxASSERT(!m_pFolderItem->Download());
+		return m_quit;
+	}
 
+	// Run by all scanning threads. Returns once all directories have been
+	// scanned and the GUI thread has processed all found entries.
+	void Scan()
+	{
 		CLocalFileSystem localFileSystem;
 
-		while (!TestDestroy() && !m_pFolderItem->m_remove) {
+		for (;;) {
 			m_sync.Lock();
-			if (m_dirsToCheck.empty()) {
-				if (!m_didSendEvent && !m_entryList.empty()) {
-					m_didSendEvent = true;
-					m_sync.Unlock();
-					m_pOwner->QueueEvent(new wxCommandEvent(fzEVT_FOLDERTHREAD_FILES, wxID_ANY));
-					continue;
-				}
-
-				if (!m_didSendEvent && !m_processing_entries) {
-					m_sync.Unlock();
+			while (m_dirsToCheck.empty() && !Stopping()) {
+				if (!m_busy && m_entryList.empty() && !m_didSendEvent && !m_processing_entries) {
+					m_quit = true;
+					m_condition.Broadcast();
 					break;
 				}
-				m_threadWaiting = true;
 				m_condition.Wait();
-				if (m_dirsToCheck.empty()) {
-					m_sync.Unlock();
-					break;
-				}
+			}
+			if (m_quit) {
 				m_sync.Unlock();
-				continue;
+				break;
 			}
 
-			const t_internalDirPair *pair = m_dirsToCheck.front();
+			t_internalDirPair *pair = m_dirsToCheck.front();
 			m_dirsToCheck.pop_front();
+			++m_busy;
 
 			m_sync.Unlock();
 
-			if (!localFileSystem.BeginFindFiles(pair->localPath.GetPath(), false)) {
-				delete pair;
-				continue;
-			}
+			// List the whole directory without holding the lock, the marker
+			// for the directory has to precede its contents.
+			std::list<CFolderProcessingEntry*> entries;
+			if (localFileSystem.BeginFindFiles(pair->localPath.GetPath(), false)) {
+				t_dirPair* pair2 = new t_dirPair;
+				pair2->localPath = pair->localPath;
+				pair2->remotePath = pair->remotePath;
+				entries.push_back(pair2);
+
+				t_newEntry* entry = new t_newEntry;
+
+				wxString name;
+				bool is_link;
+				bool is_dir;
+				while (localFileSystem.GetNextFile(name, is_link, is_dir, &entry->size, &entry->time, &entry->attributes)) {
+					if (is_link)
+						continue;
 
-			t_dirPair* pair2 = new t_dirPair;
-			pair2->localPath = pair->localPath;
-			pair2->remotePath = pair->remotePath;
-			AddEntry(pair2);
+					entry->name = name;
+					entry->dir = is_dir;
 
-			t_newEntry* entry = new t_newEntry;
+					entries.push_back(entry);
 
-			wxString name;
-			bool is_link;
-			bool is_dir;
-			while (localFileSystem.GetNextFile(name, is_link, is_dir, &entry->size, &entry->time, &entry->attributes)) {
-				if (is_link)
-					continue;
+					entry = new t_newEntry;
+				}
+				delete entry;
+				localFileSystem.EndFindFiles();
+			}
+			delete pair;
 
-				entry->name = name;
-				entry->dir = is_dir;
+			m_sync.Lock();
+			--m_busy;
+			m_entryList.splice(m_entryList.end(), entries);
 
-				AddEntry(entry);
+			bool send = false;
+			if (!m_didSendEvent && !m_entryList.empty()) {
+				m_didSendEvent = true;
+				send = true;
+			}
+			m_condition.Broadcast();
+			m_sync.Unlock();
 
-				entry = new t_newEntry;
+			if (send) {
+				// We send the notification after leaving the critical section, else we
+				// could get into a deadlock. wxWidgets event system does internal
+				// locking.
+				m_pOwner->QueueEvent(new wxCommandEvent(fzEVT_FOLDERTHREAD_FILES, wxID_ANY));
 			}
-			delete entry;
 
-			delete pair;
+			m_sync.Lock();
+			while (m_entryList.size() >= max_pending_entries && !Stopping()) {
+				m_condition.Wait();
+			}
+			m_sync.Unlock();
 		}
-
-		m_pOwner->QueueEvent(new wxCommandEvent(fzEVT_FOLDERTHREAD_COMPLETE, wxID_ANY));
-		return 0;
 	}
 
-	std::list<t_internalDirPair*> m_dirsToCheck;
-
 	// Access has to be guarded by m_sync
+	std::list<t_internalDirPair*> m_dirsToCheck;
 	std::list<CFolderProcessingEntry*> m_entryList;
 
 	CQueueView* m_pOwner;
@@ -429,10 +460,10 @@ protected:
 
 	wxMutex m_sync;
 	wxCondition m_condition;
-	bool m_threadWaiting;
-	bool m_throttleWait;
-	bool m_didSendEvent;
-	bool m_processing_entries;
+	int m_busy{};
+	bool m_quit{};
+	bool m_didSendEvent{};
+	bool m_processing_entries{};
 };
 
 CQueueView::CQueueView(CQueue* parent, int index, CMainFrame* pMainFrame, CAsyncRequestQueue *pAsyncRequestQueue)
@@ -452,9 +483,6 @@ CQueueView::CQueueView(CQueue* parent, int index, CMainFrame* pMainFrame, CAsync
 	m_lastTopItem = -1;
 	m_pFolderProcessingThread = 0;
 
-	m_totalQueueSize = 0;
-	m_filesWithUnknownSize = 0;
-
 	m_actionAfterState = ActionAfterState_Disabled;
 #if defined(__WXMSW__) || defined(__WXMAC__)
 	m_actionAfterWarnDialog = 0;
@@ -502,14 +530,13 @@ CQueueView::~CQueueView()
 #endif
 }
 
-bool CQueueView::QueueFile(const bool queueOnly, const bool download,
-						   const wxString& sourceFile, const wxString& targetFile,
-						   const CLocalPath& localPath, const CServerPath& remotePath,
-						   const CServer& server, const wxLongLong size, enum CEditHandler::fileType edit,
-						   QueuePriority priority)
+namespace {
+CFileItem* CreateFileItem(CServerItem* pServerItem, const bool queueOnly, const bool download,
+						  const wxString& sourceFile, const wxString& targetFile,
+						  const CLocalPath& localPath, const CServerPath& remotePath,
+						  const wxLongLong size, enum CEditHandler::fileType edit,
+						  QueuePriority priority)
 {
-	CServerItem* pServerItem = CreateServerItem(server);
-
 	CFileItem* fileItem;
 	if (sourceFile.empty())
 	{
@@ -536,11 +563,61 @@ bool CQueueView::QueueFile(const bool queueOnly, const bool download,
 	}
 
 	fileItem->SetPriorityRaw(priority);
+
+	return fileItem;
+}
+}
+
+bool CQueueView::QueueFile(const bool queueOnly, const bool download,
+						   const wxString& sourceFile, const wxString& targetFile,
+						   const CLocalPath& localPath, const CServerPath& remotePath,
+						   const CServer& server, const wxLongLong size, enum CEditHandler::fileType edit,
+						   QueuePriority priority)
+{
+	CServerItem* pServerItem = CreateServerItem(server);
+
+	CFileItem* fileItem = CreateFileItem(pServerItem, queueOnly, download, sourceFile, targetFile, localPath, remotePath, size, edit, priority);
 	InsertItem(pServerItem, fileItem);
 
 	return true;
 }
 
+CQueueBatch::CQueueBatch(CServer const& server)
+	: m_server(server)
+{
+}
+
+CQueueBatch::~CQueueBatch()
+{
+	for (auto item : m_items)
+		delete item;
+}
+
+void CQueueBatch::AddFile(const bool queueOnly, const bool download,
+						  const wxString& sourceFile, const wxString& targetFile,
+						  const CLocalPath& localPath, const CServerPath& remotePath,
+						  const wxLongLong size, enum CEditHandler::fileType edit,
+						  QueuePriority priority)
+{
+	// The server item gets assigned once the files are added to the queue
+	CFileItem* fileItem = CreateFileItem(0, queueOnly, download, sourceFile, targetFile, localPath, remotePath, size, edit, priority);
+	fileItem->m_defaultFileExistsAction = m_fileExistsAction;
+	m_items.push_back(fileItem);
+}
+
+void CQueueView::QueueFiles(CQueueBatch & batch)
+{
+	if (batch.empty())
+		return;
+
+	CServerItem* pServerItem = CreateServerItem(batch.m_server);
+	for (auto item : batch.m_items)
+		item->SetParent(pServerItem);
+
+	InsertItems(pServerItem, batch.m_items);
+	batch.m_items.clear();
+}
+
 void CQueueView::QueueFile_Finish(const bool start)
 {
 	bool need_refresh = false;
@@ -554,12 +631,10 @@ void CQueueView::QueueFile_Finish(const bool start)
 		CContextManager::Get()->NotifyGlobalHandlers(STATECHANGE_QUEUEPROCESSING);
 	}
 
-	if (m_activeMode)
-	{
-		m_waitStatusLineUpdate = true;
-		AdvanceQueue(false);
-		m_waitStatusLineUpdate = false;
-	}
+	// Even if the queue isn't being processed, engines may get warmed up
+	m_waitStatusLineUpdate = true;
+	AdvanceQueue(false);
+	m_waitStatusLineUpdate = false;
 
 	UpdateStatusLinePositions();
 
@@ -572,27 +647,25 @@ extern wxString StripVMSRevision(const wxString& name);
 
 bool CQueueView::QueueFiles(const bool queueOnly, const CLocalPath& localPath, const CRemoteDataObject& dataObject)
 {
-	CServerItem* pServerItem = CreateServerItem(dataObject.GetServer());
-
 	const std::list<CRemoteDataObject::t_fileInfo>& files = dataObject.GetFiles();
 
+	CQueueBatch batch(dataObject.GetServer());
+	batch.reserve(files.size());
+
 	for (auto const& fileInfo : files) {
 		if (fileInfo.dir)
 			continue;
 
-		CFileItem* fileItem;
 		wxString localFile = ReplaceInvalidCharacters(fileInfo.name);
 		if (dataObject.GetServerPath().GetType() == VMS && COptions::Get()->GetOptionVal(OPTION_STRIP_VMS_REVISION))
 			localFile = StripVMSRevision(localFile);
 
-		fileItem = new CFileItem(pServerItem, queueOnly, true,
+		batch.AddFile(queueOnly, true,
 			fileInfo.name, (fileInfo.name != localFile) ? localFile : wxString(),
 			localPath, dataObject.GetServerPath(), fileInfo.size);
-		fileItem->SetAscii(CAutoAsciiFiles::TransferRemoteAsAscii(fileInfo.name, dataObject.GetServerPath().GetType()));
-
-		InsertItem(pServerItem, fileItem);
 	}
 
+	QueueFiles(batch);
 	QueueFile_Finish(!queueOnly);
 
 	return true;
@@ -716,7 +789,8 @@ bool CQueueView::CanStartTransfer(const CServerItem& server_item, struct t_Engin
 	if (!max_count)
 		return true;
 
-	int active_count = server_item.m_activeCount;
+	// Engines prefetching or connecting ahead of time use connections as well
+	int active_count = server_item.m_activeCount + GetBackgroundCount(server);
 
 	CState* browsingStateOnSameServer = 0;
 	const std::vector<CState*> *pStates = CContextManager::Get()->GetAllStates();
@@ -795,29 +869,36 @@ bool CQueueView::TryStartNextTransfer()
 	else
 		wantedDirection = TransferDirection::both;
 
+	// Keep slots free for small files if needed
+	TransferPolicy const policy = transfer_policy::from_option(COptions::Get()->GetOptionVal(OPTION_TRANSFER_POLICY));
+	bool const smallOnly = m_activeCountLarge >= transfer_policy::large_slots(policy, COptions::Get()->GetOptionVal(OPTION_NUMTRANSFERS));
+
 	struct t_bestMatch
 	{
 		t_bestMatch()
-			: fileItem(), serverItem(), pEngineData()
+			: fileItem(), serverItem(), pEngineData(), serverIndex()
 		{
 		}
 
 		CFileItem* fileItem;
 		CServerItem* serverItem;
 		t_EngineData* pEngineData;
+		size_t serverIndex;
 	} bestMatch;
 
 	// Find inactive file. Check all servers for
 	// the file with the highest priority
-	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter)
+	size_t const firstServer = (policy == TransferPolicy::round_robin && !m_serverList.empty()) ? (m_nextServer % m_serverList.size()) : 0;
+	for (size_t i = 0; i < m_serverList.size(); ++i)
 	{
 		t_EngineData* pEngineData = 0;
-		CServerItem* currentServerItem = *iter;
+		size_t const serverIndex = (firstServer + i) % m_serverList.size();
+		CServerItem* currentServerItem = m_serverList[serverIndex];
 
 		if (!CanStartTransfer(*currentServerItem, pEngineData))
 			continue;
 
-		CFileItem* newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection);
+		CFileItem* newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection, policy, smallOnly);
 
 		while (newFileItem && newFileItem->Download() && newFileItem->GetType() == QueueItemType::Folder)
 		{
@@ -835,7 +916,7 @@ bool CQueueView::TryStartNextTransfer()
 
 				return true;
 			}
-			newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection);
+			newFileItem = currentServerItem->GetIdleChild(m_activeMode == 1, wantedDirection, policy, smallOnly);
 		}
 
 		if (!newFileItem)
@@ -846,6 +927,7 @@ bool CQueueView::TryStartNextTransfer()
 			bestMatch.serverItem = currentServerItem;
 			bestMatch.fileItem = newFileItem;
 			bestMatch.pEngineData = pEngineData;
+			bestMatch.serverIndex = serverIndex;
 			if (newFileItem->GetPriority() == QueuePriority::highest)
 				break;
 		}
@@ -868,6 +950,7 @@ bool CQueueView::TryStartNextTransfer()
 	// Assign the file to the engine.
 
 	bestMatch.fileItem->SetActive(true);
+	m_nextServer = bestMatch.serverIndex + 1;
 
 	pEngineData->pItem = bestMatch.fileItem;
 	bestMatch.fileItem->m_pEngineData = pEngineData;
@@ -881,6 +964,14 @@ bool CQueueView::TryStartNextTransfer()
 	else
 		m_activeCountUp++;
 
+	if (bestMatch.fileItem->GetType() == QueueItemType::File)
+	{
+		pEngineData->large = !transfer_policy::is_small(bestMatch.fileItem->GetSize().GetValue());
+		if (pEngineData->large)
+			m_activeCountLarge++;
+		m_transferStats.started(wxGetUTCTimeMillis().GetValue());
+	}
+
 	const CServer oldServer = pEngineData->lastServer;
 	pEngineData->lastServer = bestMatch.serverItem->GetServer();
 
@@ -1107,9 +1198,23 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 		}
 
 		break;
+	case t_EngineData::listconnect:
+		if (replyCode != FZ_REPLY_OK) {
+			ResetEngine(*pEngineData, remove);
+			return;
+		}
+		// Prefetching is independent of the queue being active
+		pEngineData->state = t_EngineData::list;
+		SendNextCommand(*pEngineData);
+		return;
 	case t_EngineData::list:
 		ResetEngine(*pEngineData, remove);
 		return;
+	case t_EngineData::warmup:
+		if (replyCode != FZ_REPLY_OK)
+			m_warmUpFailed.push_back(pEngineData->lastServer);
+		ResetEngine(*pEngineData, remove);
+		return;
 	default:
 		return;
 	}
@@ -1199,6 +1304,15 @@ void CQueueView::ResetEngine(t_EngineData& data, const enum ResetReason reason)
 				pFileItem->m_onetime_action = CFileExistsNotification::unknown;
 				pFileItem->set_made_progress(false);
 			}
+
+			if (data.large)
+			{
+				wxASSERT(m_activeCountLarge > 0);
+				if (m_activeCountLarge > 0)
+					m_activeCountLarge--;
+				data.large = false;
+			}
+			m_transferStats.finished(wxGetUTCTimeMillis().GetValue(), pFileItem->GetSize().GetValue(), reason == success);
 		}
 
 		wxASSERT(data.pItem->IsActive());
@@ -1270,9 +1384,19 @@ void CQueueView::ResetEngine(t_EngineData& data, const enum ResetReason reason)
 			RemoveItem(data.pItem, true);
 		data.pItem = 0;
 	}
-	wxASSERT(m_activeCount > 0);
-	if (m_activeCount > 0)
-		m_activeCount--;
+	if (data.background)
+	{
+		wxASSERT(m_backgroundCount > 0);
+		if (m_backgroundCount > 0)
+			m_backgroundCount--;
+		data.background = false;
+	}
+	else
+	{
+		wxASSERT(m_activeCount > 0);
+		if (m_activeCount > 0)
+			m_activeCount--;
+	}
 	data.active = false;
 
 	if (data.state == t_EngineData::waitprimary && data.pEngine)
@@ -1291,6 +1415,7 @@ void CQueueView::ResetEngine(t_EngineData& data, const enum ResetReason reason)
 	}
 
 	data.state = t_EngineData::none;
+	data.listPath.clear();
 
 	AdvanceQueue();
 
@@ -1302,29 +1427,19 @@ bool CQueueView::RemoveItem(CQueueItem* item, bool destroy, bool updateItemCount
 {
 	// RemoveItem assumes that the item has already been removed from all engines
 
-	if (item->GetType() == QueueItemType::File)
-	{
-		// Update size information
-		const CFileItem* const pFileItem = (const CFileItem* const)item;
-		const wxLongLong& size = pFileItem->GetSize();
-		if (size < 0)
-		{
-			m_filesWithUnknownSize--;
-			wxASSERT(m_filesWithUnknownSize >= 0);
-			if (!m_filesWithUnknownSize && updateItemCount)
-				DisplayQueueSize();
-		}
-		else if (size > 0)
-		{
-			m_totalQueueSize -= size;
-			if (updateItemCount)
-				DisplayQueueSize();
-			wxASSERT(m_totalQueueSize >= 0);
-		}
-	}
+	bool const isFile = item->GetType() == QueueItemType::File;
+
+	m_queue_storage.JournalRemove(*item);
+
+	CServerItem* pServerItem = static_cast<CServerItem*>(item->GetTopLevelItem());
+	if (pServerItem->GetChildrenCount(false) == 1)
+		m_queue_storage.JournalForgetServer(*pServerItem);
 
 	bool didRemoveParent = CQueueViewBase::RemoveItem(item, destroy, updateItemCount, updateSelections);
 
+	if (isFile && updateItemCount)
+		DisplayQueueSize();
+
 	UpdateStatusLinePositions();
 
 	return didRemoveParent;
@@ -1332,6 +1447,32 @@ bool CQueueView::RemoveItem(CQueueItem* item, bool destroy, bool updateItemCount
 
 void CQueueView::SendNextCommand(t_EngineData& engineData)
 {
+	if (engineData.state == t_EngineData::listconnect) {
+		int res = engineData.pEngine->Execute(CConnectCommand(engineData.lastServer, false));
+		if (res == FZ_REPLY_WOULDBLOCK)
+			return;
+		if (res != FZ_REPLY_OK) {
+			ResetEngine(engineData, remove);
+			return;
+		}
+		engineData.state = t_EngineData::list;
+	}
+	if (engineData.state == t_EngineData::list) {
+		int res = engineData.pEngine->Execute(CListCommand(engineData.listPath));
+		if (res != FZ_REPLY_WOULDBLOCK)
+			ResetEngine(engineData, remove);
+		return;
+	}
+	if (engineData.state == t_EngineData::warmup) {
+		int res = engineData.pEngine->Execute(CConnectCommand(engineData.lastServer, false));
+		if (res == FZ_REPLY_WOULDBLOCK)
+			return;
+		if (res != FZ_REPLY_OK)
+			m_warmUpFailed.push_back(engineData.lastServer);
+		ResetEngine(engineData, remove);
+		return;
+	}
+
 	for (;;) {
 		if (engineData.state == t_EngineData::waitprimary) {
 			engineData.pItem->SetStatusMessage(CFileItem::wait_browsing);
@@ -1503,6 +1644,8 @@ bool CQueueView::SetActive(bool active /*=true*/)
 				pRecursiveOperation->ChangeOperationMode(CRecursiveOperation::recursive_addtoqueue);
 			if (pRecursiveOperation->GetOperationMode() == CRecursiveOperation::recursive_download_flatten)
 				pRecursiveOperation->ChangeOperationMode(CRecursiveOperation::recursive_addtoqueue_flatten);
+			if (pRecursiveOperation->GetOperationMode() == CRecursiveOperation::recursive_synchronize)
+				pRecursiveOperation->ChangeOperationMode(CRecursiveOperation::recursive_addtoqueue_synchronize);
 		}
 
 		UpdateStatusLinePositions();
@@ -1513,6 +1656,11 @@ bool CQueueView::SetActive(bool active /*=true*/)
 			if (!pEngineData->active)
 				continue;
 
+			// Prefetched listings and connections being warmed up stay
+			// useful for when the queue gets started again
+			if (pEngineData->background && !m_quit)
+				continue;
+
 			if (pEngineData->state == t_EngineData::waitprimary) {
 				if (pEngineData->pItem)
 					pEngineData->pItem->SetStatusMessage(CFileItem::interrupted);
@@ -1532,6 +1680,7 @@ bool CQueueView::SetActive(bool active /*=true*/)
 	}
 	else {
 		m_activeMode = 2;
+		m_warmUpFailed.clear();
 
 		m_waitStatusLineUpdate = true;
 		AdvanceQueue();
@@ -1559,7 +1708,7 @@ bool CQueueView::Quit()
 #endif
 
 	bool canQuit = true;
-	if (!SetActive(false))
+	if (!SetActive(false) || m_backgroundCount)
 		canQuit = false;
 
 	for (unsigned int i = 0; i < 2; ++i) {
@@ -1608,6 +1757,10 @@ void CQueueView::CheckQueueState()
 	if (m_activeCount)
 		return;
 
+	// Background engines got cancelled, they have to finish before quitting
+	if (m_quit && m_backgroundCount)
+		return;
+
 	if (m_activeMode) {
 		m_activeMode = 0;
 		/* Users don't seem to like this, so comment it out for now.
@@ -1625,6 +1778,8 @@ void CQueueView::CheckQueueState()
 
 		TryRefreshListings();
 
+		LogTransferStats();
+
 		CContextManager::Get()->NotifyGlobalHandlers(STATECHANGE_QUEUEPROCESSING);
 
 		if (!m_quit)
@@ -1635,9 +1790,43 @@ void CQueueView::CheckQueueState()
 		m_pMainFrame->Close();
 }
 
+void CQueueView::LogTransferStats()
+{
+	if (m_transferStats.files() || m_transferStats.failed())
+	{
+		wxString policy;
+		switch (transfer_policy::from_option(COptions::Get()->GetOptionVal(OPTION_TRANSFER_POLICY)))
+		{
+		case TransferPolicy::reserve_small:
+			policy = _("small files get reserved slots");
+			break;
+		case TransferPolicy::largest_first:
+			policy = _("largest files first");
+			break;
+		case TransferPolicy::round_robin:
+			policy = _("servers take turns");
+			break;
+		default:
+			policy = _("queue order");
+			break;
+		}
+
+		wxString const msg = wxString::Format(_("Queue processed: %d files transferred, %d failed, %s in %s at %s/s (%s)"),
+			m_transferStats.files(), m_transferStats.failed(),
+			CSizeFormat::Format(m_transferStats.bytes(), true),
+			wxTimeSpan::Milliseconds(m_transferStats.busy_time()).Format(_T("%H:%M:%S")),
+			CSizeFormat::Format(m_transferStats.throughput(), true),
+			policy);
+		m_pMainFrame->GetStatusView()->AddToLog(MessageType::Status, msg, wxDateTime::Now());
+	}
+
+	m_transferStats.reset();
+}
+
 bool CQueueView::IncreaseErrorCount(t_EngineData& engineData)
 {
 	++engineData.pItem->m_errorCount;
+	m_queue_storage.JournalUpdate(*engineData.pItem);
 	if (engineData.pItem->m_errorCount <= COptions::Get()->GetOptionVal(OPTION_RECONNECTCOUNT))
 		return true;
 
@@ -1681,14 +1870,18 @@ void CQueueView::UpdateStatusLinePositions()
 
 void CQueueView::CalculateQueueSize()
 {
-	// Collect total queue size
-	m_totalQueueSize = 0;
+	// Collect the file counts from the totals kept by the server items
 	m_fileCount = 0;
 	m_folderScanCount = 0;
 
-	m_filesWithUnknownSize = 0;
+	int filesWithUnknownSize = 0;
 	for (std::vector<CServerItem*>::const_iterator iter = m_serverList.begin(); iter != m_serverList.end(); ++iter)
-		m_totalQueueSize += (*iter)->GetTotalSize(m_filesWithUnknownSize, m_fileCount, m_folderScanCount);
+	{
+#if wxDEBUG_LEVEL >= 2
+		(*iter)->VerifyTotals();
+#endif
+		(*iter)->GetTotalSize(filesWithUnknownSize, m_fileCount, m_folderScanCount);
+	}
 
 	DisplayQueueSize();
 	DisplayNumberQueuedFiles();
@@ -1699,7 +1892,15 @@ void CQueueView::DisplayQueueSize()
 	CStatusBar* pStatusBar = dynamic_cast<CStatusBar*>(m_pMainFrame->GetStatusBar());
 	if (!pStatusBar)
 		return;
-	pStatusBar->DisplayQueueSize(m_totalQueueSize, m_filesWithUnknownSize != 0);
+
+	wxLongLong totalSize = 0;
+	int filesWithUnknownSize = 0;
+	int fileCount = 0;
+	int folderScanCount = 0;
+	for (std::vector<CServerItem*>::const_iterator iter = m_serverList.begin(); iter != m_serverList.end(); ++iter)
+		totalSize += (*iter)->GetTotalSize(filesWithUnknownSize, fileCount, folderScanCount);
+
+	pStatusBar->DisplayQueueSize(totalSize, filesWithUnknownSize != 0);
 }
 
 bool CQueueView::QueueFolder(bool queueOnly, bool download, const CLocalPath& localPath, const CServerPath& remotePath, const CServer& server)
@@ -1786,6 +1987,8 @@ void CQueueView::OnFolderThreadComplete(wxCommandEvent&)
 	delete m_pFolderProcessingThread;
 	m_pFolderProcessingThread = 0;
 
+	LogMemoryUsage();
+
 	ProcessUploadFolderItems();
 }
 
@@ -1795,7 +1998,8 @@ int CQueueView::QueueFiles(const std::list<CFolderProcessingEntry*> &entryList,
 
 	CFolderScanItem* pFolderScanItem = m_pFolderProcessingThread->GetFolderScanItem();
 
-	int added = 0;
+	std::vector<CQueueItem*> items;
+	items.reserve(entryList.size());
 
 	CFilterManager filters;
 	for (std::list<CFolderProcessingEntry*>::const_iterator iter = entryList.begin(); iter != entryList.end(); ++iter)
@@ -1803,9 +2007,7 @@ int CQueueView::QueueFiles(const std::list<CFolderProcessingEntry*> &entryList,
 		const CFolderProcessingEntry* entry = *iter;
 		if (entry->m_type == CFolderProcessingEntry::dir) {
 			if (m_pFolderProcessingThread->GetFolderScanItem()->m_dir_is_empty) {
-				CFileItem* fileItem = new CFolderItem(pServerItem, queueOnly, pFolderScanItem->m_current_remote_path, _T(""));
-				InsertItem(pServerItem, fileItem);
-				added++;
+				items.push_back(new CFolderItem(pServerItem, queueOnly, pFolderScanItem->m_current_remote_path, _T("")));
 			}
 
 			const CFolderProcessingThread::t_dirPair* entry = (const CFolderProcessingThread::t_dirPair*)*iter;
@@ -1840,19 +2042,30 @@ int CQueueView::QueueFiles(const std::list<CFolderProcessingEntry*> &entryList,
 
 			delete entry;
 
-			InsertItem(pServerItem, fileItem);
-
-			added++;
+			items.push_back(fileItem);
 		}
 	}
 
+	InsertItems(pServerItem, items);
 	QueueFile_Finish(!queueOnly);
 
-	return added;
+	return items.size();
 }
 
 void CQueueView::SaveQueue()
 {
+	StopLoadingQueue(false);
+
+	if (m_queue_storage.IsJournaling()) {
+		// All changes already have been handed to the journal, only need to
+		// wait for the remaining ones to be written.
+		if (!m_queue_storage.CloseJournal()) {
+			wxString msg = wxString::Format(_("An error occurred saving the transfer queue to \"%s\".\nSome queue items might not have been saved."), m_queue_storage.GetDatabaseFilename());
+			wxMessageBoxEx(msg, _("Error saving queue"), wxICON_ERROR);
+		}
+		return;
+	}
+
 	// Kiosk mode 2 doesn't save queue
 	if (COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) == 2)
 		return;
@@ -1903,64 +2116,282 @@ void CQueueView::LoadQueue()
 	// to the same file or one is reading while the other one writes.
 	CInterProcessMutex mutex(MUTEX_QUEUE);
 
+	// The first instance owns the stored queue and keeps it in sync with its
+	// queue while running. Any further instance starts with an empty queue
+	// and adds its queue to the storage when quitting.
+	// Kiosk mode 2 doesn't save the queue, but still restores it.
+	bool const kiosk = COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) == 2;
+	bool const owner = !kiosk && m_queue_storage.StartJournal();
+
 	LoadQueueFromXML();
 
-	bool error = false;
+	if (!owner && !kiosk)
+		return;
 
+	bool error = false;
 	if (!m_queue_storage.BeginTransaction())
 		error = true;
-	else
+	else {
+		m_loadingServerId = m_queue_storage.GetServer(m_loadingServer, true);
+		if (m_loadingServerId > 0) {
+			m_loadingQueue = true;
+			m_loadingFiles = false;
+
+			// Load the first chunk right away, the rest once the UI is up
+			LoadQueueChunk();
+		}
+		else {
+			if (m_loadingServerId < 0)
+				error = true;
+			m_queue_storage.EndTransaction();
+		}
+	}
+
+	if (error)
 	{
-		CServer server;
-		wxLongLong_t id;
-		for (id = m_queue_storage.GetServer(server, true); id > 0; id = m_queue_storage.GetServer(server, false))
-		{
-			m_insertionStart = -1;
-			m_insertionCount = 0;
-			CServerItem *pServerItem = CreateServerItem(server);
+		wxString file = CQueueStorage::GetDatabaseFilename();
+		wxString msg = wxString::Format(_("An error occurred loading the transfer queue from \"%s\".\nSome queue items might not have been restored."), file);
+		wxMessageBoxEx(msg, _("Error loading queue"), wxICON_ERROR);
+	}
+}
+
+void CQueueView::LoadQueueChunk()
+{
+	if (!m_loadingQueue)
+		return;
+
+	bool error = false;
 
+	int remaining = 5000;
+	while (m_loadingQueue && remaining > 0) {
+		m_insertionStart = -1;
+		m_insertionCount = 0;
+		bool const newServerItem = !GetServerItem(m_loadingServer);
+		CServerItem *pServerItem = CreateServerItem(m_loadingServer);
+
+		// Also needed if continuing a server, its item might have been removed
+		// and recreated in between
+		m_queue_storage.JournalAdopt(*pServerItem, m_loadingServerId);
+
+		m_restoringItems = true;
+		while (remaining > 0) {
 			CFileItem* fileItem = 0;
-			wxLongLong_t fileId;
-			for (fileId = m_queue_storage.GetFile(&fileItem, id); fileItem; fileId = m_queue_storage.GetFile(&fileItem, 0))
-			{
-				fileItem->SetParent(pServerItem);
-				fileItem->SetPriority(fileItem->GetPriority());
-				InsertItem(pServerItem, fileItem);
+			wxLongLong_t const fileId = m_queue_storage.GetFile(&fileItem, m_loadingFiles ? 0 : m_loadingServerId);
+			if (!fileItem) {
+				if (fileId < 0)
+					error = true;
+				m_loadingFiles = false;
+				break;
 			}
-			if (fileId < 0)
-				error = true;
+			m_loadingFiles = true;
 
-			if (!pServerItem->GetChild(0))
-			{
-				m_itemCount--;
-				m_serverList.pop_back();
-				delete pServerItem;
-			}
+			fileItem->SetParent(pServerItem);
+			fileItem->SetPriority(fileItem->GetPriority());
+			InsertItem(pServerItem, fileItem);
+			m_queue_storage.JournalAdopt(*fileItem, fileId);
+			--remaining;
 		}
-		if (id < 0)
-			error = true;
+		m_restoringItems = false;
 
-		if (COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) != 2)
-			if (!m_queue_storage.Clear())
-				error = true;
+		if (newServerItem && !pServerItem->GetChild(0))
+		{
+			m_queue_storage.JournalRemoveServer(*pServerItem);
+			m_itemCount--;
+			m_serverList.pop_back();
+			delete pServerItem;
 
-		if (!m_queue_storage.EndTransaction())
-			error = true;
+			m_insertionStart = -1;
+			m_insertionCount = 0;
+		}
+		CommitChanges();
 
-		if (!m_queue_storage.Vacuum())
-			error = true;
+		if (!m_loadingFiles) {
+			m_loadingServerId = m_queue_storage.GetServer(m_loadingServer, false);
+			if (m_loadingServerId <= 0) {
+				if (m_loadingServerId < 0)
+					error = true;
+				StopLoadingQueue(false);
+			}
+		}
 	}
 
-	m_insertionStart = -1;
-	m_insertionCount = 0;
-	CommitChanges();
-
 	if (error)
 	{
 		wxString file = CQueueStorage::GetDatabaseFilename();
 		wxString msg = wxString::Format(_("An error occurred loading the transfer queue from \"%s\".\nSome queue items might not have been restored."), file);
 		wxMessageBoxEx(msg, _("Error loading queue"), wxICON_ERROR);
 	}
+
+	if (m_loadingQueue)
+		CallAfter(&CQueueView::LoadQueueChunk);
+	else
+		LogMemoryUsage();
+}
+
+void CQueueView::LogMemoryUsage()
+{
+	if (!COptions::Get()->GetOptionVal(OPTION_LOGGING_DEBUGLEVEL))
+		return;
+
+	size_t items, reserved, unpooled;
+	CFileItem::GetAllocationStats(items, reserved, unpooled);
+	if (!items)
+		return;
+
+	size_t localPaths = 0;
+	size_t remotePaths = 0;
+	size_t sharedPathBytes = 0;
+	size_t unsharedPathBytes = 0;
+	for (auto const& server : m_serverList) {
+		localPaths += server->GetLocalPathCount();
+		remotePaths += server->GetRemotePathCount();
+
+		size_t shared, unshared;
+		server->GetPathStats(shared, unshared);
+		sharedPathBytes += shared;
+		unsharedPathBytes += unshared;
+	}
+
+	// Per item, as is and as it would be with every item allocated on its
+	// own and keeping its own paths. Debug messages are not translated.
+	wxString msg = wxString::Format(_T("Queue memory: %lu file items, %lu bytes per item in slabs instead of about %lu on the heap."),
+		static_cast<unsigned long>(items), static_cast<unsigned long>(reserved / items), static_cast<unsigned long>(unpooled / items));
+	msg += wxString::Format(_T(" Paths take %lu bytes per item shared among %lu local and %lu remote paths, instead of %lu unshared."),
+		static_cast<unsigned long>(sharedPathBytes / items), static_cast<unsigned long>(localPaths), static_cast<unsigned long>(remotePaths),
+		static_cast<unsigned long>(unsharedPathBytes / items));
+	msg += wxString::Format(_T(" In total %lu instead of %lu bytes per item."),
+		static_cast<unsigned long>((reserved + sharedPathBytes) / items), static_cast<unsigned long>((unpooled + unsharedPathBytes) / items));
+	m_pMainFrame->GetStatusView()->AddToLog(MessageType::Debug_Info, msg, wxDateTime::Now());
+}
+
+void CQueueView::StopLoadingQueue(bool removeRemaining)
+{
+	if (!m_loadingQueue)
+		return;
+
+	m_loadingQueue = false;
+
+	if (removeRemaining) {
+		while (m_loadingServerId > 0) {
+			m_queue_storage.JournalRemoveServer(m_loadingServerId);
+			m_loadingServerId = m_queue_storage.GetServer(m_loadingServer, false);
+		}
+	}
+
+	m_loadingServerId = 0;
+	m_loadingFiles = false;
+	m_queue_storage.EndTransaction();
+}
+
+CFileItem* CQueueView::ImportFile(TiXmlElement* pFile, CServerItem* pServerItem, CLocalPath& previousLocalPath, CServerPath& previousRemotePath)
+{
+	wxString localFile = GetTextElement(pFile, "LocalFile");
+	wxString remoteFile = GetTextElement(pFile, "RemoteFile");
+	wxString safeRemotePath = GetTextElement(pFile, "RemotePath");
+	bool download = GetTextElementInt(pFile, "Download") != 0;
+	wxLongLong size = GetTextElementLongLong(pFile, "Size", -1);
+	unsigned char errorCount = static_cast<unsigned char>(GetTextElementInt(pFile, "ErrorCount"));
+	unsigned int priority = GetTextElementInt(pFile, "Priority", static_cast<unsigned int>(QueuePriority::normal));
+
+	int dataType = GetTextElementInt(pFile, "DataType", -1);
+	if (dataType == -1)
+		dataType = GetTextElementInt(pFile, "TransferMode", 1);
+	bool binary = dataType != 0;
+	int overwrite_action = GetTextElementInt(pFile, "OverwriteAction", CFileExistsNotification::unknown);
+
+	CServerPath remotePath;
+	if (localFile.empty() || remoteFile.empty() || !remotePath.SetSafePath(safeRemotePath) ||
+		size < -1 || priority >= static_cast<int>(QueuePriority::count))
+	{
+		return 0;
+	}
+
+	wxString localFileName;
+	CLocalPath localPath(localFile, &localFileName);
+
+	if (localFileName.empty())
+		return 0;
+
+	// CServerPath and wxString are reference counted.
+	// Save some memory here by re-using the old copy
+	if (localPath != previousLocalPath)
+		previousLocalPath = localPath;
+	if (previousRemotePath != remotePath)
+		previousRemotePath = remotePath;
+
+	CFileItem* fileItem = new CFileItem(pServerItem, true, download,
+		download ? remoteFile : localFileName,
+		(remoteFile != localFileName) ? (download ? localFileName : remoteFile) : wxString(),
+		previousLocalPath, previousRemotePath, size);
+	fileItem->SetAscii(!binary);
+	fileItem->SetPriorityRaw(QueuePriority(priority));
+	fileItem->m_errorCount = errorCount;
+
+	if (overwrite_action > 0 && overwrite_action < CFileExistsNotification::ACTION_COUNT)
+		fileItem->m_defaultFileExistsAction = (CFileExistsNotification::OverwriteAction)overwrite_action;
+
+	return fileItem;
+}
+
+CFolderItem* CQueueView::ImportFolder(TiXmlElement* pFolder, CServerItem* pServerItem)
+{
+	CFolderItem* folderItem;
+
+	bool download = GetTextElementInt(pFolder, "Download") != 0;
+	if (download)
+	{
+		wxString localFile = GetTextElement(pFolder, "LocalFile");
+		if (localFile.empty())
+			return 0;
+		folderItem = new CFolderItem(pServerItem, true, CLocalPath(localFile));
+	}
+	else
+	{
+		wxString remoteFile = GetTextElement(pFolder, "RemoteFile");
+		wxString safeRemotePath = GetTextElement(pFolder, "RemotePath");
+		if (safeRemotePath.empty())
+			return 0;
+
+		CServerPath remotePath;
+		if (!remotePath.SetSafePath(safeRemotePath))
+			return 0;
+		folderItem = new CFolderItem(pServerItem, true, remotePath, remoteFile);
+	}
+
+	unsigned int priority = GetTextElementInt(pFolder, "Priority", static_cast<int>(QueuePriority::normal));
+	if (priority >= static_cast<int>(QueuePriority::count)) {
+		delete folderItem;
+		return 0;
+	}
+
+	// Not yet in the queue of its server, the raw setter avoids touching it
+	folderItem->SetPriorityRaw(QueuePriority(priority));
+
+	return folderItem;
+}
+
+void CQueueView::FinishImportServer(CServerItem* pServerItem, bool updateSelections)
+{
+	if (!pServerItem->GetChild(0))
+	{
+		m_itemCount--;
+		m_serverList.pop_back();
+		delete pServerItem;
+	}
+	else if (updateSelections)
+		CommitChanges();
+}
+
+void CQueueView::FinishImport(bool updateSelections)
+{
+	if (!updateSelections)
+	{
+		m_insertionStart = -1;
+		m_insertionCount = 0;
+		CommitChanges();
+	}
+	else
+		RefreshListOnly();
 }
 
 void CQueueView::ImportQueue(TiXmlElement* pElement, bool updateSelections)
@@ -1980,106 +2411,113 @@ void CQueueView::ImportQueue(TiXmlElement* pElement, bool updateSelections)
 
 			for (TiXmlElement* pFile = pServer->FirstChildElement("File"); pFile; pFile = pFile->NextSiblingElement("File"))
 			{
-				wxString localFile = GetTextElement(pFile, "LocalFile");
-				wxString remoteFile = GetTextElement(pFile, "RemoteFile");
-				wxString safeRemotePath = GetTextElement(pFile, "RemotePath");
-				bool download = GetTextElementInt(pFile, "Download") != 0;
-				wxLongLong size = GetTextElementLongLong(pFile, "Size", -1);
-				unsigned char errorCount = static_cast<unsigned char>(GetTextElementInt(pFile, "ErrorCount"));
-				unsigned int priority = GetTextElementInt(pFile, "Priority", static_cast<unsigned int>(QueuePriority::normal));
-
-				int dataType = GetTextElementInt(pFile, "DataType", -1);
-				if (dataType == -1)
-					dataType = GetTextElementInt(pFile, "TransferMode", 1);
-				bool binary = dataType != 0;
-				int overwrite_action = GetTextElementInt(pFile, "OverwriteAction", CFileExistsNotification::unknown);
-
-				CServerPath remotePath;
-				if (!localFile.empty() && !remoteFile.empty() && remotePath.SetSafePath(safeRemotePath) &&
-					size >= -1 && priority < static_cast<int>(QueuePriority::count))
-				{
-					wxString localFileName;
-					CLocalPath localPath(localFile, &localFileName);
-
-					if (localFileName.empty())
-						continue;
-
-					// CServerPath and wxString are reference counted.
-					// Save some memory here by re-using the old copy
-					if (localPath != previousLocalPath)
-						previousLocalPath = localPath;
-					if (previousRemotePath != remotePath)
-						previousRemotePath = remotePath;
-
-					CFileItem* fileItem = new CFileItem(pServerItem, true, download,
-						download ? remoteFile : localFileName,
-						(remoteFile != localFileName) ? (download ? localFileName : remoteFile) : wxString(),
-						previousLocalPath, previousRemotePath, size);
-					fileItem->SetAscii(!binary);
-					fileItem->SetPriorityRaw(QueuePriority(priority));
-					fileItem->m_errorCount = errorCount;
+				CFileItem* fileItem = ImportFile(pFile, pServerItem, previousLocalPath, previousRemotePath);
+				if (fileItem)
 					InsertItem(pServerItem, fileItem);
-
-					if (overwrite_action > 0 && overwrite_action < CFileExistsNotification::ACTION_COUNT)
-						fileItem->m_defaultFileExistsAction = (CFileExistsNotification::OverwriteAction)overwrite_action;
-				}
 			}
 			for (TiXmlElement* pFolder = pServer->FirstChildElement("Folder"); pFolder; pFolder = pFolder->NextSiblingElement("Folder"))
 			{
-				CFolderItem* folderItem;
+				CFolderItem* folderItem = ImportFolder(pFolder, pServerItem);
+				if (folderItem)
+					InsertItem(pServerItem, folderItem);
+			}
 
-				bool download = GetTextElementInt(pFolder, "Download") != 0;
-				if (download)
-				{
-					wxString localFile = GetTextElement(pFolder, "LocalFile");
-					if (localFile.empty())
-						continue;
-					folderItem = new CFolderItem(pServerItem, true, CLocalPath(localFile));
-				}
-				else
-				{
-					wxString remoteFile = GetTextElement(pFolder, "RemoteFile");
-					wxString safeRemotePath = GetTextElement(pFolder, "RemotePath");
-					if (safeRemotePath.empty())
-						continue;
+			FinishImportServer(pServerItem, updateSelections);
+		}
 
-					CServerPath remotePath;
-					if (!remotePath.SetSafePath(safeRemotePath))
-						continue;
-					folderItem = new CFolderItem(pServerItem, true, remotePath, remoteFile);
-				}
+		pServer = pServer->NextSiblingElement("Server");
+	}
+
+	FinishImport(updateSelections);
+}
+
+bool CQueueView::ImportQueue(CXmlStreamReader& reader, bool updateSelections)
+{
+	// Items are inserted in batches of this size, so that neither the
+	// document nor all of the items need to be held in memory at once.
+	size_t const batchSize = 10000;
+
+	bool ok = true;
+	std::string xml;
+	CXmlStreamReader::token t;
+	while (ok && (t = reader.next()) == CXmlStreamReader::token::start)
+	{
+		if (reader.name() != "Server")
+		{
+			ok = reader.skip_element();
+			continue;
+		}
+
+		// The server data precedes the items. Collect it until the first item,
+		// only then the server is known.
+		TiXmlElement serverElement("Server");
+		CServerItem* pServerItem = 0;
+		bool invalidServer = false;
+
+		CLocalPath previousLocalPath;
+		CServerPath previousRemotePath;
+		std::vector<CQueueItem*> items;
+
+		while ((t = reader.next()) == CXmlStreamReader::token::start)
+		{
+			bool const file = reader.name() == "File";
+			bool const folder = reader.name() == "Folder";
+			if (!reader.read_element(xml))
+				break;
+
+			TiXmlDocument document;
+			TiXmlElement* pElement = ParseElement(document, xml);
+			if (!pElement)
+				continue;
+
+			if (!file && !folder)
+			{
+				if (!pServerItem)
+					serverElement.InsertEndChild(*pElement);
+				continue;
+			}
 
-				unsigned int priority = GetTextElementInt(pFolder, "Priority", static_cast<int>(QueuePriority::normal));
-				if (priority >= static_cast<int>(QueuePriority::count)) {
-					delete folderItem;
+			if (!pServerItem)
+			{
+				CServer server;
+				if (invalidServer || !GetServer(&serverElement, server))
+				{
+					invalidServer = true;
 					continue;
 				}
-				folderItem->SetPriority(QueuePriority(priority));
 
-				InsertItem(pServerItem, folderItem);
+				m_insertionStart = -1;
+				m_insertionCount = 0;
+				pServerItem = CreateServerItem(server);
 			}
 
-			if (!pServerItem->GetChild(0))
+			CQueueItem* pItem;
+			if (file)
+				pItem = ImportFile(pElement, pServerItem, previousLocalPath, previousRemotePath);
+			else
+				pItem = ImportFolder(pElement, pServerItem);
+			if (!pItem)
+				continue;
+
+			items.push_back(pItem);
+			if (items.size() >= batchSize)
 			{
-				m_itemCount--;
-				m_serverList.pop_back();
-				delete pServerItem;
+				InsertItems(pServerItem, items);
+				items.clear();
 			}
-			else if (updateSelections)
-				CommitChanges();
 		}
+		ok = t == CXmlStreamReader::token::end;
 
-		pServer = pServer->NextSiblingElement("Server");
+		if (pServerItem)
+		{
+			InsertItems(pServerItem, items);
+			FinishImportServer(pServerItem, updateSelections);
+		}
 	}
 
-	if (!updateSelections)
-	{
-		m_insertionStart = -1;
-		m_insertionCount = 0;
-		CommitChanges();
-	}
-	else
-		RefreshListOnly();
+	FinishImport(updateSelections);
+
+	return ok && t == CXmlStreamReader::token::end;
 }
 
 void CQueueView::OnPostScroll()
@@ -2211,16 +2649,25 @@ void CQueueView::RemoveAll()
 			SetItemState(item, 0, wxLIST_STATE_SELECTED);
 	}
 
+	StopLoadingQueue(true);
+
 	std::vector<CServerItem*> newServerList;
 	m_itemCount = 0;
 	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter)
 	{
+		// Items get removed in bulk, let the storage drop the whole server
+		// and store the remaining items again.
+		m_queue_storage.JournalRemoveServer(**iter);
+
 		if ((*iter)->TryRemoveAll())
 			delete *iter;
 		else
 		{
 			newServerList.push_back(*iter);
 			m_itemCount += 1 + (*iter)->GetChildrenCount(true);
+
+			for (unsigned int i = 0; i < (*iter)->GetChildrenCount(false); ++i)
+				m_queue_storage.JournalInsert(**iter, *(*iter)->GetChild(i, false));
 		}
 	}
 
@@ -2435,8 +2882,10 @@ void CQueueView::OnFolderThreadFiles(wxCommandEvent&)
 
 void CQueueView::SetDefaultFileExistsAction(enum CFileExistsNotification::OverwriteAction action, const TransferDirection direction)
 {
-	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter)
+	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
 		(*iter)->SetDefaultFileExistsAction(action, direction);
+		StoreItemChanges(*iter);
+	}
 }
 
 void CQueueView::OnSetDefaultFileExistsAction(wxCommandEvent &)
@@ -2550,6 +2999,7 @@ void CQueueView::OnSetDefaultFileExistsAction(wxCommandEvent &)
 						break;
 					pFileItem->m_defaultFileExistsAction = uploadAction;
 				}
+				m_queue_storage.JournalUpdate(*pFileItem);
 			}
 			break;
 		case QueueItemType::Server:
@@ -2559,6 +3009,7 @@ void CQueueView::OnSetDefaultFileExistsAction(wxCommandEvent &)
 					pServerItem->SetDefaultFileExistsAction(downloadAction, TransferDirection::download);
 				if (has_upload)
 					pServerItem->SetDefaultFileExistsAction(uploadAction, TransferDirection::upload);
+				StoreItemChanges(pServerItem);
 			}
 			break;
 		default:
@@ -2685,6 +3136,192 @@ void CQueueView::TryRefreshListings()
 	}
 }
 
+void CQueueView::PrefetchListings(CServer const& server, std::vector<CServerPath> const& paths)
+{
+	// Limits the number of listings retrieved speculatively
+	size_t const max_pending = 100;
+
+	if (m_quit || paths.empty())
+		return;
+
+	if (COptions::Get()->GetOptionVal(OPTION_PREFETCH_CONNECTIONS) <= 0)
+		return;
+
+	// Don't bother the user with prompts just to prefetch listings
+	if (server.GetLogonType() == INTERACTIVE)
+		return;
+
+	if (m_prefetchServer != server) {
+		m_prefetchServer = server;
+		m_prefetchPaths.clear();
+	}
+
+	for (auto iter = paths.rbegin(); iter != paths.rend(); ++iter) {
+		auto const old = std::find(m_prefetchPaths.begin(), m_prefetchPaths.end(), *iter);
+		if (old != m_prefetchPaths.end())
+			m_prefetchPaths.erase(old);
+		m_prefetchPaths.push_front(*iter);
+	}
+	if (m_prefetchPaths.size() > max_pending)
+		m_prefetchPaths.resize(max_pending);
+
+	TryPrefetchListings();
+}
+
+void CQueueView::TryPrefetchListings()
+{
+	if (m_quit)
+		return;
+
+	int maxEngines = COptions::Get()->GetOptionVal(OPTION_PREFETCH_CONNECTIONS);
+
+	// While files are being transferred, a single connection keeps
+	// prefetching so that listings don't take bandwidth from the transfers
+	if (m_activeCount > 0)
+		maxEngines = std::min(maxEngines, 1);
+
+	while (!m_prefetchPaths.empty()) {
+		int prefetching = 0;
+		for (auto const* pData : m_engineData) {
+			if (!pData->active || pData->listPath.empty())
+				continue;
+
+			if (pData->listPath == m_prefetchPaths.front() && pData->lastServer == m_prefetchServer)
+				prefetching = -1;
+			else if (prefetching >= 0)
+				++prefetching;
+		}
+		if (prefetching == -1) {
+			// Already being listed
+			m_prefetchPaths.pop_front();
+			continue;
+		}
+		if (prefetching >= maxEngines)
+			break;
+
+		t_EngineData* pEngineData = GetIdleEngine(&m_prefetchServer);
+		if (!pEngineData)
+			break;
+
+		bool const connected = pEngineData->pEngine->IsConnected();
+		if (connected && pEngineData->lastServer != m_prefetchServer) {
+			// Keep engines connected to other servers as they are
+			break;
+		}
+		if (!connected) {
+			if (!CanConnect(m_prefetchServer))
+				break;
+
+			CServer server = m_prefetchServer;
+			if (server.GetLogonType() == ASK && !CLoginManager::Get().GetPassword(server, true)) {
+				m_prefetchPaths.clear();
+				break;
+			}
+			pEngineData->lastServer = server;
+		}
+
+		pEngineData->listPath = m_prefetchPaths.front();
+		m_prefetchPaths.pop_front();
+
+		pEngineData->active = true;
+		pEngineData->background = true;
+		delete pEngineData->m_idleDisconnectTimer;
+		pEngineData->m_idleDisconnectTimer = 0;
+		m_backgroundCount++;
+
+		pEngineData->state = connected ? t_EngineData::list : t_EngineData::listconnect;
+		SendNextCommand(*pEngineData);
+	}
+}
+
+int CQueueView::GetConnectionCount(const CServer& server) const
+{
+	int connections = 0;
+	for (auto const* pData : m_engineData) {
+		if (pData->transient || pData->lastServer != server)
+			continue;
+		if (pData->active || pData->pEngine->IsConnected())
+			++connections;
+	}
+	return connections;
+}
+
+int CQueueView::GetBackgroundCount(const CServer& server) const
+{
+	int count = 0;
+	for (auto const* pData : m_engineData) {
+		if (pData->active && pData->background && pData->lastServer == server)
+			++count;
+	}
+	return count;
+}
+
+bool CQueueView::CanConnect(const CServer& server) const
+{
+	int const max_count = server.MaximumMultipleConnections();
+	if (!max_count)
+		return true;
+
+	int connections = GetConnectionCount(server);
+
+	// Browsing the server counts against its limit, see CanStartTransfer
+	const std::vector<CState*> *pStates = CContextManager::Get()->GetAllStates();
+	for (auto const* pState : *pStates) {
+		const CServer* pBrowsingServer = pState->GetServer();
+		if (pBrowsingServer && *pBrowsingServer == server) {
+			++connections;
+			break;
+		}
+	}
+
+	return connections < max_count;
+}
+
+void CQueueView::TryWarmUpEngines()
+{
+	if (m_quit)
+		return;
+
+	int const warm = COptions::Get()->GetOptionVal(OPTION_WARM_CONNECTIONS);
+	if (warm <= 0)
+		return;
+
+	for (auto const* pServerItem : m_serverList) {
+		CServer server = pServerItem->GetServer();
+
+		// Don't bother the user with prompts just to connect ahead of time
+		if (server.GetLogonType() == INTERACTIVE)
+			continue;
+		if (server.GetLogonType() == ASK && !CLoginManager::Get().GetPassword(server, true))
+			continue;
+
+		if (std::find(m_warmUpFailed.begin(), m_warmUpFailed.end(), server) != m_warmUpFailed.end())
+			continue;
+
+		for (int connections = GetConnectionCount(server); connections < warm && CanConnect(server); ++connections) {
+			t_EngineData* pEngineData = GetIdleEngine(&server);
+
+			// Keep engines connected to other servers as they are
+			if (!pEngineData || pEngineData->pEngine->IsConnected())
+				break;
+
+			pEngineData->lastServer = server;
+			pEngineData->active = true;
+			pEngineData->background = true;
+			delete pEngineData->m_idleDisconnectTimer;
+			pEngineData->m_idleDisconnectTimer = 0;
+			m_backgroundCount++;
+
+			pEngineData->state = t_EngineData::warmup;
+			SendNextCommand(*pEngineData);
+			if (!pEngineData->active) {
+				// Failed right away
+				break;
+			}
+		}
+	}
+}
+
 void CQueueView::OnAskPassword(wxCommandEvent&)
 {
 	while (!m_waitingForPassword.empty())
@@ -2720,31 +3357,12 @@ void CQueueView::UpdateItemSize(CFileItem* pItem, wxLongLong size)
 {
 	wxASSERT(pItem);
 
-	const wxLongLong oldSize = pItem->GetSize();
-	if (size == oldSize)
+	if (size == pItem->GetSize())
 		return;
 
-	if (oldSize == -1)
-	{
-		wxASSERT(m_filesWithUnknownSize);
-		if (m_filesWithUnknownSize)
-			m_filesWithUnknownSize--;
-	}
-	else
-	{
-		wxASSERT(m_totalQueueSize >= oldSize);
-		if (m_totalQueueSize > oldSize)
-			m_totalQueueSize -= oldSize;
-		else
-			m_totalQueueSize = 0;
-	}
-
-	if (size == -1)
-		m_filesWithUnknownSize++;
-	else
-		m_totalQueueSize += size;
-
+	// Also updates the totals of the server item
 	pItem->SetSize(size);
+	m_queue_storage.JournalUpdate(*pItem);
 
 	DisplayQueueSize();
 }
@@ -2760,27 +3378,43 @@ void CQueueView::AdvanceQueue(bool refresh /*=true*/)
 	{
 	}
 
-	// Set timer for connected, idle engines
+	// Transfers take precedence, leftover engines may prefetch listings
+	// or connect ahead of time
+	TryPrefetchListings();
+	TryWarmUpEngines();
+
+	// Set timer for connected, idle engines. Up to OPTION_WARM_CONNECTIONS
+	// of them per server are kept connected.
+	int const warm = COptions::Get()->GetOptionVal(OPTION_WARM_CONNECTIONS);
+	int const timeout = std::max(1, COptions::Get()->GetOptionVal(OPTION_IDLE_DISCONNECT_TIMEOUT));
+	std::vector<CServer const*> warmServers;
 	for (unsigned int i = 0; i < m_engineData.size(); i++)
 	{
-		if (m_engineData[i]->active || m_engineData[i]->transient)
+		t_EngineData & data = *m_engineData[i];
+		if (data.active || data.transient)
 			continue;
 
-		if (m_engineData[i]->m_idleDisconnectTimer)
+		bool keep = false;
+		bool const connected = data.pEngine->IsConnected();
+		if (connected && warm > 0)
 		{
-			if (m_engineData[i]->pEngine->IsConnected())
-				continue;
+			auto const count = std::count_if(warmServers.begin(), warmServers.end(), [&data](CServer const* server) { return *server == data.lastServer; });
+			if (count < warm)
+			{
+				warmServers.push_back(&data.lastServer);
+				keep = true;
+			}
+		}
 
-			delete m_engineData[i]->m_idleDisconnectTimer;
-			m_engineData[i]->m_idleDisconnectTimer = 0;
+		if (!connected || keep)
+		{
+			delete data.m_idleDisconnectTimer;
+			data.m_idleDisconnectTimer = 0;
 		}
-		else
+		else if (!data.m_idleDisconnectTimer)
 		{
-			if (!m_engineData[i]->pEngine->IsConnected())
-				continue;
-
-			m_engineData[i]->m_idleDisconnectTimer = new wxTimer(this);
-			m_engineData[i]->m_idleDisconnectTimer->Start(60000, true);
+			data.m_idleDisconnectTimer = new wxTimer(this);
+			data.m_idleDisconnectTimer->Start(timeout * 1000, true);
 		}
 	}
 
@@ -2796,22 +3430,27 @@ void CQueueView::InsertItem(CServerItem* pServerItem, CQueueItem* pItem)
 {
 	CQueueViewBase::InsertItem(pServerItem, pItem);
 
-	if (pItem->GetType() == QueueItemType::File)
-	{
-		CFileItem* pFileItem = (CFileItem*)pItem;
+	if (!m_restoringItems)
+		m_queue_storage.JournalInsert(*pServerItem, *pItem);
+}
 
-		const wxLongLong& size = pFileItem->GetSize();
-		if (size < 0)
-			m_filesWithUnknownSize++;
-		else if (size > 0)
-			m_totalQueueSize += size;
-	}
+void CQueueView::InsertItems(CServerItem* pServerItem, std::vector<CQueueItem*> const& items)
+{
+	CQueueViewBase::InsertItems(pServerItem, items);
+
+	if (!m_restoringItems)
+		m_queue_storage.JournalInsert(*pServerItem, items);
 }
 
 void CQueueView::CommitChanges()
 {
 	CQueueViewBase::CommitChanges();
 
+#if wxDEBUG_LEVEL >= 2
+	for (auto const& server : m_serverList)
+		server->VerifyTotals();
+#endif
+
 	DisplayQueueSize();
 }
 
@@ -2863,17 +3502,14 @@ void CQueueView::DeleteEngines()
 	m_engineData.clear();
 }
 
-void CQueueView::WriteToFile(TiXmlElement* pElement) const
+void CQueueView::WriteToFile(CXmlStreamWriter& writer) const
 {
-	TiXmlElement* pQueue = pElement->FirstChildElement("Queue");
-	if (!pQueue) {
-		pQueue = pElement->LinkEndChild(new TiXmlElement("Queue"))->ToElement();
-	}
-
-	wxASSERT(pQueue);
+	writer.start("Queue");
 
 	for (std::vector<CServerItem*>::const_iterator iter = m_serverList.begin(); iter != m_serverList.end(); ++iter)
-		(*iter)->SaveItem(pQueue);
+		(*iter)->SaveItem(writer);
+
+	writer.end();
 }
 
 void CQueueView::OnSetPriority(wxCommandEvent& event)
@@ -2914,6 +3550,7 @@ void CQueueView::OnSetPriority(wxCommandEvent& event)
 			pSkip = 0;
 
 		pItem->SetPriority(priority);
+		StoreItemChanges(pItem);
 	}
 
 	RefreshListOnly();
@@ -3001,7 +3638,8 @@ void CQueueView::ActionAfter(bool warned /*=false*/)
 			continue;
 
 		if (pRecursiveOperationHandler->GetOperationMode() == CRecursiveOperation::recursive_download ||
-			pRecursiveOperationHandler->GetOperationMode() == CRecursiveOperation::recursive_download_flatten)
+			pRecursiveOperationHandler->GetOperationMode() == CRecursiveOperation::recursive_download_flatten ||
+			pRecursiveOperationHandler->GetOperationMode() == CRecursiveOperation::recursive_synchronize)
 		{
 			return;
 		}
@@ -3214,6 +3852,9 @@ bool CQueueView::SwitchEngine(t_EngineData** ppEngineData)
 		pNewEngineData->active = true;
 		pEngineData->active = false;
 
+		pNewEngineData->large = pEngineData->large;
+		pEngineData->large = false;
+
 		delete pNewEngineData->m_idleDisconnectTimer;
 		pNewEngineData->m_idleDisconnectTimer = 0;
 
@@ -3326,9 +3967,24 @@ void CQueueView::RenameFileInTransfer(CFileZillaEngine *pEngine, const wxString&
 	else
 		pFile->SetTargetFile(newName);
 
+	m_queue_storage.JournalUpdate(*pFile);
+
 	RefreshItem(pFile);
 }
 
+void CQueueView::StoreItemChanges(CQueueItem* pItem)
+{
+	if (!m_queue_storage.IsJournaling())
+		return;
+
+	if (pItem->GetType() == QueueItemType::Server) {
+		for (unsigned int i = 0; i < pItem->GetChildrenCount(false); ++i)
+			m_queue_storage.JournalUpdate(*pItem->GetChild(i, false));
+	}
+	else
+		m_queue_storage.JournalUpdate(*pItem);
+}
+
 wxString CQueueView::ReplaceInvalidCharacters(const wxString& filename)
 {
 	if (!COptions::Get()->GetOptionVal(OPTION_INVALID_CHAR_REPLACE_ENABLE))
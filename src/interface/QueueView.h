@@ -7,11 +7,14 @@
 #include <libfilezilla.h>
 #include <option_change_event_handler.h>
 
+#include <deque>
 #include <set>
 #include <wx/progdlg.h>
 
 #include "queue_storage.h"
 
+class CXmlStreamReader;
+
 class CFolderProcessingEntry
 {
 public:
@@ -42,6 +45,41 @@ public:
 	bool dir;
 };
 
+// Collects new files for the queue of a single server, so that they can be
+// added to the queue all at once using CQueueView::QueueFiles.
+// Filling a batch doesn't touch the queue, it can be done on any thread.
+class CQueueBatch final
+{
+public:
+	explicit CQueueBatch(CServer const& server);
+	~CQueueBatch();
+
+	CQueueBatch(CQueueBatch const&) = delete;
+	CQueueBatch& operator=(CQueueBatch const&) = delete;
+
+	// Same arguments as CQueueView::QueueFile, minus the server
+	void AddFile(const bool queueOnly, const bool download,
+		const wxString& sourceFile, const wxString& targetFile,
+		const CLocalPath& localPath, const CServerPath& remotePath,
+		const wxLongLong size, enum CEditHandler::fileType edit = CEditHandler::none,
+		QueuePriority priority = QueuePriority::normal);
+
+	// What to do if files added from now on already exist
+	void SetFileExistsAction(CFileExistsNotification::OverwriteAction action) { m_fileExistsAction = action; }
+
+	void reserve(size_t count) { m_items.reserve(count); }
+	bool empty() const { return m_items.empty(); }
+	size_t size() const { return m_items.size(); }
+
+private:
+	friend class CQueueView;
+
+	CServer const m_server;
+	std::vector<CQueueItem*> m_items;
+
+	CFileExistsNotification::OverwriteAction m_fileExistsAction{CFileExistsNotification::unknown};
+};
+
 enum ActionAfterState
 {
 	ActionAfterState_Disabled,
@@ -67,6 +105,8 @@ struct t_EngineData
 		: pEngine()
 		, active()
 		, transient()
+		, large()
+		, background()
 		, state(t_EngineData::none)
 		, pItem()
 		, pStatusLineCtrl()
@@ -86,6 +126,13 @@ struct t_EngineData
 	bool active;
 	bool transient;
 
+	// Transferring a file not counting as small
+	bool large;
+
+	// Prefetching a listing or connecting ahead of time. Such engines are
+	// counted by m_backgroundCount instead of m_activeCount.
+	bool background;
+
 	enum EngineDataState
 	{
 		none,
@@ -94,13 +141,19 @@ struct t_EngineData
 		connect,
 		transfer,
 		list,
+		listconnect,
 		mkdir,
 		askpassword,
-		waitprimary
+		waitprimary,
+		warmup
 	} state;
 
 	CFileItem* pItem;
 	CServer lastServer;
+
+	// Directory being prefetched in the list and listconnect states
+	CServerPath listPath;
+
 	CStatusLineCtrl* pStatusLineCtrl;
 	wxTimer* m_idleDisconnectTimer;
 };
@@ -131,6 +184,10 @@ public:
 
 	void QueueFile_Finish(const bool start); // Need to be called after QueueFile
 	bool QueueFiles(const bool queueOnly, const CLocalPath& localPath, const CRemoteDataObject& dataObject);
+
+	// Adds all files of the batch at once, leaving the batch empty. Like
+	// QueueFile, needs to be followed by QueueFile_Finish.
+	void QueueFiles(CQueueBatch & batch);
 	int QueueFiles(const std::list<CFolderProcessingEntry*> &entryList, bool queueOnly, bool download, CServerItem* pServerItem, const CFileExistsNotification::OverwriteAction defaultFileExistsAction);
 	bool QueueFolder(bool queueOnly, bool download, const CLocalPath& localPath, const CServerPath& remotePath, const CServer& server);
 
@@ -151,11 +208,17 @@ public:
 	void LoadQueueFromXML();
 	void ImportQueue(TiXmlElement* pElement, bool updateSelections);
 
+	// Imports the queue element the reader is positioned at, right after its
+	// start tag. Returns false if the document is malformed, the items read
+	// up to that point remain in the queue.
+	bool ImportQueue(CXmlStreamReader& reader, bool updateSelections);
+
 	virtual void InsertItem(CServerItem* pServerItem, CQueueItem* pItem);
+	virtual void InsertItems(CServerItem* pServerItem, std::vector<CQueueItem*> const& items);
 
 	virtual void CommitChanges();
 
-	void WriteToFile(TiXmlElement* pElement) const;
+	void WriteToFile(CXmlStreamWriter& writer) const;
 
 	void ProcessNotification(CFileZillaEngine* pEngine, std::unique_ptr<CNotification>&& pNotification);
 
@@ -163,6 +226,11 @@ public:
 
 	static wxString ReplaceInvalidCharacters(const wxString& filename);
 
+	// Lists the given directories in the background using idle engines,
+	// so that they are in the directory cache by the time they are needed.
+	// Paths are processed in the given order, ahead of earlier requests.
+	void PrefetchListings(CServer const& server, std::vector<CServerPath> const& paths);
+
 	// Get the current download speed as the sum of all active downloads.
 	// Unit is byte/s.
 	wxFileOffset GetCurrentDownloadSpeed();
@@ -220,6 +288,16 @@ protected:
 	void DisplayQueueSize();
 	void SaveQueue();
 
+	// Loads the stored queue a chunk at a time so that startup isn't blocked
+	// by huge queues
+	void LoadQueueChunk();
+
+	// If removeRemaining is set, stored items not loaded yet get deleted
+	void StopLoadingQueue(bool removeRemaining);
+
+	// Writes changed items, including all children, to the queue storage
+	void StoreItemChanges(CQueueItem* pItem);
+
 	bool IsActionAfter(enum ActionAfterState);
 	void ActionAfter(bool warned = false);
 #if defined(__WXMSW__) || defined(__WXMAC__)
@@ -236,6 +314,31 @@ protected:
 	CServerPath m_last_refresh_path;
 	CMonotonicTime m_last_refresh_listing_time;
 
+	// Hands out pending prefetch paths to idle engines, within the limit of
+	// OPTION_PREFETCH_CONNECTIONS and that of the server. Only one engine
+	// prefetches while files are being transferred.
+	void TryPrefetchListings();
+	CServer m_prefetchServer;
+	std::deque<CServerPath> m_prefetchPaths;
+
+	// Connects idle engines to the servers with queued items ahead of time,
+	// up to OPTION_WARM_CONNECTIONS per server
+	void TryWarmUpEngines();
+
+	// Number of queue engines connected or connecting to the server
+	int GetConnectionCount(const CServer& server) const;
+
+	// Number of background engines busy with the server
+	int GetBackgroundCount(const CServer& server) const;
+
+	// Whether another engine may connect to the server without exceeding
+	// its limit of simultaneous connections
+	bool CanConnect(const CServer& server) const;
+
+	// Servers that could not be connected to for warming up. They are not
+	// tried again until the queue gets started.
+	std::vector<CServer> m_warmUpFailed;
+
 	// Called from Process Reply.
 	// After a disconnect, check if there's another idle engine that
 	// is already connected.
@@ -273,6 +376,10 @@ protected:
 	int m_activeCount;
 	int m_activeCountDown;
 	int m_activeCountUp;
+	int m_activeCountLarge{};
+
+	// Active engines that aren't transferring, see t_EngineData::background
+	int m_backgroundCount{};
 	int m_activeMode; // 0 inactive, 1 only immediate transfers, 2 all
 	int m_quit;
 
@@ -285,9 +392,6 @@ protected:
 	int m_actionAfterTimerId;
 #endif
 
-	wxLongLong m_totalQueueSize;
-	int m_filesWithUnknownSize;
-
 	CMainFrame* m_pMainFrame;
 	CAsyncRequestQueue* m_pAsyncRequestQueue;
 
@@ -313,6 +417,30 @@ protected:
 
 	CQueueStorage m_queue_storage;
 
+	// Server to look at first under TransferPolicy::round_robin
+	size_t m_nextServer{};
+
+	// Throughput of the current run of the queue, logged once it is done
+	transfer_policy::stats m_transferStats;
+	void LogTransferStats();
+
+	// With debug logging enabled, logs the memory taken by the file items
+	void LogMemoryUsage();
+
+	// Create the items for the File and Folder elements of an imported queue.
+	// The items still have to be inserted. Return 0 for invalid elements.
+	CFileItem* ImportFile(TiXmlElement* pFile, CServerItem* pServerItem, CLocalPath& previousLocalPath, CServerPath& previousRemotePath);
+	CFolderItem* ImportFolder(TiXmlElement* pFolder, CServerItem* pServerItem);
+	void FinishImportServer(CServerItem* pServerItem, bool updateSelections);
+	void FinishImport(bool updateSelections);
+
+	// State of loading the stored queue
+	bool m_loadingQueue{};
+	bool m_loadingFiles{};
+	bool m_restoringItems{};
+	wxLongLong_t m_loadingServerId{};
+	CServer m_loadingServer;
+
 	// Get the current transfer speed.
 	// Unit is byte/s.
 	wxFileOffset GetCurrentSpeed(bool countDownload, bool countUpload);
@@ -340,6 +340,7 @@ BEGIN_EVENT_TABLE(CRemoteListView, CFileListCtrl<CGenericFileData>)
 	// Map both ID_DOWNLOAD and ID_ADDTOQUEUE to OnMenuDownload, code is identical
 	EVT_MENU(XRCID("ID_DOWNLOAD"), CRemoteListView::OnMenuDownload)
 	EVT_MENU(XRCID("ID_ADDTOQUEUE"), CRemoteListView::OnMenuDownload)
+	EVT_MENU(XRCID("ID_SYNCHRONIZE"), CRemoteListView::OnMenuSynchronize)
 	EVT_MENU(XRCID("ID_MKDIR"), CRemoteListView::OnMenuMkdir)
 	EVT_MENU(XRCID("ID_MKDIR_CHGDIR"), CRemoteListView::OnMenuMkdirChgDir)
 	EVT_MENU(XRCID("ID_NEW_FILE"), CRemoteListView::OnMenuNewfile)
@@ -353,6 +354,7 @@ BEGIN_EVENT_TABLE(CRemoteListView, CFileListCtrl<CGenericFileData>)
 	EVT_MENU(XRCID("ID_ENTER"), CRemoteListView::OnMenuEnter)
 	EVT_MENU(XRCID("ID_GETURL"), CRemoteListView::OnMenuGeturl)
 	EVT_MENU(XRCID("ID_CONTEXT_REFRESH"), CRemoteListView::OnMenuRefresh)
+	EVT_TIMER(wxID_ANY, CRemoteListView::OnTimer)
 END_EVENT_TABLE()
 
 CRemoteListView::CRemoteListView(wxWindow* pParent, CState *pState, CQueueView* pQueue)
@@ -369,6 +371,8 @@ CRemoteListView::CRemoteListView(wxWindow* pParent, CState *pState, CQueueView*
 	m_pInfoText = 0;
 	m_pDirectoryListing = 0;
 
+	m_modifiedTimer.SetOwner(this);
+
 	const unsigned long widths[6] = { 80, 75, 80, 100, 80, 80 };
 
 	AddColumn(_("Filename"), wxLIST_FORMAT_LEFT, widths[0], true);
@@ -412,8 +416,11 @@ int CRemoteListView::OnGetItemImage(long item) const
 	if (icon != -2)
 		return icon;
 
-	icon = pThis->GetIconIndex(iconType::file, (*m_pDirectoryListing)[index].name, false, (*m_pDirectoryListing)[index].is_dir());
-	return icon;
+	bool placeholder;
+	int const fileIcon = pThis->GetFileIconIndex((*m_pDirectoryListing)[index].name, false, false, placeholder);
+	if (!placeholder)
+		icon = fileIcon;
+	return fileIcon;
 }
 
 int CRemoteListView::GetItemIndex(unsigned int item) const
@@ -440,276 +447,215 @@ bool CRemoteListView::IsItemValid(unsigned int item) const
 	return true;
 }
 
-void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
+bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
 {
-	const unsigned int to_add = pDirectoryListing->GetCount() - m_pDirectoryListing->GetCount();
-	m_pDirectoryListing = pDirectoryListing;
-
-	m_indexMapping[0] = pDirectoryListing->GetCount();
-
-	std::list<unsigned int> added;
-
-	CFilterManager filter;
-	const wxString path = m_pDirectoryListing->path.GetPath();
+	wxASSERT(!IsComparing());
 
-	CGenericFileData last = m_fileData.back();
-	m_fileData.pop_back();
+	const int unsure = pDirectoryListing->get_unsure_flags() & ~(CDirectoryListing::unsure_unknown);
 
-	for (unsigned int i = pDirectoryListing->GetCount() - to_add; i < pDirectoryListing->GetCount(); i++)
-	{
-		const CDirentry& entry = (*pDirectoryListing)[i];
-		CGenericFileData data;
-		if (entry.is_dir())
-		{
-			data.icon = m_dirIcon;
-#ifndef __WXMSW__
-			if (entry.is_link())
-				data.icon += 3;
-#endif
-		}
-		m_fileData.push_back(data);
+	if (!unsure)
+		return false;
 
-		if (filter.FilenameFiltered(entry.name, path, entry.is_dir(), entry.size, false, 0, entry.time))
-			continue;
+	if (unsure & CDirectoryListing::unsure_invalid)
+		return false;
 
-		if (m_pFilelistStatusBar)
+	// Only ever access entries through const references, everything else
+	// would unshare them.
+	const CDirectoryListing& oldListing = *m_pDirectoryListing;
+	const CDirectoryListing& newListing = *pDirectoryListing;
+	const unsigned int oldCount = oldListing.GetCount();
+	const unsigned int newCount = newListing.GetCount();
+
+	// Cached listings only get entries removed, changed in place or
+	// appended, so a single pass over both listings finds all differences.
+	// Unchanged entries usually are still shared by both listings.
+	std::vector<int> oldToNew(oldCount, -1);
+	std::vector<char> changed(newCount, 0);
+	std::vector<size_t> removed;
+	unsigned int kept = 0;
+	unsigned int changedCount = 0;
+	for (unsigned int i = 0; i < oldCount; i++)
+	{
+		if (kept < newCount)
 		{
-			if (entry.is_dir())
-				m_pFilelistStatusBar->AddDirectory();
-			else
-				m_pFilelistStatusBar->AddFile(entry.size);
+			const CDirentry& oldEntry = oldListing[i];
+			const CDirentry& newEntry = newListing[kept];
+			if (&oldEntry == &newEntry || oldEntry.name == newEntry.name)
+			{
+				if (&oldEntry != &newEntry && !(oldEntry == newEntry))
+				{
+					changed[kept] = 1;
+					changedCount++;
+				}
+				oldToNew[i] = kept++;
+				continue;
+			}
 		}
+		removed.push_back(i);
+	}
 
-		// Find correct position in index mapping
-		std::vector<unsigned int>::iterator start = m_indexMapping.begin();
-		if (m_hasParent)
-			++start;
-		CFileListCtrl<CGenericFileData>::CSortComparisonObject compare = GetSortComparisonObject();
-		std::vector<unsigned int>::iterator insertPos = std::lower_bound(start, m_indexMapping.end(), i, compare);
-		compare.Destroy();
-
-		const int item = insertPos - m_indexMapping.begin();
-		m_indexMapping.insert(insertPos, i);
-
-		for (auto iter = added.begin(); iter != added.end(); ++iter)
-		{
-			unsigned int &pos = *iter;
-			if (pos >= (unsigned int)item)
-				pos++;
-		}
-		added.push_back(item);
+	const size_t differences = removed.size() + changedCount + newCount - kept;
+	if (!differences)
+	{
+		m_pDirectoryListing = pDirectoryListing;
+		return true;
 	}
 
-	m_fileData.push_back(last);
+	// Sorting everything again is quicker then
+	if (differences > newCount / 2)
+		return false;
 
-	std::list<bool> selected;
-	unsigned int start;
-	added.push_back(m_indexMapping.size());
-	start = added.front();
+	// Selection and focus stay with the entries, remembered by their index
+	// in the new listing. The parent directory always stays the first item.
+	std::vector<unsigned int> selected;
+	int item = 0;
+	while ((item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED)) != -1)
+	{
+		const unsigned int index = m_indexMapping[item];
+		SetSelection(item, false);
 
-	SetItemCount(m_indexMapping.size());
+		const int newIndex = oldToNew[index];
+		if (newIndex != -1)
+			selected.push_back(newIndex);
+		if (newIndex != -1 && !changed[newIndex])
+			continue;
 
-	for (unsigned int i = start; i < m_indexMapping.size(); i++)
-	{
-		if (i == added.front())
+		// Selected again below with its new size if it's still shown
+		if (m_pFilelistStatusBar)
 		{
-			selected.push_front(false);
-			added.pop_front();
+			const CDirentry& entry = oldListing[index];
+			if (entry.is_dir())
+				m_pFilelistStatusBar->UnselectDirectory();
+			else
+				m_pFilelistStatusBar->UnselectFile(entry.size);
 		}
-		bool is_selected = GetItemState(i, wxLIST_STATE_SELECTED) != 0;
-		selected.push_back(is_selected);
-
-		bool should_selected = selected.front();
-		selected.pop_front();
-		if (is_selected != should_selected)
-			SetSelection(i, should_selected);
 	}
 
-	if (m_pFilelistStatusBar)
-		m_pFilelistStatusBar->SetHidden(m_pDirectoryListing->GetCount() + 1 - m_indexMapping.size());
-
-	wxASSERT(m_indexMapping.size() <= pDirectoryListing->GetCount() + 1);
-}
-
-void CRemoteListView::UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
-{
-	const unsigned int removed = m_pDirectoryListing->GetCount() - pDirectoryListing->GetCount();
-	if (!removed)
+	int focused = -1;
+	const int focusedItem = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED);
+	if (focusedItem > 0)
 	{
-		m_pDirectoryListing = pDirectoryListing;
-		return;
+		focused = oldToNew[m_indexMapping[focusedItem]];
+		SetItemState(focusedItem, 0, wxLIST_STATE_FOCUSED);
 	}
-	wxASSERT(!IsComparing());
-
-	std::list<unsigned int> removedItems;
 
-	// Get indexes of the removed items in the listing
-	unsigned int j = 0;
-	unsigned int i = 0;
-	while (i < pDirectoryListing->GetCount() && j < m_pDirectoryListing->GetCount())
-	{
-		const CDirentry& oldEntry = (*m_pDirectoryListing)[j];
-		const wxString& oldName = oldEntry.name;
-		const wxString& newName = (*pDirectoryListing)[i].name;
-		if (oldName == newName)
+	auto makeFileData = [this](const CDirentry& entry) {
+		CGenericFileData data;
+		if (entry.is_dir())
 		{
-			i++;
-			j++;
-			continue;
+			data.icon = m_dirIcon;
+#ifndef __WXMSW__
+			if (entry.is_link())
+				data.icon += 3;
+#endif
 		}
+		return data;
+	};
 
-		removedItems.push_back(j++);
-	}
-	for (; j < m_pDirectoryListing->GetCount(); j++)
-		removedItems.push_back(j);
-
-	wxASSERT(removedItems.size() == removed);
-
-	std::list<int> selectedItems;
-
-	// Number of items left to remove
-	unsigned int toRemove = removed;
-
-	std::list<int> removedIndexes;
-
-	const int size = m_indexMapping.size();
-	for (int i = size - 1; i >= 0; i--)
+	std::vector<CGenericFileData> fileData;
+	fileData.reserve(newCount + 1);
+	for (unsigned int i = 0; i < oldCount; i++)
 	{
-		bool removed = false;
-
-		unsigned int& index = m_indexMapping[i];
-
-		// j is the offset the index has to be adjusted
-		int j = 0;
-		for (std::list<unsigned int>::const_iterator iter = removedItems.begin(); iter != removedItems.end(); ++iter, ++j)
+		const int newIndex = oldToNew[i];
+		if (newIndex == -1)
+			continue;
+		if (changed[newIndex])
+			fileData.push_back(makeFileData(newListing[newIndex]));
+		else
+			fileData.push_back(m_fileData[i]);
+	}
+	for (unsigned int i = kept; i < newCount; i++)
+		fileData.push_back(makeFileData(newListing[i]));
+	fileData.push_back(m_fileData.back());
+
+	// Drop the items of removed and changed entries, the latter get
+	// inserted again at their new position
+	std::vector<unsigned int> indexMapping;
+	indexMapping.reserve(m_indexMapping.size() + newCount - kept);
+	indexMapping.push_back(newCount);
+	for (unsigned int i = 1; i < m_indexMapping.size(); i++)
+	{
+		const unsigned int index = m_indexMapping[i];
+		const int newIndex = oldToNew[index];
+		if (newIndex != -1 && !changed[newIndex])
 		{
-			if (*iter > index)
-				break;
-
-			if (*iter == index)
-			{
-				removedIndexes.push_back(i);
-				removed = true;
-				toRemove--;
-				break;
-			}
+			indexMapping.push_back(newIndex);
+			continue;
 		}
 
-		// Get old selection
-		bool isSelected = GetItemState(i, wxLIST_STATE_SELECTED) != 0;
-
-		// Update statusbar info
-		if (removed && m_pFilelistStatusBar)
+		if (m_pFilelistStatusBar)
 		{
-			const CDirentry& oldEntry = (*m_pDirectoryListing)[index];
-			if (isSelected)
-			{
-				if (oldEntry.is_dir())
-					m_pFilelistStatusBar->UnselectDirectory();
-				else
-					m_pFilelistStatusBar->UnselectFile(oldEntry.size);
-			}
-			if (oldEntry.is_dir())
+			const CDirentry& entry = oldListing[index];
+			if (entry.is_dir())
 				m_pFilelistStatusBar->RemoveDirectory();
 			else
-				m_pFilelistStatusBar->RemoveFile(oldEntry.size);
+				m_pFilelistStatusBar->RemoveFile(entry.size);
 		}
+	}
 
-		// Update index
-		index -= j;
+	CFilterManager filter;
+	const wxString path = newListing.path.GetPath();
 
-		// Update selections
-		bool needSelection;
-		if (selectedItems.empty())
-			needSelection = false;
-		else if (selectedItems.front() == i)
-		{
-			needSelection = true;
-			selectedItems.pop_front();
-		}
-		else
-			needSelection = false;
+	std::vector<unsigned int> added;
+	for (unsigned int i = 0; i < newCount; i++)
+	{
+		if (i < kept && !changed[i])
+			continue;
 
-		if (isSelected)
-		{
-			if (!needSelection && (toRemove || removed))
-				SetSelection(i, false);
+		const CDirentry& entry = newListing[i];
+		if (filter.FilenameFiltered(entry.name, path, entry.is_dir(), entry.size, false, 0, entry.time))
+			continue;
 
-			if (!removed)
-				selectedItems.push_back(i - toRemove);
+		if (m_pFilelistStatusBar)
+		{
+			if (entry.is_dir())
+				m_pFilelistStatusBar->AddDirectory();
+			else
+				m_pFilelistStatusBar->AddFile(entry.size);
 		}
-		else if (needSelection)
-			SetSelection(i, true);
-	}
-
-	// Erase file data
-	for (std::list<unsigned int>::reverse_iterator iter = removedItems.rbegin(); iter != removedItems.rend(); ++iter)
-	{
-		m_fileData.erase(m_fileData.begin() + *iter);
-	}
 
-	// Erase indexes
-	wxASSERT(!toRemove);
-	wxASSERT(removedIndexes.size() == removed);
-	for (auto iter = removedIndexes.begin(); iter != removedIndexes.end(); ++iter)
-	{
-		m_indexMapping.erase(m_indexMapping.begin() + *iter);
+		added.push_back(i);
 	}
 
-	wxASSERT(m_indexMapping.size() == pDirectoryListing->GetCount() + 1);
+	// Names of kept entries don't change, neither do their keys
+	m_sortKeys.erase(removed);
 
 	m_pDirectoryListing = pDirectoryListing;
-
-	if (m_pFilelistStatusBar)
-		m_pFilelistStatusBar->SetHidden(m_pDirectoryListing->GetCount() + 1 - m_indexMapping.size());
+	m_fileData.swap(fileData);
+	m_indexMapping.swap(indexMapping);
 
 	SaveSetItemCount(m_indexMapping.size());
-}
+	InsertSorted(added);
 
-bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
-{
-	wxASSERT(!IsComparing());
-
-	const int unsure = pDirectoryListing->get_unsure_flags() & ~(CDirectoryListing::unsure_unknown);
-
-	if (!unsure)
-		return false;
-
-	if (unsure & CDirectoryListing::unsure_invalid)
-		return false;
-
-	if (!(unsure & ~(CDirectoryListing::unsure_dir_changed | CDirectoryListing::unsure_file_changed)))
+	if (!selected.empty() || focused != -1)
 	{
-		if (m_sortColumn && m_sortColumn != 2)
+		std::sort(selected.begin(), selected.end());
+		for (unsigned int i = 1; i < m_indexMapping.size(); i++)
 		{
-			// If not sorted by file or type, changing file attributes can influence
-			// sort order.
-			return false;
-		}
-
-		if (CFilterManager::HasActiveFilters())
-			return false;
-
-		wxASSERT(pDirectoryListing->GetCount() == m_pDirectoryListing->GetCount());
-		if (pDirectoryListing->GetCount() != m_pDirectoryListing->GetCount())
-			return false;
+			const unsigned int index = m_indexMapping[i];
+			if ((int)index == focused)
+				SetItemState(i, wxLIST_STATE_FOCUSED, wxLIST_STATE_FOCUSED);
 
-		m_pDirectoryListing = pDirectoryListing;
+			if (!std::binary_search(selected.begin(), selected.end(), index))
+				continue;
 
-		// We don't have to do anything
-		return true;
+			SetSelection(i, true);
+			if (changed[index] && m_pFilelistStatusBar)
+			{
+				const CDirentry& entry = newListing[index];
+				if (entry.is_dir())
+					m_pFilelistStatusBar->SelectDirectory();
+				else
+					m_pFilelistStatusBar->SelectFile(entry.size);
+			}
+		}
 	}
 
-	if (unsure & (CDirectoryListing::unsure_dir_added | CDirectoryListing::unsure_file_added))
-	{
-		if (unsure & (CDirectoryListing::unsure_dir_removed | CDirectoryListing::unsure_file_removed))
-			return false; // Cannot handle both at the same time unfortunately
-		UpdateDirectoryListing_Added(pDirectoryListing);
-		return true;
-	}
+	if (m_pFilelistStatusBar)
+		m_pFilelistStatusBar->SetHidden(newCount + 1 - m_indexMapping.size());
+
+	wxASSERT(m_indexMapping.size() <= newCount + 1);
 
-	wxASSERT(pDirectoryListing->GetCount() <= m_pDirectoryListing->GetCount());
-	UpdateDirectoryListing_Removed(pDirectoryListing);
 	return true;
 }
 
@@ -773,6 +719,7 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 
 	m_fileData.clear();
 	m_indexMapping.clear();
+	m_sortKeys.clear();
 
 	wxLongLong totalSize;
 	int unknown_sizes = 0;
@@ -819,6 +766,8 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 				else
 					totalSize += entry.size;
 				totalFileCount++;
+
+				QueueIconLookup(entry.name, false);
 			}
 
 			m_indexMapping.push_back(i);
@@ -827,6 +776,8 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 		CGenericFileData data;
 		data.icon = m_dirIcon;
 		m_fileData.push_back(data);
+
+		StartResolvingIcons();
 	}
 	else
 	{
@@ -1095,6 +1046,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 		pMenu->Delete(XRCID("ID_ENTER"));
 		pMenu->Enable(XRCID("ID_DOWNLOAD"), false);
 		pMenu->Enable(XRCID("ID_ADDTOQUEUE"), false);
+		pMenu->Enable(XRCID("ID_SYNCHRONIZE"), false);
 		pMenu->Enable(XRCID("ID_MKDIR"), false);
 		pMenu->Enable(XRCID("ID_MKDIR_CHGDIR"), false);
 		pMenu->Enable(XRCID("ID_DELETE"), false);
@@ -1183,6 +1135,9 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 		}
 	}
 
+	if (!m_pState->GetLocalDir().IsWriteable())
+		pMenu->Enable(XRCID("ID_SYNCHRONIZE"), false);
+
 	PopupMenu(pMenu);
 	delete pMenu;
 }
@@ -1296,6 +1251,34 @@ void CRemoteListView::TransferSelectedFiles(const CLocalPath& local_parent, bool
 	}
 }
 
+void CRemoteListView::OnMenuSynchronize(wxCommandEvent&)
+{
+	if (!m_pState->IsRemoteConnected() || !m_pState->IsRemoteIdle() || !m_pDirectoryListing)
+	{
+		wxBell();
+		return;
+	}
+
+	const CLocalPath localDir = m_pState->GetLocalDir();
+	if (!localDir.IsWriteable())
+	{
+		wxBell();
+		return;
+	}
+
+	CRecursiveOperation* pRecursiveOperation = m_pState->GetRecursiveOperationHandler();
+	wxASSERT(pRecursiveOperation);
+
+	if (IsComparing())
+		ExitComparisonMode();
+
+	// The current directory itself, against the current local directory
+	pRecursiveOperation->AddDirectoryToVisit(m_pDirectoryListing->path, _T(""), localDir);
+
+	CFilterManager filter;
+	pRecursiveOperation->StartRecursiveOperation(CRecursiveOperation::recursive_synchronize, m_pDirectoryListing->path, filter.GetActiveFilters(false), true);
+}
+
 // Create a new Directory
 void CRemoteListView::OnMenuMkdir(wxCommandEvent&)
 {
@@ -2049,9 +2032,17 @@ void CRemoteListView::OnStateChange(CState* pState, enum t_statechange_notificat
 {
 	wxASSERT(pState);
 	if (notification == STATECHANGE_REMOTE_DIR)
+	{
+		m_modifiedTimer.Stop();
 		SetDirectoryListing(pState->GetRemoteDir());
+	}
 	else if (notification == STATECHANGE_REMOTE_DIR_MODIFIED)
-		SetDirectoryListing(pState->GetRemoteDir());
+	{
+		// Listings get modified once per file during transfers and
+		// deletions, show only the latest one now and then.
+		if (!m_modifiedTimer.IsRunning())
+			m_modifiedTimer.Start(modified_delay, true);
+	}
 	else if (notification == STATECHANGE_REMOTE_LINKNOTDIR)
 	{
 		wxASSERT(data2);
@@ -2684,6 +2675,17 @@ void CRemoteListView::OnMenuRefresh(wxCommandEvent&)
 		m_pState->RefreshRemote();
 }
 
+void CRemoteListView::OnTimer(wxTimerEvent& event)
+{
+	if (event.GetId() != m_modifiedTimer.GetId())
+	{
+		event.Skip();
+		return;
+	}
+
+	SetDirectoryListing(m_pState->GetRemoteDir());
+}
+
 void CRemoteListView::OnNavigationEvent(bool forward)
 {
 	if (!forward) {
@@ -54,9 +54,16 @@ protected:
 	virtual void OnStateChange(CState* pState, enum t_statechange_notifications notification, const wxString& data, const void* data2);
 	void ApplyCurrentFilter();
 	void SetDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
+
+	// Applies the differences between the displayed and the modified listing
+	// without sorting everything again, keeping the selected entries
+	// selected. Returns false if the list has to be rebuilt instead.
 	bool UpdateDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
-	void UpdateDirectoryListing_Removed(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
-	void UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing);
+
+	// Modifications of the listing arriving in short succession are
+	// displayed together
+	enum { modified_delay = 100 };
+	wxTimer m_modifiedTimer;
 
 #ifdef __WXDEBUG__
 	void ValidateIndexMapping();
@@ -103,6 +110,7 @@ protected:
 	void OnItemActivated(wxListEvent &event);
 	void OnContextMenu(wxContextMenuEvent& event);
 	void OnMenuDownload(wxCommandEvent& event);
+	void OnMenuSynchronize(wxCommandEvent&);
 	void OnMenuMkdir(wxCommandEvent&);
 	void OnMenuMkdirChgDir(wxCommandEvent&);
 	void OnMenuDelete(wxCommandEvent&);
@@ -116,6 +124,7 @@ protected:
 	void OnMenuGeturl(wxCommandEvent&);
 	void OnMenuRefresh(wxCommandEvent&);
 	void OnMenuNewfile(wxCommandEvent& event);
+	void OnTimer(wxTimerEvent& event);
 };
 
 #endif
@@ -365,6 +365,9 @@ void CRemoteTreeView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 #endif
 
 	m_busy = false;
+
+	if (!modified && !pListing->failed())
+		PrefetchSubdirs(*pListing);
 }
 
 wxTreeItemId CRemoteTreeView::MakeParent(CServerPath path, bool select)
@@ -1304,7 +1307,10 @@ bool CRemoteTreeView::ListExpand(wxTreeItemId item)
 
 	CDirectoryListing listing;
 	if (m_pState->m_pEngine->CacheLookup(path, listing) == FZ_REPLY_OK)
+	{
 		RefreshItem(item, listing, false);
+		PrefetchSubdirs(listing);
+	}
 	else
 	{
 		SetItemImages(item, true);
@@ -1317,6 +1323,42 @@ bool CRemoteTreeView::ListExpand(wxTreeItemId item)
 	return true;
 }
 
+void CRemoteTreeView::PrefetchSubdirs(const CDirectoryListing& listing)
+{
+	// No point in looking far ahead, users rarely open more than a few
+	const unsigned int max_prefetch = 20;
+
+	const CServer* pServer = m_pState->GetServer();
+	if (!pServer || !m_pQueue)
+		return;
+
+	CFilterManager filter;
+
+	const wxString path = listing.path.GetPath();
+
+	std::vector<CServerPath> paths;
+	for (unsigned int i = 0; i < listing.GetCount() && paths.size() < max_prefetch; i++)
+	{
+		const CDirentry& entry = listing[i];
+		if (!entry.is_dir() || entry.is_link())
+			continue;
+
+		if (filter.FilenameFiltered(entry.name, path, true, -1, false, 0, entry.time))
+			continue;
+
+		CServerPath subdir = listing.path;
+		subdir.AddSegment(entry.name);
+
+		CDirectoryListing subListing;
+		if (m_pState->m_pEngine->CacheLookup(subdir, subListing) == FZ_REPLY_OK)
+			continue;
+
+		paths.push_back(subdir);
+	}
+
+	m_pQueue->PrefetchListings(*pServer, paths);
+}
+
 void CRemoteTreeView::OnChar(wxKeyEvent& event)
 {
 	m_contextMenuItem = GetSelection();
@@ -34,6 +34,10 @@ protected:
 
 	bool ListExpand(wxTreeItemId item);
 
+	// Subdirectories are the likely next navigation targets, have the queue
+	// list those not in the cache yet in the background.
+	void PrefetchSubdirs(const CDirectoryListing& listing);
+
 	void ApplyFilters(bool resort);
 
 	CQueueView* m_pQueue;
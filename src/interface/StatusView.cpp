@@ -1,105 +1,78 @@
 #include <filezilla.h>
 #include "StatusView.h"
 #include "Options.h"
+#include "inputdialog.h"
 
+#include <wx/clipbrd.h>
 #include <wx/dcclient.h>
-
-#define MAX_LINECOUNT 1000
-#define LINECOUNT_REMOVAL 10
+#include <wx/textfile.h>
+#include <wx/vlbox.h>
 
 BEGIN_EVENT_TABLE(CStatusView, wxNavigationEnabled<wxWindow>)
 EVT_SIZE(CStatusView::OnSize)
 EVT_MENU(XRCID("ID_CLEARALL"), CStatusView::OnClear)
 EVT_MENU(XRCID("ID_COPYTOCLIPBOARD"), CStatusView::OnCopy)
+EVT_MENU(XRCID("ID_FIND_IN_LOG"), CStatusView::OnFind)
 END_EVENT_TABLE()
 
-class CFastTextCtrl : public wxNavigationEnabled<wxTextCtrl>
+// Draws the lines kept by the status view, only those visible get drawn
+class CLogView final : public wxVListBox
 {
 public:
-	CFastTextCtrl(wxWindow* parent)
+	CLogView(CStatusView* parent)
+		: wxVListBox(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxNO_BORDER | wxLB_MULTIPLE | wxTAB_TRAVERSAL)
+		, m_owner(*parent)
 	{
-		Create(parent, -1, wxString(), wxDefaultPosition, wxDefaultSize,
-			wxNO_BORDER | wxVSCROLL | wxTE_MULTILINE |
-			wxTE_READONLY | wxTE_RICH | wxTE_RICH2 | wxTE_NOHIDESEL |
-			wxTAB_TRAVERSAL);
 	}
-#ifdef __WXMSW__
-	// wxTextCtrl::Remove is somewhat slow, this is a faster version
-	virtual void Remove(long from, long to)
-	{
-		DoSetSelection(from, to, false);
 
-		m_updatesCount = -2; // suppress any update event
-		::SendMessage((HWND)GetHandle(), EM_REPLACESEL, 0, (LPARAM)_T(""));
-	}
-
-	void AppendText(const wxString& text, int lineCount, const CHARFORMAT2& cf)
+protected:
+	virtual void OnDrawItem(wxDC& dc, const wxRect& rect, size_t n) const
 	{
-		HWND hwnd = (HWND)GetHWND();
-
-		CHARRANGE range;
-		range.cpMin = GetLastPosition();
-		range.cpMax = range.cpMin;
-		::SendMessage(hwnd, EM_EXSETSEL, 0, (LPARAM)&range);
-		::SendMessage(hwnd, EM_SETCHARFORMAT, SCF_SELECTION, (LPARAM)&cf);
-		m_updatesCount = -2; // suppress any update event
-		::SendMessage(hwnd, EM_REPLACESEL, 0, reinterpret_cast<LPARAM>(static_cast<wxChar const*>(text.c_str())));
-		::SendMessage(hwnd, EM_LINESCROLL, (WPARAM)0, (LPARAM)lineCount);
+		m_owner.DrawLine(dc, rect, n, IsSelected(n));
 	}
-#endif
 
-#ifndef __WXMAC__
-	void SetDefaultColor(const wxColour& color)
+	virtual wxCoord OnMeasureItem(size_t n) const
 	{
-		m_defaultStyle.SetTextColour(color);
+		return m_owner.MeasureLine(n);
 	}
-#endif
 
-	DECLARE_EVENT_TABLE()
+	CStatusView& m_owner;
 
-	void OnText(wxCommandEvent&)
-	{
-		// Do nothing here.
-		// Having this event handler prevents the event from propagating up the
-		// window hierarchy which saves a few CPU cycles.
-	}
+	// Lines get wrapped to this width
+	int m_width{-1};
 
-#ifdef __WXMAC__
-	void OnChar(wxKeyEvent& event)
+	DECLARE_EVENT_TABLE()
+	void OnSize(wxSizeEvent& event)
 	{
-		if (event.GetKeyCode() != WXK_TAB) {
-			event.Skip();
-			return;
-		}
+		int const width = GetClientSize().GetWidth();
+		if (width != m_width) {
+			m_width = width;
 
-		HandleAsNavigationKey(event);
+			// Line heights change with the wrapping
+			RefreshAll();
+		}
+		event.Skip();
 	}
-#endif
 };
 
-BEGIN_EVENT_TABLE(CFastTextCtrl, wxNavigationEnabled<wxTextCtrl>)
-	EVT_TEXT(wxID_ANY, CFastTextCtrl::OnText)
-#ifdef __WXMAC__
-	EVT_CHAR_HOOK(CFastTextCtrl::OnChar)
-#endif
+BEGIN_EVENT_TABLE(CLogView, wxVListBox)
+EVT_SIZE(CLogView::OnSize)
 END_EVENT_TABLE()
 
-
 CStatusView::CStatusView(wxWindow* parent, wxWindowID id)
 {
 	Create(parent, id, wxDefaultPosition, wxDefaultSize, wxSUNKEN_BORDER);
-	m_pTextCtrl = new CFastTextCtrl(this);
+	m_pView = new CLogView(this);
 
 #ifdef __WXMAC__
-	m_pTextCtrl->SetFont(wxSystemSettings::GetFont(wxSYS_DEFAULT_GUI_FONT));
+	m_pView->SetFont(wxSystemSettings::GetFont(wxSYS_DEFAULT_GUI_FONT));
 #else
-	m_pTextCtrl->SetFont(GetFont());
+	m_pView->SetFont(GetFont());
 #endif
+	m_pView->SetBackgroundColour(wxSystemSettings::GetColour(wxSYS_COLOUR_LISTBOX));
 
-	m_pTextCtrl->Connect(wxID_ANY, wxEVT_CONTEXT_MENU, wxContextMenuEventHandler(CStatusView::OnContextMenu), 0, this);
-#ifdef __WXMSW__
-	::SendMessage((HWND)m_pTextCtrl->GetHandle(), EM_SETOLECALLBACK, 0, 0);
-#endif
+	m_pView->Connect(wxID_ANY, wxEVT_CONTEXT_MENU, wxContextMenuEventHandler(CStatusView::OnContextMenu), 0, this);
+	m_pView->Connect(wxID_ANY, wxEVT_KEY_DOWN, wxKeyEventHandler(CStatusView::OnKeyDown), 0, this);
 
 	InitDefAttr();
 
@@ -112,9 +85,9 @@ CStatusView::~CStatusView()
 
 void CStatusView::OnSize(wxSizeEvent &)
 {
-	if (m_pTextCtrl) {
+	if (m_pView) {
 		wxSize s = GetClientSize();
-		m_pTextCtrl->SetSize(0, 0, s.GetWidth(), s.GetHeight());
+		m_pView->SetSize(0, 0, s.GetWidth(), s.GetHeight());
 	}
 }
 
@@ -125,152 +98,200 @@ void CStatusView::AddToLog(CLogmsgNotification const& notification)
 
 void CStatusView::AddToLog(MessageType messagetype, const wxString& message, const wxDateTime& time)
 {
-	if (!m_shown) {
-		if (m_hiddenLines.size() >= MAX_LINECOUNT) {
-			auto it = m_hiddenLines.begin();
-			it->messagetype = messagetype;
-			it->message = message;
-			it->time = time;
-			m_hiddenLines.splice(m_hiddenLines.end(), m_hiddenLines, it );
-		}
-		else {
-			t_line line;
-			line.messagetype = messagetype;
-			line.message = message;
-			line.time = time;
-			m_hiddenLines.push_back(line);
-		}
-		return;
+	m_lines.push_back(static_cast<int>(messagetype), time.GetValue().GetValue(), message.wc_str(), message.size());
+
+	if (m_shown && !m_updatePending) {
+		m_updatePending = true;
+		CallAfter(&CStatusView::UpdateView);
 	}
+}
 
-	const int messageLength = message.Length();
+void CStatusView::UpdateView()
+{
+	m_updatePending = false;
+	if (!m_pView || !m_shown)
+		return;
 
-	wxString prefix;
-	prefix.Alloc(25 + messageLength);
+	size_t const count = m_lines.size();
+	size_t const oldCount = m_pView->GetItemCount();
+	size_t const dropped = static_cast<size_t>(m_lines.dropped() - m_viewDropped);
+	m_viewDropped = m_lines.dropped();
+
+	// Keep showing the newest lines unless scrolled up
+	bool const atEnd = !oldCount || m_pView->GetVisibleRowsEnd() >= oldCount;
+	size_t const top = m_pView->GetVisibleRowsBegin();
+
+	// Selected lines move up as older ones get dropped
+	std::vector<size_t> selected;
+	if (dropped && m_pView->GetSelectedCount()) {
+		unsigned long cookie;
+		for (int item = m_pView->GetFirstSelected(cookie); item != wxNOT_FOUND; item = m_pView->GetNextSelected(cookie)) {
+			if (static_cast<size_t>(item) >= dropped)
+				selected.push_back(item - dropped);
+		}
+		m_pView->DeselectAll();
+	}
 
-	if (m_nLineCount)
-#ifdef __WXMSW__
-		prefix = _T("\r\n");
-#else
-		prefix = _T("\n");
-#endif
+	m_pView->SetItemCount(count);
 
-	if (m_nLineCount >= MAX_LINECOUNT) {
-#ifndef __WXGTK__
-		m_pTextCtrl->Freeze();
-#endif //__WXGTK__
-		int oldLength = 0;
-		auto it = m_lineLengths.begin();
-		for (int i = 0; i < LINECOUNT_REMOVAL; ++i) {
-			oldLength += *(it++) + 1;
-		}
-		m_unusedLineLengths.splice(m_unusedLineLengths.end(), m_lineLengths, m_lineLengths.begin(), it);
-		m_pTextCtrl->Remove(0, oldLength);
+	for (auto const& item : selected) {
+		if (item < count)
+			m_pView->Select(item);
 	}
-#ifdef __WXMAC__
-	if (m_pTextCtrl->GetInsertionPoint() != m_pTextCtrl->GetLastPosition()) {
-		m_pTextCtrl->SetInsertionPointEnd();
+
+	if (atEnd) {
+		if (count)
+			m_pView->ScrollToRow(count - 1);
 	}
-#endif
+	else if (dropped)
+		m_pView->ScrollToRow(top > dropped ? top - dropped : 0);
 
-	int lineLength = m_attributeCache[static_cast<int>(messagetype)].len + messageLength;
+	m_pView->Refresh(false);
+}
 
+void CStatusView::DrawLine(wxDC& dc, const wxRect& rect, size_t line, bool selected) const
+{
+	// Long lines can push out several old ones before the view is updated
+	if (line >= m_lines.size())
+		return;
+
+	t_attributeCache const& attr = m_attributeCache[m_lines.type(line)];
+
+	dc.SetFont(m_pView->GetFont());
+	dc.SetTextForeground(selected ? wxSystemSettings::GetColour(wxSYS_COLOUR_HIGHLIGHTTEXT) : attr.colour);
+
+	int x = rect.GetX() + 2;
 	if (m_showTimestamps) {
-		if (time != m_lastTime) {
-			m_lastTime = time;
-#ifndef __WXMAC__
-			m_lastTimeString = time.Format(_T("%H:%M:%S\t"));
-#else
-			// Tabs on OS X cannot be freely positioned
-			m_lastTimeString = time.Format(_T("%H:%M:%S "));
-#endif
-		}
-		prefix += m_lastTimeString;
-		lineLength += m_lastTimeString.Len();
+		dc.DrawText(wxDateTime(wxLongLong(m_lines.time(line))).Format(_T("%H:%M:%S")), x, rect.GetY());
+		x += m_timestampWidth;
 	}
 
-#ifdef __WXMAC__
-	m_pTextCtrl->SetDefaultStyle(m_attributeCache[static_cast<int>(messagetype)].attr);
-#elif __WXGTK__
-	m_pTextCtrl->SetDefaultColor(m_attributeCache[static_cast<int>(messagetype)].attr.GetTextColour());
-#endif
-
-	prefix += m_attributeCache[static_cast<int>(messagetype)].prefix;
+	dc.DrawText(attr.prefix, x, rect.GetY());
+	x += m_prefixWidth;
 
-	if (m_rtl) {
-		// Unicode control characters that control reading direction
+	wxString prefix;
+	const MessageType messagetype = static_cast<MessageType>(m_lines.type(line));
+	if (m_rtl && (messagetype == MessageType::Command || messagetype == MessageType::Response || messagetype >= MessageType::Debug_Warning)) {
+		// Commands, responses and debug message contain English text,
+		// set LTR reading order for them.
 		const wxChar LTR_MARK = 0x200e;
-		//const wxChar RTL_MARK = 0x200f;
 		const wxChar LTR_EMBED = 0x202A;
-		//const wxChar RTL_EMBED = 0x202B;
-		//const wxChar POP = 0x202c;
-		//const wxChar LTR_OVERRIDE = 0x202D;
-		//const wxChar RTL_OVERRIDE = 0x202E;
-
-		if (messagetype == MessageType::Command || messagetype == MessageType::Response || messagetype >= MessageType::Debug_Warning) {
-			// Commands, responses and debug message contain English text,
-			// set LTR reading order for them.
-			prefix += LTR_MARK;
-			prefix += LTR_EMBED;
-			lineLength += 2;
-		}
+		prefix += LTR_MARK;
+		prefix += LTR_EMBED;
 	}
 
-	prefix += message;
-#if defined(__WXGTK__)
-	// AppendText always calls SetInsertionPointEnd, which is very expensive.
-	// This check however is negligible.
-	if (m_pTextCtrl->GetInsertionPoint() != m_pTextCtrl->GetLastPosition())
-		m_pTextCtrl->AppendText(prefix);
-	else
-		m_pTextCtrl->WriteText(prefix);
-#elif defined(__WXMAC__)
-	m_pTextCtrl->WriteText(prefix);
-#else
-	m_pTextCtrl->AppendText(prefix, m_nLineCount, m_attributeCache[static_cast<int>(messagetype)].cf);
-#endif
+	// Rows of messages spanning multiple lines or wrapped lines are drawn
+	// below each other
+	std::vector<std::pair<size_t, size_t>> rows;
+	WrapLine(dc, line, rect.GetX() + rect.GetWidth() - x - 2, rows);
 
-	if (m_nLineCount >= MAX_LINECOUNT) {
-		m_nLineCount -= LINECOUNT_REMOVAL - 1;
-#ifndef __WXGTK__
-		m_pTextCtrl->Thaw();
-#endif
-	}
-	else {
-		m_nLineCount++;
-	}
-	if (m_unusedLineLengths.empty()) {
-		m_lineLengths.push_back(lineLength);
+	wchar_t const* const text = m_lines.text(line);
+	int y = rect.GetY();
+	for (auto const& row : rows) {
+		dc.DrawText(prefix + wxString(text + row.first, row.second - row.first), x, y);
+		y += m_lineHeight;
 	}
-	else {
-		m_unusedLineLengths.front() = lineLength;
-		m_lineLengths.splice(m_lineLengths.end(), m_unusedLineLengths, m_unusedLineLengths.begin());
+}
+
+wxCoord CStatusView::MeasureLine(size_t line) const
+{
+	if (line >= m_lines.size())
+		return m_lineHeight;
+
+	wxClientDC dc(m_pView);
+	dc.SetFont(m_pView->GetFont());
+
+	std::vector<std::pair<size_t, size_t>> rows;
+	WrapLine(dc, line, m_pView->GetClientSize().GetWidth() - 4 - m_timestampWidth - m_prefixWidth, rows);
+
+	return rows.size() * m_lineHeight;
+}
+
+void CStatusView::WrapLine(wxDC& dc, size_t line, int width, std::vector<std::pair<size_t, size_t>>& rows) const
+{
+	rows.clear();
+
+	// Wrapping into very narrow rows isn't helpful
+	width = std::max(width, 20 * dc.GetCharWidth());
+
+	wchar_t const* const text = m_lines.text(line);
+	size_t const length = m_lines.length(line);
+
+	wxArrayInt extents;
+	size_t start = 0;
+	for (size_t i = 0; i <= length; ++i) {
+		if (i < length && text[i] != '\n')
+			continue;
+
+		size_t end = i;
+		if (end > start && text[end - 1] == '\r')
+			--end;
+
+		wxString const part(text + start, end - start);
+		if (!dc.GetPartialTextExtents(part, extents) || extents.empty() || extents.Last() <= width)
+			rows.push_back(std::make_pair(start, end));
+		else {
+			// Extents include all preceding characters
+			size_t rowStart = 0;
+			int offset = 0;
+			while (rowStart < part.size()) {
+				size_t rowEnd = rowStart;
+				while (rowEnd < part.size() && extents[rowEnd] - offset <= width)
+					++rowEnd;
+
+				size_t next = rowEnd;
+				if (rowEnd < part.size()) {
+					// Break at the last space that fits, or anywhere if
+					// there is none
+					size_t space = rowEnd;
+					while (space > rowStart && part[space] != ' ')
+						--space;
+					if (space > rowStart) {
+						rowEnd = space;
+						next = space + 1;
+					}
+					else if (rowEnd == rowStart)
+						next = ++rowEnd;
+				}
+
+				rows.push_back(std::make_pair(start + rowStart, start + rowEnd));
+				rowStart = next;
+				offset = extents[next - 1];
+			}
+		}
+
+		start = i + 1;
 	}
 }
 
+wxString CStatusView::FormatLine(size_t line) const
+{
+	wxString ret;
+	if (m_showTimestamps)
+		ret = wxDateTime(wxLongLong(m_lines.time(line))).Format(_T("%H:%M:%S\t"));
+	ret += m_attributeCache[m_lines.type(line)].prefix;
+	ret += _T("\t");
+	ret.append(m_lines.text(line), m_lines.length(line));
+	return ret;
+}
+
 void CStatusView::InitDefAttr()
 {
 	m_showTimestamps = COptions::Get()->GetOptionVal(OPTION_MESSAGELOG_TIMESTAMP) != 0;
-	m_lastTime = wxDateTime::Now();
-	m_lastTimeString = m_lastTime.Format(_T("%H:%M:%S\t"));
 
 	// Measure withs of all types
-	wxClientDC dc(this);
+	wxClientDC dc(m_pView ? static_cast<wxWindow*>(m_pView) : this);
+	dc.SetFont(m_pView ? m_pView->GetFont() : GetFont());
+
+	wxCoord width = 0;
+	wxCoord height = 0;
 
-	int timestampWidth = 0;
+	m_timestampWidth = 0;
 	if (m_showTimestamps) {
-		wxCoord width = 0;
-		wxCoord height = 0;
-#ifndef __WXMAC__
-		dc.GetTextExtent(_T("88:88:88 "), &width, &height);
-#else
 		dc.GetTextExtent(_T("88:88:88 "), &width, &height);
-#endif
-		timestampWidth = width;
+		m_timestampWidth = width + 6;
 	}
 
-	wxCoord width = 0;
-	wxCoord height = 0;
 	dc.GetTextExtent(_("Error:") + _T(" "), &width, &height);
 	int maxPrefixWidth = width;
 	dc.GetTextExtent(_("Command:") + _T(" "), &width, &height);
@@ -288,59 +309,33 @@ void CStatusView::InitDefAttr()
 	dc.GetTextExtent(_("Status:") + _T(" "), &width, &height);
 	if (width > maxPrefixWidth)
 		maxPrefixWidth = width;
+	m_prefixWidth = maxPrefixWidth + 6;
 
-#ifdef __WXMAC__
-	wxCoord spaceWidth;
-	dc.GetTextExtent(_T(" "), &spaceWidth, &height);
-#endif
-
-	dc.SetMapMode(wxMM_LOMETRIC);
-
-	int maxWidth = dc.DeviceToLogicalX(maxPrefixWidth) + 20;
-	if (timestampWidth != 0) {
-		timestampWidth = dc.DeviceToLogicalX(timestampWidth) + 20;
-		maxWidth += timestampWidth;
-	}
-	wxArrayInt array;
-#ifndef __WXMAC__
-	if (timestampWidth != 0)
-		array.Add(timestampWidth);
-#endif
-	array.Add(maxWidth);
-	wxTextAttr defAttr;
-	defAttr.SetTabs(array);
-	defAttr.SetLeftIndent(0, maxWidth);
-	m_pTextCtrl->SetDefaultStyle(defAttr);
-#ifdef __WXMSW__
-	m_pTextCtrl->SetStyle(0, 0, defAttr);
-#endif
+	m_lineHeight = dc.GetCharHeight() + 1;
 
 	const wxColour background = wxSystemSettings::GetColour(wxSYS_COLOUR_LISTBOX);
 	const bool is_dark = background.Red() + background.Green() + background.Blue() < 384;
 
 	for (int i = 0; i < static_cast<int>(MessageType::count); i++) {
 		t_attributeCache& entry = m_attributeCache[i];
-#ifndef __WXMAC__
-		entry.attr = defAttr;
-#endif
 		switch (static_cast<MessageType>(i)) {
 		case MessageType::Error:
 			entry.prefix = _("Error:");
-			entry.attr.SetTextColour(wxColour(255, 0, 0));
+			entry.colour = wxColour(255, 0, 0);
 			break;
 		case MessageType::Command:
 			entry.prefix = _("Command:");
 			if (is_dark)
-				entry.attr.SetTextColour(wxColour(128, 128, 255));
+				entry.colour = wxColour(128, 128, 255);
 			else
-				entry.attr.SetTextColour(wxColour(0, 0, 128));
+				entry.colour = wxColour(0, 0, 128);
 			break;
 		case MessageType::Response:
 			entry.prefix = _("Response:");
 			if (is_dark)
-				entry.attr.SetTextColour(wxColour(128, 255, 128));
+				entry.colour = wxColour(128, 255, 128);
 			else
-				entry.attr.SetTextColour(wxColour(0, 128, 0));
+				entry.colour = wxColour(0, 128, 0);
 			break;
 		case MessageType::Debug_Warning:
 		case MessageType::Debug_Info:
@@ -348,41 +343,30 @@ void CStatusView::InitDefAttr()
 		case MessageType::Debug_Debug:
 			entry.prefix = _("Trace:");
 			if (is_dark)
-				entry.attr.SetTextColour(wxColour(255, 128, 255));
+				entry.colour = wxColour(255, 128, 255);
 			else
-				entry.attr.SetTextColour(wxColour(128, 0, 128));
+				entry.colour = wxColour(128, 0, 128);
 			break;
 		case MessageType::RawList:
 			entry.prefix = _("Listing:");
 			if (is_dark)
-				entry.attr.SetTextColour(wxColour(128, 255, 255));
+				entry.colour = wxColour(128, 255, 255);
 			else
-				entry.attr.SetTextColour(wxColour(0, 128, 128));
+				entry.colour = wxColour(0, 128, 128);
 			break;
 		default:
 			entry.prefix = _("Status:");
-			entry.attr.SetTextColour(wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT));
+			entry.colour = wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT);
 			break;
 		}
-
-#ifdef __WXMAC__
-		// Fill with blanks to approach best size
-		dc.GetTextExtent(entry.prefix, &width, &height);
-		wxASSERT(width <= maxPrefixWidth);
-		wxCoord spaces = (maxPrefixWidth - width) / spaceWidth;
-		entry.prefix += wxString(spaces, ' ');
-#endif
-		entry.prefix += _T("\t");
-		entry.len = entry.prefix.Length();
-
-#ifdef __WXMSW__
-		m_pTextCtrl->SetStyle(0, 0, entry.attr);
-		entry.cf.cbSize = sizeof(CHARFORMAT2);
-		::SendMessage((HWND)m_pTextCtrl->GetHWND(), EM_GETCHARFORMAT, SCF_SELECTION, (LPARAM)&entry.cf);
-#endif
 	}
 
 	m_rtl = wxTheApp->GetLayoutDirection() == wxLayout_RightToLeft;
+
+	if (m_pView) {
+		// Line heights might have changed
+		m_pView->RefreshAll();
+	}
 }
 
 void CStatusView::OnContextMenu(wxContextMenuEvent&)
@@ -399,52 +383,116 @@ void CStatusView::OnContextMenu(wxContextMenuEvent&)
 	delete pMenu;
 }
 
+void CStatusView::OnKeyDown(wxKeyEvent& event)
+{
+	if (event.GetKeyCode() == WXK_F3 && !event.HasModifiers())
+		Find(true);
+	else if (event.GetModifiers() == wxMOD_CMD && event.GetKeyCode() == 'F')
+		Find(false);
+	else if (event.GetModifiers() == wxMOD_CMD && event.GetKeyCode() == 'C') {
+		wxCommandEvent evt;
+		OnCopy(evt);
+	}
+	else
+		event.Skip();
+}
+
 void CStatusView::OnClear(wxCommandEvent&)
 {
-	if (m_pTextCtrl)
-		m_pTextCtrl->Clear();
-	m_nLineCount = 0;
-	m_lineLengths.clear();
+	m_lines.clear();
+	m_viewDropped = m_lines.dropped();
+	if (m_pView) {
+		m_pView->DeselectAll();
+		m_pView->SetItemCount(0);
+	}
 }
 
 void CStatusView::OnCopy(wxCommandEvent&)
 {
-	if (!m_pTextCtrl)
+	if (!m_pView || m_lines.empty())
 		return;
 
-	long from, to;
-	m_pTextCtrl->GetSelection(&from, &to);
-	if (from != to)
-		m_pTextCtrl->Copy();
+	// The selected lines, or all of them if none is
+	wxString text;
+	if (m_pView->GetSelectedCount()) {
+		unsigned long cookie;
+		for (int item = m_pView->GetFirstSelected(cookie); item != wxNOT_FOUND; item = m_pView->GetNextSelected(cookie)) {
+			if (static_cast<size_t>(item) >= m_lines.size())
+				break;
+			text += FormatLine(item);
+			text += wxTextFile::GetEOL();
+		}
+	}
 	else {
-		m_pTextCtrl->Freeze();
-		m_pTextCtrl->SetSelection(-1, -1);
-		m_pTextCtrl->Copy();
-		m_pTextCtrl->SetSelection(from, to);
-		m_pTextCtrl->Thaw();
+		for (size_t i = 0; i < m_lines.size(); ++i) {
+			text += FormatLine(i);
+			text += wxTextFile::GetEOL();
+		}
+	}
+
+	if (!wxTheClipboard->Open()) {
+		wxBell();
+		return;
 	}
+	wxTheClipboard->SetData(new wxTextDataObject(text));
+	wxTheClipboard->Flush();
+	wxTheClipboard->Close();
+}
+
+void CStatusView::OnFind(wxCommandEvent&)
+{
+	Find(false);
+}
+
+void CStatusView::Find(bool again)
+{
+	if (!m_pView)
+		return;
+
+	if (!again || m_searchText.empty()) {
+		CInputDialog dlg;
+		if (!dlg.Create(this, _("Find in message log"), _("Please enter the text to search for:")))
+			return;
+		dlg.SetValue(m_searchText);
+		dlg.SelectText(0, m_searchText.size());
+		if (dlg.ShowModal() != wxID_OK)
+			return;
+		m_searchText = dlg.GetValue();
+	}
+
+	// Starts after the last selected line, i.e. the previous match
+	size_t start = 0;
+	if (m_pView->GetSelectedCount()) {
+		unsigned long cookie;
+		for (int item = m_pView->GetFirstSelected(cookie); item != wxNOT_FOUND; item = m_pView->GetNextSelected(cookie))
+			start = item + 1;
+	}
+
+	size_t const found = m_lines.find(m_searchText.ToStdWstring(), start);
+	if (found == CLogBuffer::npos) {
+		wxBell();
+		return;
+	}
+
+	m_pView->DeselectAll();
+	m_pView->Select(found);
+	if (!m_pView->IsRowVisible(found))
+		m_pView->ScrollToRow(found);
 }
 
 void CStatusView::SetFocus()
 {
-	m_pTextCtrl->SetFocus();
+	m_pView->SetFocus();
 }
 
 bool CStatusView::Show(bool show /*=true*/)
 {
 	m_shown = show;
 
-	if (show && m_pTextCtrl) {
-		if (m_hiddenLines.size() >= MAX_LINECOUNT) {
-			m_pTextCtrl->Clear();
-			m_nLineCount = 0;
-			m_unusedLineLengths.splice(m_unusedLineLengths.end(), m_lineLengths, m_lineLengths.begin(), m_lineLengths.end());
-		}
-
-		for (auto const& line : m_hiddenLines) {
-			AddToLog(line.messagetype, line.message, line.time);
-		}
-		m_hiddenLines.clear();
+	// Lines got added in the meantime
+	if (show && !m_updatePending) {
+		m_updatePending = true;
+		CallAfter(&CStatusView::UpdateView);
 	}
 
 	return wxWindow::Show(show);
@@ -1,13 +1,12 @@
 #ifndef __STATUSVIEW_H__
 #define __STATUSVIEW_H__
 
-#ifdef __WXMSW__
-#include "richedit.h"
-#endif
+#include "log_buffer.h"
 
-class CFastTextCtrl;
+class CLogView;
 class CStatusView : public wxNavigationEnabled<wxWindow>
 {
+	friend class CLogView;
 public:
 	CStatusView(wxWindow* parent, wxWindowID id);
 	virtual ~CStatusView();
@@ -22,49 +21,59 @@ public:
 	virtual bool Show(bool show = true);
 
 protected:
+	enum : size_t
+	{
+		max_lines = 10000,
+		max_chars = 2000000
+	};
+
+	// Only the visible lines get drawn
+	CLogBuffer m_lines{max_lines, max_chars};
+	CLogView *m_pView{};
+
+	// Number of dropped lines when the view last got updated
+	uint64_t m_viewDropped{};
+
+	// Lines get added to the view once per event loop iteration
+	void UpdateView();
+	bool m_updatePending{};
+
+	void DrawLine(wxDC& dc, const wxRect& rect, size_t line, bool selected) const;
+	wxCoord MeasureLine(size_t line) const;
+
+	// Splits the message into the rows it gets drawn in, given by the
+	// offsets of their first and past their last character. Rows end at
+	// line breaks or wherever needed to fit the width.
+	void WrapLine(wxDC& dc, size_t line, int width, std::vector<std::pair<size_t, size_t>>& rows) const;
+	wxString FormatLine(size_t line) const;
 
-	int m_nLineCount{};
-	wxString m_Content;
-	CFastTextCtrl *m_pTextCtrl{};
+	void Find(bool again);
+	wxString m_searchText;
 
 	DECLARE_EVENT_TABLE()
 	void OnSize(wxSizeEvent &);
 	void OnContextMenu(wxContextMenuEvent&);
+	void OnKeyDown(wxKeyEvent& event);
 	void OnClear(wxCommandEvent& );
 	void OnCopy(wxCommandEvent& );
-	void OnTimer(wxTimerEvent&);
-
-	std::list<int> m_lineLengths;
-	std::list<int> m_unusedLineLengths;
+	void OnFind(wxCommandEvent& );
 
 	struct t_attributeCache
 	{
 		wxString prefix;
-		int len;
-		wxTextAttr attr;
-#ifdef __WXMSW__
-		CHARFORMAT2 cf;
-#endif
+		wxColour colour;
 	} m_attributeCache[static_cast<int>(MessageType::count)];
 
+	int m_timestampWidth{};
+	int m_prefixWidth{};
+	int m_lineHeight{};
+
 	bool m_rtl{};
 
+	// Don't update the view while hidden, do it once showing it.
 	bool m_shown{};
 
-	// Don't update actual log window if not shown,
-	// do it later when showing the window.
-	struct t_line
-	{
-		MessageType messagetype;
-		wxString message;
-		wxDateTime time;
-	};
-	std::list<t_line> m_hiddenLines;
-
 	bool m_showTimestamps{};
-	wxDateTime m_lastTime;
-	wxString m_lastTimeString;
 };
 
 #endif
-
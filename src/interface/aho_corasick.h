@@ -0,0 +1,199 @@
+#ifndef FZ_AHO_CORASICK_HEADER
+#define FZ_AHO_CORASICK_HEADER
+
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+Finds out which of a set of patterns occur in a string, scanning the string
+only once no matter how many patterns there are.
+
+The patterns are compiled into an Aho-Corasick automaton. Transitions on ASCII
+characters are precomputed into full tables, so that the common case costs a
+single lookup per character. Other characters are looked up in sorted lists,
+following the failure links.
+*/
+
+template<typename Char>
+class CAhoCorasick final
+{
+public:
+	typedef std::basic_string<Char> string_type;
+
+	CAhoCorasick() = default;
+
+	explicit CAhoCorasick(std::vector<string_type> const& patterns)
+		: patterns_(patterns.size())
+	{
+		nodes_.emplace_back();
+		for (size_t i = 0; i < patterns.size(); ++i) {
+			insert(patterns[i], i);
+		}
+		build();
+	}
+
+	// Number of patterns
+	size_t size() const { return patterns_; }
+	bool empty() const { return !patterns_; }
+
+	// Sets found[i] for every pattern i occurring in the given string. Does
+	// not reset the other elements, found needs to hold at least size()
+	// elements.
+	template<typename Found>
+	void find(Char const* s, size_t len, Found& found) const
+	{
+		if (nodes_.empty()) {
+			return;
+		}
+
+		for (auto const& p : nodes_[0].out) {
+			found[p] = true;
+		}
+
+		int state = 0;
+		for (size_t i = 0; i < len; ++i) {
+			state = next(state, s[i]);
+			for (auto const& p : nodes_[state].out) {
+				found[p] = true;
+			}
+		}
+	}
+
+private:
+	static size_t const ascii = 128;
+
+	struct node
+	{
+		node()
+		{
+			std::fill(std::begin(next), std::end(next), -1);
+		}
+
+		// Complete transitions on ASCII characters once built
+		int next[ascii];
+
+		// Children on other characters, sorted
+		std::vector<std::pair<Char, int>> other;
+
+		int fail{};
+
+		// Patterns ending here, including those reached through failure links
+		std::vector<size_t> out;
+	};
+
+	static bool is_ascii(Char c)
+	{
+		return static_cast<typename std::make_unsigned<Char>::type>(c) < ascii;
+	}
+
+	int child(int n, Char c) const
+	{
+		auto const& other = nodes_[n].other;
+		auto it = std::lower_bound(other.begin(), other.end(), c, [](std::pair<Char, int> const& e, Char c) { return e.first < c; });
+		if (it != other.end() && it->first == c) {
+			return it->second;
+		}
+		return -1;
+	}
+
+	int next(int state, Char c) const
+	{
+		if (is_ascii(c)) {
+			return nodes_[state].next[static_cast<size_t>(c)];
+		}
+
+		for (;;) {
+			int const n = child(state, c);
+			if (n != -1) {
+				return n;
+			}
+			if (!state) {
+				return 0;
+			}
+			state = nodes_[state].fail;
+		}
+	}
+
+	void insert(string_type const& pattern, size_t id)
+	{
+		int n = 0;
+		for (auto const& c : pattern) {
+			int m;
+			if (is_ascii(c)) {
+				m = nodes_[n].next[static_cast<size_t>(c)];
+				if (m == -1) {
+					m = static_cast<int>(nodes_.size());
+					nodes_[n].next[static_cast<size_t>(c)] = m;
+					nodes_.emplace_back();
+				}
+			}
+			else {
+				m = child(n, c);
+				if (m == -1) {
+					m = static_cast<int>(nodes_.size());
+					auto& other = nodes_[n].other;
+					auto it = std::lower_bound(other.begin(), other.end(), c, [](std::pair<Char, int> const& e, Char c) { return e.first < c; });
+					other.insert(it, std::make_pair(c, m));
+					nodes_.emplace_back();
+				}
+			}
+			n = m;
+		}
+		nodes_[n].out.push_back(id);
+	}
+
+	// Computes failure links and completes the ASCII transitions, visiting
+	// nodes in breadth-first order so that the failure target of each node
+	// is complete by the time the node is visited.
+	void build()
+	{
+		std::deque<int> pending;
+
+		for (size_t c = 0; c < ascii; ++c) {
+			int& n = nodes_[0].next[c];
+			if (n == -1) {
+				n = 0;
+			}
+			else {
+				pending.push_back(n);
+			}
+		}
+		for (auto const& e : nodes_[0].other) {
+			pending.push_back(e.second);
+		}
+
+		while (!pending.empty()) {
+			int const n = pending.front();
+			pending.pop_front();
+
+			int const fail = nodes_[n].fail;
+			auto const& failOut = nodes_[fail].out;
+			nodes_[n].out.insert(nodes_[n].out.end(), failOut.begin(), failOut.end());
+
+			for (size_t c = 0; c < ascii; ++c) {
+				int const m = nodes_[n].next[c];
+				if (m == -1) {
+					nodes_[n].next[c] = nodes_[fail].next[c];
+				}
+				else {
+					nodes_[m].fail = nodes_[fail].next[c];
+					pending.push_back(m);
+				}
+			}
+			for (auto const& e : nodes_[n].other) {
+				nodes_[e.second].fail = next(fail, e.first);
+				pending.push_back(e.second);
+			}
+		}
+	}
+
+	std::vector<node> nodes_;
+	size_t patterns_{};
+};
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef FZ_COMPARISON_KEYS_HEADER
+#define FZ_COMPARISON_KEYS_HEADER
+
+#include "sort_keys.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*
+Precomputed keys to match the entries of two directory listings against each
+other.
+
+Each name is transformed once into a key made up of its class (the parent
+directory first, then directories, then files), its sort key and the name it
+is matched by. Both listings get sorted by their keys independently of how
+they are shown, entries with equal keys match. Matching is then a single
+linear merge.
+
+Adding the names is cheap. The expensive part, building and sorting the keys,
+is done by prepare(), which can be run for both listings at the same time on
+separate threads. Listings that didn't change can be matched again without
+preparing them again.
+*/
+
+class CComparisonKeys final
+{
+public:
+	CComparisonKeys() = default;
+
+	// Names are matched exactly, or ignoring case unless caseSensitive is
+	// set. Matching entries are ordered by sortMode, directories go first
+	// if dirsFirst is set.
+	void reset(CNameSortKeys::mode sortMode, bool caseSensitive, bool dirsFirst)
+	{
+		if (!caseSensitive && sortMode == CNameSortKeys::case_sensitive) {
+			// Names equal but for case need equal sort keys
+			sortMode = CNameSortKeys::case_insensitive;
+		}
+		sortMode_ = sortMode;
+		caseSensitive_ = caseSensitive;
+		dirsFirst_ = dirsFirst;
+
+		clear();
+	}
+
+	void clear()
+	{
+		names_.clear();
+		entries_.clear();
+		keys_.clear();
+		order_.clear();
+		prepared_ = false;
+	}
+
+	bool same_options(CComparisonKeys const& other) const
+	{
+		return sortMode_ == other.sortMode_ && caseSensitive_ == other.caseSensitive_ && dirsFirst_ == other.dirsFirst_;
+	}
+
+	size_t size() const { return entries_.size(); }
+
+	void push_back(wchar_t const* name, size_t len, bool dir)
+	{
+		entry e;
+		e.nameOffset = names_.size();
+		e.nameLength = len;
+		e.dir = dir;
+		names_.append(name, len);
+		entries_.push_back(e);
+
+		prepared_ = false;
+	}
+
+	void push_back(std::wstring const& name, bool dir)
+	{
+		push_back(name.c_str(), name.size(), dir);
+	}
+
+	bool prepared() const { return prepared_; }
+
+	void prepare()
+	{
+		if (prepared_) {
+			return;
+		}
+
+		keys_.clear();
+		order_.resize(entries_.size());
+		for (size_t i = 0; i < entries_.size(); ++i) {
+			entry& e = entries_[i];
+			wchar_t const* name = names_.data() + e.nameOffset;
+
+			e.keyOffset = keys_.size();
+			if (e.nameLength == 2 && name[0] == '.' && name[1] == '.') {
+				keys_ += static_cast<wchar_t>(class_parent);
+			}
+			else if (e.dir && dirsFirst_) {
+				keys_ += static_cast<wchar_t>(class_dir);
+			}
+			else {
+				keys_ += static_cast<wchar_t>(class_file);
+			}
+
+			CNameSortKeys::append_key(keys_, name, e.nameLength, sortMode_);
+			if (sortMode_ != (caseSensitive_ ? CNameSortKeys::case_sensitive : CNameSortKeys::case_insensitive)) {
+				// The sort key alone might be equal for names that don't match
+				keys_ += static_cast<wchar_t>(0);
+				CNameSortKeys::append_key(keys_, name, e.nameLength, caseSensitive_ ? CNameSortKeys::case_sensitive : CNameSortKeys::case_insensitive);
+			}
+			e.keyLength = keys_.size() - e.keyOffset;
+
+			order_[i] = i;
+		}
+
+		// Listings often are in order already
+		auto const less = [this](size_t a, size_t b) { return compare(*this, a, *this, b) < 0; };
+		if (!std::is_sorted(order_.begin(), order_.end(), less)) {
+			std::stable_sort(order_.begin(), order_.end(), less);
+		}
+
+		prepared_ = true;
+	}
+
+	// Calls f(left, right) for all entries of both prepared listings, in the
+	// order of their keys. The arguments are the indexes the entries got
+	// added at, or -1 if the entry has no match in the other listing.
+	template<typename F>
+	static void match(CComparisonKeys const& left, CComparisonKeys const& right, F && f)
+	{
+		size_t l = 0;
+		size_t r = 0;
+		while (l < left.order_.size() && r < right.order_.size()) {
+			size_t const a = left.order_[l];
+			size_t const b = right.order_[r];
+			int const cmp = compare(left, a, right, b);
+			if (!cmp) {
+				f(static_cast<int>(a), static_cast<int>(b));
+				++l;
+				++r;
+			}
+			else if (cmp < 0) {
+				f(static_cast<int>(a), -1);
+				++l;
+			}
+			else {
+				f(-1, static_cast<int>(b));
+				++r;
+			}
+		}
+		for (; l < left.order_.size(); ++l) {
+			f(static_cast<int>(left.order_[l]), -1);
+		}
+		for (; r < right.order_.size(); ++r) {
+			f(-1, static_cast<int>(right.order_[r]));
+		}
+	}
+
+private:
+	enum : wchar_t
+	{
+		class_parent = 1,
+		class_dir,
+		class_file
+	};
+
+	struct entry
+	{
+		size_t nameOffset{};
+		size_t nameLength{};
+		size_t keyOffset{};
+		size_t keyLength{};
+		bool dir{};
+	};
+
+	static int compare(CComparisonKeys const& ka, size_t a, CComparisonKeys const& kb, size_t b)
+	{
+		entry const& ea = ka.entries_[a];
+		entry const& eb = kb.entries_[b];
+		wchar_t const* pa = ka.keys_.data() + ea.keyOffset;
+		wchar_t const* pb = kb.keys_.data() + eb.keyOffset;
+
+		size_t const len = std::min(ea.keyLength, eb.keyLength);
+		for (size_t i = 0; i < len; ++i) {
+			uint32_t const ca = static_cast<uint32_t>(pa[i]);
+			uint32_t const cb = static_cast<uint32_t>(pb[i]);
+			if (ca != cb) {
+				return ca < cb ? -1 : 1;
+			}
+		}
+		if (ea.keyLength != eb.keyLength) {
+			return ea.keyLength < eb.keyLength ? -1 : 1;
+		}
+		return 0;
+	}
+
+	CNameSortKeys::mode sortMode_{CNameSortKeys::case_insensitive};
+	bool caseSensitive_{true};
+	bool dirsFirst_{true};
+
+	std::wstring names_;
+	std::vector<entry> entries_;
+
+	std::wstring keys_;
+	std::vector<size_t> order_;
+	bool prepared_{};
+};
+
+#endif
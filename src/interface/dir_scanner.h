@@ -0,0 +1,213 @@
+#ifndef __DIR_SCANNER_H__
+#define __DIR_SCANNER_H__
+
+#include <local_path.h>
+#include <mutex.h>
+
+#include <wx/thread.h>
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+
+// Reads directories in the background ahead of the time they are needed, so
+// that walking a tree doesn't wait for the disk at every directory.
+//
+// Only the directories named in the last call to Prefetch are kept, which
+// bounds the memory needed regardless of the size of the tree. The thread
+// gets started by the first call to Prefetch.
+//
+// How directories are read is up to the reader, which gets called on the
+// thread of the scanner as well as on the thread calling Get. It should
+// give up once cancelled returns true, the scanner is being destroyed then.
+
+template<typename Entry>
+class CDirScanner
+{
+public:
+	typedef std::function<bool(CLocalPath const& path, std::vector<Entry>& entries, std::function<bool()> const& cancelled)> reader;
+
+	explicit CDirScanner(reader const& read)
+		: m_read(read)
+	{}
+
+	virtual ~CDirScanner()
+	{
+		if (!m_thread)
+			return;
+
+		{
+			scoped_lock l(m_sync);
+			m_quit = true;
+			m_work.signal(l);
+		}
+		m_thread->Wait(wxTHREAD_WAIT_BLOCK);
+	}
+
+	CDirScanner(CDirScanner const&) = delete;
+	CDirScanner& operator=(CDirScanner const&) = delete;
+
+	// The directories likely needed next, the first one first. Directories
+	// of earlier calls not named anymore are dropped.
+	void Prefetch(std::vector<CLocalPath> const& paths)
+	{
+		if (!m_thread && !m_threadFailed) {
+			m_thread.reset(new worker(*this));
+			if (m_thread->Create() != wxTHREAD_NO_ERROR || m_thread->Run() != wxTHREAD_NO_ERROR) {
+				m_thread.reset();
+				m_threadFailed = true;
+			}
+		}
+		if (!m_thread)
+			return;
+
+		scoped_lock l(m_sync);
+
+		std::list<t_dir> dirs;
+		for (auto const& path : paths) {
+			auto it = m_dirs.begin();
+			while (it != m_dirs.end() && it->path.GetPath() != path.GetPath())
+				++it;
+
+			if (it != m_dirs.end())
+				dirs.splice(dirs.end(), m_dirs, it);
+			else {
+				dirs.push_back(t_dir());
+				dirs.back().path = path;
+			}
+		}
+		m_dirs.swap(dirs);
+
+		m_work.signal(l);
+	}
+
+	// Gets the entries of the directory. Waits for it if it is being read in
+	// the background, reads it right away unless already done or started.
+	// Returns false if it cannot be read.
+	bool Get(CLocalPath const& path, std::vector<Entry>& entries)
+	{
+		entries.clear();
+
+		if (m_thread) {
+			scoped_lock l(m_sync);
+			for (;;) {
+				auto it = m_dirs.begin();
+				while (it != m_dirs.end() && it->path.GetPath() != path.GetPath())
+					++it;
+
+				if (it != m_dirs.end() && it->done) {
+					bool const ok = it->ok;
+					entries.swap(it->entries);
+					m_dirs.erase(it);
+					return ok;
+				}
+
+				if (m_reading != path.GetPath()) {
+					// Not started yet, quicker to read it here than to wait
+					if (it != m_dirs.end())
+						m_dirs.erase(it);
+					break;
+				}
+
+				m_done.wait(l);
+			}
+		}
+
+		return m_read(path, entries, [this]() { return Quitting(); });
+	}
+
+private:
+	// Not derived from wxThread, the thread only needs what's in here
+	class worker final : public wxThread
+	{
+	public:
+		explicit worker(CDirScanner& owner)
+			: wxThread(wxTHREAD_JOINABLE)
+			, m_owner(owner)
+		{}
+
+	protected:
+		virtual ExitCode Entry()
+		{
+			m_owner.Run();
+			return 0;
+		}
+
+		CDirScanner& m_owner;
+	};
+
+	struct t_dir
+	{
+		CLocalPath path;
+		bool done{};
+		bool ok{};
+		std::vector<Entry> entries;
+	};
+
+	bool Quitting()
+	{
+		scoped_lock l(m_sync);
+		return m_quit;
+	}
+
+	void Run()
+	{
+		for (;;) {
+			CLocalPath path;
+			{
+				scoped_lock l(m_sync);
+				for (;;) {
+					if (m_quit)
+						return;
+
+					auto it = m_dirs.begin();
+					while (it != m_dirs.end() && it->done)
+						++it;
+					if (it != m_dirs.end()) {
+						path = it->path;
+						m_reading = path.GetPath();
+						break;
+					}
+
+					m_work.wait(l);
+				}
+			}
+
+			std::vector<Entry> entries;
+			bool const ok = m_read(path, entries, [this]() { return Quitting(); });
+
+			scoped_lock l(m_sync);
+			m_reading.clear();
+
+			// Might not be wanted anymore
+			for (auto& dir : m_dirs) {
+				if (!dir.done && dir.path.GetPath() == path.GetPath()) {
+					dir.done = true;
+					dir.ok = ok;
+					dir.entries.swap(entries);
+					break;
+				}
+			}
+
+			m_done.signal(l);
+		}
+	}
+
+	reader const m_read;
+
+	std::unique_ptr<worker> m_thread;
+	bool m_threadFailed{};
+
+	mutex m_sync{false};
+	condition m_work;
+	condition m_done;
+	bool m_quit{};
+
+	std::list<t_dir> m_dirs;
+
+	// The directory the thread is reading at the moment, if any
+	wxString m_reading;
+};
+
+#endif //__DIR_SCANNER_H__
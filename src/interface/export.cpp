@@ -4,6 +4,9 @@
 #include "xmlfunctions.h"
 #include "ipcmutex.h"
 #include "queue.h"
+#include "xml_stream.h"
+
+#include <wx/ffile.h>
 
 CExportDialog::CExportDialog(wxWindow* parent, CQueueView* pQueueView)
 	: m_parent(parent), m_pQueueView(pQueueView)
@@ -44,9 +47,15 @@ void CExportDialog::Run()
 	if (dlg.ShowModal() != wxID_OK)
 		return;
 
-	CXmlFile xml(dlg.GetPath());
+	// The queue can be huge, write the file as a stream so that it never
+	// needs to be held in memory as a whole
+	wxFFile f(dlg.GetPath(), _T("w"));
+	if (!f.IsOpened())
+		return;
 
-	TiXmlElement* exportRoot = xml.CreateEmpty();
+	CXmlStreamWriter writer(f.fp());
+	writer.declaration();
+	writer.start("FileZilla3");
 
 	if (sitemanager) {
 		CInterProcessMutex mutex(MUTEX_SITEMANAGER);
@@ -56,7 +65,7 @@ void CExportDialog::Run()
 		if (pDocument) {
 			TiXmlElement* pElement = pDocument->FirstChildElement("Servers");
 			if (pElement)
-				exportRoot->InsertEndChild(*pElement);
+				WriteElement(writer, *pElement);
 		}
 	}
 	if (settings) {
@@ -66,13 +75,18 @@ void CExportDialog::Run()
 		if (pDocument) {
 			TiXmlElement* pElement = pDocument->FirstChildElement("Settings");
 			if (pElement)
-				exportRoot->InsertEndChild(*pElement);
+				WriteElement(writer, *pElement);
 		}
 	}
 
 	if (queue) {
-		m_pQueueView->WriteToFile(exportRoot);
+		m_pQueueView->WriteToFile(writer);
 	}
 
-	xml.Save(true);
+	writer.finish();
+
+	if (writer.error() || !f.Close()) {
+		wxString msg = wxString::Format(_("Could not write \"%s\":"), dlg.GetPath());
+		wxMessageBoxEx(msg + _T("\n") + _("Failed to write xml file"), _("Error writing xml file"), wxICON_ERROR);
+	}
 }
@@ -0,0 +1,90 @@
+#ifndef FZ_FENWICK_TREE_HEADER
+#define FZ_FENWICK_TREE_HEADER
+
+#include <vector>
+
+/*
+Binary indexed tree over a sequence of non-negative counts.
+
+Appending, changing a count, summing up a prefix of the sequence and finding
+the element containing a given offset all take logarithmic time.
+*/
+
+class CFenwickTree final
+{
+public:
+	size_t size() const { return tree_.size() - 1; }
+	bool empty() const { return size() == 0; }
+
+	void clear()
+	{
+		tree_.resize(1);
+	}
+
+	// Replaces the sequence in linear time
+	void assign(std::vector<int> const& counts)
+	{
+		size_t const n = counts.size();
+		tree_.assign(n + 1, 0);
+		for (size_t i = 1; i <= n; ++i) {
+			tree_[i] += counts[i - 1];
+			size_t const parent = i + lowbit(i);
+			if (parent <= n) {
+				tree_[parent] += tree_[i];
+			}
+		}
+	}
+
+	void push_back(int count)
+	{
+		size_t const i = tree_.size();
+		tree_.push_back(count + prefix(i - 1) - prefix(i - lowbit(i)));
+	}
+
+	void add(size_t index, int delta)
+	{
+		for (size_t i = index + 1; i < tree_.size(); i += lowbit(i)) {
+			tree_[i] += delta;
+		}
+	}
+
+	// Sum of the first n counts
+	int prefix(size_t n) const
+	{
+		int sum = 0;
+		for (; n; n -= lowbit(n)) {
+			sum += tree_[n];
+		}
+		return sum;
+	}
+
+	// Returns the index of the element covering the given offset, that is
+	// the smallest index with prefix(index + 1) > offset. Returns size() if
+	// offset is past the end. On return, offset is relative to the start of
+	// the element.
+	size_t find(int& offset) const
+	{
+		size_t const n = size();
+		size_t step = 1;
+		while (step * 2 <= n) {
+			step *= 2;
+		}
+
+		size_t pos = 0;
+		for (; step; step /= 2) {
+			if (pos + step <= n && tree_[pos + step] <= offset) {
+				pos += step;
+				offset -= tree_[pos];
+			}
+		}
+		return pos;
+	}
+
+private:
+	static size_t lowbit(size_t i) { return i & (~i + 1); }
+
+	// One-based, tree_[0] is unused
+	std::vector<int> tree_ = std::vector<int>(1);
+};
+
+#endif
@@ -7,7 +7,10 @@
 #include "Options.h"
 #include "conditionaldialog.h"
 #include <algorithm>
+#include <deque>
 #include "filelist_statusbar.h"
+#include "Mainfrm.h"
+#include "StatusView.h"
 #if defined(__WXGTK__) && !defined(__WXGTK3__)
 #include <gtk/gtk.h>
 #endif
@@ -230,12 +233,13 @@ static gboolean gtk_button_release_event(GtkWidget*, void *gdk_event, CGtkEventC
 }
 #endif
 
-template<class CFileData> CFileListCtrl<CFileData>::CFileListCtrl(wxWindow* pParent, CState*, CQueueView* pQueue, bool border /*=false*/)
+template<class CFileData> CFileListCtrl<CFileData>::CFileListCtrl(wxWindow* pParent, CState* pState, CQueueView* pQueue, bool border /*=false*/)
 : wxListCtrlEx(pParent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTAB_TRAVERSAL | wxLC_VIRTUAL | wxLC_REPORT | wxLC_EDIT_LABELS | (border ? wxBORDER_SUNKEN : wxNO_BORDER)),
 	CComparableListing(this)
 {
 	CreateSystemImageList(16);
 	m_pQueue = pQueue;
+	m_pFilelistState = pState;
 
 	m_sortColumn = 0;
 	m_sortDirection = 0;
@@ -275,6 +279,70 @@ template<class CFileData> CFileListCtrl<CFileData>::~CFileListCtrl()
 {
 }
 
+namespace {
+// Sorts part of the index mapping in the background
+template<typename Compare>
+class CSortThread final : public wxThread
+{
+public:
+	CSortThread(std::vector<unsigned int>::iterator begin, std::vector<unsigned int>::iterator end, Compare const& compare)
+		: wxThread(wxTHREAD_JOINABLE)
+		, m_begin(begin), m_end(end), m_compare(compare)
+	{
+	}
+
+protected:
+	virtual ExitCode Entry()
+	{
+		std::sort(m_begin, m_end, m_compare);
+		return 0;
+	}
+
+	std::vector<unsigned int>::iterator const m_begin;
+	std::vector<unsigned int>::iterator const m_end;
+	Compare m_compare;
+};
+
+// Below this, starting the threads costs more than they save
+unsigned int const parallelSortThreshold = 50000;
+
+// Sorts large ranges in parallel parts which then get merged
+template<typename Compare>
+void ParallelSort(std::vector<unsigned int>::iterator begin, std::vector<unsigned int>::iterator end, Compare const& compare)
+{
+	size_t const size = end - begin;
+	size_t parts = std::min(4, std::max(1, wxThread::GetCPUCount()));
+	if (size < parallelSortThreshold || parts < 2) {
+		std::sort(begin, end, compare);
+		return;
+	}
+
+	std::vector<std::vector<unsigned int>::iterator> bounds;
+	for (size_t i = 0; i <= parts; ++i)
+		bounds.push_back(begin + size * i / parts);
+
+	std::vector<CSortThread<Compare>*> threads;
+	for (size_t i = 1; i < parts; ++i) {
+		auto thread = new CSortThread<Compare>(bounds[i], bounds[i + 1], compare);
+		if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR) {
+			delete thread;
+			std::sort(bounds[i], bounds[i + 1], compare);
+		}
+		else
+			threads.push_back(thread);
+	}
+	std::sort(bounds[0], bounds[1], compare);
+
+	for (auto thread : threads) {
+		thread->Wait(wxTHREAD_WAIT_BLOCK);
+		delete thread;
+	}
+
+	for (size_t i = 2; i <= parts; ++i)
+		std::inplace_merge(begin, bounds[i - 1], bounds[i], compare);
+}
+}
+
 template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=-1*/, int direction /*=-1*/, bool updateSelections /*=true*/)
 {
 	CancelLabelEdit();
@@ -362,7 +430,7 @@ template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=
 	if (m_hasParent)
 		++start;
 	CSortComparisonObject object = GetSortComparisonObject();
-	std::sort(start, m_indexMapping.end(), object);
+	ParallelSort(start, m_indexMapping.end(), object);
 	object.Destroy();
 
 	if (updateSelections)
@@ -372,6 +440,112 @@ template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=
 	}
 }
 
+template<class CFileData> void CFileListCtrl<CFileData>::InsertSorted(std::vector<unsigned int> indexes)
+{
+	if (indexes.empty())
+		return;
+
+	const unsigned int first = m_hasParent ? 1 : 0;
+	if (m_indexMapping.size() < first)
+		return;
+
+	CSortComparisonObject compare = GetSortComparisonObject();
+	std::sort(indexes.begin(), indexes.end(), compare);
+
+	// Merge in a single pass, remembering the new positions of the added
+	// entries
+	std::vector<unsigned int> mapping;
+	mapping.reserve(m_indexMapping.size() + indexes.size());
+	mapping.insert(mapping.end(), m_indexMapping.begin(), m_indexMapping.begin() + first);
+
+	std::vector<unsigned int> added;
+	added.reserve(indexes.size());
+
+	auto it = m_indexMapping.cbegin() + first;
+	for (auto const& index : indexes) {
+		while (it != m_indexMapping.cend() && !compare(index, *it))
+			mapping.push_back(*it++);
+		added.push_back(mapping.size());
+		mapping.push_back(index);
+	}
+	mapping.insert(mapping.end(), it, m_indexMapping.cend());
+	compare.Destroy();
+
+	m_indexMapping.swap(mapping);
+
+	SetItemCount(m_indexMapping.size());
+
+#ifndef __WXMSW__
+	// GetSelectedItemCount() is O(1)
+	if (!GetSelectedItemCount())
+		return;
+#endif
+
+	// Items after an added one move down, their selection with them
+	std::deque<bool> selected;
+	auto next = added.cbegin();
+	for (unsigned int i = added.front(); i < m_indexMapping.size(); ++i) {
+		if (next != added.cend() && i == *next) {
+			selected.push_front(false);
+			++next;
+		}
+		bool is_selected = GetItemState(i, wxLIST_STATE_SELECTED) != 0;
+		selected.push_back(is_selected);
+
+		bool should_selected = selected.front();
+		selected.pop_front();
+		if (is_selected != should_selected)
+			SetSelection(i, should_selected);
+	}
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::StartResolvingIcons()
+{
+	if (!m_resolvingIcons) {
+		m_resolvingIcons = true;
+		CallAfter(&CFileListCtrl<CFileData>::ResolveIcons);
+	}
+}
+
+template<class CFileData> int CFileListCtrl<CFileData>::GetFileIconIndex(const wxString& fileName, bool physical, bool symlink, bool& placeholder)
+{
+	int const icon = GetCachedIconIndex(fileName, physical, symlink, placeholder);
+	if (!placeholder)
+		return icon;
+
+	m_placeholderIcons = true;
+	StartResolvingIcons();
+
+	return GetIconIndex(iconType::file, _T(""), false, symlink);
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::ResolveIcons()
+{
+	bool const more = ResolvePendingIcons(10);
+
+	// Displayed icons get looked up first, so they should be known by now
+	if (m_placeholderIcons) {
+		m_placeholderIcons = false;
+		RefreshListOnly(false);
+	}
+
+	if (more) {
+		CallAfter(&CFileListCtrl<CFileData>::ResolveIcons);
+		return;
+	}
+	m_resolvingIcons = false;
+
+	if (!COptions::Get()->GetOptionVal(OPTION_LOGGING_DEBUGLEVEL) || !m_pFilelistState)
+		return;
+
+	// Debug messages are not translated
+	CSystemImageList::iconCacheStats const stats = GetIconCacheStats();
+	wxString const msg = wxString::Format(_T("Icon cache: %lu extensions, %lu hits, %lu looked up ahead, %lu looked up when needed."),
+		static_cast<unsigned long>(stats.extensions), static_cast<unsigned long>(stats.hits),
+		static_cast<unsigned long>(stats.resolved), static_cast<unsigned long>(stats.misses));
+	m_pFilelistState->GetMainFrame()->GetStatusView()->AddToLog(MessageType::Debug_Info, msg, wxDateTime::Now());
+}
+
 template<class CFileData> void CFileListCtrl<CFileData>::SortList_UpdateSelections(bool* selections, int focus)
 {
 	for (unsigned int i = m_hasParent ? 1 : 0; i < m_indexMapping.size(); i++)
@@ -625,7 +799,7 @@ template<class CFileData> void CFileListCtrl<CFileData>::OnExitComparisonMode()
 	RefreshListOnly();
 }
 
-template<class CFileData> void CFileListCtrl<CFileData>::CompareAddFile(t_fileEntryFlags flags)
+template<class CFileData> void CFileListCtrl<CFileData>::CompareAddFile(t_fileEntryFlags flags, int index)
 {
 	if (flags == fill)
 	{
@@ -633,10 +807,10 @@ template<class CFileData> void CFileListCtrl<CFileData>::CompareAddFile(t_fileEn
 		return;
 	}
 
-	int index = m_originalIndexMapping[m_comparisonIndex];
-	m_fileData[index].comparison_flags = flags;
+	int const dataIndex = m_originalIndexMapping[index];
+	m_fileData[dataIndex].comparison_flags = flags;
 
-	m_indexMapping.push_back(index);
+	m_indexMapping.push_back(dataIndex);
 }
 
 template<class CFileData> void CFileListCtrl<CFileData>::ComparisonRememberSelections()
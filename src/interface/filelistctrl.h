@@ -4,6 +4,7 @@
 #include "listctrlex.h"
 #include "systemimagelist.h"
 #include "listingcomparison.h"
+#include "sort_keys.h"
 
 #include <memory>
 
@@ -136,10 +137,30 @@ public:
 			return &CFileListCtrlSortBase::CmpNatural;
 		}
 	}
+
+	static CNameSortKeys::mode GetSortKeysMode(NameSortMode mode)
+	{
+		switch (mode)
+		{
+		default:
+		case CFileListCtrlSortBase::namesort_caseinsensitive:
+			return CNameSortKeys::case_insensitive;
+		case CFileListCtrlSortBase::namesort_casesensitive:
+			return CNameSortKeys::case_sensitive;
+		case CFileListCtrlSortBase::namesort_natural:
+			return CNameSortKeys::natural;
+		}
+	}
 };
 
+template<class CFileData> class CFileListCtrl;
+
 // Helper classes for fast sorting using std::sort
 // -----------------------------------------------
+//
+// Names are compared through the sort keys of the list control, which get
+// brought up to date with the listing on construction. Once constructed,
+// the helpers don't modify anything and can be used from multiple threads.
 
 template<typename Listing>
 class CFileListCtrlSort : public CFileListCtrlSortBase
@@ -148,9 +169,22 @@ public:
 	typedef Listing List;
 	typedef typename Listing::value_type value_type;
 
-	CFileListCtrlSort(Listing const& listing, enum DirSortMode dirSortMode, enum NameSortMode nameSortMode)
-		: m_listing(listing), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
+	template<typename DataEntry>
+	CFileListCtrlSort(Listing const& listing, enum DirSortMode dirSortMode, enum NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
+		: m_listing(listing), m_keys(pListView->m_sortKeys), m_dirSortMode(dirSortMode), m_nameSortMode(nameSortMode)
 	{
+		CNameSortKeys& keys = pListView->m_sortKeys;
+
+		// Entries only ever get appended to a listing without clearing the
+		// keys. Keys of entries that got removed have been erased as well.
+		size_t const count = GetCount(listing);
+		CNameSortKeys::mode const mode = GetSortKeysMode(nameSortMode);
+		if (keys.get_mode() != mode || keys.size() > count)
+			keys.clear(mode);
+		for (size_t i = keys.size(); i < count; ++i) {
+			wxString const& name = listing[i].name;
+			keys.push_back(name.wc_str(), name.size());
+		}
 	}
 
 	inline int CmpDir(value_type const& data1, value_type const& data2) const
@@ -189,20 +223,9 @@ public:
 		}
 	}
 
-	inline int CmpName(const value_type &data1, const value_type &data2) const
+	inline int CmpName(int a, int b) const
 	{
-		switch (m_nameSortMode)
-		{
-		case namesort_casesensitive:
-			return CmpCase(data1.name, data2.name);
-
-		default:
-		case namesort_caseinsensitive:
-			return CmpNoCase(data1.name, data2.name);
-
-		case namesort_natural:
-			return CmpNatural(data1.name, data2.name);
-		}
+		return m_keys.compare(a, b);
 	}
 
 	inline int CmpSize(const value_type &data1, const value_type &data2) const
@@ -235,14 +258,17 @@ public:
 	}
 
 protected:
+	static size_t GetCount(CDirectoryListing const& listing) { return listing.GetCount(); }
+	template<typename T>
+	static size_t GetCount(std::vector<T> const& listing) { return listing.size(); }
+
 	Listing const& m_listing;
+	CNameSortKeys const& m_keys;
 
 	const enum DirSortMode m_dirSortMode;
 	const enum NameSortMode m_nameSortMode;
 };
 
-template<class CFileData> class CFileListCtrl;
-
 template<class T, typename DataEntry> class CReverseSort : public T
 {
 public:
@@ -261,8 +287,8 @@ template<typename Listing, typename DataEntry>
 class CFileListCtrlSortName : public CFileListCtrlSort<Listing>
 {
 public:
-	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortName(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
+		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode, pListView)
 	{
 	}
 
@@ -273,7 +299,7 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
@@ -281,8 +307,8 @@ template<typename Listing, typename DataEntry>
 class CFileListCtrlSortSize : public CFileListCtrlSort<Listing>
 {
 public:
-	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortSize(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
+		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode, pListView)
 	{
 	}
 
@@ -295,7 +321,7 @@ public:
 
 		CMP(CmpSize, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
@@ -304,8 +330,15 @@ class CFileListCtrlSortType : public CFileListCtrlSort<Listing>
 {
 public:
 	CFileListCtrlSortType(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode), m_pListView(pListView), m_fileData(fileData)
+		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode, pListView), m_fileData(fileData)
 	{
+		// Look up all types up front instead of while sorting
+		size_t const count = std::min(this->GetCount(listing), fileData.size());
+		for (size_t i = 0; i < count; ++i) {
+			DataEntry& data = fileData[i];
+			if (data.fileType.empty() && data.comparison_flags != CComparableListing::fill)
+				data.fileType = pListView->GetType(listing[i].name, listing[i].is_dir());
+		}
 	}
 
 	bool operator()(int a, int b) const
@@ -315,29 +348,21 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		DataEntry &type1 = m_fileData[a];
-		DataEntry &type2 = m_fileData[b];
-		if (type1.fileType.empty())
-			type1.fileType = m_pListView->GetType(data1.name, data1.is_dir());
-		if (type2.fileType.empty())
-			type2.fileType = m_pListView->GetType(data2.name, data2.is_dir());
+		CMP(CmpStringNoCase, m_fileData[a].fileType, m_fileData[b].fileType);
 
-		CMP(CmpStringNoCase, type1.fileType, type2.fileType);
-
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 
 protected:
-	CFileListCtrl<DataEntry>* const m_pListView;
-	std::vector<DataEntry>& m_fileData;
+	std::vector<DataEntry> const& m_fileData;
 };
 
 template<typename Listing, typename DataEntry>
 class CFileListCtrlSortTime : public CFileListCtrlSort<Listing>
 {
 public:
-	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortTime(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
+		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode, pListView)
 	{
 	}
 
@@ -350,7 +375,7 @@ public:
 
 		CMP(CmpTime, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
@@ -358,8 +383,8 @@ template<typename Listing, typename DataEntry>
 class CFileListCtrlSortPermissions : public CFileListCtrlSort<Listing>
 {
 public:
-	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortPermissions(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
+		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode, pListView)
 	{
 	}
 
@@ -372,7 +397,7 @@ public:
 
 		CMP(CmpStringNoCase, *data1.permissions, *data2.permissions);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
@@ -380,8 +405,8 @@ template<typename Listing, typename DataEntry>
 class CFileListCtrlSortOwnerGroup : public CFileListCtrlSort<Listing>
 {
 public:
-	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortOwnerGroup(Listing const& listing, std::vector<DataEntry>&, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
+		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode, pListView)
 	{
 	}
 
@@ -394,7 +419,7 @@ public:
 
 		CMP(CmpStringNoCase, *data1.ownerGroup, *data2.ownerGroup);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 };
 
@@ -402,8 +427,8 @@ template<typename Listing, typename DataEntry>
 class CFileListCtrlSortPath : public CFileListCtrlSort<Listing>
 {
 public:
-	CFileListCtrlSortPath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const)
-		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode)
+	CFileListCtrlSortPath(Listing const& listing, std::vector<DataEntry>& fileData, CFileListCtrlSortBase::DirSortMode dirSortMode, CFileListCtrlSortBase::NameSortMode nameSortMode, CFileListCtrl<DataEntry>* const pListView)
+		: CFileListCtrlSort<Listing>(listing, dirSortMode, nameSortMode, pListView)
 		, m_fileData(fileData)
 	{
 	}
@@ -418,7 +443,7 @@ public:
 		if (this->m_listing[a].path != m_fileData[b].path)
 			return false;
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpName, a, b);
 	}
 	std::vector<DataEntry>& m_fileData;
 };
@@ -432,6 +457,7 @@ namespace genericTypes {
 
 template<class CFileData> class CFileListCtrl : public wxListCtrlEx, public CComparableListing
 {
+	template<typename Listing> friend class CFileListCtrlSort;
 	template<typename Listing, typename DataEntry> friend class CFileListCtrlSortType;
 public:
 	CFileListCtrl(wxWindow* pParent, CState *pState, CQueueView *pQueue, bool border = false);
@@ -472,6 +498,11 @@ protected:
 	std::vector<unsigned int> m_indexMapping;
 	std::vector<unsigned int> m_originalIndexMapping; // m_originalIndexMapping will only be set on comparisons
 
+	// Keys of the names in the listing, indexed like m_fileData. Has to be
+	// cleared whenever the listing gets replaced, entries removed from the
+	// listing need to be erased from it.
+	CNameSortKeys m_sortKeys;
+
 	virtual bool ItemIsDir(int index) const = 0;
 	virtual wxLongLong ItemGetSize(int index) const = 0;
 
@@ -485,6 +516,11 @@ protected:
 
 	void InitSort(int optionID); // Has to be called after initializing columns
 	void SortList(int column = -1, int direction = -1, bool updateSelections = true);
+
+	// Merges the given indexes into the sorted index mapping, moving the
+	// selections along. Cheaper than sorting everything again if only few
+	// entries got added.
+	void InsertSorted(std::vector<unsigned int> indexes);
 	enum CFileListCtrlSortBase::DirSortMode GetDirSortMode();
 	enum CFileListCtrlSortBase::NameSortMode GetNameSortMode();
 	virtual CSortComparisonObject GetSortComparisonObject() = 0;
@@ -496,7 +532,7 @@ protected:
 	virtual void ScrollTopItem(int item);
 	virtual void OnPostScroll();
 	virtual void OnExitComparisonMode();
-	virtual void CompareAddFile(t_fileEntryFlags flags);
+	virtual void CompareAddFile(t_fileEntryFlags flags, int index);
 
 	int m_comparisonIndex;
 
@@ -508,6 +544,13 @@ protected:
 
 	CFilelistStatusBar* m_pFilelistStatusBar;
 
+	// Icons of files are looked up a few at a time while the user interface
+	// is idle, ahead of being displayed, see QueueIconLookup. Until then the
+	// items show the generic file icon, placeholder gets set if the returned
+	// icon is that stand-in.
+	void StartResolvingIcons();
+	int GetFileIconIndex(const wxString& fileName, bool physical, bool symlink, bool& placeholder);
+
 #ifndef __WXMSW__
 	// Generic wxListCtrl does not support wxLIST_STATE_DROPHILITED, emulate it
 	wxListItemAttr m_dropHighlightAttribute;
@@ -526,6 +569,15 @@ protected:
 private:
 	void SortList_UpdateSelections(bool* selections, int focus);
 
+	void ResolveIcons();
+
+	CState* m_pFilelistState;
+
+	bool m_resolvingIcons{};
+
+	// Set if items showed the generic icon in place of one not looked up yet
+	bool m_placeholderIcons{};
+
 	// If this is set to true, don't process selection changed events
 	bool m_insideSetSelection;
 
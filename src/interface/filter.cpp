@@ -11,12 +11,18 @@
 #include "xmlfunctions.h"
 
 #include <wx/regex.h>
+#include <wx/stopwatch.h>
+
+#include <algorithm>
 
 bool CFilterManager::m_loaded = false;
 std::vector<CFilter> CFilterManager::m_globalFilters;
 std::vector<CFilterSet> CFilterManager::m_globalFilterSets;
 unsigned int CFilterManager::m_globalCurrentFilterSet = 0;
 bool CFilterManager::m_filters_disabled = false;
+CCompiledFilters CFilterManager::m_compiledLocalFilters;
+CCompiledFilters CFilterManager::m_compiledRemoteFilters;
+bool CFilterManager::m_compiled = false;
 
 BEGIN_EVENT_TABLE(CFilterDialog, wxDialogEx)
 EVT_BUTTON(XRCID("wxID_OK"), CFilterDialog::OnOkOrApply)
@@ -115,6 +121,7 @@ void CFilterDialog::OnOkOrApply(wxCommandEvent& event)
 	CompileRegexes();
 	m_globalFilterSets = m_filterSets;
 	m_globalCurrentFilterSet = m_currentFilterSet;
+	CompileFilters();
 
 	SaveFilters();
 
@@ -524,6 +531,9 @@ CFilterManager::CFilterManager()
 
 		m_globalFilterSets.push_back(set);
 	}
+
+	if (!m_compiled)
+		CompileFilters();
 }
 
 bool CFilterManager::HasActiveFilters(bool ignore_disabled /*=false*/)
@@ -573,25 +583,12 @@ bool CFilterManager::FilenameFiltered(const wxString& name, const wxString& path
 	if (m_filters_disabled)
 		return false;
 
-	wxASSERT(m_globalCurrentFilterSet < m_globalFilterSets.size());
+	wxASSERT(m_compiled);
 
-	const CFilterSet& set = m_globalFilterSets[m_globalCurrentFilterSet];
-
-	// Check active filters
-	for (unsigned int i = 0; i < m_globalFilters.size(); ++i) {
-		if (local) {
-			if (set.local[i])
-				if (FilenameFilteredByFilter(m_globalFilters[i], name, path, dir, size, attributes, date))
-					return true;
-		}
-		else {
-			if (set.remote[i])
-				if (FilenameFilteredByFilter(m_globalFilters[i], name, path, dir, size, attributes, date))
-					return true;
-		}
-	}
-
-	return false;
+	if (local)
+		return m_compiledLocalFilters.Filtered(name, path, dir, size, attributes, date);
+	else
+		return m_compiledRemoteFilters.Filtered(name, path, dir, size, attributes, date);
 }
 
 bool CFilterManager::FilenameFiltered(const std::list<CFilter> &filters, const wxString& name, const wxString& path, bool dir, wxLongLong size, bool local, int attributes, CDateTime const& date) const
@@ -604,6 +601,56 @@ bool CFilterManager::FilenameFiltered(const std::list<CFilter> &filters, const w
 	return false;
 }
 
+#ifdef __WXMSW__
+static int AttributeFlag(int condition)
+{
+	switch (condition)
+	{
+	case 0:
+		return FILE_ATTRIBUTE_ARCHIVE;
+	case 1:
+		return FILE_ATTRIBUTE_COMPRESSED;
+	case 2:
+		return FILE_ATTRIBUTE_ENCRYPTED;
+	case 3:
+		return FILE_ATTRIBUTE_HIDDEN;
+	case 4:
+		return FILE_ATTRIBUTE_READONLY;
+	case 5:
+		return FILE_ATTRIBUTE_SYSTEM;
+	default:
+		return 0;
+	}
+}
+#else
+static int PermissionFlag(int condition)
+{
+	switch (condition)
+	{
+	case 0:
+		return S_IRUSR;
+	case 1:
+		return S_IWUSR;
+	case 2:
+		return S_IXUSR;
+	case 3:
+		return S_IRGRP;
+	case 4:
+		return S_IWGRP;
+	case 5:
+		return S_IXGRP;
+	case 6:
+		return S_IROTH;
+	case 7:
+		return S_IWOTH;
+	case 8:
+		return S_IXOTH;
+	default:
+		return 0;
+	}
+}
+#endif
+
 static bool StringMatch(const wxString& subject, const wxString& filter, int condition, bool matchCase, std::shared_ptr<const wxRegEx> const& pRegEx)
 {
 	bool match = false;
@@ -727,30 +774,7 @@ bool CFilterManager::FilenameFilteredByFilter(const CFilter& filter, const wxStr
 				continue;
 
 			{
-				int flag = 0;
-				switch (condition.condition)
-				{
-				case 0:
-					flag = FILE_ATTRIBUTE_ARCHIVE;
-					break;
-				case 1:
-					flag = FILE_ATTRIBUTE_COMPRESSED;
-					break;
-				case 2:
-					flag = FILE_ATTRIBUTE_ENCRYPTED;
-					break;
-				case 3:
-					flag = FILE_ATTRIBUTE_HIDDEN;
-					break;
-				case 4:
-					flag = FILE_ATTRIBUTE_READONLY;
-					break;
-				case 5:
-					flag = FILE_ATTRIBUTE_SYSTEM;
-					break;
-				}
-
-				int set = (flag & attributes) ? 1 : 0;
+				int set = (AttributeFlag(condition.condition) & attributes) ? 1 : 0;
 				if (set == condition.value)
 					match = true;
 			}
@@ -764,39 +788,7 @@ bool CFilterManager::FilenameFilteredByFilter(const CFilter& filter, const wxStr
 				continue;
 
 			{
-				int flag = 0;
-				switch (condition.condition)
-				{
-				case 0:
-					flag = S_IRUSR;
-					break;
-				case 1:
-					flag = S_IWUSR;
-					break;
-				case 2:
-					flag = S_IXUSR;
-					break;
-				case 3:
-					flag = S_IRGRP;
-					break;
-				case 4:
-					flag = S_IWGRP;
-					break;
-				case 5:
-					flag = S_IXGRP;
-					break;
-				case 6:
-					flag = S_IROTH;
-					break;
-				case 7:
-					flag = S_IWOTH;
-					break;
-				case 8:
-					flag = S_IXOTH;
-					break;
-				}
-
-				int set = (flag & attributes) ? 1 : 0;
+				int set = (PermissionFlag(condition.condition) & attributes) ? 1 : 0;
 				if (set == condition.value)
 					match = true;
 			}
@@ -844,6 +836,306 @@ bool CFilterManager::FilenameFilteredByFilter(const CFilter& filter, const wxStr
 	return false;
 }
 
+namespace {
+// Regexes consisting of nothing but literal characters, optionally anchored,
+// get turned into the equivalent string condition.
+bool LiteralFromRegex(wxString const& pattern, int& condition, wxString& literal)
+{
+	size_t begin = 0;
+	size_t end = pattern.size();
+
+	bool const anchoredStart = end && pattern[0] == '^';
+	if (anchoredStart)
+		++begin;
+
+	bool anchoredEnd = false;
+	if (end > begin && pattern[end - 1] == '$') {
+		// Could be an escaped dollar sign or an escaped backslash
+		if (end - 1 > begin && pattern[end - 2] == '\\')
+			return false;
+		anchoredEnd = true;
+		--end;
+	}
+
+	literal.clear();
+	for (size_t i = begin; i < end; ++i) {
+		wxUniChar c = pattern[i];
+		if (c == '\\') {
+			if (++i == end)
+				return false;
+			c = pattern[i];
+
+			// Escaped letters and digits have special meanings
+			if (!c.IsAscii() || wxIsalnum(c))
+				return false;
+		}
+		else if (wxString(_T(".[]()*+?{}|^$")).Find(c) != wxNOT_FOUND)
+			return false;
+		literal += c;
+	}
+
+	if (literal.empty())
+		return false;
+
+	if (anchoredStart)
+		condition = anchoredEnd ? 1 : 2;
+	else
+		condition = anchoredEnd ? 3 : 0;
+
+	return true;
+}
+
+// Cheaper conditions get checked first
+int ConditionCost(CFilterCondition const& condition, bool matchCase)
+{
+	if (condition.type != filter_name && condition.type != filter_path)
+		return 0;
+
+	switch (condition.condition)
+	{
+	case 0:
+	case 5:
+		return 3;
+	case 4:
+		return 4;
+	default:
+		return matchCase ? 1 : 2;
+	}
+}
+}
+
+// The name or path of an entry, lowered and searched for the needles of the
+// contains conditions only once needed
+class CCompiledFilters::subject final
+{
+public:
+	explicit subject(wxString const& value)
+		: value_(value)
+	{}
+
+	wxString const& value(bool matchCase)
+	{
+		if (matchCase)
+			return value_;
+
+		if (!lowered_) {
+			lower_ = value_.Lower();
+			lowered_ = true;
+		}
+		return lower_;
+	}
+
+	bool contains(CAhoCorasick<wchar_t> const& needles, bool matchCase, size_t needle)
+	{
+		std::vector<bool>& found = found_[matchCase ? 1 : 0];
+		if (found.empty()) {
+			found.resize(needles.size());
+			wxString const& s = value(matchCase);
+			needles.find(s.wc_str(), s.size(), found);
+		}
+		return found[needle];
+	}
+
+private:
+	wxString const& value_;
+
+	wxString lower_;
+	bool lowered_{};
+
+	std::vector<bool> found_[2];
+};
+
+CCompiledFilters::CCompiledFilters(std::list<CFilter> const& filters)
+{
+	std::vector<std::wstring> needles[2][2];
+
+	for (auto const& f : filters) {
+		compiled_filter compiled;
+		compiled.filterFiles = f.filterFiles;
+		compiled.filterDirs = f.filterDirs;
+		compiled.matchType = f.matchType;
+		compiled.hasConditions = !f.filters.empty();
+
+		std::vector<std::pair<int, compiled_condition>> conditions;
+		for (auto const& c : f.filters) {
+#ifdef __WXMSW__
+			// Never match, only count towards the conditions
+			if (c.type == filter_permissions)
+				continue;
+#else
+			if (c.type == filter_attributes)
+				continue;
+#endif
+
+			compiled_condition cc;
+			cc.type = c.type;
+			cc.condition = c.condition;
+			cc.matchCase = f.matchCase;
+			cc.value = c.strValue;
+			cc.size = c.value;
+			cc.date = c.date;
+			cc.flag = 0;
+			cc.set = c.value != 0;
+			cc.needle = 0;
+
+			if (c.type == filter_attributes || c.type == filter_permissions) {
+#ifdef __WXMSW__
+				cc.flag = AttributeFlag(c.condition);
+#else
+				cc.flag = PermissionFlag(c.condition);
+#endif
+			}
+			else if (c.type == filter_name || c.type == filter_path) {
+				if (c.condition == 4) {
+					// Regexes are case-sensitive
+					if (LiteralFromRegex(c.strValue, cc.condition, cc.value))
+						cc.matchCase = true;
+					else
+						cc.pRegEx = c.pRegEx;
+				}
+				if (!cc.matchCase)
+					cc.value.MakeLower();
+
+				if (cc.condition == 0 || cc.condition == 5) {
+					auto& fieldNeedles = needles[c.type == filter_path ? 1 : 0][cc.matchCase ? 1 : 0];
+					cc.needle = fieldNeedles.size();
+					fieldNeedles.push_back(cc.value.ToStdWstring());
+				}
+			}
+
+			int const cost = ConditionCost(c, f.matchCase);
+			conditions.emplace_back(cost, cc);
+		}
+
+		std::stable_sort(conditions.begin(), conditions.end(), [](std::pair<int, compiled_condition> const& lhs, std::pair<int, compiled_condition> const& rhs) { return lhs.first < rhs.first; });
+		for (auto const& c : conditions)
+			compiled.conditions.push_back(c.second);
+
+		m_filters.push_back(std::move(compiled));
+	}
+
+	for (int field = 0; field < 2; ++field) {
+		for (int matchCase = 0; matchCase < 2; ++matchCase)
+			m_needles[field][matchCase] = CAhoCorasick<wchar_t>(needles[field][matchCase]);
+	}
+}
+
+bool CCompiledFilters::Matches(compiled_condition const& c, subject* subjects, wxLongLong size, int attributes, CDateTime const& date) const
+{
+	switch (c.type)
+	{
+	case filter_name:
+	case filter_path:
+		{
+			int const field = c.type == filter_path ? 1 : 0;
+			subject& s = subjects[field];
+			switch (c.condition)
+			{
+			case 0:
+				return s.contains(m_needles[field][c.matchCase ? 1 : 0], c.matchCase, c.needle);
+			case 1:
+				return s.value(c.matchCase) == c.value;
+			case 2:
+				return s.value(c.matchCase).StartsWith(c.value);
+			case 3:
+				return s.value(c.matchCase).EndsWith(c.value);
+			case 4:
+				wxASSERT(c.pRegEx);
+				return c.pRegEx && c.pRegEx->Matches(s.value(true));
+			case 5:
+				return !s.contains(m_needles[field][c.matchCase ? 1 : 0], c.matchCase, c.needle);
+			default:
+				return false;
+			}
+		}
+	case filter_size:
+		switch (c.condition)
+		{
+		case 0:
+			return size > c.size;
+		case 1:
+			return size == c.size;
+		case 2:
+			return size != c.size;
+		case 3:
+			return size < c.size;
+		default:
+			return false;
+		}
+	case filter_attributes:
+	case filter_permissions:
+		return ((c.flag & attributes) != 0) == c.set;
+	case filter_date:
+		if (!date.IsValid())
+			return false;
+		{
+			int const cmp = date.Compare(c.date);
+			switch (c.condition)
+			{
+			case 0:
+				return cmp < 0;
+			case 1:
+				return cmp == 0;
+			case 2:
+				return cmp != 0;
+			case 3:
+				return cmp > 0;
+			default:
+				return false;
+			}
+		}
+	default:
+		return false;
+	}
+}
+
+bool CCompiledFilters::Filtered(const wxString& name, const wxString& path, bool dir, wxLongLong size, int attributes, CDateTime const& date) const
+{
+	subject subjects[2] = { subject(name), subject(path) };
+
+	for (auto const& f : m_filters) {
+		if (dir ? !f.filterDirs : !f.filterFiles)
+			continue;
+
+		bool decided = false;
+		bool filtered = false;
+		for (auto const& c : f.conditions) {
+			if (c.type == filter_size && size == -1)
+				continue;
+#ifdef __WXMSW__
+			if (c.type == filter_attributes && !attributes)
+				continue;
+#else
+			if (c.type == filter_permissions && attributes == -1)
+				continue;
+#endif
+
+			if (Matches(c, subjects, size, attributes, date)) {
+				if (f.matchType == CFilter::any) {
+					decided = true;
+					filtered = true;
+					break;
+				}
+				else if (f.matchType == CFilter::none) {
+					decided = true;
+					break;
+				}
+			}
+			else if (f.matchType == CFilter::all) {
+				decided = true;
+				break;
+			}
+		}
+		if (!decided)
+			filtered = f.matchType != CFilter::any || !f.hasConditions;
+
+		if (filtered)
+			return true;
+	}
+
+	return false;
+}
+
 bool CFilterManager::CompileRegexes(CFilter& filter)
 {
 	for (auto iter = filter.filters.begin(); iter != filter.filters.end(); ++iter)
@@ -871,6 +1163,26 @@ bool CFilterManager::CompileRegexes()
 	return true;
 }
 
+void CFilterManager::CompileFilters()
+{
+	std::list<CFilter> local;
+	std::list<CFilter> remote;
+
+	if (m_globalCurrentFilterSet < m_globalFilterSets.size()) {
+		const CFilterSet& set = m_globalFilterSets[m_globalCurrentFilterSet];
+		for (unsigned int i = 0; i < m_globalFilters.size(); ++i) {
+			if (set.local[i])
+				local.push_back(m_globalFilters[i]);
+			if (set.remote[i])
+				remote.push_back(m_globalFilters[i]);
+		}
+	}
+
+	m_compiledLocalFilters = CCompiledFilters(local);
+	m_compiledRemoteFilters = CCompiledFilters(remote);
+	m_compiled = true;
+}
+
 bool CFilterManager::LoadFilter(TiXmlElement* pElement, CFilter& filter)
 {
 	filter.name = GetTextElement(pElement, "Name");
@@ -1061,3 +1373,51 @@ std::list<CFilter> CFilterManager::GetActiveFilters(bool local)
 
 	return filters;
 }
+
+wxString CFilterManager::BenchmarkFilters(CDirectoryListing const& listing)
+{
+	std::list<CFilter> const filters = GetActiveFilters(false);
+	if (filters.empty() || !listing.GetCount())
+		return wxString();
+
+	wxString const path = listing.path.GetPath();
+
+	// Check the entries often enough to get measurable times on small
+	// directories as well
+	unsigned int const rounds = std::max(1u, 1000000u / listing.GetCount());
+
+	wxStopWatch sw;
+	int interpreted = 0;
+	for (unsigned int round = 0; round < rounds; ++round) {
+		for (unsigned int i = 0; i < listing.GetCount(); ++i) {
+			CDirentry const& entry = listing[i];
+			for (auto const& filter : filters) {
+				if (FilenameFilteredByFilter(filter, entry.name, path, entry.is_dir(), entry.size, 0, entry.time)) {
+					++interpreted;
+					break;
+				}
+			}
+		}
+	}
+	long const interpretedTime = sw.Time();
+
+	// Includes compiling them
+	sw.Start();
+	CCompiledFilters const compiledFilters(filters);
+	int compiled = 0;
+	for (unsigned int round = 0; round < rounds; ++round) {
+		for (unsigned int i = 0; i < listing.GetCount(); ++i) {
+			CDirentry const& entry = listing[i];
+			if (compiledFilters.Filtered(entry.name, path, entry.is_dir(), entry.size, 0, entry.time))
+				++compiled;
+		}
+	}
+	long const compiledTime = sw.Time();
+
+	wxString ret = wxString::Format(_T("%u entries checked %u times against %d active remote filters:\n"), listing.GetCount(), rounds, static_cast<int>(filters.size()));
+	ret += wxString::Format(_T("Interpreted: %ld ms, %d filtered\n"), interpretedTime, interpreted);
+	ret += wxString::Format(_T("Compiled: %ld ms, %d filtered"), compiledTime, compiled);
+	if (interpreted != compiled)
+		ret += _T("\n\nThe results differ!");
+	return ret;
+}
@@ -1,6 +1,7 @@
 #ifndef __FILTER_H__
 #define __FILTER_H__
 
+#include "aho_corasick.h"
 #include "dialogex.h"
 #include <wx/regex.h>
 
@@ -72,6 +73,66 @@ public:
 	std::vector<bool> remote;
 };
 
+// Filters compiled for checking many entries against them. Gives the same
+// results as checking the filters one by one with
+// CFilterManager::FilenameFilteredByFilter, but
+// - conditions are checked cheapest first, so that the outcome of a filter is
+//   usually known before getting to substring searches or regexes,
+// - values are lowered up front, the name and path of an entry at most once,
+// - the substrings of all contains conditions are searched for at once,
+// - regexes without special characters are matched as plain strings.
+class CCompiledFilters final
+{
+public:
+	CCompiledFilters() = default;
+	explicit CCompiledFilters(std::list<CFilter> const& filters);
+
+	bool empty() const { return m_filters.empty(); }
+
+	bool Filtered(const wxString& name, const wxString& path, bool dir, wxLongLong size, int attributes, CDateTime const& date) const;
+
+private:
+	struct compiled_condition
+	{
+		enum t_filterType type;
+		int condition;
+		bool matchCase;
+
+		// Lowered unless matching case
+		wxString value;
+
+		wxLongLong size;
+		CDateTime date;
+
+		// Flag to check for attribute and permission conditions
+		int flag;
+		bool set;
+
+		std::shared_ptr<const wxRegEx> pRegEx;
+
+		// Index of the value among the needles of contains conditions
+		size_t needle;
+	};
+
+	struct compiled_filter
+	{
+		bool filterFiles;
+		bool filterDirs;
+		CFilter::t_matchType matchType;
+		bool hasConditions;
+		std::vector<compiled_condition> conditions;
+	};
+
+	class subject;
+	bool Matches(compiled_condition const& c, subject* subjects, wxLongLong size, int attributes, CDateTime const& date) const;
+
+	std::vector<compiled_filter> m_filters;
+
+	// Values of contains conditions, for name and path, each ignoring and
+	// matching case
+	CAhoCorasick<wchar_t> m_needles[2][2];
+};
+
 class TiXmlElement;
 class CFilterManager
 {
@@ -90,6 +151,11 @@ public:
 
 	std::list<CFilter> GetActiveFilters(bool local);
 
+	// Times checking the entries of the listing against the active remote
+	// filters, both one by one and compiled. Returns a summary for display,
+	// empty if there is nothing to check.
+	wxString BenchmarkFilters(CDirectoryListing const& listing);
+
 	static bool CompileRegexes(CFilter& filter);
 
 	static bool LoadFilter(TiXmlElement* pElement, CFilter& filter);
@@ -97,6 +163,12 @@ public:
 protected:
 	static bool CompileRegexes();
 
+	// Compiles the filters of the current filter set
+	static void CompileFilters();
+	static CCompiledFilters m_compiledLocalFilters;
+	static CCompiledFilters m_compiledRemoteFilters;
+	static bool m_compiled;
+
 	static void LoadFilters();
 	static bool m_loaded;
 
@@ -0,0 +1,330 @@
+#ifndef FZ_IDLEQUEUE_HEADER
+#define FZ_IDLEQUEUE_HEADER
+
+#include <stdint.h>
+
+/*
+Scheduling structure for finding the next idle item to transfer.
+
+Idle items are kept in intrusive lists, one per combination of
+immediate/queued, priority and direction. Active items are not part of
+any list, so finding the next item only looks at the heads of the lists.
+
+Each item carries its position in the queue. When an item becomes idle
+again, it is inserted at its old position, searching from the closer end
+of its list. Items usually become idle again close to the front, so this
+rarely has to look at more than a few items.
+
+All other operations take constant time, except for changing the
+priority of all items at once, which is linear.
+*/
+
+template<typename T>
+class CIdleQueueHook final
+{
+public:
+	CIdleQueueHook() = default;
+
+	// Copies of an item are never part of a list
+	CIdleQueueHook(CIdleQueueHook const&) {}
+	CIdleQueueHook& operator=(CIdleQueueHook const&) { return *this; }
+
+	bool linked() const { return list_ != 0; }
+
+private:
+	template<typename U, CIdleQueueHook<U> U::*> friend class CIdleList;
+	template<typename U, CIdleQueueHook<U> U::*, int> friend class CIdleQueue;
+
+	T* prev_{};
+	T* next_{};
+	void const* list_{};
+	int64_t position_{};
+};
+
+template<typename T, CIdleQueueHook<T> T::*hook>
+class CIdleList final
+{
+public:
+	CIdleList() = default;
+
+	CIdleList(CIdleList const&) = delete;
+	CIdleList& operator=(CIdleList const&) = delete;
+
+	bool empty() const { return !head_; }
+	T* front() const { return head_; }
+	T* back() const { return tail_; }
+
+	static T* next(T const& item) { return (item.*hook).next_; }
+	static T* prev(T const& item) { return (item.*hook).prev_; }
+	static int64_t position(T const& item) { return (item.*hook).position_; }
+
+	void push_front(T& item)
+	{
+		link(item, 0, head_);
+	}
+
+	void push_back(T& item)
+	{
+		link(item, tail_, 0);
+	}
+
+	// Inserts the item according to its position
+	void insert(T& item)
+	{
+		int64_t const pos = position(item);
+		if (!head_ || pos <= position(*head_)) {
+			push_front(item);
+		}
+		else if (pos >= position(*tail_)) {
+			push_back(item);
+		}
+		else if (pos - position(*head_) < position(*tail_) - pos) {
+			T* before = head_;
+			while (position(*next(*before)) < pos) {
+				before = next(*before);
+			}
+			link(item, before, next(*before));
+		}
+		else {
+			T* after = tail_;
+			while (position(*prev(*after)) > pos) {
+				after = prev(*after);
+			}
+			link(item, prev(*after), after);
+		}
+	}
+
+	void remove(T& item)
+	{
+		CIdleQueueHook<T>& h = item.*hook;
+		if (h.prev_) {
+			(h.prev_->*hook).next_ = h.next_;
+		}
+		else {
+			head_ = h.next_;
+		}
+		if (h.next_) {
+			(h.next_->*hook).prev_ = h.prev_;
+		}
+		else {
+			tail_ = h.prev_;
+		}
+		h.prev_ = 0;
+		h.next_ = 0;
+		h.list_ = 0;
+	}
+
+	void clear()
+	{
+		while (head_) {
+			remove(*head_);
+		}
+	}
+
+private:
+	void link(T& item, T* prev, T* next)
+	{
+		CIdleQueueHook<T>& h = item.*hook;
+		h.prev_ = prev;
+		h.next_ = next;
+		h.list_ = this;
+		if (prev) {
+			(prev->*hook).next_ = &item;
+		}
+		else {
+			head_ = &item;
+		}
+		if (next) {
+			(next->*hook).prev_ = &item;
+		}
+		else {
+			tail_ = &item;
+		}
+	}
+
+	T* head_{};
+	T* tail_{};
+};
+
+template<typename T, CIdleQueueHook<T> T::*hook, int priorities>
+class CIdleQueue final
+{
+public:
+	typedef CIdleList<T, hook> list_type;
+
+	CIdleQueue() = default;
+
+	CIdleQueue(CIdleQueue const&) = delete;
+	CIdleQueue& operator=(CIdleQueue const&) = delete;
+
+	// Add idle item behind all other items
+	void push_back(T& item, bool immediate, int priority, bool download)
+	{
+		(item.*hook).position_ = ++back_;
+		list(immediate, priority, download).push_back(item);
+	}
+
+	// Add idle item in front of all other items
+	void push_front(T& item, bool immediate, int priority, bool download)
+	{
+		(item.*hook).position_ = --front_;
+		list(immediate, priority, download).push_front(item);
+	}
+
+	// Assign position for items not currently idle
+	void move_back(T& item) { (item.*hook).position_ = ++back_; }
+	void move_front(T& item) { (item.*hook).position_ = --front_; }
+
+	// Insert item that has become idle at its previous position
+	void requeue(T& item, bool immediate, int priority, bool download)
+	{
+		list(immediate, priority, download).insert(item);
+	}
+
+	void remove(T& item)
+	{
+		CIdleQueueHook<T>& h = item.*hook;
+		if (h.list_) {
+			static_cast<list_type*>(const_cast<void*>(h.list_))->remove(item);
+		}
+	}
+
+	// Returns the idle item with the highest priority, the earliest one if
+	// there are multiple. Immediate items take precedence over queued ones.
+	T* pick(bool immediateOnly, bool download, bool upload)
+	{
+		for (int i = 1; i >= (immediateOnly ? 1 : 0); --i) {
+			for (int p = priorities - 1; p >= 0; --p) {
+				T* d = download ? lists_[i][p][1].front() : 0;
+				T* u = upload ? lists_[i][p][0].front() : 0;
+				if (d && u) {
+					return (list_type::position(*d) < list_type::position(*u)) ? d : u;
+				}
+				if (d) {
+					return d;
+				}
+				if (u) {
+					return u;
+				}
+			}
+		}
+		return 0;
+	}
+
+	// Like above, but looks at up to lookahead items in queue order and
+	// returns the one with the highest score, the earliest one if there are
+	// multiple. Items with a negative score are skipped. Only the items the
+	// plain pick would choose from are looked at, that is those of the
+	// highest priority with idle items. Returns null if none of them has a
+	// non-negative score, even if items of lower priorities would.
+	template<typename Score>
+	T* pick(bool immediateOnly, bool download, bool upload, int lookahead, Score const& score)
+	{
+		for (int i = 1; i >= (immediateOnly ? 1 : 0); --i) {
+			for (int p = priorities - 1; p >= 0; --p) {
+				T* d = download ? lists_[i][p][1].front() : 0;
+				T* u = upload ? lists_[i][p][0].front() : 0;
+				if (!d && !u) {
+					continue;
+				}
+
+				T* best = 0;
+				int64_t bestScore = -1;
+				for (int n = 0; n < lookahead && (d || u); ++n) {
+					T* item;
+					if (d && (!u || list_type::position(*d) < list_type::position(*u))) {
+						item = d;
+						d = list_type::next(*d);
+					}
+					else {
+						item = u;
+						u = list_type::next(*u);
+					}
+
+					int64_t const s = score(*item);
+					if (s > bestScore) {
+						best = item;
+						bestScore = s;
+					}
+				}
+				return best;
+			}
+		}
+		return 0;
+	}
+
+	// Moves all idle immediate items in front of the queued items, keeping
+	// their order. Calls f(item) for each of them.
+	template<typename F>
+	void queue_immediate(F const& f)
+	{
+		for (int p = 0; p < priorities; ++p) {
+			list_type& downloads = lists_[1][p][1];
+			list_type& uploads = lists_[1][p][0];
+			for (;;) {
+				T* d = downloads.back();
+				T* u = uploads.back();
+				if (!d && !u) {
+					break;
+				}
+				bool const download = d && (!u || list_type::position(*d) > list_type::position(*u));
+				T& item = download ? *d : *u;
+				(download ? downloads : uploads).remove(item);
+				f(item);
+				push_front(item, false, p, download);
+			}
+		}
+	}
+
+	// Moves all idle items to the given priority. Items of the other
+	// priorities get added behind the items already having that priority,
+	// lowest priority first.
+	void set_priority(int priority)
+	{
+		for (int i = 0; i < 2; ++i) {
+			for (int p = 0; p < priorities; ++p) {
+				if (p == priority) {
+					continue;
+				}
+				list_type& downloads = lists_[i][p][1];
+				list_type& uploads = lists_[i][p][0];
+				for (;;) {
+					T* d = downloads.front();
+					T* u = uploads.front();
+					if (!d && !u) {
+						break;
+					}
+					bool const download = d && (!u || list_type::position(*d) < list_type::position(*u));
+					T& item = download ? *d : *u;
+					(download ? downloads : uploads).remove(item);
+					push_back(item, i != 0, priority, download);
+				}
+			}
+		}
+	}
+
+	void clear()
+	{
+		for (auto & a : lists_) {
+			for (auto & b : a) {
+				for (auto & l : b) {
+					l.clear();
+				}
+			}
+		}
+	}
+
+private:
+	list_type& list(bool immediate, int priority, bool download)
+	{
+		return lists_[immediate ? 1 : 0][priority][download ? 1 : 0];
+	}
+
+	// Indexed by immediate, priority and download
+	list_type lists_[2][priorities][2];
+
+	int64_t front_{};
+	int64_t back_{};
+};
+
+#endif
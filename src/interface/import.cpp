@@ -5,6 +5,9 @@
 #include "ipcmutex.h"
 #include "Options.h"
 #include "queue.h"
+#include "xml_stream.h"
+
+#include <wx/ffile.h>
 
 CImportDialog::CImportDialog(wxWindow* parent, CQueueView* pQueueView)
 	: m_parent(parent), m_pQueueView(pQueueView)
@@ -29,14 +32,34 @@ void CImportDialog::Run()
 		return;
 	}
 
-	CXmlFile fz3(dlg.GetPath());
-	TiXmlElement* fz3Root = fz3.Load();
-	if (fz3Root) {
-		bool settings = fz3Root->FirstChildElement("Settings") != 0;
-		bool queue = fz3Root->FirstChildElement("Queue") != 0;
-		bool sites = fz3Root->FirstChildElement("Servers") != 0;
+	// Exported queues can be huge, so the file is streamed instead of loading
+	// it as a whole. The first pass only looks at the categories it contains.
+	wxFFile f(dlg.GetPath(), _T("rb"));
+	if (f.IsOpened()) {
+		bool settings = false;
+		bool queue = false;
+		bool sites = false;
+
+		bool valid = false;
+		{
+			CXmlStreamReader reader(f.fp());
+			if (reader.next() == CXmlStreamReader::token::start && reader.name() == "FileZilla3") {
+				CXmlStreamReader::token t;
+				while ((t = reader.next()) == CXmlStreamReader::token::start) {
+					if (reader.name() == "Settings")
+						settings = true;
+					else if (reader.name() == "Queue")
+						queue = true;
+					else if (reader.name() == "Servers")
+						sites = true;
+					if (!reader.skip_element())
+						break;
+				}
+				valid = t == CXmlStreamReader::token::end && !reader.depth();
+			}
+		}
 
-		if (settings || queue || sites) {
+		if (valid && (settings || queue || sites)) {
 			Load(m_parent, _T("ID_IMPORT"));
 			if (!queue)
 				XRCCTRL(*this, "ID_QUEUE", wxCheckBox)->Hide();
@@ -50,22 +73,53 @@ void CImportDialog::Run()
 				return;
 			}
 
-			if (queue && XRCCTRL(*this, "ID_QUEUE", wxCheckBox)->IsChecked()) {
-				m_pQueueView->ImportQueue(fz3Root->FirstChildElement("Queue"), true);
+			bool const importQueue = queue && XRCCTRL(*this, "ID_QUEUE", wxCheckBox)->IsChecked();
+			bool const importSites = sites && XRCCTRL(*this, "ID_SITEMANAGER", wxCheckBox)->IsChecked();
+			bool const importSettings = settings && XRCCTRL(*this, "ID_SETTINGS", wxCheckBox)->IsChecked();
+
+			f.Seek(0);
+			CXmlStreamReader reader(f.fp());
+			reader.next();
+
+			bool ok = true;
+			std::string xml;
+			while (ok && reader.next() == CXmlStreamReader::token::start) {
+				if (reader.name() == "Queue" && importQueue) {
+					ok = m_pQueueView->ImportQueue(reader, true);
+				}
+				else if ((reader.name() == "Servers" && importSites) || (reader.name() == "Settings" && importSettings)) {
+					bool const isSites = reader.name() == "Servers";
+					ok = reader.read_element(xml);
+
+					TiXmlDocument document;
+					TiXmlElement* pElement = ok ? ParseElement(document, xml) : 0;
+					if (!pElement)
+						ok = false;
+					else {
+						if (isSites) {
+							ImportSites(pElement);
+						}
+						else {
+							COptions::Get()->Import(pElement);
+							wxMessageBoxEx(_("The settings have been imported. You have to restart FileZilla for all settings to have effect."), _("Import successful"), wxOK, this);
+						}
+					}
+				}
+				else {
+					ok = reader.skip_element();
+				}
 			}
 
-			if (sites && XRCCTRL(*this, "ID_SITEMANAGER", wxCheckBox)->IsChecked()) {
-				ImportSites(fz3Root->FirstChildElement("Servers"));
+			if (!ok) {
+				wxString msg = wxString::Format(_("An error occurred reading \"%s\".\nThe selected categories might have been imported only partially."), dlg.GetPath());
+				wxMessageBoxEx(msg, _("Error importing"), wxICON_ERROR, this);
 			}
-
-			if (settings && XRCCTRL(*this, "ID_SETTINGS", wxCheckBox)->IsChecked()) {
-				COptions::Get()->Import(fz3Root->FirstChildElement("Settings"));
-				wxMessageBoxEx(_("The settings have been imported. You have to restart FileZilla for all settings to have effect."), _("Import successful"), wxOK, this);
-			}
-
-			wxMessageBoxEx(_("The selected categories have been imported."), _("Import successful"), wxOK, this);
+			else
+				wxMessageBoxEx(_("The selected categories have been imported."), _("Import successful"), wxOK, this);
 			return;
 		}
+
+		f.Close();
 	}
 
 	CXmlFile fz2(dlg.GetPath(), _T("FileZilla"));
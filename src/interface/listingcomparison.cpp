@@ -59,10 +59,10 @@ void CComparableListing::RefreshComparison()
 		return;
 	}
 
-	m_pComparisonManager->CompareListings();
+	m_pComparisonManager->CompareListings(this);
 }
 
-bool CComparisonManager::CompareListings()
+bool CComparisonManager::CompareListings(CComparableListing* pChanged)
 {
 	if (!m_pLeft || !m_pRight)
 		return false;
@@ -102,134 +102,178 @@ bool CComparisonManager::CompareListings()
 	m_pLeft->StartComparison();
 	m_pRight->StartComparison();
 
-	wxString localFile, remoteFile;
-	bool localDir = false;
-	bool remoteDir = false;
-	wxLongLong localSize, remoteSize;
-	CDateTime localDate, remoteDate;
+	CNameSortKeys::mode sortMode;
+	switch (COptions::Get()->GetOptionVal(OPTION_FILELIST_NAMESORT))
+	{
+	case 0:
+	default:
+		sortMode = CNameSortKeys::case_insensitive;
+		break;
+	case 1:
+		sortMode = CNameSortKeys::case_sensitive;
+		break;
+	case 2:
+		sortMode = CNameSortKeys::natural;
+		break;
+	}
+	const bool dirsFirst = COptions::Get()->GetOptionVal(OPTION_FILELIST_DIRSORT) != 2;
+	if (sortMode != m_sortMode || dirsFirst != m_dirsFirst)
+	{
+		m_sortMode = sortMode;
+		m_dirsFirst = dirsFirst;
+		m_leftSide.valid = false;
+		m_rightSide.valid = false;
+	}
 
-	const int dirSortMode = COptions::Get()->GetOptionVal(OPTION_FILELIST_DIRSORT);
+	if (!m_leftSide.valid || !pChanged || pChanged == m_pLeft)
+		ReadFiles(m_pLeft, m_leftSide);
+	if (!m_rightSide.valid || !pChanged || pChanged == m_pRight)
+		ReadFiles(m_pRight, m_rightSide);
 
-	const bool hide_identical = COptions::Get()->GetOptionVal(OPTION_COMPARE_HIDEIDENTICAL) != 0;
+	PrepareKeys();
 
-	bool gotLocal = m_pLeft->GetNextFile(localFile, localDir, localSize, localDate);
-	bool gotRemote = m_pRight->GetNextFile(remoteFile, remoteDir, remoteSize, remoteDate);
+	const bool hide_identical = COptions::Get()->GetOptionVal(OPTION_COMPARE_HIDEIDENTICAL) != 0;
 
-	while (gotLocal && gotRemote)
+	CComparisonKeys::match(m_leftSide.keys, m_rightSide.keys, [&](int left, int right)
 	{
-		int cmp = CompareFiles(dirSortMode, localFile, remoteFile, localDir, remoteDir);
-		if (!cmp)
+		if (left == -1)
 		{
-			if (!mode)
-			{
-				const CComparableListing::t_fileEntryFlags flag = (localDir || localSize == remoteSize) ? CComparableListing::normal : CComparableListing::different;
+			m_pLeft->CompareAddFile(CComparableListing::fill, -1);
+			m_pRight->CompareAddFile(CComparableListing::lonely, right);
+			return;
+		}
+		if (right == -1)
+		{
+			m_pLeft->CompareAddFile(CComparableListing::lonely, left);
+			m_pRight->CompareAddFile(CComparableListing::fill, -1);
+			return;
+		}
+
+		const t_file& localFile = m_leftSide.files[left];
+		const t_file& remoteFile = m_rightSide.files[right];
 
-				if (!hide_identical || flag != CComparableListing::normal || localFile == _T(".."))
+		if (!mode)
+		{
+			const CComparableListing::t_fileEntryFlags flag = (localFile.dir || localFile.size == remoteFile.size) ? CComparableListing::normal : CComparableListing::different;
+
+			if (!hide_identical || flag != CComparableListing::normal || localFile.parent)
+			{
+				m_pLeft->CompareAddFile(flag, left);
+				m_pRight->CompareAddFile(flag, right);
+			}
+		}
+		else
+		{
+			CDateTime localDate = localFile.date;
+			CDateTime remoteDate = remoteFile.date;
+			if (!localDate.IsValid() || !remoteDate.IsValid())
+			{
+				if (!hide_identical || localDate.IsValid() || remoteDate.IsValid() || localFile.parent)
 				{
-					m_pLeft->CompareAddFile(flag);
-					m_pRight->CompareAddFile(flag);
+					const CComparableListing::t_fileEntryFlags flag = CComparableListing::normal;
+					m_pLeft->CompareAddFile(flag, left);
+					m_pRight->CompareAddFile(flag, right);
 				}
 			}
 			else
 			{
-				if (!localDate.IsValid() || !remoteDate.IsValid())
-				{
-					if (!hide_identical || localDate.IsValid() || remoteDate.IsValid() || localFile == _T(".."))
-					{
-						const CComparableListing::t_fileEntryFlags flag = CComparableListing::normal;
-						m_pLeft->CompareAddFile(flag);
-						m_pRight->CompareAddFile(flag);
-					}
+				CComparableListing::t_fileEntryFlags localFlag, remoteFlag;
+
+				int cmp = localDate.Compare(remoteDate);
+				if( cmp < 0 )
+					localDate += threshold;
+				else if( cmp > 0 ) {
+					remoteDate += threshold;
+				}
+				int cmp2 = localDate.Compare(remoteDate);
+				if( cmp && cmp == -cmp2) {
+					cmp = 0;
+				}
+
+				localFlag = CComparableListing::normal;
+				remoteFlag = CComparableListing::normal;
+				if( cmp < 0 ) {
+					remoteFlag = CComparableListing::newer;
 				}
-				else
+				else if( cmp > 0 ) {
+					localFlag = CComparableListing::newer;
+				}
+				if (!hide_identical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || localFile.parent)
 				{
-					CComparableListing::t_fileEntryFlags localFlag, remoteFlag;
-
-					int cmp = localDate.Compare(remoteDate);
-					if( cmp < 0 )
-						localDate += threshold;
-					else if( cmp > 0 ) {
-						remoteDate += threshold;
-					}
-					int cmp2 = localDate.Compare(remoteDate);
-					if( cmp && cmp == -cmp2) {
-						cmp = 0;
-					}
-
-					localFlag = CComparableListing::normal;
-					remoteFlag = CComparableListing::normal;
-					if( cmp < 0 ) {
-						remoteFlag = CComparableListing::newer;
-					}
-					else if( cmp > 0 ) {
-						localFlag = CComparableListing::newer;
-					}
-					if (!hide_identical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || localFile == _T(".."))
-					{
-						m_pLeft->CompareAddFile(localFlag);
-						m_pRight->CompareAddFile(remoteFlag);
-					}
+					m_pLeft->CompareAddFile(localFlag, left);
+					m_pRight->CompareAddFile(remoteFlag, right);
 				}
 			}
-			gotLocal = m_pLeft->GetNextFile(localFile, localDir, localSize, localDate);
-			gotRemote = m_pRight->GetNextFile(remoteFile, remoteDir, remoteSize, remoteDate);
-			continue;
 		}
+	});
 
-		if (cmp < 0) {
-			m_pLeft->CompareAddFile(CComparableListing::lonely);
-			m_pRight->CompareAddFile(CComparableListing::fill);
-			gotLocal = m_pLeft->GetNextFile(localFile, localDir, localSize, localDate);
-		}
-		else {
-			m_pLeft->CompareAddFile(CComparableListing::fill);
-			m_pRight->CompareAddFile(CComparableListing::lonely);
-			gotRemote = m_pRight->GetNextFile(remoteFile, remoteDir, remoteSize, remoteDate);
-		}
-	}
-	while (gotLocal) {
-		m_pLeft->CompareAddFile(CComparableListing::lonely);
-		m_pRight->CompareAddFile(CComparableListing::fill);
-		gotLocal = m_pLeft->GetNextFile(localFile, localDir, localSize, localDate);
+	m_pRight->FinishComparison();
+	m_pLeft->FinishComparison();
+
+	return true;
+}
+
+void CComparisonManager::ReadFiles(CComparableListing* pListing, t_side& side)
+{
+#ifdef __WXMSW__
+	const bool caseSensitive = false;
+#else
+	const bool caseSensitive = true;
+#endif
+	side.keys.reset(m_sortMode, caseSensitive, m_dirsFirst);
+	side.files.clear();
+
+	wxString name;
+	t_file file;
+	while (pListing->GetNextFile(name, file.dir, file.size, file.date))
+	{
+		file.parent = name == _T("..");
+		side.keys.push_back(name.wc_str(), name.size(), file.dir);
+		side.files.push_back(file);
+
+		// Not every file has a date
+		file.date = CDateTime();
 	}
-	while (gotRemote)
+
+	side.valid = true;
+}
+
+namespace {
+class CPrepareKeysThread final : public wxThread
+{
+public:
+	explicit CPrepareKeysThread(CComparisonKeys& keys)
+		: wxThread(wxTHREAD_JOINABLE)
+		, m_keys(keys)
 	{
-		m_pLeft->CompareAddFile(CComparableListing::fill);
-		m_pRight->CompareAddFile(CComparableListing::lonely);
-		gotRemote = m_pRight->GetNextFile(remoteFile, remoteDir, remoteSize, remoteDate);
 	}
 
-	m_pRight->FinishComparison();
-	m_pLeft->FinishComparison();
+protected:
+	virtual ExitCode Entry()
+	{
+		m_keys.prepare();
+		return 0;
+	}
 
-	return true;
+	CComparisonKeys& m_keys;
+};
 }
 
-int CComparisonManager::CompareFiles(const int dirSortMode, const wxString& local, const wxString& remote, bool localDir, bool remoteDir)
+void CComparisonManager::PrepareKeys()
 {
-	switch (dirSortMode)
+	// Both listings at once if worth a thread
+	if (!m_leftSide.keys.prepared() && !m_rightSide.keys.prepared() && m_leftSide.keys.size() + m_rightSide.keys.size() >= 50000)
 	{
-	default:
-		if (localDir)
+		CPrepareKeysThread thread(m_leftSide.keys);
+		if (thread.Create() == wxTHREAD_NO_ERROR && thread.Run() == wxTHREAD_NO_ERROR)
 		{
-			if (!remoteDir)
-				return -1;
+			m_rightSide.keys.prepare();
+			thread.Wait(wxTHREAD_WAIT_BLOCK);
 		}
-		else if (remoteDir)
-			return 1;
-		break;
-	case 2:
-		// Inline
-		break;
 	}
 
-#ifdef __WXMSW__
-	return local.CmpNoCase(remote);
-#else
-	return local.Cmp(remote);
-#endif
-
-	return 0;
+	m_leftSide.keys.prepare();
+	m_rightSide.keys.prepare();
 }
 
 CComparisonManager::CComparisonManager(CState* pState)
@@ -252,6 +296,8 @@ void CComparisonManager::SetListings(CComparableListing* pLeft, CComparableListi
 
 	m_pLeft = pLeft;
 	m_pRight = pRight;
+	m_leftSide.valid = false;
+	m_rightSide.valid = false;
 
 	if (m_pLeft)
 		m_pLeft->SetOther(m_pRight);
@@ -265,6 +311,8 @@ void CComparisonManager::ExitComparisonMode()
 		return;
 
 	m_isComparing = false;
+	m_leftSide = t_side();
+	m_rightSide = t_side();
 	if (m_pLeft)
 		m_pLeft->OnExitComparisonMode();
 	if (m_pRight)
@@ -1,6 +1,8 @@
 #ifndef __LISTINGCOMPARISON_H__
 #define __LISTINGCOMPARISON_H__
 
+#include "comparison_keys.h"
+
 class CComparisonManager;
 class CComparableListing
 {
@@ -21,7 +23,11 @@ public:
 	virtual bool CanStartComparison(wxString* pError) = 0;
 	virtual void StartComparison() = 0;
 	virtual bool GetNextFile(wxString& name, bool &dir, wxLongLong &size, CDateTime& date) = 0;
-	virtual void CompareAddFile(t_fileEntryFlags flags) = 0;
+
+	// Adds a file to the comparison. The index refers to the order in which
+	// GetNextFile returned the files since the last call to StartComparison
+	// that was followed by calls to GetNextFile. Unused for fill.
+	virtual void CompareAddFile(t_fileEntryFlags flags, int index) = 0;
 	virtual void FinishComparison() = 0;
 	virtual void ScrollTopItem(int item) = 0;
 	virtual void OnExitComparisonMode() = 0;
@@ -51,7 +57,9 @@ class CComparisonManager
 public:
 	CComparisonManager(CState* pState);
 
-	bool CompareListings();
+	// Only reads the files of the given listing again if set, the other one
+	// didn't change since the last comparison.
+	bool CompareListings(CComparableListing* pChanged = 0);
 	bool IsComparing() const { return m_isComparing; }
 
 	void ExitComparisonMode();
@@ -59,7 +67,23 @@ public:
 	void SetListings(CComparableListing* pLeft, CComparableListing* pRight);
 
 protected:
-	int CompareFiles(const int dirSortMode, const wxString& local, const wxString& remote, bool localDir, bool remoteDir);
+	struct t_file
+	{
+		wxLongLong size;
+		CDateTime date;
+		bool dir;
+		bool parent;
+	};
+
+	struct t_side
+	{
+		CComparisonKeys keys;
+		std::vector<t_file> files;
+		bool valid{};
+	};
+
+	void ReadFiles(CComparableListing* pListing, t_side& side);
+	void PrepareKeys();
 
 	CState* m_pState;
 
@@ -68,6 +92,13 @@ protected:
 	CComparableListing* m_pRight;
 
 	bool m_isComparing;
+
+	// Files of both listings as of the last comparison
+	t_side m_leftSide;
+	t_side m_rightSide;
+
+	CNameSortKeys::mode m_sortMode{CNameSortKeys::case_insensitive};
+	bool m_dirsFirst{true};
 };
 
 #endif //__LISTINGCOMPARISON_H__
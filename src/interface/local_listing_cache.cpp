@@ -0,0 +1,448 @@
+#include <filezilla.h>
+#include "local_listing_cache.h"
+#include "local_filesys.h"
+#include <mutex.h>
+
+#include <set>
+
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#endif
+
+DECLARE_EVENT_TYPE(fzEVT_LOCALDIR_CHANGED, -1)
+DEFINE_EVENT_TYPE(fzEVT_LOCALDIR_CHANGED)
+
+#if HAVE_SYS_INOTIFY_H
+namespace {
+// inotify only reports changes made through the local kernel. On network
+// filesystems and those implemented in user space, other clients can change
+// directories unnoticed.
+bool IsWatchable(wxString const& path)
+{
+	struct statfs buf;
+	if (statfs(path.fn_str(), &buf))
+		return false;
+
+	switch (static_cast<unsigned long>(buf.f_type)) {
+	case 0x6969UL: // NFS
+	case 0x517bUL: // SMB
+	case 0xff534d42UL: // CIFS
+	case 0xfe534d42UL: // SMB2
+	case 0x564cUL: // NCP
+	case 0x65735546UL: // FUSE
+	case 0x01021997UL: // 9P
+	case 0x5346414fUL: // AFS
+	case 0x6b414653UL: // kAFS
+	case 0x73757245UL: // Coda
+	case 0x00c36400UL: // Ceph
+	case 0x0bd00bd0UL: // Lustre
+	case 0x47504653UL: // GPFS
+	case 0x01161970UL: // GFS2
+	case 0x7461636fUL: // OCFS2
+		return false;
+	default:
+		return true;
+	}
+}
+}
+
+// Waits for inotify events in the background and hands them to the cache
+class CLocalDirWatcher final : protected wxThread
+{
+public:
+	struct t_change
+	{
+		int wd;
+		uint32_t mask;
+		wxString name;
+	};
+
+	explicit CLocalDirWatcher(wxEvtHandler& handler)
+		: wxThread(wxTHREAD_JOINABLE)
+		, m_handler(handler)
+	{
+		m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_fd == -1)
+			return;
+
+		if (pipe(m_pipe)) {
+			m_pipe[0] = m_pipe[1] = -1;
+			return;
+		}
+		fcntl(m_pipe[0], F_SETFD, FD_CLOEXEC);
+		fcntl(m_pipe[1], F_SETFD, FD_CLOEXEC);
+
+		m_running = Create() == wxTHREAD_NO_ERROR && Run() == wxTHREAD_NO_ERROR;
+	}
+
+	virtual ~CLocalDirWatcher()
+	{
+		if (m_running) {
+			// Wake up the thread
+			char const c = 0;
+			if (write(m_pipe[1], &c, 1) == 1)
+				Wait(wxTHREAD_WAIT_BLOCK);
+		}
+
+		if (m_fd != -1)
+			close(m_fd);
+		if (m_pipe[0] != -1) {
+			close(m_pipe[0]);
+			close(m_pipe[1]);
+		}
+	}
+
+	bool Running() const { return m_running; }
+
+	// Returns the watch descriptor, -1 on failure or if changes to the
+	// directory could go unnoticed. A directory that is already being
+	// watched, e.g. through a symlink, gets the same one.
+	int Add(wxString const& path)
+	{
+		if (!IsWatchable(path))
+			return -1;
+
+		// Modifications are only reported once the file gets closed, anything
+		// else would flood the cache while files are being transferred.
+		uint32_t const mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB |
+			IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+		return inotify_add_watch(m_fd, path.fn_str(), mask);
+	}
+
+	void Remove(int wd)
+	{
+		inotify_rm_watch(m_fd, wd);
+	}
+
+	// Moves the changes since the last call into changes
+	void GetChanges(std::vector<t_change>& changes)
+	{
+		scoped_lock l(m_sync);
+		changes.clear();
+		changes.swap(m_changes);
+		m_notified = false;
+	}
+
+protected:
+	virtual ExitCode Entry()
+	{
+		alignas(inotify_event) char buffer[65536];
+
+		pollfd fds[2]{};
+		fds[0].fd = m_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = m_pipe[0];
+		fds[1].events = POLLIN;
+
+		for (;;) {
+			if (poll(fds, 2, -1) == -1) {
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			if (fds[1].revents)
+				break;
+			if (!fds[0].revents)
+				continue;
+
+			ssize_t const len = read(m_fd, buffer, sizeof(buffer));
+			if (len <= 0) {
+				if (len == -1 && (errno == EAGAIN || errno == EINTR))
+					continue;
+				break;
+			}
+
+			std::vector<t_change> changes;
+			for (char const* p = buffer; p < buffer + len; ) {
+				inotify_event const* event = reinterpret_cast<inotify_event const*>(p);
+
+				t_change change;
+				change.wd = event->wd;
+				change.mask = event->mask;
+				if (event->len)
+					change.name = wxString(event->name, *wxConvFileName);
+				changes.push_back(change);
+
+				p += sizeof(inotify_event) + event->len;
+			}
+
+			HandOver(changes);
+		}
+
+		return 0;
+	}
+
+	void HandOver(std::vector<t_change>& changes)
+	{
+		scoped_lock l(m_sync);
+		if (m_changes.empty())
+			m_changes.swap(changes);
+		else
+			m_changes.insert(m_changes.end(), changes.begin(), changes.end());
+
+		// One pending event at a time, changes arriving in the meantime
+		// get handled along with it
+		if (!m_notified) {
+			m_notified = true;
+			m_handler.QueueEvent(new wxCommandEvent(fzEVT_LOCALDIR_CHANGED));
+		}
+	}
+
+	wxEvtHandler& m_handler;
+
+	int m_fd{-1};
+	int m_pipe[2]{-1, -1};
+	bool m_running{};
+
+	mutex m_sync{false};
+	std::vector<t_change> m_changes;
+	bool m_notified{};
+};
+#endif
+
+BEGIN_EVENT_TABLE(CLocalListingCache, wxEvtHandler)
+EVT_COMMAND(wxID_ANY, fzEVT_LOCALDIR_CHANGED, CLocalListingCache::OnChanges)
+END_EVENT_TABLE()
+
+CLocalListingCache* CLocalListingCache::m_pLocalListingCache = 0;
+
+void CLocalListingCache::Create()
+{
+	if (!m_pLocalListingCache)
+		m_pLocalListingCache = new CLocalListingCache();
+}
+
+void CLocalListingCache::Destroy()
+{
+	delete m_pLocalListingCache;
+	m_pLocalListingCache = 0;
+}
+
+CLocalListingCache::CLocalListingCache()
+{
+#if HAVE_SYS_INOTIFY_H
+	m_watcher = new CLocalDirWatcher(*this);
+	if (!m_watcher->Running()) {
+		delete m_watcher;
+		m_watcher = 0;
+	}
+#endif
+}
+
+CLocalListingCache::~CLocalListingCache()
+{
+#if HAVE_SYS_INOTIFY_H
+	delete m_watcher;
+#endif
+}
+
+int CLocalListingCache::AddWatch(wxString const& path)
+{
+#if HAVE_SYS_INOTIFY_H
+	return m_watcher->Add(path);
+#else
+	return -1;
+#endif
+}
+
+void CLocalListingCache::RemoveWatch(int wd)
+{
+#if HAVE_SYS_INOTIFY_H
+	// Fails harmlessly if the watch is already gone
+	m_watcher->Remove(wd);
+#endif
+}
+
+void CLocalListingCache::BeginRead(CLocalPath const& path)
+{
+	if (!m_watcher)
+		return;
+
+	auto it = m_paths.find(path.GetPath());
+	if (it == m_paths.end()) {
+		int const wd = AddWatch(path.GetPath());
+		if (wd == -1)
+			return;
+
+		// Already known under a different path. Not cached twice, the watch
+		// belongs to the other one.
+		if (m_watches.find(wd) != m_watches.end())
+			return;
+
+		t_dir dir;
+		dir.path = path.GetPath();
+		dir.wd = wd;
+		m_dirs.push_front(dir);
+
+		it = m_paths.insert(std::make_pair(dir.path, m_dirs.begin())).first;
+		m_watches[wd] = m_dirs.begin();
+	}
+	else
+		m_dirs.splice(m_dirs.begin(), m_dirs, it->second);
+
+	t_dir& dir = *it->second;
+	if (!dir.reads++)
+		dir.changed = false;
+
+	dir.complete = false;
+	m_entryCount -= dir.entries.size();
+	dir.entries.clear();
+
+	Prune();
+}
+
+void CLocalListingCache::Store(CLocalPath const& path, std::vector<CLocalFileData> const& entries)
+{
+	auto it = m_paths.find(path.GetPath());
+	if (it == m_paths.end())
+		return;
+
+	t_dir& dir = *it->second;
+	if (dir.reads)
+		--dir.reads;
+
+	if (dir.changed || entries.size() > max_entries) {
+		if (!dir.reads && !dir.complete)
+			Remove(it->second);
+		return;
+	}
+
+	m_entryCount -= dir.entries.size();
+	dir.entries = entries;
+	m_entryCount += dir.entries.size();
+	dir.complete = true;
+
+	Prune();
+}
+
+void CLocalListingCache::CancelRead(CLocalPath const& path)
+{
+	auto it = m_paths.find(path.GetPath());
+	if (it == m_paths.end())
+		return;
+
+	t_dir& dir = *it->second;
+	if (dir.reads)
+		--dir.reads;
+
+	if (!dir.reads && !dir.complete)
+		Remove(it->second);
+}
+
+bool CLocalListingCache::Lookup(CLocalPath const& path, std::vector<CLocalFileData>& entries)
+{
+	auto it = m_paths.find(path.GetPath());
+	if (it == m_paths.end() || !it->second->complete)
+		return false;
+
+	m_dirs.splice(m_dirs.begin(), m_dirs, it->second);
+	entries = it->second->entries;
+
+	return true;
+}
+
+void CLocalListingCache::Remove(t_dirs::iterator dir)
+{
+	RemoveWatch(dir->wd);
+
+	m_entryCount -= dir->entries.size();
+	m_watches.erase(dir->wd);
+	m_paths.erase(dir->path);
+	m_dirs.erase(dir);
+}
+
+void CLocalListingCache::Prune()
+{
+	while (m_dirs.size() > max_dirs || (m_entryCount > max_entries && m_dirs.size() > 1))
+		Remove(--m_dirs.end());
+}
+
+void CLocalListingCache::Clear()
+{
+	while (!m_dirs.empty())
+		Remove(m_dirs.begin());
+}
+
+void CLocalListingCache::ApplyChange(t_dir& dir, wxString const& name)
+{
+	auto it = dir.entries.begin();
+	while (it != dir.entries.end() && it->name != name)
+		++it;
+
+	CLocalFileData data;
+	bool wasLink;
+	enum CLocalFileSystem::local_fileType type = CLocalFileSystem::GetFileInfo(dir.path + name, wasLink, &data.size, &data.time, &data.attributes);
+	if (type == CLocalFileSystem::unknown) {
+		if (it != dir.entries.end()) {
+			dir.entries.erase(it);
+			--m_entryCount;
+		}
+		return;
+	}
+
+	data.name = name;
+	data.dir = type == CLocalFileSystem::dir;
+
+	if (it != dir.entries.end())
+		*it = data;
+	else {
+		dir.entries.push_back(data);
+		++m_entryCount;
+	}
+}
+
+void CLocalListingCache::OnChanges(wxCommandEvent&)
+{
+#if HAVE_SYS_INOTIFY_H
+	if (!m_watcher)
+		return;
+
+	std::vector<CLocalDirWatcher::t_change> changes;
+	m_watcher->GetChanges(changes);
+
+	// Files usually change more than once in a row
+	std::set<std::pair<int, wxString>> changed;
+	for (auto const& change : changes) {
+		if (change.mask & IN_Q_OVERFLOW) {
+			// Lost track, start over
+			Clear();
+			return;
+		}
+
+		auto it = m_watches.find(change.wd);
+		if (it == m_watches.end())
+			continue;
+
+		if (change.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_IGNORED)) {
+			Remove(it->second);
+			continue;
+		}
+
+		t_dir& dir = *it->second;
+		if (dir.reads)
+			dir.changed = true;
+		if (!change.name.empty())
+			changed.insert(std::make_pair(change.wd, change.name));
+	}
+
+	std::vector<CState*> const* states = CContextManager::Get()->GetAllStates();
+	for (auto const& change : changed) {
+		auto it = m_watches.find(change.first);
+		if (it == m_watches.end())
+			continue;
+
+		t_dir& dir = *it->second;
+		if (dir.complete)
+			ApplyChange(dir, change.second);
+
+		// Views still reading the directory catch up once done
+		for (auto const& state : *states)
+			state->RefreshLocalFile(dir.path + change.second);
+	}
+#endif
+}
@@ -0,0 +1,92 @@
+#ifndef __LOCAL_LISTING_CACHE_H__
+#define __LOCAL_LISTING_CACHE_H__
+
+#include "LocalListView.h"
+
+#include <list>
+#include <map>
+
+// Keeps the listings of recently shown local directories, so that revisiting
+// a directory doesn't require reading it again.
+//
+// A listing is only kept while the directory is being watched for changes,
+// which requires inotify. Directories on network and FUSE filesystems don't
+// get cached, as inotify doesn't see changes made by other clients there.
+// Changed entries are updated in the cached listing and passed on to the
+// views showing the directory, so that they don't need to re-read it either.
+// The number of cached directories and entries is limited, the least recently
+// used listings get dropped first.
+
+class CLocalDirWatcher;
+class CLocalListingCache final : protected wxEvtHandler
+{
+public:
+	static void Create();
+	static void Destroy();
+
+	// Returns 0 if not created
+	static CLocalListingCache* Get() { return m_pLocalListingCache; }
+
+	// Starts watching the directory, to be called before reading it. If it
+	// changes before the read is finished, its listing doesn't get cached.
+	void BeginRead(CLocalPath const& path);
+
+	// Caches the complete listing of a directory started with BeginRead
+	void Store(CLocalPath const& path, std::vector<CLocalFileData> const& entries);
+
+	// For reads started with BeginRead that didn't finish
+	void CancelRead(CLocalPath const& path);
+
+	// Returns false unless the directory has been cached
+	bool Lookup(CLocalPath const& path, std::vector<CLocalFileData>& entries);
+
+protected:
+	CLocalListingCache();
+	virtual ~CLocalListingCache();
+
+	static CLocalListingCache* m_pLocalListingCache;
+
+	enum : size_t
+	{
+		max_dirs = 100,
+		max_entries = 250000
+	};
+
+	struct t_dir
+	{
+		wxString path;
+		int wd{-1};
+
+		// Number of unfinished reads and whether the directory changed
+		// since the first of them got started
+		int reads{};
+		bool changed{};
+
+		bool complete{};
+		std::vector<CLocalFileData> entries;
+	};
+	typedef std::list<t_dir> t_dirs;
+
+	int AddWatch(wxString const& path);
+	void RemoveWatch(int wd);
+
+	void Remove(t_dirs::iterator dir);
+	void Prune();
+	void Clear();
+
+	void ApplyChange(t_dir& dir, wxString const& name);
+
+	CLocalDirWatcher* m_watcher{};
+
+	// Most recently used first
+	t_dirs m_dirs;
+	std::map<wxString, t_dirs::iterator> m_paths;
+	std::map<int, t_dirs::iterator> m_watches;
+
+	size_t m_entryCount{};
+
+	DECLARE_EVENT_TABLE()
+	void OnChanges(wxCommandEvent& event);
+};
+
+#endif //__LOCAL_LISTING_CACHE_H__
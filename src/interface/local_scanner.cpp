@@ -0,0 +1,29 @@
+#include <filezilla.h>
+#include "local_scanner.h"
+#include "local_filesys.h"
+
+CLocalScanner::CLocalScanner()
+	: CDirScanner<CLocalFileData>(&CLocalScanner::Read)
+{
+}
+
+bool CLocalScanner::Read(CLocalPath const& path, std::vector<CLocalFileData>& entries, std::function<bool()> const& cancelled)
+{
+	CLocalFileSystem fs;
+	if (!fs.BeginFindFiles(path.GetPath(), false))
+		return false;
+
+	CLocalFileData data;
+	bool wasLink;
+	while (fs.GetNextFile(data.name, wasLink, data.dir, &data.size, &data.time, &data.attributes)) {
+		if (data.name.empty())
+			continue;
+		entries.push_back(data);
+
+		// Don't hold up shutting down on huge directories
+		if (!(entries.size() % 1024) && cancelled())
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,19 @@
+#ifndef __LOCAL_SCANNER_H__
+#define __LOCAL_SCANNER_H__
+
+#include "dir_scanner.h"
+#include "LocalListView.h"
+
+// Reads local directories in the background, so that comparing a remote tree
+// against the local one doesn't wait for the disk at every directory.
+
+class CLocalScanner final : public CDirScanner<CLocalFileData>
+{
+public:
+	CLocalScanner();
+
+protected:
+	static bool Read(CLocalPath const& path, std::vector<CLocalFileData>& entries, std::function<bool()> const& cancelled);
+};
+
+#endif //__LOCAL_SCANNER_H__
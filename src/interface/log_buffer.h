@@ -0,0 +1,183 @@
+#ifndef FZ_LOG_BUFFER_HEADER
+#define FZ_LOG_BUFFER_HEADER
+
+#include <stdint.h>
+#include <wctype.h>
+
+#include <string>
+#include <vector>
+
+/*
+The lines of the message log, kept in a fixed number of compact records.
+
+Each record holds the type and time of a line, and where its text is
+found in a single character buffer, the arena. Once all records are in
+use, every new line replaces the oldest one. Lines also get dropped once
+their texts take up more than a given number of characters.
+
+Texts are appended to the arena. Those of dropped lines stay in front of
+it until they make up half of it, then the remaining texts are moved down
+in one go. Offsets count all characters ever appended, moving texts thus
+doesn't touch the records.
+
+Lines are indexed from the oldest one kept. The number of lines dropped so
+far tells views by how much the indexes of the lines they show moved.
+*/
+
+class CLogBuffer final
+{
+public:
+	CLogBuffer(size_t maxLines, size_t maxChars)
+		: records_(maxLines ? maxLines : 1)
+		, maxChars_(maxChars ? maxChars : 1)
+	{}
+
+	size_t size() const { return count_; }
+	bool empty() const { return !count_; }
+	size_t capacity() const { return records_.size(); }
+
+	// Number of lines dropped since the buffer got created, including
+	// cleared ones
+	uint64_t dropped() const { return dropped_; }
+
+	void clear()
+	{
+		dropped_ += count_;
+		count_ = 0;
+		first_ = 0;
+		base_ += arena_.size();
+		arena_.clear();
+	}
+
+	// Texts longer than the character limit get cut
+	void push_back(int type, int64_t time, wchar_t const* text, size_t len)
+	{
+		if (len > maxChars_) {
+			len = maxChars_;
+		}
+
+		if (count_ == records_.size()) {
+			pop_front();
+		}
+
+		record& r = records_[(first_ + count_) % records_.size()];
+		r.offset = base_ + arena_.size();
+		r.time = time;
+		r.length = static_cast<uint32_t>(len);
+		r.type = static_cast<uint8_t>(type);
+		++count_;
+		arena_.append(text, len);
+
+		while (count_ > 1 && base_ + arena_.size() - at(0).offset > maxChars_) {
+			pop_front();
+		}
+		compact();
+	}
+
+	void push_back(int type, int64_t time, std::wstring const& text)
+	{
+		push_back(type, time, text.c_str(), text.size());
+	}
+
+	int type(size_t i) const { return at(i).type; }
+	int64_t time(size_t i) const { return at(i).time; }
+
+	// Not null-terminated
+	wchar_t const* text(size_t i) const { return arena_.data() + (at(i).offset - base_); }
+	size_t length(size_t i) const { return at(i).length; }
+
+	// Returns the index of the first line from start on whose text contains
+	// the needle, ignoring case. Searches backwards if not forward, wraps
+	// around in either case. Returns npos if no line contains it.
+	size_t find(std::wstring const& needle, size_t start, bool forward = true) const
+	{
+		if (!count_) {
+			return npos;
+		}
+
+		std::wstring lowered;
+		for (auto const& c : needle) {
+			lowered += static_cast<wchar_t>(towlower(c));
+		}
+
+		size_t i = start % count_;
+		for (size_t n = 0; n < count_; ++n) {
+			if (contains(i, lowered)) {
+				return i;
+			}
+			i = forward ? (i + 1) % count_ : (i + count_ - 1) % count_;
+		}
+		return npos;
+	}
+
+	enum : size_t
+	{
+		npos = size_t(-1)
+	};
+
+private:
+	struct record
+	{
+		uint64_t offset{};
+		int64_t time{};
+		uint32_t length{};
+		uint8_t type{};
+	};
+
+	record const& at(size_t i) const { return records_[(first_ + i) % records_.size()]; }
+
+	void pop_front()
+	{
+		first_ = (first_ + 1) % records_.size();
+		--count_;
+		++dropped_;
+	}
+
+	void compact()
+	{
+		// Offset of the first text still needed
+		uint64_t const live = count_ ? at(0).offset : base_ + arena_.size();
+		size_t const dead = static_cast<size_t>(live - base_);
+		if (dead > 4096 && dead > arena_.size() / 2) {
+			arena_.erase(0, dead);
+			base_ = live;
+		}
+	}
+
+	bool contains(size_t i, std::wstring const& lowered) const
+	{
+		size_t const len = length(i);
+		if (lowered.size() > len) {
+			return false;
+		}
+
+		wchar_t const* t = text(i);
+		for (size_t pos = 0; pos + lowered.size() <= len; ++pos) {
+			size_t j = 0;
+			while (j < lowered.size() && static_cast<wchar_t>(towlower(t[pos + j])) == lowered[j]) {
+				++j;
+			}
+			if (j == lowered.size()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<record> records_;
+
+	// Index of the oldest line in records_
+	size_t first_{};
+	size_t count_{};
+
+	uint64_t dropped_{};
+
+	std::wstring arena_;
+
+	// Offset of the first character in the arena
+	uint64_t base_{};
+
+	size_t const maxChars_;
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include "sizeformatting.h"
 #include "timeformatting.h"
 #include "themeprovider.h"
+#include "xml_stream.h"
 
 CQueueItem::CQueueItem(CQueueItem* parent)
 	: m_parent(parent)
@@ -14,209 +15,208 @@ CQueueItem::CQueueItem(CQueueItem* parent)
 
 CQueueItem::~CQueueItem()
 {
-	for (auto iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter)
+	for (auto iter = m_children.begin(); iter != m_children.end(); ++iter)
 		delete *iter;
 }
 
 void CQueueItem::SetPriority(QueuePriority priority)
 {
-	for (auto iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter)
-		(*iter)->SetPriority(priority);
+	for (auto iter = m_children.begin(); iter != m_children.end(); ++iter)
+		if (*iter)
+			(*iter)->SetPriority(priority);
 }
 
 void CQueueItem::AddChild(CQueueItem* item)
 {
-	if (m_removed_at_front) {
-		m_children.erase(m_children.begin(), m_children.begin() + m_removed_at_front);
-		m_removed_at_front = 0;
-	}
+	item->m_slot = m_children.size();
 	m_children.push_back(item);
 
-	m_visibleOffspring += 1 + item->m_visibleOffspring;
-	m_maxCachedIndex = -1;
+	int const count = 1 + item->m_visibleOffspring;
+	m_childIndex.push_back(count);
+	UpdateVisibleOffspring(count);
+}
+
+void CQueueItem::AddChildren(std::vector<CQueueItem*> const& items)
+{
+	m_children.reserve(m_children.size() + items.size());
+
+	int total = 0;
+	for (auto item : items)
+	{
+		item->m_slot = m_children.size();
+		m_children.push_back(item);
+
+		int const count = 1 + item->m_visibleOffspring;
+		m_childIndex.push_back(count);
+		total += count;
+	}
+	UpdateVisibleOffspring(total);
+}
+
+void CQueueItem::UpdateVisibleOffspring(int delta)
+{
+	m_visibleOffspring += delta;
+
+	CQueueItem* item = this;
 	CQueueItem* parent = GetParent();
-	while (parent)
+	while (parent && parent->IsChild(item))
 	{
-		parent->m_visibleOffspring += 1 + item->m_visibleOffspring;
-		parent->m_maxCachedIndex = -1;
+		parent->m_visibleOffspring += delta;
+		parent->m_childIndex.add(item->m_slot, delta);
+
+		item = parent;
 		parent = parent->GetParent();
 	}
 }
 
+bool CQueueItem::IsChild(CQueueItem const* item) const
+{
+	return item->m_slot >= 0 && static_cast<size_t>(item->m_slot) < m_children.size() && m_children[item->m_slot] == item;
+}
+
 CQueueItem* CQueueItem::GetChild(unsigned int item, bool recursive /*=true*/)
 {
-	std::vector<CQueueItem*>::iterator iter;
 	if (!recursive)
 	{
-		if (item + m_removed_at_front >= m_children.size())
+		if (m_removedChildren)
+			Compact();
+		if (item >= m_children.size())
 			return 0;
-		iter = m_children.begin();
-		iter += item + m_removed_at_front;
-		return *iter;
+		return m_children[item];
 	}
 
-	if ((int)item <= m_maxCachedIndex)
-	{
-		// Index is cached
-		iter = m_children.begin() + m_removed_at_front;
-		iter += m_lookupCache[item].child;
-		item -= m_lookupCache[item].index;
-		if (!item)
-			return *iter;
-		else
-			return (*iter)->GetChild(item - 1);
-	}
-
-	int index;
-	int child;
-	iter = m_children.begin() + m_removed_at_front;
-	if (m_maxCachedIndex == -1)
-	{
-		child = 0;
-		index = 0;
-	}
-	else
-	{
-		// Start with loop with the last cached item index
-		iter += m_lookupCache[m_maxCachedIndex].child + 1;
-		item -= m_maxCachedIndex + 1;
-		index = m_maxCachedIndex + 1;
-		child = m_lookupCache[m_maxCachedIndex].child + 1;
-	}
+	int offset = item;
+	size_t const slot = m_childIndex.find(offset);
+	if (slot >= m_children.size())
+		return 0;
 
-	for (; iter != m_children.end(); ++iter, ++child)
-	{
-		if (!item)
-			return *iter;
+	CQueueItem* child = m_children[slot];
+	wxASSERT(child);
+	if (!offset)
+		return child;
 
-		unsigned int count = (*iter)->GetChildrenCount(true);
-		if (item > count)
-		{
-			if (m_maxCachedIndex == -1 && m_lookupCache.size() < (unsigned int)m_visibleOffspring)
-				m_lookupCache.resize(m_visibleOffspring);
-			for (unsigned int k = index; k <= index + count; k++)
-			{
-				m_lookupCache[k].child = child;
-				m_lookupCache[k].index = index;
-			}
-			m_maxCachedIndex = index + count;
-			item -= count + 1;
-			index += count + 1;
-			continue;
-		}
-
-		return (*iter)->GetChild(item - 1);
-	}
-	return 0;
+	return child->GetChild(offset - 1);
 }
 
 unsigned int CQueueItem::GetChildrenCount(bool recursive)
 {
 	if (!recursive)
-		return m_children.size() - m_removed_at_front;
+		return m_children.size() - m_removedChildren;
 
 	return m_visibleOffspring;
 }
 
 bool CQueueItem::RemoveChild(CQueueItem* pItem, bool destroy /*=true*/)
 {
-	int oldVisibleOffspring = m_visibleOffspring;
-	bool deleted = false;
-	for (auto iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter)
+	// Find the child containing the item by following its parents
+	size_t slot;
+	CQueueItem* child = pItem;
+	while (child && child->m_parent != this)
+		child = child->m_parent;
+	if (child && IsChild(child))
+		slot = child->m_slot;
+	else
 	{
-		if (*iter == pItem)
+		// Parents not set up, search the whole tree
+		for (slot = 0; slot < m_children.size(); ++slot)
 		{
-			m_visibleOffspring -= 1;
-			m_visibleOffspring -= pItem->m_visibleOffspring;
-			if (destroy)
-				delete pItem;
+			child = m_children[slot];
+			if (child == pItem)
+				break;
 
-			if (iter - m_children.begin() - m_removed_at_front <= 10)
+			if (child && child->RemoveChild(pItem, destroy))
 			{
-				m_removed_at_front++;
-				unsigned int end = iter - m_children.begin();
-				int c = 0;
-				for (int i = end; i >= m_removed_at_front; i--, c++)
-					m_children[i] = m_children[i - 1];
+				if (!child->GetChildrenCount(false))
+					RemoveChildAt(slot, true);
+				return true;
 			}
-			else
-				m_children.erase(iter);
-
-			deleted = true;
-			break;
 		}
+		if (slot == m_children.size())
+			return false;
+	}
 
-		int visibleOffspring = (*iter)->m_visibleOffspring;
-		if ((*iter)->RemoveChild(pItem, destroy))
-		{
-			m_visibleOffspring -= visibleOffspring - (*iter)->m_visibleOffspring;
-			if (!((*iter)->m_children.size() - (*iter)->m_removed_at_front))
-			{
-				m_visibleOffspring -= 1;
-				delete *iter;
+	if (child == pItem)
+	{
+		RemoveChildAt(slot, destroy);
+		return true;
+	}
 
-				if (iter - m_children.begin() - m_removed_at_front <= 10)
-				{
-					m_removed_at_front++;
-					unsigned int end = iter - m_children.begin();
-					for (int i = end; i >= m_removed_at_front; i--)
-						m_children[i] = m_children[i - 1];
-				}
-				else
-					m_children.erase(iter);
-			}
+	if (!child->RemoveChild(pItem, destroy))
+		return false;
 
-			deleted = true;
-			break;
-		}
+	if (!child->GetChildrenCount(false))
+		RemoveChildAt(slot, true);
+
+	return true;
+}
+
+void CQueueItem::RemoveChildAt(size_t slot, bool destroy)
+{
+	CQueueItem* child = m_children[slot];
+	int const count = 1 + child->m_visibleOffspring;
+	m_childIndex.add(slot, -count);
+	UpdateVisibleOffspring(-count);
+
+	m_children[slot] = 0;
+	++m_removedChildren;
+	child->m_slot = -1;
+	if (destroy)
+		delete child;
+
+	if (m_removedChildren == static_cast<int>(m_children.size()))
+	{
+		m_children.clear();
+		m_childIndex.clear();
+		m_removedChildren = 0;
 	}
+	else if (m_removedChildren > 32 && static_cast<size_t>(m_removedChildren) * 2 > m_children.size())
+		Compact();
+}
 
-	if (!deleted)
-		return false;
+void CQueueItem::Compact()
+{
+	std::vector<CQueueItem*> children;
+	children.reserve(m_children.size() - m_removedChildren);
+	for (auto iter = m_children.begin(); iter != m_children.end(); ++iter)
+		if (*iter)
+			children.push_back(*iter);
 
-	m_maxCachedIndex = -1;
+	SetChildren(std::move(children));
+}
 
-	// Propagate new children count to parent
-	CQueueItem* parent = GetParent();
-	while (parent)
+void CQueueItem::SetChildren(std::vector<CQueueItem*> && children)
+{
+	m_children = std::move(children);
+	m_removedChildren = 0;
+
+	std::vector<int> counts;
+	counts.reserve(m_children.size());
+	int visibleOffspring = 0;
+	for (size_t i = 0; i < m_children.size(); ++i)
 	{
-		parent->m_maxCachedIndex = -1;
-		parent->m_visibleOffspring -= oldVisibleOffspring - m_visibleOffspring;
-		parent = parent->GetParent();
+		m_children[i]->m_slot = i;
+		counts.push_back(1 + m_children[i]->m_visibleOffspring);
+		visibleOffspring += counts.back();
 	}
+	m_childIndex.assign(counts);
 
-	return true;
+	UpdateVisibleOffspring(visibleOffspring - m_visibleOffspring);
 }
 
 bool CQueueItem::TryRemoveAll()
 {
-	const int oldVisibleOffspring = m_visibleOffspring;
-	std::vector<CQueueItem*>::iterator iter;
 	std::vector<CQueueItem*> keepChildren;
-	m_visibleOffspring = 0;
-	for (iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter)
+	for (auto iter = m_children.begin(); iter != m_children.end(); ++iter)
 	{
 		CQueueItem* pItem = *iter;
+		if (!pItem)
+			continue;
 		if (pItem->TryRemoveAll())
 			delete pItem;
 		else
-		{
 			keepChildren.push_back(pItem);
-			m_visibleOffspring++;
-			m_visibleOffspring += pItem->GetChildrenCount(true);
-		}
-	}
-	m_children = keepChildren;
-	m_maxCachedIndex = -1;
-	m_removed_at_front = 0;
-
-	CQueueItem* parent = GetParent();
-	while (parent)
-	{
-		parent->m_maxCachedIndex = -1;
-		parent->m_visibleOffspring -= oldVisibleOffspring - m_visibleOffspring;
-		parent = parent->GetParent();
 	}
+	SetChildren(std::move(keepChildren));
 
 	return m_children.empty();
 }
@@ -259,16 +259,9 @@ int CQueueItem::GetItemIndex() const
 	if (!pParent)
 		return 0;
 
-	int index = 1;
-	for (std::vector<CQueueItem*>::const_iterator iter = pParent->m_children.begin() + pParent->m_removed_at_front; iter != pParent->m_children.end(); ++iter)
-	{
-		if (*iter == this)
-			break;
-
-		index += (*iter)->GetChildrenCount(true) + 1;
-	}
+	wxASSERT(pParent->IsChild(this));
 
-	return index + pParent->GetItemIndex();
+	return 1 + pParent->m_childIndex.prefix(m_slot) + pParent->GetItemIndex();
 }
 
 CFileItem::CFileItem(CServerItem* parent, bool queued, bool download,
@@ -291,6 +284,66 @@ CFileItem::~CFileItem()
 {
 }
 
+namespace {
+CSlabAllocator& FileItemAllocator()
+{
+	static CSlabAllocator allocator(sizeof(CFileItem));
+	return allocator;
+}
+
+CSlabAllocator& FolderItemAllocator()
+{
+	static CSlabAllocator allocator(sizeof(CFolderItem));
+	return allocator;
+}
+
+// Rough estimate of the memory taken by allocating an object on its own.
+// Common heap implementations add a header of one pointer and round up to
+// twice the size of a pointer.
+size_t HeapSize(size_t size)
+{
+	size_t const granularity = 2 * sizeof(void*);
+	return (size + sizeof(void*) + granularity - 1) / granularity * granularity;
+}
+
+// Rough size of the data of a path, ignoring the string objects themselves
+size_t PathSize(CLocalPath const& path)
+{
+	return path.empty() ? 0 : (path.GetPath().size() + 1) * sizeof(wxChar);
+}
+
+size_t PathSize(CServerPath const& path)
+{
+	return path.empty() ? 0 : (path.GetPath().size() + 1) * sizeof(wxChar);
+}
+}
+
+void* CFileItem::operator new(size_t size)
+{
+	if (size == sizeof(CFileItem))
+		return FileItemAllocator().allocate();
+	if (size == sizeof(CFolderItem))
+		return FolderItemAllocator().allocate();
+	return ::operator new(size);
+}
+
+void CFileItem::operator delete(void* p, size_t size)
+{
+	if (size == sizeof(CFileItem))
+		FileItemAllocator().deallocate(p);
+	else if (size == sizeof(CFolderItem))
+		FolderItemAllocator().deallocate(p);
+	else
+		::operator delete(p);
+}
+
+void CFileItem::GetAllocationStats(size_t& items, size_t& reserved, size_t& unpooled)
+{
+	items = FileItemAllocator().used() + FolderItemAllocator().used();
+	reserved = FileItemAllocator().reserved() + FolderItemAllocator().reserved();
+	unpooled = FileItemAllocator().used() * HeapSize(sizeof(CFileItem)) + FolderItemAllocator().used() * HeapSize(sizeof(CFolderItem));
+}
+
 void CFileItem::SetPriority(QueuePriority priority)
 {
 	if (priority == m_priority)
@@ -304,6 +357,16 @@ void CFileItem::SetPriority(QueuePriority priority)
 	m_priority = priority;
 }
 
+void CFileItem::SetSize(wxLongLong size)
+{
+	if (size == m_size)
+		return;
+
+	if (m_parent && m_parent->IsChild(this))
+		static_cast<CServerItem*>(m_parent)->SetChildSize(this, m_size, size);
+	m_size = size;
+}
+
 void CFileItem::SetPriorityRaw(QueuePriority priority)
 {
 	m_priority = priority;
@@ -320,12 +383,16 @@ void CFileItem::SetActive(const bool active)
 	{
 		AddChild(new CStatusItem);
 		flags |= flag_active;
+		if (m_parent)
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, true);
 	}
 	else if (!active && IsActive())
 	{
 		CQueueItem* pItem = GetChild(0, false);
 		RemoveChild(pItem);
 		flags &= ~flag_active;
+		if (m_parent)
+			static_cast<CServerItem*>(m_parent)->SetChildActive(this, false);
 	}
 }
 
@@ -423,10 +490,16 @@ void CFolderItem::SaveItem(TiXmlElement* pElement) const
 
 void CFolderItem::SetActive(const bool active)
 {
+	if (active == IsActive())
+		return;
+
 	if (active)
 		flags |= flag_active;
 	else
 		flags &= ~flag_active;
+
+	if (m_parent)
+		static_cast<CServerItem*>(m_parent)->SetChildActive(this, active);
 }
 
 CServerItem::CServerItem(const CServer& server)
@@ -454,7 +527,89 @@ void CServerItem::AddChild(CQueueItem* pItem)
 	CQueueItem::AddChild(pItem);
 	if (pItem->GetType() == QueueItemType::File ||
 		pItem->GetType() == QueueItemType::Folder)
+	{
+		SharePaths(*(CFileItem*)pItem);
 		AddFileItemToList((CFileItem*)pItem);
+	}
+	UpdateTotals(*pItem, 1);
+}
+
+void CServerItem::AddChildren(std::vector<CQueueItem*> const& items)
+{
+	CQueueItem::AddChildren(items);
+	for (auto pItem : items)
+	{
+		if (pItem->GetType() == QueueItemType::File ||
+			pItem->GetType() == QueueItemType::Folder)
+		{
+			SharePaths(*(CFileItem*)pItem);
+			AddFileItemToList((CFileItem*)pItem);
+		}
+		UpdateTotals(*pItem, 1);
+	}
+}
+
+void CServerItem::SharePaths(CFileItem& item)
+{
+	if (!item.m_localPath.empty())
+		item.m_localPath = *m_localPaths.insert(item.m_localPath).first;
+	if (!item.m_remotePath.empty())
+		item.m_remotePath = *m_remotePaths.insert(item.m_remotePath).first;
+}
+
+void CServerItem::GetPathStats(size_t& shared, size_t& unshared) const
+{
+	shared = 0;
+	for (auto const& path : m_localPaths)
+		shared += PathSize(path);
+	for (auto const& path : m_remotePaths)
+		shared += PathSize(path);
+
+	unshared = 0;
+	for (auto const* child : GetChildren())
+	{
+		if (!child || (child->GetType() != QueueItemType::File && child->GetType() != QueueItemType::Folder))
+			continue;
+
+		CFileItem const& item = *static_cast<CFileItem const*>(child);
+		unshared += PathSize(item.GetLocalPath()) + PathSize(item.GetRemotePath());
+	}
+}
+
+void CServerItem::UpdateTotals(CQueueItem const& item, int sign)
+{
+	if (item.GetType() == QueueItemType::File)
+	{
+		m_fileCount += sign;
+
+		wxLongLong const size = static_cast<CFileItem const&>(item).GetSize();
+		if (size < 0)
+			m_filesWithUnknownSize += sign;
+		else if (sign > 0)
+			m_totalSize += size;
+		else
+			m_totalSize -= size;
+	}
+	else if (item.GetType() == QueueItemType::Folder)
+		m_fileCount += sign;
+	else if (item.GetType() == QueueItemType::FolderScan)
+		m_folderScanCount += sign;
+}
+
+void CServerItem::SetChildSize(CFileItem* pItem, wxLongLong oldSize, wxLongLong newSize)
+{
+	if (pItem->GetType() != QueueItemType::File)
+		return;
+
+	if (oldSize < 0)
+		m_filesWithUnknownSize--;
+	else
+		m_totalSize -= oldSize;
+
+	if (newSize < 0)
+		m_filesWithUnknownSize++;
+	else
+		m_totalSize += newSize;
 }
 
 void CServerItem::AddFileItemToList(CFileItem* pItem)
@@ -462,25 +617,33 @@ void CServerItem::AddFileItemToList(CFileItem* pItem)
 	if (!pItem)
 		return;
 
-	m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())].push_back(pItem);
+	if (pItem->IsActive())
+		m_idleFiles.move_back(*pItem);
+	else
+		m_idleFiles.push_back(*pItem, !pItem->queued(), static_cast<int>(pItem->GetPriority()), pItem->Download());
 }
 
 void CServerItem::RemoveFileItemFromList(CFileItem* pItem)
 {
-	std::list<CFileItem*>& fileList = m_fileList[pItem->queued() ? 0 : 1][static_cast<int>(pItem->GetPriority())];
-	for (auto iter = fileList.begin(); iter != fileList.end(); ++iter) {
-		if (*iter == pItem) {
-			fileList.erase(iter);
-			return;
-		}
-	}
-	wxFAIL_MSG(_T("File item not deleted from m_fileList"));
+	wxASSERT(pItem->IsActive() || pItem->m_idleHook.linked());
+	m_idleFiles.remove(*pItem);
+}
+
+void CServerItem::SetChildActive(CFileItem* pItem, bool active)
+{
+	if (active)
+		m_idleFiles.remove(*pItem);
+	else if (!pItem->m_idleHook.linked())
+		m_idleFiles.requeue(*pItem, !pItem->queued(), static_cast<int>(pItem->GetPriority()), pItem->Download());
 }
 
 void CServerItem::SetDefaultFileExistsAction(CFileExistsNotification::OverwriteAction action, const TransferDirection direction)
 {
-	for (auto iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter) {
+	for (auto iter = m_children.begin(); iter != m_children.end(); ++iter) {
 		CQueueItem *pItem = *iter;
+		if (!pItem)
+			continue;
+
 		if (pItem->GetType() == QueueItemType::File) {
 			CFileItem* pFileItem = ((CFileItem *)pItem);
 			if (direction == TransferDirection::upload && pFileItem->Download())
@@ -497,38 +660,16 @@ void CServerItem::SetDefaultFileExistsAction(CFileExistsNotification::OverwriteA
 	}
 }
 
-namespace {
-CFileItem* DoGetIdleChild(std::list<CFileItem*> const* fileList, TransferDirection direction)
+CFileItem* CServerItem::GetIdleChild(bool immediateOnly, TransferDirection direction, TransferPolicy policy, bool smallOnly)
 {
-	int i = 0;
-	for (i = static_cast<int>(QueuePriority::count) - 1; i >= 0; --i) {
-		for (auto const& item : fileList[i]) {
-			if (item->IsActive())
-				continue;
+	bool const download = direction != TransferDirection::upload;
+	bool const upload = direction != TransferDirection::download;
 
-			if (direction == TransferDirection::both)
-				return item;
-
-			if (direction == TransferDirection::download)
-			{
-				if (item->Download())
-					return item;
-			}
-			else if (!item->Download())
-				return item;
-		}
-	}
-	return 0;
-}
-}
-
-CFileItem* CServerItem::GetIdleChild(bool immediateOnly, TransferDirection direction)
-{
-	CFileItem* item = DoGetIdleChild(m_fileList[1], direction);
-	if( !item && !immediateOnly ) {
-		item = DoGetIdleChild(m_fileList[0], direction);
-	}
-	return item;
+	auto size = [](CFileItem const& item) -> int64_t {
+		// Folder items merely create directories
+		return (item.GetType() == QueueItemType::Folder) ? 0 : item.GetSize().GetValue();
+	};
+	return transfer_policy::pick(m_idleFiles, policy, smallOnly, immediateOnly, download, upload, size);
 }
 
 bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy /*=true*/)
@@ -542,27 +683,19 @@ bool CServerItem::RemoveChild(CQueueItem* pItem, bool destroy /*=true*/)
 		RemoveFileItemFromList(pFileItem);
 	}
 
+	if (IsChild(pItem))
+		UpdateTotals(*pItem, -1);
+
 	return CQueueItem::RemoveChild(pItem, destroy);
 }
 
 void CServerItem::QueueImmediateFiles()
 {
-	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i) {
-		std::list<CFileItem*> activeList;
-		std::list<CFileItem*>& fileList = m_fileList[1][i];
-		for (std::list<CFileItem*>::reverse_iterator iter = fileList.rbegin(); iter != fileList.rend(); ++iter) {
-			CFileItem* item = *iter;
-			wxASSERT(!item->queued());
-			if (item->IsActive())
-				activeList.push_front(item);
-			else
-			{
-				item->set_queued(true);
-				m_fileList[0][i].push_front(item);
-			}
-		}
-		fileList = activeList;
-	}
+	// Active immediate items stay immediate
+	m_idleFiles.queue_immediate([](CFileItem& item) {
+		wxASSERT(!item.queued());
+		item.set_queued(true);
+	});
 }
 
 void CServerItem::QueueImmediateFile(CFileItem* pItem)
@@ -570,18 +703,13 @@ void CServerItem::QueueImmediateFile(CFileItem* pItem)
 	if (pItem->queued())
 		return;
 
-	std::list<CFileItem*>& fileList = m_fileList[1][static_cast<int>(pItem->GetPriority())];
-	for (auto iter = fileList.begin(); iter != fileList.end(); ++iter)
-	{
-		if (*iter != pItem)
-			continue;
-
-		pItem->set_queued(true);
-		fileList.erase(iter);
-		m_fileList[0][static_cast<int>(pItem->GetPriority())].push_front(pItem);
-		return;
+	pItem->set_queued(true);
+	if (pItem->IsActive())
+		m_idleFiles.move_front(*pItem);
+	else {
+		m_idleFiles.remove(*pItem);
+		m_idleFiles.push_front(*pItem, false, static_cast<int>(pItem->GetPriority()), pItem->Download());
 	}
-	wxASSERT(false);
 }
 
 void CServerItem::SaveItem(TiXmlElement* pElement) const
@@ -589,53 +717,90 @@ void CServerItem::SaveItem(TiXmlElement* pElement) const
 	TiXmlElement *server = new TiXmlElement("Server");
 	SetServer(server, m_server);
 
-	for (std::vector<CQueueItem*>::const_iterator iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter)
-		(*iter)->SaveItem(server);
+	for (std::vector<CQueueItem*>::const_iterator iter = m_children.begin(); iter != m_children.end(); ++iter)
+		if (*iter)
+			(*iter)->SaveItem(server);
 
 	pElement->LinkEndChild(server);
 }
 
+void CServerItem::SaveItem(CXmlStreamWriter& writer) const
+{
+	writer.start("Server");
+
+	TiXmlElement server("Server");
+	SetServer(&server, m_server);
+	for (TiXmlElement* pElement = server.FirstChildElement(); pElement; pElement = pElement->NextSiblingElement())
+		WriteElement(writer, *pElement);
+
+	for (std::vector<CQueueItem*>::const_iterator iter = m_children.begin(); iter != m_children.end(); ++iter)
+	{
+		if (!*iter)
+			continue;
+
+		TiXmlElement parent("Server");
+		(*iter)->SaveItem(&parent);
+		if (TiXmlElement* pElement = parent.FirstChildElement())
+			WriteElement(writer, *pElement);
+	}
+
+	writer.end();
+}
+
 wxLongLong CServerItem::GetTotalSize(int& filesWithUnknownSize, int& queuedFiles, int& folderScanCount) const
+{
+	filesWithUnknownSize += m_filesWithUnknownSize;
+	queuedFiles += m_fileCount;
+	folderScanCount += m_folderScanCount;
+
+	return m_totalSize;
+}
+
+#if wxDEBUG_LEVEL >= 2
+void CServerItem::VerifyTotals() const
 {
 	wxLongLong totalSize = 0;
-	for (int i = 0; i < static_cast<int>(QueuePriority::count); ++i)
+	int filesWithUnknownSize = 0;
+	int fileCount = 0;
+	int folderScanCount = 0;
+	for (std::vector<CQueueItem*>::const_iterator iter = m_children.begin(); iter != m_children.end(); ++iter)
 	{
-		for (int j = 0; j < 2; j++)
+		if (!*iter)
+			continue;
+
+		if ((*iter)->GetType() == QueueItemType::File)
 		{
-			const std::list<CFileItem*>& fileList = m_fileList[j][i];
-			for (std::list<CFileItem*>::const_iterator iter = fileList.begin(); iter != fileList.end(); ++iter)
-			{
-				const CFileItem* item = *iter;
-				wxLongLong size = item->GetSize();
-				if (size >= 0)
-					totalSize += size;
-				else
-					filesWithUnknownSize++;
-			}
-		}
-	}
+			fileCount++;
 
-	for (std::vector<CQueueItem*>::const_iterator iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter)
-	{
-		if ((*iter)->GetType() == QueueItemType::File ||
-			(*iter)->GetType() == QueueItemType::Folder)
-			queuedFiles++;
+			wxLongLong const size = static_cast<CFileItem const*>(*iter)->GetSize();
+			if (size >= 0)
+				totalSize += size;
+			else
+				filesWithUnknownSize++;
+		}
+		else if ((*iter)->GetType() == QueueItemType::Folder)
+			fileCount++;
 		else if ((*iter)->GetType() == QueueItemType::FolderScan)
 			folderScanCount++;
 	}
 
-	return totalSize;
+	wxASSERT(totalSize == m_totalSize);
+	wxASSERT(filesWithUnknownSize == m_filesWithUnknownSize);
+	wxASSERT(fileCount == m_fileCount);
+	wxASSERT(folderScanCount == m_folderScanCount);
 }
+#endif
 
 bool CServerItem::TryRemoveAll()
 {
-	const int oldVisibleOffspring = m_visibleOffspring;
 	std::vector<CQueueItem*>::iterator iter;
 	std::vector<CQueueItem*> keepChildren;
-	m_visibleOffspring = 0;
-	for (iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter)
+	for (iter = m_children.begin(); iter != m_children.end(); ++iter)
 	{
 		CQueueItem* pItem = *iter;
+		if (!pItem)
+			continue;
+
 		if (pItem->TryRemoveAll())
 		{
 			if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder)
@@ -643,24 +808,13 @@ bool CServerItem::TryRemoveAll()
 				CFileItem* pFileItem = reinterpret_cast<CFileItem*>(pItem);
 				RemoveFileItemFromList(pFileItem);
 			}
+			UpdateTotals(*pItem, -1);
 			delete pItem;
 		}
 		else
-		{
 			keepChildren.push_back(pItem);
-			m_visibleOffspring++;
-			m_visibleOffspring += pItem->GetChildrenCount(true);
-		}
-	}
-	m_children = keepChildren;
-	m_removed_at_front = 0;
-
-	CQueueItem* parent = GetParent();
-	while (parent)
-	{
-		parent->m_visibleOffspring -= oldVisibleOffspring - m_visibleOffspring;
-		parent = parent->GetParent();
 	}
+	SetChildren(std::move(keepChildren));
 
 	return m_children.empty();
 }
@@ -670,48 +824,43 @@ void CServerItem::DetachChildren()
 	wxASSERT(!m_activeCount);
 
 	m_children.clear();
+	m_childIndex.clear();
+	m_removedChildren = 0;
 	m_visibleOffspring = 0;
-	m_maxCachedIndex = -1;
-	m_removed_at_front = 0;
 
-	for (int i = 0; i < 2; i++)
-		for (int j = 0; j < static_cast<int>(QueuePriority::count); j++)
-			m_fileList[i][j].clear();
+	m_idleFiles.clear();
+
+	m_totalSize = 0;
+	m_filesWithUnknownSize = 0;
+	m_fileCount = 0;
+	m_folderScanCount = 0;
 }
 
 void CServerItem::SetPriority(QueuePriority priority)
 {
 	std::vector<CQueueItem*>::iterator iter;
-	for (iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter)
+	for (iter = m_children.begin(); iter != m_children.end(); ++iter)
 	{
+		if (!*iter)
+			continue;
+
 		if ((*iter)->GetType() == QueueItemType::File)
 			((CFileItem*)(*iter))->SetPriorityRaw(priority);
 		else
 			(*iter)->SetPriority(priority);
 	}
 
-	for (int i = 0; i < 2; ++i)
-		for (int j = 0; j < static_cast<int>(QueuePriority::count); ++j) {
-			if (j != static_cast<int>(priority))
-				m_fileList[i][static_cast<int>(priority)].splice(m_fileList[i][static_cast<int>(priority)].end(), m_fileList[i][j]);
-		}
+	m_idleFiles.set_priority(static_cast<int>(priority));
 }
 
-void CServerItem::SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority)
+void CServerItem::SetChildPriority(CFileItem* pItem, QueuePriority, QueuePriority newPriority)
 {
-	int i = pItem->queued() ? 0 : 1;
-
-	for (auto iter = m_fileList[i][static_cast<int>(oldPriority)].begin(); iter != m_fileList[i][static_cast<int>(oldPriority)].end(); ++iter)
-	{
-		if (*iter != pItem)
-			continue;
-
-		m_fileList[i][static_cast<int>(oldPriority)].erase(iter);
-		m_fileList[i][static_cast<int>(newPriority)].push_back(pItem);
-		return;
+	if (pItem->IsActive())
+		m_idleFiles.move_back(*pItem);
+	else {
+		m_idleFiles.remove(*pItem);
+		m_idleFiles.push_back(*pItem, !pItem->queued(), static_cast<int>(newPriority), pItem->Download());
 	}
-
-	wxFAIL;
 }
 
 CFolderScanItem::CFolderScanItem(CServerItem* parent, bool queued, bool download, const CLocalPath& localPath, const CServerPath& remotePath)
@@ -1311,6 +1460,35 @@ void CQueueViewBase::InsertItem(CServerItem* pServerItem, CQueueItem* pItem)
 	}
 }
 
+void CQueueViewBase::InsertItems(CServerItem* pServerItem, std::vector<CQueueItem*> const& items)
+{
+	if (items.empty())
+		return;
+
+	const int newIndex = GetItemIndex(pServerItem) + pServerItem->GetChildrenCount(true) + 1;
+
+	pServerItem->AddChildren(items);
+	m_itemCount += items.size();
+
+	if (m_insertionStart == -1)
+		m_insertionStart = newIndex;
+	m_insertionCount += items.size();
+
+	for (auto pItem : items)
+	{
+		if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder)
+		{
+			m_fileCount++;
+			m_fileCountChanged = true;
+		}
+		else if (pItem->GetType() == QueueItemType::FolderScan)
+		{
+			m_folderScanCount++;
+			m_folderScanCountChanged = true;
+		}
+	}
+}
+
 bool CQueueViewBase::RemoveItem(CQueueItem* pItem, bool destroy, bool updateItemCount /*=true*/, bool updateSelections /*=true*/)
 {
 	if (pItem->GetType() == QueueItemType::File || pItem->GetType() == QueueItemType::Folder)
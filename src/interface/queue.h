@@ -4,7 +4,16 @@
 #include "aui_notebook_ex.h"
 #include "listctrlex.h"
 #include "edithandler.h"
+#include "fenwick_tree.h"
+#include "idlequeue.h"
 #include "optional.h"
+#include "slab_allocator.h"
+#include "transfer_policy.h"
+
+#include <set>
+#include <unordered_set>
+
+class CXmlStreamWriter;
 
 enum class QueuePriority : char {
 	lowest,
@@ -40,6 +49,7 @@ public:
 	virtual void SetPriority(QueuePriority priority);
 
 	virtual void AddChild(CQueueItem* pItem);
+	virtual void AddChildren(std::vector<CQueueItem*> const& items); // Like AddChild, updates the parents only once
 	unsigned int GetChildrenCount(bool recursive);
 	CQueueItem* GetChild(unsigned int item, bool recursive = true);
 	CQueueItem* GetParent() { return m_parent; }
@@ -51,6 +61,7 @@ public:
 	CQueueItem* GetTopLevelItem();
 	const CQueueItem* GetTopLevelItem() const;
 	int GetItemIndex() const; // Return the visible item index relative to the topmost parent item.
+	bool IsChild(CQueueItem const* item) const; // Whether the item is a direct child
 	virtual void SaveItem(TiXmlElement*) const {}
 
 	virtual QueueItemType GetType() const = 0;
@@ -58,8 +69,9 @@ public:
 	wxDateTime GetTime() const { return m_time; }
 	void UpdateTime() { m_time = wxDateTime::UNow(); }
 
+	// Removed children are left as null entries until enough of them have
+	// accumulated. Skip them when iterating.
 	const std::vector<CQueueItem*>& GetChildren() const { return m_children; }
-	int GetRemovedAtFront() const { return m_removed_at_front; }
 
 protected:
 	CQueueItem(CQueueItem* parent = 0);
@@ -67,74 +79,35 @@ protected:
 	CQueueItem* m_parent;
 
 	int m_visibleOffspring{}; // Visible offspring over all sublevels
-	int m_maxCachedIndex{-1};
 
-	struct t_cacheItem
-	{
-		int index;
-		int child;
-	};
-	std::vector<t_cacheItem> m_lookupCache;
+	// Adds delta to the visible offspring of this item and its parents
+	void UpdateVisibleOffspring(int delta);
+
+	// Replaces the children, e.g. after removing some of them
+	void SetChildren(std::vector<CQueueItem*> && children);
 
 	friend class CServerItem;
 
 	wxDateTime m_time;
 
 private:
-	std::vector<CQueueItem*> m_children;
-
-	// Number of items removed at front of list
-	// Increased instead of calling slow m_children.erase(0),
-	// resetted on insert.
-	int m_removed_at_front{};
-};
+	void RemoveChildAt(size_t slot, bool destroy);
+	void Compact();
 
-class CFileItem;
-class CServerItem : public CQueueItem
-{
-public:
-	CServerItem(const CServer& server);
-	virtual ~CServerItem();
-	virtual QueueItemType GetType() const { return QueueItemType::Server; }
-
-	const CServer& GetServer() const;
-	wxString GetName() const;
-
-	virtual void AddChild(CQueueItem* pItem);
-
-	CFileItem* GetIdleChild(bool immadiateOnly, TransferDirection direction);
-	virtual bool RemoveChild(CQueueItem* pItem, bool destroy = true); // Removes a child item with is somewhere in the tree of children
-	wxLongLong GetTotalSize(int& filesWithUnknownSize, int& queuedFiles, int& folderScanCount) const;
-
-	void QueueImmediateFiles();
-	void QueueImmediateFile(CFileItem* pItem);
-
-	virtual void SaveItem(TiXmlElement* pElement) const;
-
-	void SetDefaultFileExistsAction(CFileExistsNotification::OverwriteAction action, const TransferDirection direction);
-
-	virtual bool TryRemoveAll();
-
-	void DetachChildren();
-
-	virtual void SetPriority(QueuePriority priority);
-
-	void SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority);
-
-	int m_activeCount;
+	std::vector<CQueueItem*> m_children;
 
-protected:
-	void AddFileItemToList(CFileItem* pItem);
-	void RemoveFileItemFromList(CFileItem* pItem);
+	// Visible items per child, that is the child itself along with its
+	// visible offspring. Maps item indexes to children and vice versa.
+	CFenwickTree m_childIndex;
 
-	CServer m_server;
+	// Position in the children of the parent
+	int m_slot{-1};
 
-	// array of item lists, sorted by priority. Used by scheduler to find
-	// next file to transfer
-	// First index specifies whether the item is queued (0) or immediate (1)
-	std::list<CFileItem*> m_fileList[2][static_cast<int>(QueuePriority::count)];
+	// Number of null entries in m_children
+	int m_removedChildren{};
 };
 
+class CServerItem;
 struct t_EngineData;
 
 class CFileItem : public CQueueItem
@@ -146,6 +119,15 @@ public:
 
 	virtual ~CFileItem();
 
+	// File and folder items are allocated from slabs, see slab_allocator.h
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
+
+	// Number of allocated file and folder items, the memory taken by their
+	// slabs and an estimate of the memory they would take if allocated one
+	// by one
+	static void GetAllocationStats(size_t& items, size_t& reserved, size_t& unpooled);
+
 	virtual void SetPriority(QueuePriority priority);
 	void SetPriorityRaw(QueuePriority priority);
 	QueuePriority GetPriority() const;
@@ -157,7 +139,7 @@ public:
 	const CLocalPath& GetLocalPath() const { return m_localPath; }
 	const CServerPath& GetRemotePath() const { return m_remotePath; }
 	const wxLongLong& GetSize() const { return m_size; }
-	void SetSize(wxLongLong size) { m_size = size; }
+	void SetSize(wxLongLong size);
 	inline bool Download() const { return flags & flag_download; }
 
 	inline bool queued() const { return (flags & flag_queued) != 0; }
@@ -232,6 +214,7 @@ protected:
 public:
 	t_EngineData* m_pEngineData{};
 
+	CIdleQueueHook<CFileItem> m_idleHook;
 
 	inline bool made_progress() const { return (flags & flag_made_progress) != 0; }
 	inline void set_made_progress(bool made_progress)
@@ -255,10 +238,14 @@ public:
 	}
 
 protected:
+	// The server item replaces the paths with equal ones shared by its
+	// other children
+	friend class CServerItem;
+
 	wxString const m_sourceFile;
 	CSparseOptional<wxString> m_targetFile;
-	CLocalPath const m_localPath;
-	CServerPath const m_remotePath;
+	CLocalPath m_localPath;
+	CServerPath m_remotePath;
 	wxLongLong m_size;
 };
 
@@ -275,6 +262,107 @@ public:
 	virtual void SetActive(bool active);
 };
 
+class CServerItem : public CQueueItem
+{
+public:
+	CServerItem(const CServer& server);
+	virtual ~CServerItem();
+	virtual QueueItemType GetType() const { return QueueItemType::Server; }
+
+	const CServer& GetServer() const;
+	wxString GetName() const;
+
+	virtual void AddChild(CQueueItem* pItem);
+	virtual void AddChildren(std::vector<CQueueItem*> const& items);
+
+	// If smallOnly is set, only small files and folders are considered
+	CFileItem* GetIdleChild(bool immadiateOnly, TransferDirection direction, TransferPolicy policy = TransferPolicy::queue_order, bool smallOnly = false);
+	virtual bool RemoveChild(CQueueItem* pItem, bool destroy = true); // Removes a child item with is somewhere in the tree of children
+
+	// Adds the number of files and folder scans to the given counters and
+	// returns the total size of the files. Takes constant time, the totals
+	// are kept up to date as children get added, removed or resized.
+	wxLongLong GetTotalSize(int& filesWithUnknownSize, int& queuedFiles, int& folderScanCount) const;
+
+#if wxDEBUG_LEVEL >= 2
+	// Recounts the totals from scratch and asserts they match. Takes linear
+	// time, so only done with expensive debug checks enabled.
+	void VerifyTotals() const;
+#endif
+
+	void QueueImmediateFiles();
+	void QueueImmediateFile(CFileItem* pItem);
+
+	virtual void SaveItem(TiXmlElement* pElement) const;
+
+	// Writes the items one by one, only ever keeping a single one of them
+	// in a temporary DOM
+	void SaveItem(CXmlStreamWriter& writer) const;
+
+	void SetDefaultFileExistsAction(CFileExistsNotification::OverwriteAction action, const TransferDirection direction);
+
+	virtual bool TryRemoveAll();
+
+	void DetachChildren();
+
+	virtual void SetPriority(QueuePriority priority);
+
+	void SetChildPriority(CFileItem* pItem, QueuePriority oldPriority, QueuePriority newPriority);
+
+	// Called by the file items if they get (de)activated
+	void SetChildActive(CFileItem* pItem, bool active);
+
+	// Called by the file items if their size changes
+	void SetChildSize(CFileItem* pItem, wxLongLong oldSize, wxLongLong newSize);
+
+	int m_activeCount;
+
+	// Number of distinct local and remote paths of the children
+	size_t GetLocalPathCount() const { return m_localPaths.size(); }
+	size_t GetRemotePathCount() const { return m_remotePaths.size(); }
+
+	// Rough size of the path data of the children as shared, and as it would
+	// be if each child had its own copies
+	void GetPathStats(size_t& shared, size_t& unshared) const;
+
+protected:
+	void AddFileItemToList(CFileItem* pItem);
+
+	// Makes the item use the same path objects as the other children with
+	// the same paths. Most items share their paths with lots of others, this
+	// way their data is only kept once.
+	void SharePaths(CFileItem& item);
+	void RemoveFileItemFromList(CFileItem* pItem);
+
+	// sign is 1 for added children, -1 for removed ones
+	void UpdateTotals(CQueueItem const& item, int sign);
+
+	CServer m_server;
+
+	// Totals over the children
+	wxLongLong m_totalSize;
+	int m_filesWithUnknownSize{};
+	int m_fileCount{};
+	int m_folderScanCount{};
+
+	// The idle file items. Used by scheduler to find next file to transfer
+	CIdleQueue<CFileItem, &CFileItem::m_idleHook, static_cast<int>(QueuePriority::count)> m_idleFiles;
+
+	// Exact comparison, CLocalPath ignores case on Windows
+	struct local_path_hash
+	{
+		size_t operator()(CLocalPath const& path) const { return wxStringHash()(path.GetPath()); }
+	};
+	struct local_path_equal
+	{
+		bool operator()(CLocalPath const& a, CLocalPath const& b) const { return a.GetPath() == b.GetPath(); }
+	};
+
+	// Paths of the children, kept until the server item goes away
+	std::unordered_set<CLocalPath, local_path_hash, local_path_equal> m_localPaths;
+	std::set<CServerPath> m_remotePaths;
+};
+
 class CFolderScanItem : public CQueueItem
 {
 public:
@@ -344,6 +432,7 @@ public:
 	CServerItem* CreateServerItem(const CServer& server);
 
 	virtual void InsertItem(CServerItem* pServerItem, CQueueItem* pItem);
+	virtual void InsertItems(CServerItem* pServerItem, std::vector<CQueueItem*> const& items);
 	virtual bool RemoveItem(CQueueItem* pItem, bool destroy, bool updateItemCount = true, bool updateSelections = true);
 
 	// Has to be called after adding or removing items. Also updates
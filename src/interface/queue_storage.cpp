@@ -1,12 +1,16 @@
 #include <filezilla.h>
 #include "queue_storage.h"
+#include "ipcmutex.h"
 #include "Options.h"
 #include "queue.h"
 
 #include <sqlite3.h>
 #include <wx/wx.h>
+#include <wx/thread.h>
 
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 
 #define INVALID_DATA -1
 
@@ -119,6 +123,86 @@ _column path_table_columns[] = {
 	{ _T("path"), Column_type::text, not_null }
 };
 
+namespace update_file_parameters
+{
+	enum type
+	{
+		target_file = 1,
+		size,
+		error_count,
+		priority,
+		ascii_file,
+		default_exists_action,
+		id
+	};
+}
+
+// The columns of a file or directory row, in a form that can be handed over
+// to the journal thread. Paths are kept as strings, CLocalPath and
+// CServerPath share their data without thread-safe reference counting.
+struct file_record
+{
+	bool directory{};
+	bool download{};
+	wxString sourceFile;
+	bool hasTargetFile{};
+	wxString targetFile;
+	wxString localPath;
+	wxString remotePath;
+	wxLongLong_t size{-1};
+	int errorCount{};
+	int priority{};
+	bool ascii{};
+	int defaultExistsAction{CFileExistsNotification::unknown};
+};
+
+namespace {
+// Returns false for items not stored in the database
+bool MakeRecord(CQueueItem const& item, file_record& record)
+{
+	record = file_record();
+
+	if (item.GetType() == QueueItemType::File) {
+		CFileItem const& file = static_cast<CFileItem const&>(item);
+		if (file.m_edit != CEditHandler::none)
+			return false;
+
+		record.directory = false;
+		record.download = file.Download();
+		record.sourceFile = file.GetSourceFile();
+		auto const& targetFile = file.GetTargetFile();
+		record.hasTargetFile = static_cast<bool>(targetFile);
+		if (targetFile)
+			record.targetFile = *targetFile;
+		record.localPath = file.GetLocalPath().GetPath();
+		record.remotePath = file.GetRemotePath().GetSafePath();
+		record.size = file.GetSize().GetValue();
+		record.errorCount = file.m_errorCount;
+		record.priority = static_cast<int>(file.GetPriority());
+		record.ascii = file.Ascii();
+		record.defaultExistsAction = file.m_defaultFileExistsAction;
+		return true;
+	}
+	else if (item.GetType() == QueueItemType::Folder) {
+		CFolderItem const& directory = static_cast<CFolderItem const&>(item);
+
+		record.directory = true;
+		record.download = directory.Download();
+		if (record.download)
+			record.localPath = directory.GetLocalPath().GetPath();
+		else {
+			record.sourceFile = directory.GetSourceFile();
+			record.remotePath = directory.GetRemotePath().GetSafePath();
+		}
+		record.errorCount = directory.m_errorCount;
+		record.priority = static_cast<int>(directory.GetPriority());
+		return true;
+	}
+
+	return false;
+}
+}
+
 struct fast_equal
 {
 	bool operator()(wxString const& lhs, wxString const& rhs) const
@@ -143,6 +227,8 @@ public:
 	{
 	}
 
+	bool Open();
+	void Close();
 
 	void CreateTables();
 	wxString CreateColumnDefs(_column* columns, size_t count);
@@ -152,12 +238,24 @@ public:
 	sqlite3_stmt* PrepareStatement(const wxString& query);
 	sqlite3_stmt* PrepareInsertStatement(const wxString& name, const _column*, unsigned int count);
 
-	bool SaveServer(const CServerItem& item);
-	bool SaveFile(wxLongLong server, const CFileItem& item);
-	bool SaveDirectory(wxLongLong server, const CFolderItem& item);
+	bool SaveServer(const CServerItem& item, bool kiosk_mode);
+
+	// Returns the id of the new row, -1 on failure
+	wxLongLong_t SaveServer(const CServer& server, bool kiosk_mode);
+	wxLongLong_t SaveFile(wxLongLong_t server, file_record const& record);
 
-	wxLongLong_t SaveLocalPath(const CLocalPath& path);
-	wxLongLong_t SaveRemotePath(const CServerPath& path);
+	bool UpdateFile(wxLongLong_t id, file_record const& record);
+	bool DeleteFile(wxLongLong_t id);
+	bool DeleteServer(wxLongLong_t id);
+	bool MoveFiles(wxLongLong_t from, wxLongLong_t to);
+
+	// Removes rows no longer referenced by anything
+	bool DeleteOrphans();
+
+	wxLongLong_t SaveLocalPath(const wxString& path);
+	wxLongLong_t SaveRemotePath(const wxString& safePath);
+
+	bool Step(sqlite3_stmt* statement);
 
 	void ReadLocalPaths();
 	void ReadRemotePaths();
@@ -192,6 +290,12 @@ public:
 	sqlite3_stmt* selectLocalPathQuery_;
 	sqlite3_stmt* selectRemotePathQuery_;
 
+	sqlite3_stmt* updateFileQuery_{};
+	sqlite3_stmt* deleteFileQuery_{};
+	sqlite3_stmt* deleteServerQuery_{};
+	sqlite3_stmt* deleteServerFilesQuery_{};
+	sqlite3_stmt* moveFilesQuery_{};
+
 #ifndef __WXMSW__
 	wxMBConvUTF16 utf16_;
 #endif
@@ -311,13 +415,13 @@ void CQueueStorage::Impl::ClearCaches()
 }
 
 
-wxLongLong_t CQueueStorage::Impl::SaveLocalPath(const CLocalPath& path)
+wxLongLong_t CQueueStorage::Impl::SaveLocalPath(const wxString& path)
 {
-	std::unordered_map<wxString, wxLongLong_t, wxStringHash, fast_equal>::const_iterator it = localPaths_.find(path.GetPath());
+	std::unordered_map<wxString, wxLongLong_t, wxStringHash, fast_equal>::const_iterator it = localPaths_.find(path);
 	if (it != localPaths_.end())
 		return it->second;
 
-	Bind(insertLocalPathQuery_, path_table_column_names::path, path.GetPath());
+	Bind(insertLocalPathQuery_, path_table_column_names::path, path);
 
 	int res;
 	do {
@@ -329,7 +433,7 @@ wxLongLong_t CQueueStorage::Impl::SaveLocalPath(const CLocalPath& path)
 	if (res == SQLITE_DONE)
 	{
 		wxLongLong_t id = sqlite3_last_insert_rowid(db_);
-		localPaths_[path.GetPath()] = id;
+		localPaths_[path] = id;
 		return id;
 	}
 
@@ -337,9 +441,8 @@ wxLongLong_t CQueueStorage::Impl::SaveLocalPath(const CLocalPath& path)
 }
 
 
-wxLongLong_t CQueueStorage::Impl::SaveRemotePath(const CServerPath& path)
+wxLongLong_t CQueueStorage::Impl::SaveRemotePath(const wxString& safePath)
 {
-	wxString const& safePath = path.GetSafePath();
 	std::unordered_map<wxString, wxLongLong_t, wxStringHash>::const_iterator it = remotePaths_.find(safePath);
 	if (it != remotePaths_.end())
 		return it->second;
@@ -527,10 +630,64 @@ bool CQueueStorage::Impl::PrepareStatements()
 		if (!(selectRemotePathQuery_ = PrepareStatement(query)))
 			return false;
 	}
+
+	{
+		wxString query = _T("UPDATE files SET target_file=:target_file, size=:size, error_count=:error_count, priority=:priority, ascii_file=:ascii_file, default_exists_action=:default_exists_action WHERE id=:id");
+		if (!(updateFileQuery_ = PrepareStatement(query)))
+			return false;
+	}
+
+	if (!(deleteFileQuery_ = PrepareStatement(_T("DELETE FROM files WHERE id=:id"))))
+		return false;
+	if (!(deleteServerQuery_ = PrepareStatement(_T("DELETE FROM servers WHERE id=:id"))))
+		return false;
+	if (!(deleteServerFilesQuery_ = PrepareStatement(_T("DELETE FROM files WHERE server=:server"))))
+		return false;
+	if (!(moveFilesQuery_ = PrepareStatement(_T("UPDATE files SET server=:to WHERE server=:from"))))
+		return false;
+
 	return true;
 }
 
 
+bool CQueueStorage::Impl::Open()
+{
+	int ret = sqlite3_open(GetDatabaseFilename().ToUTF8(), &db_);
+	if (ret != SQLITE_OK) {
+		sqlite3_close(db_);
+		db_ = 0;
+		return false;
+	}
+
+	if (sqlite3_exec(db_, "PRAGMA encoding=\"UTF-16le\"", 0, 0, 0) != SQLITE_OK)
+		return false;
+
+	MigrateSchema();
+	CreateTables();
+	return PrepareStatements();
+}
+
+
+void CQueueStorage::Impl::Close()
+{
+	sqlite3_finalize(insertServerQuery_);
+	sqlite3_finalize(insertFileQuery_);
+	sqlite3_finalize(insertLocalPathQuery_);
+	sqlite3_finalize(insertRemotePathQuery_);
+	sqlite3_finalize(selectServersQuery_);
+	sqlite3_finalize(selectFilesQuery_);
+	sqlite3_finalize(selectLocalPathQuery_);
+	sqlite3_finalize(selectRemotePathQuery_);
+	sqlite3_finalize(updateFileQuery_);
+	sqlite3_finalize(deleteFileQuery_);
+	sqlite3_finalize(deleteServerQuery_);
+	sqlite3_finalize(deleteServerFilesQuery_);
+	sqlite3_finalize(moveFilesQuery_);
+	sqlite3_close(db_);
+	db_ = 0;
+}
+
+
 bool CQueueStorage::Impl::Bind(sqlite3_stmt* statement, int index, int value)
 {
 	return sqlite3_bind_int(statement, index, value) == SQLITE_OK;
@@ -579,12 +736,27 @@ bool CQueueStorage::Impl::BindNull(sqlite3_stmt* statement, int index)
 }
 
 
-bool CQueueStorage::Impl::SaveServer(const CServerItem& item)
+bool CQueueStorage::Impl::SaveServer(const CServerItem& item, bool kiosk_mode)
 {
-	bool kiosk_mode = COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) != 0;
+	wxLongLong_t serverId = SaveServer(item.GetServer(), kiosk_mode);
+	if (serverId < 0)
+		return false;
 
-	const CServer& server = item.GetServer();
+	bool ret = true;
 
+	file_record record;
+	const std::vector<CQueueItem*>& children = item.GetChildren();
+	for (std::vector<CQueueItem*>::const_iterator it = children.begin(); it != children.end(); ++it) {
+		if (*it && MakeRecord(**it, record))
+			ret &= SaveFile(serverId, record) > 0;
+	}
+
+	return ret;
+}
+
+
+wxLongLong_t CQueueStorage::Impl::SaveServer(const CServer& server, bool kiosk_mode)
+{
 	Bind(insertServerQuery_, server_table_column_names::host, server.GetHost());
 	Bind(insertServerQuery_, server_table_column_names::port, static_cast<int>(server.GetPort()));
 	Bind(insertServerQuery_, server_table_column_names::protocol, static_cast<int>(server.GetProtocol()));
@@ -680,114 +852,150 @@ bool CQueueStorage::Impl::SaveServer(const CServerItem& item)
 	else
 		BindNull(insertServerQuery_, server_table_column_names::name);
 
-	int res;
-	do {
-		res = sqlite3_step(insertServerQuery_);
-	} while (res == SQLITE_BUSY);
-
-	sqlite3_reset(insertServerQuery_);
-
-	bool ret = res == SQLITE_DONE;
-	if (ret)
-	{
-		sqlite3_int64 serverId = sqlite3_last_insert_rowid(db_);
-		Bind(insertFileQuery_, file_table_column_names::server, serverId);
+	if (!Step(insertServerQuery_))
+		return -1;
 
-		const std::vector<CQueueItem*>& children = item.GetChildren();
-		for (std::vector<CQueueItem*>::const_iterator it = children.begin() + item.GetRemovedAtFront(); it != children.end(); ++it)
-		{
-			CQueueItem* item = *it;
-			if (item->GetType() == QueueItemType::File)
-				ret &= SaveFile(serverId, *reinterpret_cast<CFileItem*>(item));
-			else if (item->GetType() == QueueItemType::Folder)
-				ret &= SaveDirectory(serverId, *reinterpret_cast<CFolderItem*>(item));
-		}
-	}
-	return ret;
+	return sqlite3_last_insert_rowid(db_);
 }
 
 
-bool CQueueStorage::Impl::SaveFile(wxLongLong server, const CFileItem& file)
+wxLongLong_t CQueueStorage::Impl::SaveFile(wxLongLong_t server, file_record const& record)
 {
-	if (file.m_edit != CEditHandler::none)
-		return true;
+	Bind(insertFileQuery_, file_table_column_names::server, server);
+
+	wxLongLong_t localPathId = -1;
+	wxLongLong_t remotePathId = -1;
+	if (!record.localPath.empty()) {
+		localPathId = SaveLocalPath(record.localPath);
+		if (localPathId == -1)
+			return -1;
+	}
+	if (!record.remotePath.empty()) {
+		remotePathId = SaveRemotePath(record.remotePath);
+		if (remotePathId == -1)
+			return -1;
+	}
+	if (record.directory ? (localPathId == -1 && remotePathId == -1) : (localPathId == -1 || remotePathId == -1))
+		return -1;
 
-	Bind(insertFileQuery_, file_table_column_names::source_file, file.GetSourceFile());
-	auto const& targetFile = file.GetTargetFile();
-	if (targetFile)
-		Bind(insertFileQuery_, file_table_column_names::target_file, *targetFile);
+	if (record.directory && record.download)
+		BindNull(insertFileQuery_, file_table_column_names::source_file);
+	else
+		Bind(insertFileQuery_, file_table_column_names::source_file, record.sourceFile);
+	if (record.hasTargetFile)
+		Bind(insertFileQuery_, file_table_column_names::target_file, record.targetFile);
 	else
 		BindNull(insertFileQuery_, file_table_column_names::target_file);
 
-	wxLongLong_t localPathId = SaveLocalPath(file.GetLocalPath());
-	wxLongLong_t remotePathId = SaveRemotePath(file.GetRemotePath());
-	if (localPathId == -1 || remotePathId == -1)
-		return false;
-
 	Bind(insertFileQuery_, file_table_column_names::local_path, localPathId);
 	Bind(insertFileQuery_, file_table_column_names::remote_path, remotePathId);
 
-	Bind(insertFileQuery_, file_table_column_names::download, file.Download() ? 1 : 0);
-	if (file.GetSize() != -1)
-		Bind(insertFileQuery_, file_table_column_names::size, file.GetSize().GetValue());
+	Bind(insertFileQuery_, file_table_column_names::download, record.download ? 1 : 0);
+	if (record.size != -1 && !record.directory)
+		Bind(insertFileQuery_, file_table_column_names::size, record.size);
 	else
 		BindNull(insertFileQuery_, file_table_column_names::size);
-	if (file.m_errorCount)
-		Bind(insertFileQuery_, file_table_column_names::error_count, file.m_errorCount);
+	if (record.errorCount)
+		Bind(insertFileQuery_, file_table_column_names::error_count, record.errorCount);
 	else
 		BindNull(insertFileQuery_, file_table_column_names::error_count);
-	Bind(insertFileQuery_, file_table_column_names::priority, static_cast<int>(file.GetPriority()));
-	Bind(insertFileQuery_, file_table_column_names::ascii_file, file.Ascii() ? 1 : 0);
+	Bind(insertFileQuery_, file_table_column_names::priority, record.priority);
+	if (!record.directory)
+		Bind(insertFileQuery_, file_table_column_names::ascii_file, record.ascii ? 1 : 0);
+	else
+		BindNull(insertFileQuery_, file_table_column_names::ascii_file);
 
-	if (file.m_defaultFileExistsAction != CFileExistsNotification::unknown)
-		Bind(insertFileQuery_, file_table_column_names::default_exists_action, file.m_defaultFileExistsAction);
+	if (record.defaultExistsAction != CFileExistsNotification::unknown && !record.directory)
+		Bind(insertFileQuery_, file_table_column_names::default_exists_action, record.defaultExistsAction);
 	else
 		BindNull(insertFileQuery_, file_table_column_names::default_exists_action);
 
-	int res;
-	do {
-		res = sqlite3_step(insertFileQuery_);
-	} while (res == SQLITE_BUSY);
-
-	sqlite3_reset(insertFileQuery_);
+	if (!Step(insertFileQuery_))
+		return -1;
 
-	return res == SQLITE_DONE;
+	return sqlite3_last_insert_rowid(db_);
 }
 
 
-bool CQueueStorage::Impl::SaveDirectory(wxLongLong server, const CFolderItem& directory)
+bool CQueueStorage::Impl::UpdateFile(wxLongLong_t id, file_record const& record)
 {
-	if (directory.Download())
-		BindNull(insertFileQuery_, file_table_column_names::source_file);
+	if (record.hasTargetFile)
+		Bind(updateFileQuery_, update_file_parameters::target_file, record.targetFile);
+	else
+		BindNull(updateFileQuery_, update_file_parameters::target_file);
+	if (record.size != -1 && !record.directory)
+		Bind(updateFileQuery_, update_file_parameters::size, record.size);
+	else
+		BindNull(updateFileQuery_, update_file_parameters::size);
+	if (record.errorCount)
+		Bind(updateFileQuery_, update_file_parameters::error_count, record.errorCount);
+	else
+		BindNull(updateFileQuery_, update_file_parameters::error_count);
+	Bind(updateFileQuery_, update_file_parameters::priority, record.priority);
+	if (!record.directory)
+		Bind(updateFileQuery_, update_file_parameters::ascii_file, record.ascii ? 1 : 0);
+	else
+		BindNull(updateFileQuery_, update_file_parameters::ascii_file);
+	if (record.defaultExistsAction != CFileExistsNotification::unknown && !record.directory)
+		Bind(updateFileQuery_, update_file_parameters::default_exists_action, record.defaultExistsAction);
 	else
-		Bind(insertFileQuery_, file_table_column_names::source_file, directory.GetSourceFile());
-	BindNull(insertFileQuery_, file_table_column_names::target_file);
+		BindNull(updateFileQuery_, update_file_parameters::default_exists_action);
+	Bind(updateFileQuery_, update_file_parameters::id, id);
 
-	wxLongLong_t localPathId = directory.Download() ? SaveLocalPath(directory.GetLocalPath()) : -1;
-	wxLongLong_t remotePathId = directory.Download() ? -1 : SaveRemotePath(directory.GetRemotePath());
-	if (localPathId == -1 && remotePathId == -1)
-		return false;
+	return Step(updateFileQuery_);
+}
 
-	Bind(insertFileQuery_, file_table_column_names::local_path, localPathId);
-	Bind(insertFileQuery_, file_table_column_names::remote_path, remotePathId);
 
-	Bind(insertFileQuery_, file_table_column_names::download, directory.Download() ? 1 : 0);
-	BindNull(insertFileQuery_, file_table_column_names::size);
-	if (directory.m_errorCount)
-		Bind(insertFileQuery_, file_table_column_names::error_count, directory.m_errorCount);
-	else
-		BindNull(insertFileQuery_, file_table_column_names::error_count);
-	Bind(insertFileQuery_, file_table_column_names::priority, static_cast<int>(directory.GetPriority()));
-	BindNull(insertFileQuery_, file_table_column_names::ascii_file);
+bool CQueueStorage::Impl::DeleteFile(wxLongLong_t id)
+{
+	Bind(deleteFileQuery_, 1, id);
+	return Step(deleteFileQuery_);
+}
+
+
+bool CQueueStorage::Impl::DeleteServer(wxLongLong_t id)
+{
+	Bind(deleteServerFilesQuery_, 1, id);
+	bool ret = Step(deleteServerFilesQuery_);
+
+	Bind(deleteServerQuery_, 1, id);
+	ret &= Step(deleteServerQuery_);
+
+	return ret;
+}
+
+
+bool CQueueStorage::Impl::MoveFiles(wxLongLong_t from, wxLongLong_t to)
+{
+	// The now empty server row is left alone, it still might get referenced
+	// by the journal. DeleteOrphans takes care of it.
+	Bind(moveFilesQuery_, 1, to);
+	Bind(moveFilesQuery_, 2, from);
+	return Step(moveFilesQuery_);
+}
+
+
+bool CQueueStorage::Impl::DeleteOrphans()
+{
+	if (sqlite3_exec(db_, "DELETE FROM servers WHERE id NOT IN (SELECT server FROM files)", 0, 0, 0) != SQLITE_OK)
+		return false;
+	if (sqlite3_exec(db_, "DELETE FROM local_paths WHERE id NOT IN (SELECT local_path FROM files)", 0, 0, 0) != SQLITE_OK)
+		return false;
+	if (sqlite3_exec(db_, "DELETE FROM remote_paths WHERE id NOT IN (SELECT remote_path FROM files)", 0, 0, 0) != SQLITE_OK)
+		return false;
 
-	BindNull(insertFileQuery_, file_table_column_names::default_exists_action);
+	return true;
+}
 
+
+bool CQueueStorage::Impl::Step(sqlite3_stmt* statement)
+{
 	int res;
 	do {
-		res = sqlite3_step(insertFileQuery_);
+		res = sqlite3_step(statement);
 	} while (res == SQLITE_BUSY);
 
-	sqlite3_reset(insertFileQuery_);
+	sqlite3_reset(statement);
 
 	return res == SQLITE_DONE;
 }
@@ -1006,43 +1214,458 @@ wxLongLong_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 	return GetColumnInt64(selectFilesQuery_, file_table_column_names::id);
 }
 
-CQueueStorage::CQueueStorage()
-: d_(new Impl)
+// Writes queue changes to the database on a separate connection.
+// Changes are collected and written in batches, one transaction per batch.
+// Items are identified by their address which is never dereferenced
+// by the thread. The order of the operations takes care of addresses
+// getting reused.
+class CQueueStorage::Journal final : public wxThread
 {
-	int ret = sqlite3_open(GetDatabaseFilename().ToUTF8(), &d_->db_ );
-	if (ret != SQLITE_OK)
-		d_->db_ = 0;
+public:
+	struct operation
+	{
+		enum type
+		{
+			insert_server,
+			insert_file,
+			update_file,
+			remove_file,
+			remove_server,
+			forget_server,
+			remove_server_row,
+			adopt_server,
+			adopt_file
+		};
+
+		operation(type t, void const* key)
+			: type_(t), key_(key)
+		{}
+
+		type type_;
+		void const* key_;
+		void const* server_{};
+		wxLongLong_t id_{};
+		std::unique_ptr<CServer> serverData_;
+		std::unique_ptr<file_record> record_;
+	};
+
+	Journal()
+		: wxThread(wxTHREAD_JOINABLE)
+		, ownerMutex_(MUTEX_QUEUE_JOURNAL, false)
+		, condition_(mutex_)
+	{
+		kioskMode_ = COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) != 0;
+	}
+
+	virtual ~Journal()
+	{
+		db_.Close();
+	}
+
+	bool Init()
+	{
+		if (!db_.Open())
+			return false;
+
+		// Write-ahead logging makes the frequent small transactions cheap and
+		// lets the loading connection keep reading while changes get written.
+		if (sqlite3_exec(db_.db_, "PRAGMA journal_mode=WAL", 0, 0, 0) != SQLITE_OK)
+			return false;
+		sqlite3_exec(db_.db_, "PRAGMA synchronous=NORMAL", 0, 0, 0);
+
+		return Run() == wxTHREAD_NO_ERROR;
+	}
+
+	void Add(operation && op)
+	{
+		wxMutexLocker lock(mutex_);
+		pending_.emplace_back(std::move(op));
+		if (waiting_) {
+			waiting_ = false;
+			condition_.Signal();
+		}
+	}
+
+	void Add(std::vector<operation> && ops)
+	{
+		wxMutexLocker lock(mutex_);
+		if (pending_.empty())
+			pending_.swap(ops);
+		else {
+			for (auto & op : ops)
+				pending_.emplace_back(std::move(op));
+		}
+		if (waiting_) {
+			waiting_ = false;
+			condition_.Signal();
+		}
+	}
+
+	bool Finish()
+	{
+		{
+			wxMutexLocker lock(mutex_);
+			quit_ = true;
+			if (waiting_) {
+				waiting_ = false;
+				condition_.Signal();
+			}
+		}
+		Wait(wxTHREAD_WAIT_BLOCK);
+
+		return !error_;
+	}
+
+	CInterProcessMutex ownerMutex_;
+
+	// Server items known to the thread, only accessed from the main thread
+	std::unordered_set<void const*> knownServers_;
+
+protected:
+	virtual ExitCode Entry()
+	{
+		std::vector<operation> ops;
+
+		wxMutexLocker lock(mutex_);
+		for (;;) {
+			if (pending_.empty()) {
+				if (quit_)
+					break;
+
+				waiting_ = true;
+				condition_.Wait();
+				continue;
+			}
+
+			if (!quit_) {
+				// Give the queue some time to accumulate further changes,
+				// adding thousands of files causes thousands of operations.
+				mutex_.Unlock();
+				wxMilliSleep(200);
+				mutex_.Lock();
+			}
+
+			ops.swap(pending_);
+			mutex_.Unlock();
+
+			bool error = !Process(ops);
+			ops.clear();
 
-	if (sqlite3_exec(d_->db_, "PRAGMA encoding=\"UTF-16le\"", 0, 0, 0) == SQLITE_OK)
+			mutex_.Lock();
+			if (error)
+				error_ = true;
+		}
+
+		return 0;
+	}
+
+	bool Process(std::vector<operation> & ops)
 	{
-		d_->MigrateSchema();
-		d_->CreateTables();
-		d_->PrepareStatements();
+		int res;
+		do {
+			res = sqlite3_exec(db_.db_, "BEGIN IMMEDIATE", 0, 0, 0);
+		} while (res == SQLITE_BUSY);
+		if (res != SQLITE_OK)
+			return false;
+
+		bool ret = true;
+		for (auto & op : ops) {
+			switch (op.type_) {
+			case operation::insert_server:
+				{
+					wxLongLong_t id = db_.SaveServer(*op.serverData_, kioskMode_);
+					if (id > 0)
+						servers_[op.key_].id = id;
+					else
+						ret = false;
+				}
+				break;
+			case operation::insert_file:
+				{
+					auto const server = servers_.find(op.server_);
+					if (server != servers_.end()) {
+						wxLongLong_t id = db_.SaveFile(server->second.id, *op.record_);
+						if (id > 0)
+							server->second.files[op.key_] = id;
+						else
+							ret = false;
+					}
+				}
+				break;
+			case operation::update_file:
+			case operation::remove_file:
+				{
+					auto const server = servers_.find(op.server_);
+					if (server == servers_.end())
+						break;
+
+					auto const file = server->second.files.find(op.key_);
+					if (file == server->second.files.end())
+						break;
+
+					if (op.type_ == operation::update_file)
+						ret &= db_.UpdateFile(file->second, *op.record_);
+					else {
+						ret &= db_.DeleteFile(file->second);
+						server->second.files.erase(file);
+					}
+				}
+				break;
+			case operation::remove_server:
+			case operation::forget_server:
+				{
+					auto const server = servers_.find(op.key_);
+					if (server != servers_.end()) {
+						if (op.type_ == operation::remove_server)
+							ret &= db_.DeleteServer(server->second.id);
+						servers_.erase(server);
+					}
+				}
+				break;
+			case operation::remove_server_row:
+				ret &= db_.DeleteServer(op.id_);
+				break;
+			case operation::adopt_server:
+				{
+					auto const server = servers_.find(op.key_);
+					if (server == servers_.end())
+						servers_[op.key_].id = op.id_;
+					else if (server->second.id != op.id_)
+						ret &= db_.MoveFiles(op.id_, server->second.id);
+				}
+				break;
+			case operation::adopt_file:
+				{
+					auto const server = servers_.find(op.server_);
+					if (server != servers_.end())
+						server->second.files[op.key_] = op.id_;
+				}
+				break;
+			}
+		}
+
+		// Even on previous failure, we want to at least try to commit the data we have so far
+		ret &= sqlite3_exec(db_.db_, "COMMIT", 0, 0, 0) == SQLITE_OK;
+
+		return ret;
 	}
+
+	Impl db_;
+	bool kioskMode_{};
+
+	wxMutex mutex_;
+	wxCondition condition_;
+	std::vector<operation> pending_;
+	bool waiting_{};
+	bool quit_{};
+	bool error_{};
+
+	// Row ids of the known server items and their files, only accessed from the thread
+	struct server_rows
+	{
+		wxLongLong_t id{};
+		std::unordered_map<void const*, wxLongLong_t> files;
+	};
+	std::unordered_map<void const*, server_rows> servers_;
+};
+
+CQueueStorage::CQueueStorage()
+: d_(new Impl)
+{
+	d_->Open();
 }
 
 CQueueStorage::~CQueueStorage()
 {
-	sqlite3_finalize(d_->insertServerQuery_);
-	sqlite3_finalize(d_->insertFileQuery_);
-	sqlite3_finalize(d_->insertLocalPathQuery_);
-	sqlite3_finalize(d_->insertRemotePathQuery_);
-	sqlite3_finalize(d_->selectServersQuery_);
-	sqlite3_finalize(d_->selectFilesQuery_);
-	sqlite3_finalize(d_->selectLocalPathQuery_);
-	sqlite3_finalize(d_->selectRemotePathQuery_);
-	sqlite3_close(d_->db_);
+	CloseJournal();
+
+	d_->Close();
 	delete d_;
 }
 
+bool CQueueStorage::StartJournal()
+{
+	if (journal_)
+		return true;
+
+	if (!d_->db_)
+		return false;
+
+	Journal* journal = new Journal;
+	if (journal->ownerMutex_.TryLock() != 1) {
+		delete journal;
+		return false;
+	}
+
+	// Rows left behind by a previous owner that did not finish cleanly
+	d_->DeleteOrphans();
+
+	if (!journal->Init()) {
+		delete journal;
+		return false;
+	}
+
+	journal_ = journal;
+	return true;
+}
+
+bool CQueueStorage::IsJournaling() const
+{
+	return journal_ != 0;
+}
+
+bool CQueueStorage::CloseJournal()
+{
+	if (!journal_)
+		return true;
+
+	bool ret = journal_->Finish();
+	delete journal_;
+	journal_ = 0;
+
+	return ret;
+}
+
+void CQueueStorage::JournalInsert(CServerItem const& server, CQueueItem const& item)
+{
+	if (!journal_)
+		return;
+
+	std::unique_ptr<file_record> record(new file_record);
+	if (!MakeRecord(item, *record))
+		return;
+
+	if (journal_->knownServers_.insert(&server).second) {
+		Journal::operation op(Journal::operation::insert_server, &server);
+		op.serverData_.reset(new CServer(server.GetServer()));
+		journal_->Add(std::move(op));
+	}
+
+	Journal::operation op(Journal::operation::insert_file, &item);
+	op.server_ = &server;
+	op.record_ = std::move(record);
+	journal_->Add(std::move(op));
+}
+
+void CQueueStorage::JournalInsert(CServerItem const& server, std::vector<CQueueItem*> const& items)
+{
+	if (!journal_)
+		return;
+
+	std::vector<Journal::operation> ops;
+	ops.reserve(items.size() + 1);
+
+	if (journal_->knownServers_.insert(&server).second) {
+		Journal::operation op(Journal::operation::insert_server, &server);
+		op.serverData_.reset(new CServer(server.GetServer()));
+		ops.emplace_back(std::move(op));
+	}
+
+	for (auto const& item : items) {
+		std::unique_ptr<file_record> record(new file_record);
+		if (!MakeRecord(*item, *record))
+			continue;
+
+		Journal::operation op(Journal::operation::insert_file, item);
+		op.server_ = &server;
+		op.record_ = std::move(record);
+		ops.emplace_back(std::move(op));
+	}
+
+	// Hand over all at once, so that the journal thread doesn't get woken
+	// up for every single file.
+	journal_->Add(std::move(ops));
+}
+
+void CQueueStorage::JournalUpdate(CQueueItem const& item)
+{
+	if (!journal_)
+		return;
+
+	std::unique_ptr<file_record> record(new file_record);
+	if (!MakeRecord(item, *record))
+		return;
+
+	Journal::operation op(Journal::operation::update_file, &item);
+	op.server_ = item.GetTopLevelItem();
+	op.record_ = std::move(record);
+	journal_->Add(std::move(op));
+}
+
+void CQueueStorage::JournalRemove(CQueueItem const& item)
+{
+	if (!journal_)
+		return;
+
+	if (item.GetType() != QueueItemType::File && item.GetType() != QueueItemType::Folder)
+		return;
+
+	Journal::operation op(Journal::operation::remove_file, &item);
+	op.server_ = item.GetTopLevelItem();
+	journal_->Add(std::move(op));
+}
+
+void CQueueStorage::JournalRemoveServer(CServerItem const& server)
+{
+	if (!journal_)
+		return;
+
+	if (journal_->knownServers_.erase(&server))
+		journal_->Add(Journal::operation(Journal::operation::remove_server, &server));
+}
+
+void CQueueStorage::JournalForgetServer(CServerItem const& server)
+{
+	if (!journal_)
+		return;
+
+	if (journal_->knownServers_.erase(&server))
+		journal_->Add(Journal::operation(Journal::operation::forget_server, &server));
+}
+
+void CQueueStorage::JournalRemoveServer(wxLongLong_t id)
+{
+	if (!journal_)
+		return;
+
+	Journal::operation op(Journal::operation::remove_server_row, 0);
+	op.id_ = id;
+	journal_->Add(std::move(op));
+}
+
+void CQueueStorage::JournalAdopt(CServerItem const& server, wxLongLong_t id)
+{
+	if (!journal_)
+		return;
+
+	journal_->knownServers_.insert(&server);
+
+	Journal::operation op(Journal::operation::adopt_server, &server);
+	op.id_ = id;
+	journal_->Add(std::move(op));
+}
+
+void CQueueStorage::JournalAdopt(CQueueItem const& item, wxLongLong_t id)
+{
+	if (!journal_)
+		return;
+
+	Journal::operation op(Journal::operation::adopt_file, &item);
+	op.server_ = item.GetTopLevelItem();
+	op.id_ = id;
+	journal_->Add(std::move(op));
+}
+
 bool CQueueStorage::SaveQueue(std::vector<CServerItem*> const& queue)
 {
+	bool const kiosk_mode = COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) != 0;
+
 	d_->ClearCaches();
 
 	bool ret = true;
 	if (sqlite3_exec(d_->db_, "BEGIN TRANSACTION", 0, 0, 0) == SQLITE_OK) {
 		for (std::vector<CServerItem*>::const_iterator it = queue.begin(); it != queue.end(); ++it)
-			ret &= d_->SaveServer(**it);
+			ret &= d_->SaveServer(**it, kiosk_mode);
 
 		// Even on previous failure, we want to at least try to commit the data we have so far
 		ret &= sqlite3_exec(d_->db_, "END TRANSACTION", 0, 0, 0) == SQLITE_OK;
@@ -4,6 +4,7 @@
 #include <vector>
 
 class CFileItem;
+class CQueueItem;
 class CServerItem;
 class CServer;
 
@@ -38,10 +39,48 @@ public:
 
 	wxLongLong_t GetFile(CFileItem** pItem, wxLongLong_t server);
 
+	// Journaling
+	// ----------
+	// Once the journal has been started, the database mirrors the queue:
+	// Insertions, changes and removals get written in batches by a
+	// background thread as they happen.
+	// Only one instance can journal at a time, the journal is owned by the
+	// instance that successfully started it until CloseJournal is called.
+	// Returns false if another instance owns the journal.
+	bool StartJournal();
+	bool IsJournaling() const;
+
+	// Waits for all pending changes to be written, then stops the journal.
+	// Returns false if some changes could not be written.
+	bool CloseJournal();
+
+	void JournalInsert(CServerItem const& server, CQueueItem const& item);
+	void JournalInsert(CServerItem const& server, std::vector<CQueueItem*> const& items);
+	void JournalUpdate(CQueueItem const& item);
+	void JournalRemove(CQueueItem const& item);
+
+	// Also removes all files of that server
+	void JournalRemoveServer(CServerItem const& server);
+	void JournalRemoveServer(wxLongLong_t id);
+
+	// For server items that went away after all their files have been
+	// removed. Leaves the server row alone, it might still be referenced by
+	// files not loaded yet.
+	void JournalForgetServer(CServerItem const& server);
+
+	// Associate loaded items with their rows.
+	// If the server item already has been associated with a different row,
+	// the files of that row get moved over.
+	void JournalAdopt(CServerItem const& server, wxLongLong_t id);
+	void JournalAdopt(CQueueItem const& item, wxLongLong_t id);
+
 	static wxString GetDatabaseFilename();
 
 private:
+	class Journal;
+
 	Impl* d_;
+	Journal* journal_{};
 };
 
 #endif //__QUEUE_STORAGE_H__
@@ -6,6 +6,10 @@
 #include "Options.h"
 #include "queue.h"
 #include "local_filesys.h"
+#include "local_listing_cache.h"
+#include "local_scanner.h"
+#include "remote_search_index.h"
+#include "sync_comparison.h"
 
 CRecursiveOperation::CNewDir::CNewDir()
 {
@@ -13,6 +17,7 @@ CRecursiveOperation::CNewDir::CNewDir()
 	second_try = false;
 	link = 0;
 	doVisit = true;
+	localMissing = false;
 }
 
 CRecursiveOperation::CRecursiveOperation(CState* pState)
@@ -56,7 +61,8 @@ void CRecursiveOperation::StartRecursiveOperation(enum OperationMode mode, const
 	if (mode == recursive_chmod && !m_pChmodDlg)
 		return;
 
-	if ((mode == recursive_download || mode == recursive_addtoqueue || mode == recursive_download_flatten || mode == recursive_addtoqueue_flatten) && !m_pQueue)
+	if ((mode == recursive_download || mode == recursive_addtoqueue || mode == recursive_download_flatten || mode == recursive_addtoqueue_flatten ||
+		mode == recursive_synchronize || mode == recursive_addtoqueue_synchronize) && !m_pQueue)
 		return;
 
 	if (m_dirsToVisit.empty())
@@ -77,7 +83,12 @@ void CRecursiveOperation::StartRecursiveOperation(enum OperationMode mode, const
 
 	m_allowParent = allowParent;
 
-	m_filters = filters;
+	m_filters = CCompiledFilters(filters);
+
+	m_startTime = CMonotonicTime::Now();
+
+	if (IsSynchronizing())
+		m_localScanner.reset(new CLocalScanner);
 
 	NextOperation();
 }
@@ -107,6 +118,12 @@ bool CRecursiveOperation::NextOperation()
 	if (m_operationMode == recursive_none)
 		return false;
 
+	if (m_processingCachedListing)
+	{
+		// Called at the end of ProcessDirectoryListing, the loop below continues
+		return true;
+	}
+
 	while (!m_dirsToVisit.empty())
 	{
 		const CNewDir& dirToVisit = m_dirsToVisit.front();
@@ -117,6 +134,36 @@ bool CRecursiveOperation::NextOperation()
 			continue;
 		}
 
+		PrefetchLocalDirectories();
+
+		// Directories already listed by the prefetching engines get processed
+		// right away, in the same order as they would have been otherwise.
+		CDirectoryListing listing;
+		if (GetCachedListing(dirToVisit, listing))
+		{
+			// Not seen by the main window, unlike listings retrieved by the
+			// primary engine
+			const CServer* pServer = m_pState->GetServer();
+			if (pServer && CRemoteSearchIndex::Get())
+				CRemoteSearchIndex::Get()->Add(*pServer, listing);
+
+			m_processingCachedListing = true;
+			if (m_operationMode == recursive_list)
+			{
+				// The search dialog needs to see the listing as well
+				m_pState->SetRemoteDir(std::make_shared<CDirectoryListing>(listing), false);
+			}
+			else
+				ProcessDirectoryListing(&listing);
+			m_processingCachedListing = false;
+
+			if (m_operationMode == recursive_none)
+				return false;
+			continue;
+		}
+
+		PrefetchDirectories();
+
 		CListCommand* cmd = new CListCommand(dirToVisit.parent, dirToVisit.subdir, dirToVisit.link ? LIST_FLAG_LINK : 0);
 		m_pState->m_pCommandQueue->ProcessCommand(cmd);
 		return true;
@@ -127,6 +174,88 @@ bool CRecursiveOperation::NextOperation()
 	return false;
 }
 
+void CRecursiveOperation::PrefetchDirectories()
+{
+	if (!m_pQueue)
+		return;
+
+	// Stay a bit ahead of the prefetching connections
+	const int count = COptions::Get()->GetOptionVal(OPTION_PREFETCH_CONNECTIONS) * 2;
+	if (count <= 0)
+		return;
+
+	const CServer* pServer = m_pState->GetServer();
+	if (!pServer)
+		return;
+
+	std::vector<CServerPath> paths;
+
+	// Skip the first one, it is about to be listed
+	auto iter = m_dirsToVisit.cbegin();
+	for (++iter; iter != m_dirsToVisit.cend() && static_cast<int>(paths.size()) < count; ++iter)
+	{
+		// Links need special handling by the main engine
+		if (!iter->doVisit || iter->link)
+			continue;
+
+		CServerPath path = iter->parent;
+		if (!iter->subdir.empty() && !path.ChangePath(iter->subdir))
+			continue;
+
+		if (m_visitedDirs.find(path) != m_visitedDirs.end())
+			continue;
+
+		CDirectoryListing listing;
+		if (m_pState->m_pEngine->CacheLookup(path, listing) == FZ_REPLY_OK)
+			continue;
+
+		paths.push_back(path);
+	}
+
+	m_pQueue->PrefetchListings(*pServer, paths);
+}
+
+void CRecursiveOperation::PrefetchLocalDirectories()
+{
+	if (!m_localScanner)
+		return;
+
+	// Starting with the one about to be processed, it gets read while
+	// waiting for its remote listing
+	std::vector<CLocalPath> paths;
+	for (auto const& dir : m_dirsToVisit)
+	{
+		if (paths.size() >= 8)
+			break;
+
+		if (!dir.doVisit || dir.localMissing || dir.localDir.empty())
+			continue;
+
+		paths.push_back(dir.localDir);
+	}
+
+	m_localScanner->Prefetch(paths);
+}
+
+bool CRecursiveOperation::GetCachedListing(const CNewDir& dir, CDirectoryListing& listing)
+{
+	// Links need to be resolved by the engine
+	if (!dir.doVisit || dir.link)
+		return false;
+
+	CServerPath path = dir.parent;
+	if (!dir.subdir.empty() && !path.ChangePath(dir.subdir))
+		return false;
+
+	if (m_pState->m_pEngine->CacheLookup(path, listing) != FZ_REPLY_OK)
+		return false;
+
+	if (listing.failed() || listing.get_unsure_flags())
+		return false;
+
+	return listing.m_firstListTime >= m_startTime;
+}
+
 bool CRecursiveOperation::BelowRecursionRoot(const CServerPath& path, CNewDir &dir)
 {
 	if (!dir.start_dir.empty())
@@ -157,6 +286,44 @@ bool CRecursiveOperation::BelowRecursionRoot(const CServerPath& path, CNewDir &d
 // Defined in RemoteListView.cpp
 extern wxString StripVMSRevision(const wxString& name);
 
+void CRecursiveOperation::CompareLocal(const CDirectoryListing& listing, const CNewDir& dir, std::vector<char>& changed)
+{
+	changed.assign(listing.GetCount(), 1);
+	if (dir.localMissing)
+		return;
+
+	std::vector<CLocalFileData> localFiles;
+	CLocalListingCache* pCache = CLocalListingCache::Get();
+	if (!pCache || !pCache->Lookup(dir.localDir, localFiles))
+	{
+		if (!m_localScanner || !m_localScanner->Get(dir.localDir, localFiles))
+			return;
+	}
+
+#ifdef __WXMSW__
+	const bool caseSensitive = false;
+#else
+	const bool caseSensitive = true;
+#endif
+
+	// Under the names they get downloaded to
+	std::vector<wxString> localNames;
+	localNames.reserve(listing.GetCount());
+	const bool stripVMS = listing.path.GetType() == VMS && COptions::Get()->GetOptionVal(OPTION_STRIP_VMS_REVISION);
+	for (unsigned int i = 0; i < listing.GetCount(); ++i)
+	{
+		const CDirentry& entry = listing[i];
+
+		wxString localName = CQueueView::ReplaceInvalidCharacters(entry.name);
+		if (stripVMS && !entry.is_dir())
+			localName = StripVMSRevision(localName);
+		localNames.push_back(localName);
+	}
+
+	const wxTimeSpan threshold = wxTimeSpan::Minutes(COptions::Get()->GetOptionVal(OPTION_COMPARISON_THRESHOLD));
+	FindChangedEntries(localFiles, listing, localNames, threshold, caseSensitive, changed);
+}
+
 void CRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing* pDirectoryListing)
 {
 	if (!pDirectoryListing)
@@ -219,20 +386,18 @@ void CRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing* pDire
 
 	if (!pDirectoryListing->GetCount())
 	{
-		if (m_operationMode == recursive_download)
+		if (m_operationMode == recursive_download || (m_operationMode == recursive_synchronize && dir.localMissing))
 		{
 			wxFileName::Mkdir(dir.localDir.GetPath(), 0777, wxPATH_MKDIR_FULL);
 			m_pState->RefreshLocalFile(dir.localDir.GetPath());
 		}
-		else if (m_operationMode == recursive_addtoqueue)
+		else if (m_operationMode == recursive_addtoqueue || (m_operationMode == recursive_addtoqueue_synchronize && dir.localMissing))
 		{
 			m_pQueue->QueueFile(true, true, _T(""), _T(""), dir.localDir, CServerPath(), *pServer, -1);
 			m_pQueue->QueueFile_Finish(false);
 		}
 	}
 
-	CFilterManager filter;
-
 	// Is operation restricted to a single child?
 	bool restrict = !dir.restrict.empty();
 
@@ -240,7 +405,17 @@ void CRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing* pDire
 
 	const wxString path = pDirectoryListing->path.GetPath();
 
-	bool added = false;
+	// When synchronizing, what differs from the local directory
+	std::vector<char> changed;
+	if (IsSynchronizing())
+		CompareLocal(*pDirectoryListing, dir, changed);
+
+	CQueueBatch batch(*pServer);
+
+	// Files found to differ are meant to replace the local ones, regardless
+	// of the default action for existing files
+	if (IsSynchronizing())
+		batch.SetFileExistsAction(CFileExistsNotification::overwrite);
 
 	for (int i = pDirectoryListing->GetCount() - 1; i >= 0; --i)
 	{
@@ -251,7 +426,7 @@ void CRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing* pDire
 			if (entry.name != dir.restrict)
 				continue;
 		}
-		else if (filter.FilenameFiltered(m_filters, entry.name, path, entry.is_dir(), entry.size, false, 0, entry.time))
+		else if (m_filters.Filtered(entry.name, path, entry.is_dir(), entry.size, 0, entry.time))
 			continue;
 
 		if (entry.is_dir() && (!entry.is_link() || m_operationMode != recursive_delete))
@@ -264,8 +439,10 @@ void CRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing* pDire
 				dirToVisit.localDir = dir.localDir;
 				dirToVisit.start_dir = dir.start_dir;
 
-				if (m_operationMode == recursive_download || m_operationMode == recursive_addtoqueue)
+				if (m_operationMode == recursive_download || m_operationMode == recursive_addtoqueue || IsSynchronizing())
 					dirToVisit.localDir.AddSegment(CQueueView::ReplaceInvalidCharacters(entry.name));
+				if (IsSynchronizing())
+					dirToVisit.localMissing = changed[i] != 0;
 				if (entry.is_link())
 				{
 					dirToVisit.link = 1;
@@ -284,10 +461,9 @@ void CRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing* pDire
 					wxString localFile = CQueueView::ReplaceInvalidCharacters(entry.name);
 					if (pDirectoryListing->path.GetType() == VMS && COptions::Get()->GetOptionVal(OPTION_STRIP_VMS_REVISION))
 						localFile = StripVMSRevision(localFile);
-					m_pQueue->QueueFile(m_operationMode == recursive_addtoqueue, true,
+					batch.AddFile(m_operationMode == recursive_addtoqueue, true,
 						entry.name, (entry.name == localFile) ? wxString() : localFile,
-						dir.localDir, pDirectoryListing->path, *pServer, entry.size);
-					added = true;
+						dir.localDir, pDirectoryListing->path, entry.size);
 				}
 				break;
 			case recursive_addtoqueue:
@@ -296,10 +472,21 @@ void CRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing* pDire
 					wxString localFile = CQueueView::ReplaceInvalidCharacters(entry.name);
 					if (pDirectoryListing->path.GetType() == VMS && COptions::Get()->GetOptionVal(OPTION_STRIP_VMS_REVISION))
 						localFile = StripVMSRevision(localFile);
-					m_pQueue->QueueFile(true, true,
+					batch.AddFile(true, true,
+						entry.name, (entry.name == localFile) ? wxString() : localFile,
+						dir.localDir, pDirectoryListing->path, entry.size);
+				}
+				break;
+			case recursive_synchronize:
+			case recursive_addtoqueue_synchronize:
+				if (changed[i])
+				{
+					wxString localFile = CQueueView::ReplaceInvalidCharacters(entry.name);
+					if (pDirectoryListing->path.GetType() == VMS && COptions::Get()->GetOptionVal(OPTION_STRIP_VMS_REVISION))
+						localFile = StripVMSRevision(localFile);
+					batch.AddFile(m_operationMode == recursive_addtoqueue_synchronize, true,
 						entry.name, (entry.name == localFile) ? wxString() : localFile,
-						dir.localDir, pDirectoryListing->path, *pServer, entry.size);
-					added = true;
+						dir.localDir, pDirectoryListing->path, entry.size);
 				}
 				break;
 			case recursive_delete:
@@ -324,8 +511,10 @@ void CRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing* pDire
 			}
 		}
 	}
-	if (added)
-		m_pQueue->QueueFile_Finish(m_operationMode != recursive_addtoqueue && m_operationMode != recursive_addtoqueue_flatten);
+	if (!batch.empty()) {
+		m_pQueue->QueueFiles(batch);
+		m_pQueue->QueueFile_Finish(m_operationMode != recursive_addtoqueue && m_operationMode != recursive_addtoqueue_flatten && m_operationMode != recursive_addtoqueue_synchronize);
+	}
 
 	if (m_operationMode == recursive_delete && !filesToDelete.empty())
 		m_pState->m_pCommandQueue->ProcessCommand(new CDeleteCommand(pDirectoryListing->path, filesToDelete));
@@ -352,6 +541,7 @@ void CRecursiveOperation::StopRecursiveOperation()
 	}
 	m_dirsToVisit.clear();
 	m_visitedDirs.clear();
+	m_localScanner.reset();
 
 	if (m_pChmodDlg)
 	{
@@ -395,7 +585,8 @@ void CRecursiveOperation::SetQueue(CQueueView* pQueue)
 
 bool CRecursiveOperation::ChangeOperationMode(enum OperationMode mode)
 {
-	if (mode != recursive_addtoqueue && m_operationMode != recursive_download && mode != recursive_addtoqueue_flatten && m_operationMode != recursive_download_flatten)
+	if (mode != recursive_addtoqueue && m_operationMode != recursive_download && mode != recursive_addtoqueue_flatten && m_operationMode != recursive_download_flatten &&
+		mode != recursive_addtoqueue_synchronize && m_operationMode != recursive_synchronize)
 		return false;
 
 	m_operationMode = mode;
@@ -439,8 +630,9 @@ void CRecursiveOperation::LinkIsNotDir()
 		wxString localFile = dir.subdir;
 		if (m_operationMode != recursive_addtoqueue_flatten && m_operationMode != recursive_download_flatten)
 			localPath.MakeParent();
-		m_pQueue->QueueFile(m_operationMode == recursive_addtoqueue || m_operationMode == recursive_addtoqueue_flatten, true, dir.subdir, (dir.subdir == localFile) ? wxString() : localFile, localPath, dir.parent, *pServer, -1);
-		m_pQueue->QueueFile_Finish(m_operationMode != recursive_addtoqueue);
+		const bool queueOnly = m_operationMode == recursive_addtoqueue || m_operationMode == recursive_addtoqueue_flatten || m_operationMode == recursive_addtoqueue_synchronize;
+		m_pQueue->QueueFile(queueOnly, true, dir.subdir, (dir.subdir == localFile) ? wxString() : localFile, localPath, dir.parent, *pServer, -1);
+		m_pQueue->QueueFile_Finish(m_operationMode != recursive_addtoqueue && m_operationMode != recursive_addtoqueue_synchronize);
 	}
 
 	NextOperation();
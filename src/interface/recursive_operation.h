@@ -6,6 +6,7 @@
 #include "filter.h"
 
 class CChmodDialog;
+class CLocalScanner;
 class CQueueView;
 
 class CRecursiveOperation : public CStateEventHandler
@@ -21,6 +22,8 @@ public:
 		recursive_addtoqueue,
 		recursive_download_flatten,
 		recursive_addtoqueue_flatten,
+		recursive_synchronize,
+		recursive_addtoqueue_synchronize,
 		recursive_delete,
 		recursive_chmod,
 		recursive_list
@@ -49,6 +52,16 @@ protected:
 	void ProcessDirectoryListing(const CDirectoryListing* pDirectoryListing);
 	bool NextOperation();
 
+	// Has the queue list the directories following the current one in the
+	// background, so that they can be taken from the cache once reached.
+	void PrefetchDirectories();
+
+	// Has the local directories following the current one read in the
+	// background when synchronizing.
+	void PrefetchLocalDirectories();
+
+	bool IsSynchronizing() const { return m_operationMode == recursive_synchronize || m_operationMode == recursive_addtoqueue_synchronize; }
+
 	virtual void OnStateChange(CState* pState, enum t_statechange_notifications notification, const wxString&, const void* data2);
 
 	enum OperationMode m_operationMode;
@@ -75,10 +88,23 @@ protected:
 		// Symlink target might be outside actual start dir. Yet
 		// sometimes user wants to download symlink target contents
 		CServerPath start_dir;
+
+		// When synchronizing, set if there is no local directory to compare
+		// against. Everything below it gets transferred.
+		bool localMissing;
 	};
 
 	bool BelowRecursionRoot(const CServerPath& path, CNewDir &dir);
 
+	// Looks up the listing of the directory in the cache. Only listings
+	// retrieved after the operation got started are returned.
+	bool GetCachedListing(const CNewDir& dir, CDirectoryListing& listing);
+
+	// Compares the listing against the local directory. Sets the flag of
+	// each file that needs to be transferred and of each directory that is
+	// missing locally.
+	void CompareLocal(const CDirectoryListing& listing, const CNewDir& dir, std::vector<char>& changed);
+
 	CServerPath m_startDir;
 	CServerPath m_finalDir;
 	std::set<CServerPath> m_visitedDirs;
@@ -86,12 +112,19 @@ protected:
 
 	bool m_allowParent{};
 
+	CMonotonicTime m_startTime;
+
+	// Set while processing listings taken from the cache in NextOperation
+	bool m_processingCachedListing{};
+
 	// Needed for recursive_chmod
 	CChmodDialog* m_pChmodDlg{};
 
 	CQueueView* m_pQueue{};
 
-	std::list<CFilter> m_filters;
+	CCompiledFilters m_filters;
+
+	std::unique_ptr<CLocalScanner> m_localScanner;
 
 	friend class CCommandQueue;
 };
@@ -0,0 +1,182 @@
+#include <filezilla.h>
+#include "remote_search_index.h"
+
+#include <set>
+
+CRemoteSearchIndex* CRemoteSearchIndex::m_pRemoteSearchIndex = 0;
+
+void CRemoteSearchIndex::Create()
+{
+	if (!m_pRemoteSearchIndex)
+		m_pRemoteSearchIndex = new CRemoteSearchIndex();
+}
+
+void CRemoteSearchIndex::Destroy()
+{
+	delete m_pRemoteSearchIndex;
+	m_pRemoteSearchIndex = 0;
+}
+
+void CRemoteSearchIndex::Add(const CServer& server, const CDirectoryListing& listing)
+{
+	Remove(server, listing.path);
+
+	if (listing.failed() || listing.get_unsure_flags() || listing.GetCount() > max_entries)
+		return;
+
+	t_server& s = m_servers[server];
+
+	t_dir& dir = s.dirs[listing.path];
+	dir.listing = listing;
+	m_order.push_front(std::make_pair(server, listing.path));
+	dir.order = m_order.begin();
+
+	AddToIndex(s, listing.path, dir);
+	m_entryCount += listing.GetCount();
+
+	while (m_entryCount > max_entries && m_order.size() > 1) {
+		auto const oldest = m_order.back();
+		Remove(oldest.first, oldest.second);
+	}
+}
+
+void CRemoteSearchIndex::AddToIndex(t_server& server, const CServerPath& path, t_dir& dir)
+{
+	dir.firstId = server.trigrams.size();
+	for (unsigned int i = 0; i < dir.listing.GetCount(); ++i) {
+		const wxString& name = dir.listing[i].name;
+		server.trigrams.add(name.wc_str(), name.size());
+	}
+	if (dir.listing.GetCount())
+		server.blocks[dir.firstId] = path;
+}
+
+void CRemoteSearchIndex::Remove(const CServer& server, const CServerPath& path)
+{
+	auto const sit = m_servers.find(server);
+	if (sit == m_servers.end())
+		return;
+
+	t_server& s = sit->second;
+	auto const it = s.dirs.find(path);
+	if (it == s.dirs.end())
+		return;
+
+	t_dir& dir = it->second;
+	unsigned int const count = dir.listing.GetCount();
+	for (unsigned int i = 0; i < count; ++i)
+		s.trigrams.remove(dir.firstId + i);
+	if (count)
+		s.blocks.erase(dir.firstId);
+	m_entryCount -= count;
+
+	m_order.erase(dir.order);
+	s.dirs.erase(it);
+
+	if (s.dirs.empty())
+		m_servers.erase(sit);
+	else if (s.trigrams.size() >= min_rebuild_size && s.trigrams.removed() > s.trigrams.size() / 2)
+		Rebuild(s);
+}
+
+void CRemoteSearchIndex::Rebuild(t_server& server)
+{
+	server.trigrams.clear();
+	server.blocks.clear();
+	for (auto& dir : server.dirs)
+		AddToIndex(server, dir.first, dir.second);
+}
+
+bool CRemoteSearchIndex::Search(CFileZillaEngine& engine, const CServer& server, const CServerPath& root, const wxString& needle, const wxTimeSpan& maxAge,
+	std::function<void(const CDirectoryListing&, const std::vector<unsigned int>&)> const& f)
+{
+	auto const sit = m_servers.find(server);
+	if (sit == m_servers.end())
+		return false;
+	t_server& s = sit->second;
+
+	CDateTime const now = CDateTime::Now();
+
+	// All directories of the tree need to be known, like searching by
+	// listing them would have visited them
+	std::vector<t_dir const*> dirs;
+	std::set<CServerPath> visited;
+	std::list<CServerPath> pending;
+	pending.push_back(root);
+	while (!pending.empty()) {
+		CServerPath const path = pending.front();
+		pending.pop_front();
+
+		if (!visited.insert(path).second)
+			continue;
+
+		auto const it = s.dirs.find(path);
+		if (it == s.dirs.end())
+			return false;
+
+		t_dir const& dir = it->second;
+		if (now - dir.listing.m_firstListTime.GetTime() > maxAge)
+			return false;
+
+		// Transfers, deletions and renames by any engine update the directory
+		// cache. Such changes, and listings retrieved since, make the kept
+		// listing outdated.
+		CDirectoryListing cached;
+		if (engine.CacheLookup(path, cached) != FZ_REPLY_OK || cached.get_unsure_flags() ||
+			!(cached.m_firstListTime == dir.listing.m_firstListTime))
+		{
+			Remove(server, path);
+			return false;
+		}
+
+		dirs.push_back(&dir);
+		for (unsigned int i = 0; i < dir.listing.GetCount(); ++i) {
+			const CDirentry& entry = dir.listing[i];
+			if (!entry.is_dir())
+				continue;
+
+			CServerPath child = path;
+			if (child.AddSegment(entry.name))
+				pending.push_back(child);
+		}
+	}
+
+	if (needle.size() < 3) {
+		std::vector<unsigned int> indexes;
+		for (auto const& dir : dirs) {
+			if (!dir->listing.GetCount())
+				continue;
+
+			indexes.resize(dir->listing.GetCount());
+			for (unsigned int i = 0; i < indexes.size(); ++i)
+				indexes[i] = i;
+			f(dir->listing, indexes);
+		}
+		return true;
+	}
+
+	// Candidates come in ascending order of their ids, hence grouped by
+	// directory
+	std::map<size_t, std::vector<unsigned int>> candidates;
+	std::vector<unsigned int>* block = 0;
+	size_t blockStart = 0;
+	size_t blockEnd = 0;
+	s.trigrams.find(needle.wc_str(), needle.size(), [&](size_t id)
+	{
+		if (!block || id >= blockEnd) {
+			auto const it = --s.blocks.upper_bound(id);
+			blockStart = it->first;
+			blockEnd = blockStart + s.dirs.find(it->second)->second.listing.GetCount();
+			block = &candidates[blockStart];
+		}
+		block->push_back(static_cast<unsigned int>(id - blockStart));
+	});
+
+	for (auto const& dir : dirs) {
+		auto const it = candidates.find(dir->firstId);
+		if (it != candidates.end())
+			f(dir->listing, it->second);
+	}
+
+	return true;
+}
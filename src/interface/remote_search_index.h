@@ -0,0 +1,87 @@
+#ifndef __REMOTE_SEARCH_INDEX_H__
+#define __REMOTE_SEARCH_INDEX_H__
+
+#include "trigram_index.h"
+
+#include <functional>
+#include <list>
+#include <map>
+
+// Keeps the remote directory listings retrieved during this session, per
+// server, so that searching a tree listed before doesn't need to list it
+// again. The names of all entries are indexed by their trigrams.
+//
+// Listings replace the ones previously kept for the same directory, failed
+// listings and listings not known to be accurate remove them. Listings the
+// directory cache has changed or replaced since are dropped when searching.
+// The number of entries kept is limited, the directories least recently
+// listed get dropped first.
+
+class CRemoteSearchIndex final
+{
+public:
+	static void Create();
+	static void Destroy();
+
+	// Returns 0 if not created
+	static CRemoteSearchIndex* Get() { return m_pRemoteSearchIndex; }
+
+	void Add(const CServer& server, const CDirectoryListing& listing);
+
+	// Calls f with the listings of root and all directories below it, along
+	// with the indexes of the entries whose names could contain the needle.
+	// Listings without such entries are skipped.
+	// Returns false without calling f unless all of these directories are
+	// kept, none got listed longer than maxAge ago, and the directory cache
+	// of the engine still holds the very same, unmodified listings.
+	bool Search(CFileZillaEngine& engine, const CServer& server, const CServerPath& root, const wxString& needle, const wxTimeSpan& maxAge,
+		std::function<void(const CDirectoryListing&, const std::vector<unsigned int>&)> const& f);
+
+protected:
+	CRemoteSearchIndex() = default;
+
+	static CRemoteSearchIndex* m_pRemoteSearchIndex;
+
+	enum : size_t
+	{
+		max_entries = 2000000,
+
+		// Rebuilding small indexes isn't worth it
+		min_rebuild_size = 10000
+	};
+
+	typedef std::list<std::pair<CServer, CServerPath>> t_order;
+
+	struct t_dir
+	{
+		CDirectoryListing listing;
+
+		// Id of the first entry in the trigram index
+		size_t firstId{};
+
+		t_order::iterator order;
+	};
+
+	struct t_server
+	{
+		std::map<CServerPath, t_dir> dirs;
+
+		CTrigramIndex trigrams;
+
+		// The directory each block of ids belongs to, by first id
+		std::map<size_t, CServerPath> blocks;
+	};
+
+	void AddToIndex(t_server& server, const CServerPath& path, t_dir& dir);
+	void Remove(const CServer& server, const CServerPath& path);
+	void Rebuild(t_server& server);
+
+	std::map<CServer, t_server> m_servers;
+
+	// Least recently listed last
+	t_order m_order;
+
+	size_t m_entryCount{};
+};
+
+#endif //__REMOTE_SEARCH_INDEX_H__
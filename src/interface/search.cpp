@@ -9,6 +9,7 @@
 #include "Options.h"
 #include "queue.h"
 #include "recursive_operation.h"
+#include "remote_search_index.h"
 #include "sizeformatting.h"
 #include "timeformatting.h"
 #include "window_state_manager.h"
@@ -47,7 +48,7 @@ private:
 	virtual bool CanStartComparison(wxString*) { return false; }
 	virtual void StartComparison() {}
 	virtual bool GetNextFile(wxString&, bool &, wxLongLong &, CDateTime&) { return false; }
-	virtual void CompareAddFile(CComparableListing::t_fileEntryFlags) {}
+	virtual void CompareAddFile(CComparableListing::t_fileEntryFlags, int) {}
 	virtual void FinishComparison() {}
 	virtual void ScrollTopItem(int) {}
 	virtual void OnExitComparisonMode() {}
@@ -318,28 +319,34 @@ void CSearchDialog::ProcessDirectoryListing()
 	if (!listing || listing->failed())
 		return;
 
+	ProcessDirectoryListing(*listing, 0);
+}
+
+void CSearchDialog::ProcessDirectoryListing(const CDirectoryListing& listing, const std::vector<unsigned int>* candidates)
+{
 	// Do not process same directory multiple times
-	if (!m_visited.insert(listing->path).second)
+	if (!m_visited.insert(listing.path).second)
 		return;
 
 	int old_count = m_results->m_fileData.size();
-	int added = 0;
+	std::vector<unsigned int> added;
 
-	m_results->m_fileData.reserve(m_results->m_fileData.size() + listing->GetCount());
-	m_results->m_indexMapping.reserve(m_results->m_indexMapping.size() + listing->GetCount());
+	const unsigned int count = candidates ? candidates->size() : listing.GetCount();
+	m_results->m_fileData.reserve(m_results->m_fileData.size() + count);
 
-	for (unsigned int i = 0; i < listing->GetCount(); ++i) {
-		const CDirentry& entry = (*listing)[i];
+	for (unsigned int j = 0; j < count; ++j) {
+		const unsigned int i = candidates ? (*candidates)[j] : j;
+		const CDirentry& entry = listing[i];
 
-		if (!CFilterManager::FilenameFilteredByFilter(m_search_filter, entry.name, listing->path.GetPath(), entry.is_dir(), entry.size, 0, entry.time))
+		if (!CFilterManager::FilenameFilteredByFilter(m_search_filter, entry.name, listing.path.GetPath(), entry.is_dir(), entry.size, 0, entry.time))
 			continue;
 
 		CSearchFileData data;
 		static_cast<CDirentry&>(data) = entry;
-		data.path = listing->path;
+		data.path = listing.path;
 		data.icon = entry.is_dir() ? m_results->m_dirIcon : -2;
 		m_results->m_fileData.push_back(data);
-		m_results->m_indexMapping.push_back(old_count + added++);
+		added.push_back(old_count + added.size());
 
 		if (entry.is_dir())
 			m_results->GetFilelistStatusBar()->AddDirectory();
@@ -347,13 +354,34 @@ void CSearchDialog::ProcessDirectoryListing()
 			m_results->GetFilelistStatusBar()->AddFile(entry.size);
 	}
 
-	if (added) {
-		m_results->SetItemCount(old_count + added);
-		m_results->SortList(-1, -1, true);
+	if (!added.empty()) {
+		// Only the new results need to be sorted, they then get merged into
+		// the already sorted ones
+		m_results->InsertSorted(added);
 		m_results->RefreshListOnly(false);
 	}
 }
 
+// Returns the longest substring the name of every result has to contain
+static wxString GetRequiredSubstring(const CFilter& filter)
+{
+	if (filter.matchType == CFilter::none || (filter.matchType == CFilter::any && filter.filters.size() != 1))
+		return wxString();
+
+	wxString substring;
+	for (auto const& condition : filter.filters)
+	{
+		// Contains, is equal, begins with and ends with
+		if (condition.type != filter_name || condition.condition > 3)
+			continue;
+
+		if (condition.strValue.size() > substring.size())
+			substring = condition.strValue;
+	}
+
+	return substring;
+}
+
 void CSearchDialog::OnSearch(wxCommandEvent& event)
 {
 	if (!m_pState->IsRemoteIdle())
@@ -399,12 +427,21 @@ void CSearchDialog::OnSearch(wxCommandEvent& event)
 	m_results->ClearSelection();
 	m_results->m_indexMapping.clear();
 	m_results->m_fileData.clear();
+	m_results->m_sortKeys.clear();
 	m_results->SetItemCount(0);
 	m_visited.clear();
 	m_results->RefreshListOnly(true);
 
 	m_results->GetFilelistStatusBar()->Clear();
 
+	// Trees listed not long ago don't need to be listed again
+	CRemoteSearchIndex* pIndex = CRemoteSearchIndex::Get();
+	if (pIndex && pIndex->Search(*m_pState->m_pEngine, *pServer, path, GetRequiredSubstring(m_search_filter), wxTimeSpan::Minutes(search_index_max_age),
+		[this](const CDirectoryListing& listing, const std::vector<unsigned int>& candidates) { ProcessDirectoryListing(listing, &candidates); }))
+	{
+		return;
+	}
+
 	// Start
 	m_searching = true;
 	m_pState->GetRecursiveOperationHandler()->AddDirectoryToVisitRestricted(path, _T(""), true);
@@ -644,6 +681,9 @@ void CSearchDialog::OnDownload(wxCommandEvent&)
 	bool start = XRCCTRL(dlg, "ID_QUEUE_START", wxRadioButton)->GetValue();
 	bool flatten = XRCCTRL(dlg, "ID_PATHS_FLATTEN", wxRadioButton)->GetValue();
 
+	CQueueBatch batch(*pServer);
+	batch.reserve(selected_files.size());
+
 	for (std::list<int>::const_iterator iter = selected_files.begin(); iter != selected_files.end(); ++iter)
 	{
 		const CDirentry& entry = m_results->m_fileData[*iter];
@@ -668,10 +708,11 @@ void CSearchDialog::OnDownload(wxCommandEvent&)
 		if (!entry.is_dir() && remote_path.GetType() == VMS && COptions::Get()->GetOptionVal(OPTION_STRIP_VMS_REVISION))
 			localName = StripVMSRevision(localName);
 
-		m_pQueue->QueueFile(!start, true,
+		batch.AddFile(!start, true,
 			entry.name, (localName != entry.name) ? localName : wxString(),
-			target_path, remote_path, *pServer, entry.size);
+			target_path, remote_path, entry.size);
 	}
+	m_pQueue->QueueFiles(batch);
 	m_pQueue->QueueFile_Finish(start);
 
 	enum CRecursiveOperation::OperationMode mode;
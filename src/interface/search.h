@@ -22,6 +22,13 @@ public:
 protected:
 	void ProcessDirectoryListing();
 
+	// Only the entries with the given indexes if there are candidates
+	void ProcessDirectoryListing(const CDirectoryListing& listing, const std::vector<unsigned int>* candidates);
+
+	// In minutes, older listings get retrieved again instead of taking them
+	// from the search index
+	enum { search_index_max_age = 30 };
+
 	void SetCtrlState();
 
 	void SaveConditions();
@@ -12,6 +12,8 @@ bool COptionsPageConnectionFTP::LoadPage()
 	SetRCheck(XRCID("ID_PASSIVE"), use_pasv, failure);
 	SetRCheck(XRCID("ID_ACTIVE"), !use_pasv, failure);
 	SetCheckFromOption(XRCID("ID_FALLBACK"), OPTION_ALLOW_TRANSFERMODEFALLBACK, failure);
+	SetCheckFromOption(XRCID("ID_BLOCKMODE"), OPTION_FTP_BLOCKMODE, failure);
+	SetCheckFromOption(XRCID("ID_VERIFYHASH"), OPTION_FTP_VERIFY_HASH, failure);
 	SetCheckFromOption(XRCID("ID_USEKEEPALIVE"), OPTION_FTP_SENDKEEPALIVE, failure);
 	return !failure;
 }
@@ -20,6 +22,8 @@ bool COptionsPageConnectionFTP::SavePage()
 {
 	m_pOptions->SetOption(OPTION_USEPASV, GetRCheck(XRCID("ID_PASSIVE")) ? 1 : 0);
 	SetOptionFromCheck(XRCID("ID_FALLBACK"), OPTION_ALLOW_TRANSFERMODEFALLBACK);
+	SetOptionFromCheck(XRCID("ID_BLOCKMODE"), OPTION_FTP_BLOCKMODE);
+	SetOptionFromCheck(XRCID("ID_VERIFYHASH"), OPTION_FTP_VERIFY_HASH);
 	SetOptionFromCheck(XRCID("ID_USEKEEPALIVE"), OPTION_FTP_SENDKEEPALIVE);
 	return true;
 }
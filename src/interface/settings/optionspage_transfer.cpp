@@ -41,6 +41,11 @@ bool COptionsPageTransfer::LoadPage()
 	XRCCTRL(*this, "ID_NUMTRANSFERS", wxSpinCtrl)->SetValue(m_pOptions->GetOptionVal(OPTION_NUMTRANSFERS));
 	XRCCTRL(*this, "ID_NUMDOWNLOADS", wxSpinCtrl)->SetValue(m_pOptions->GetOptionVal(OPTION_CONCURRENTDOWNLOADLIMIT));
 	XRCCTRL(*this, "ID_NUMUPLOADS", wxSpinCtrl)->SetValue(m_pOptions->GetOptionVal(OPTION_CONCURRENTUPLOADLIMIT));
+	XRCCTRL(*this, "ID_NUMPREFETCH", wxSpinCtrl)->SetValue(m_pOptions->GetOptionVal(OPTION_PREFETCH_CONNECTIONS));
+	XRCCTRL(*this, "ID_NUMWARM", wxSpinCtrl)->SetValue(m_pOptions->GetOptionVal(OPTION_WARM_CONNECTIONS));
+	XRCCTRL(*this, "ID_IDLETIMEOUT", wxSpinCtrl)->SetValue(m_pOptions->GetOptionVal(OPTION_IDLE_DISCONNECT_TIMEOUT));
+
+	SetChoice(XRCID("ID_TRANSFERPOLICY"), m_pOptions->GetOptionVal(OPTION_TRANSFER_POLICY), failure);
 
 	SetChoice(XRCID("ID_BURSTTOLERANCE"), m_pOptions->GetOptionVal(OPTION_SPEEDLIMIT_BURSTTOLERANCE), failure);
 	XRCCTRL(*this, "ID_BURSTTOLERANCE", wxChoice)->Enable(enable_speedlimits);
@@ -82,6 +87,10 @@ bool COptionsPageTransfer::SavePage()
 	m_pOptions->SetOption(OPTION_NUMTRANSFERS,				XRCCTRL(*this, "ID_NUMTRANSFERS", wxSpinCtrl)->GetValue());
 	m_pOptions->SetOption(OPTION_CONCURRENTDOWNLOADLIMIT,	XRCCTRL(*this, "ID_NUMDOWNLOADS", wxSpinCtrl)->GetValue());
 	m_pOptions->SetOption(OPTION_CONCURRENTUPLOADLIMIT,		XRCCTRL(*this, "ID_NUMUPLOADS", wxSpinCtrl)->GetValue());
+	m_pOptions->SetOption(OPTION_PREFETCH_CONNECTIONS,		XRCCTRL(*this, "ID_NUMPREFETCH", wxSpinCtrl)->GetValue());
+	m_pOptions->SetOption(OPTION_WARM_CONNECTIONS,			XRCCTRL(*this, "ID_NUMWARM", wxSpinCtrl)->GetValue());
+	m_pOptions->SetOption(OPTION_IDLE_DISCONNECT_TIMEOUT,	XRCCTRL(*this, "ID_IDLETIMEOUT", wxSpinCtrl)->GetValue());
+	m_pOptions->SetOption(OPTION_TRANSFER_POLICY,			GetChoice(XRCID("ID_TRANSFERPOLICY")));
 
 	SetOptionFromText(XRCID("ID_DOWNLOADLIMIT"), OPTION_SPEEDLIMIT_INBOUND);
 	SetOptionFromText(XRCID("ID_UPLOADLIMIT"), OPTION_SPEEDLIMIT_OUTBOUND);
@@ -116,6 +125,21 @@ bool COptionsPageTransfer::Validate()
 	if (spinValue < 0 || spinValue > 10)
 		return DisplayError(pSpinCtrl, _("Please enter a number between 0 and 10 for the number of concurrent uploads."));
 
+	pSpinCtrl = XRCCTRL(*this, "ID_NUMPREFETCH", wxSpinCtrl);
+	spinValue = pSpinCtrl->GetValue();
+	if (spinValue < 0 || spinValue > 10)
+		return DisplayError(pSpinCtrl, _("Please enter a number between 0 and 10 for the number of connections used to prefetch directory listings."));
+
+	pSpinCtrl = XRCCTRL(*this, "ID_NUMWARM", wxSpinCtrl);
+	spinValue = pSpinCtrl->GetValue();
+	if (spinValue < 0 || spinValue > 10)
+		return DisplayError(pSpinCtrl, _("Please enter a number between 0 and 10 for the number of connections to keep warm."));
+
+	pSpinCtrl = XRCCTRL(*this, "ID_IDLETIMEOUT", wxSpinCtrl);
+	spinValue = pSpinCtrl->GetValue();
+	if (spinValue < 1 || spinValue > 3600)
+		return DisplayError(pSpinCtrl, _("Please enter a number between 1 and 3600 for the seconds after which idle connections get closed."));
+
 	pCtrl = XRCCTRL(*this, "ID_DOWNLOADLIMIT", wxTextCtrl);
 	if (!pCtrl->GetValue().ToLong(&tmp) || (tmp < 0))
 	{
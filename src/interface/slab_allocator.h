@@ -0,0 +1,136 @@
+#ifndef FZ_SLAB_ALLOCATOR_HEADER
+#define FZ_SLAB_ALLOCATOR_HEADER
+
+#include <mutex.h>
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/*
+Allocator for objects of a fixed size.
+
+Objects are carved out of large slabs, freed objects are put on a free list
+and get reused first. Compared to allocating each object on the heap, this
+saves the per-allocation overhead of the heap and keeps the objects close
+together instead of scattering them over memory fragmented by the strings
+allocated along with them.
+
+The slabs are only given back once all objects have been freed. The first
+slab is kept, so that repeatedly allocating and freeing a few objects
+doesn't allocate a new slab each time.
+*/
+
+class CSlabAllocator final
+{
+public:
+	explicit CSlabAllocator(size_t objectSize, size_t objectsPerSlab = 1024)
+		: objectSize_(round_up(objectSize))
+		, objectsPerSlab_(objectsPerSlab ? objectsPerSlab : 1)
+	{}
+
+	~CSlabAllocator()
+	{
+		for (auto slab : slabs_) {
+			::operator delete(slab);
+		}
+	}
+
+	CSlabAllocator(CSlabAllocator const&) = delete;
+	CSlabAllocator& operator=(CSlabAllocator const&) = delete;
+
+	void* allocate()
+	{
+		scoped_lock l(mutex_);
+
+		void* p;
+		if (free_) {
+			p = free_;
+			free_ = free_->next;
+		}
+		else {
+			if (slabs_.empty() || unused_ == 0) {
+				slabs_.push_back(static_cast<char*>(::operator new(objectSize_ * objectsPerSlab_)));
+				unused_ = objectsPerSlab_;
+			}
+			p = slabs_.back() + (objectsPerSlab_ - unused_) * objectSize_;
+			--unused_;
+		}
+		++used_;
+
+		return p;
+	}
+
+	void deallocate(void* p)
+	{
+		if (!p) {
+			return;
+		}
+
+		scoped_lock l(mutex_);
+
+		free_entry* e = static_cast<free_entry*>(p);
+		e->next = free_;
+		free_ = e;
+
+		if (!--used_) {
+			release();
+		}
+	}
+
+	size_t object_size() const { return objectSize_; }
+
+	// Number of objects currently allocated
+	size_t used() const
+	{
+		scoped_lock l(mutex_);
+		return used_;
+	}
+
+	// Memory taken by the slabs, including the space of freed objects
+	size_t reserved() const
+	{
+		scoped_lock l(mutex_);
+		return slabs_.size() * objectsPerSlab_ * objectSize_;
+	}
+
+private:
+	struct free_entry
+	{
+		free_entry* next;
+	};
+
+	static size_t round_up(size_t size)
+	{
+		size_t const alignment = alignof(std::max_align_t);
+		if (size < sizeof(free_entry)) {
+			size = sizeof(free_entry);
+		}
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	void release()
+	{
+		for (size_t i = 1; i < slabs_.size(); ++i) {
+			::operator delete(slabs_[i]);
+		}
+		slabs_.resize(1);
+		free_ = 0;
+		unused_ = objectsPerSlab_;
+	}
+
+	size_t const objectSize_;
+	size_t const objectsPerSlab_;
+
+	mutable mutex mutex_{false};
+
+	std::vector<char*> slabs_;
+
+	// Objects not yet handed out in the newest slab
+	size_t unused_{};
+
+	free_entry* free_{};
+	size_t used_{};
+};
+
+#endif
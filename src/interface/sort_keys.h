@@ -0,0 +1,220 @@
+#ifndef FZ_SORT_KEYS_HEADER
+#define FZ_SORT_KEYS_HEADER
+
+#include <stdint.h>
+#include <wctype.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*
+Precomputed keys to sort file names by.
+
+Comparing names case-insensitively means lowering both of them on every
+comparison, natural order additionally has to look for numbers each time.
+Sorting compares each name many times. Instead, each name is transformed just
+once into a key that can be compared character by character: it's lowered
+and, for natural order, every number is replaced by its length followed by
+its digits, so that numbers compare by their value. Names with equal keys are
+ordered by comparing the names themselves, in natural order shorter names,
+i.e. those with fewer leading zeros, go first.
+
+All keys are kept in a single buffer. The first characters of each key are
+packed into an integer next to its offset, which decides most comparisons
+without looking at the buffer.
+*/
+
+class CNameSortKeys final
+{
+public:
+	enum mode
+	{
+		case_insensitive,
+		case_sensitive,
+		natural
+	};
+
+	explicit CNameSortKeys(mode m = case_insensitive)
+		: mode_(m)
+	{}
+
+	mode get_mode() const { return mode_; }
+
+	// Number of names added so far
+	size_t size() const { return entries_.size(); }
+
+	void clear()
+	{
+		entries_.clear();
+		buffer_.clear();
+	}
+
+	void clear(mode m)
+	{
+		clear();
+		mode_ = m;
+	}
+
+	// Appends the key of the given name to key
+	static void append_key(std::wstring& key, wchar_t const* name, size_t len, mode m)
+	{
+		switch (m) {
+		case case_sensitive:
+			key.append(name, len);
+			break;
+		case case_insensitive:
+			for (size_t i = 0; i < len; ++i) {
+				key += static_cast<wchar_t>(towlower(name[i]));
+			}
+			break;
+		case natural:
+			for (size_t i = 0; i < len; ) {
+				if (!is_digit(name[i])) {
+					key += static_cast<wchar_t>(towlower(name[i]));
+					++i;
+					continue;
+				}
+
+				size_t end = i;
+				while (end < len && is_digit(name[end])) {
+					++end;
+				}
+				// Leading zeros don't change the value
+				while (i + 1 < end && name[i] == '0') {
+					++i;
+				}
+
+				// Compares like a digit against anything that isn't a number
+				key += '0';
+				key += static_cast<wchar_t>(std::min<size_t>(end - i, 0xffff));
+				key.append(name + i, end - i);
+				i = end;
+			}
+			break;
+		}
+	}
+
+	void push_back(wchar_t const* name, size_t len)
+	{
+		entry e;
+		e.offset = buffer_.size();
+
+		append_key(buffer_, name, len, mode_);
+		e.keyLength = buffer_.size() - e.offset;
+
+		if (mode_ != case_sensitive) {
+			buffer_.append(name, len);
+			e.nameLength = len;
+		}
+
+		uint64_t const mask = (uint64_t(1) << prefix_bits) - 1;
+		for (size_t i = 0; i < prefix_chars; ++i) {
+			e.prefix <<= prefix_bits;
+			if (i < e.keyLength) {
+				e.prefix |= std::min<uint64_t>(static_cast<uint32_t>(buffer_[e.offset + i]), mask);
+			}
+		}
+
+		entries_.push_back(e);
+	}
+
+	void push_back(std::wstring const& name)
+	{
+		push_back(name.c_str(), name.size());
+	}
+
+	// Removes a name, the names after it move down by one. Keeps its key in
+	// the buffer until the keys get cleared.
+	void erase(size_t index)
+	{
+		if (index < entries_.size()) {
+			entries_.erase(entries_.begin() + index);
+		}
+	}
+
+	// Removes the names with the given indexes, which have to be in ascending
+	// order, in a single pass. The names after them move down.
+	void erase(std::vector<size_t> const& indexes)
+	{
+		auto it = indexes.begin();
+		size_t out = 0;
+		for (size_t i = 0; i < entries_.size(); ++i) {
+			if (it != indexes.end() && *it == i) {
+				++it;
+				continue;
+			}
+			entries_[out++] = entries_[i];
+		}
+		entries_.resize(out);
+	}
+
+	// Compares the names with the given indexes, returns a negative value if
+	// the first one goes first, a positive value if the second goes first.
+	// Only returns 0 for equal names.
+	int compare(size_t a, size_t b) const
+	{
+		entry const& ea = entries_[a];
+		entry const& eb = entries_[b];
+		if (ea.prefix != eb.prefix) {
+			return ea.prefix < eb.prefix ? -1 : 1;
+		}
+
+		// Equal prefixes mean equal first characters
+		size_t const skip = std::min<size_t>(prefix_chars, std::min(ea.keyLength, eb.keyLength));
+		int res = compare(buffer_.data() + ea.offset + skip, ea.keyLength - skip, buffer_.data() + eb.offset + skip, eb.keyLength - skip);
+		if (!res && mode_ == natural && ea.nameLength != eb.nameLength) {
+			res = ea.nameLength < eb.nameLength ? -1 : 1;
+		}
+		if (!res && mode_ != case_sensitive) {
+			res = compare(buffer_.data() + ea.offset + ea.keyLength, ea.nameLength, buffer_.data() + eb.offset + eb.keyLength, eb.nameLength);
+		}
+		return res;
+	}
+
+private:
+	enum : size_t
+	{
+		prefix_chars = 3,
+
+		// Suffices for any Unicode code point
+		prefix_bits = 21
+	};
+
+	struct entry
+	{
+		uint64_t prefix{};
+		size_t offset{};
+		size_t keyLength{};
+
+		// The name follows its key unless it is the key
+		size_t nameLength{};
+	};
+
+	static bool is_digit(wchar_t c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	static int compare(wchar_t const* a, size_t alen, wchar_t const* b, size_t blen)
+	{
+		size_t const len = std::min(alen, blen);
+		for (size_t i = 0; i < len; ++i) {
+			uint32_t const ca = static_cast<uint32_t>(a[i]);
+			uint32_t const cb = static_cast<uint32_t>(b[i]);
+			if (ca != cb) {
+				return ca < cb ? -1 : 1;
+			}
+		}
+		if (alen != blen) {
+			return alen < blen ? -1 : 1;
+		}
+		return 0;
+	}
+
+	mode mode_;
+	std::vector<entry> entries_;
+	std::wstring buffer_;
+};
+
+#endif
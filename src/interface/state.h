@@ -147,6 +147,8 @@ public:
 
 	CRecursiveOperation* GetRecursiveOperationHandler() { return m_pRecursiveOperation; }
 
+	CMainFrame* GetMainFrame() { return m_pMainFrame; }
+
 	void NotifyHandlers(enum t_statechange_notifications notification, const wxString& data = _T(""), const void* data2 = 0);
 
 	bool SuccessfulConnect() const { return m_successful_connect; }
@@ -0,0 +1,74 @@
+#ifndef __SYNC_COMPARISON_H__
+#define __SYNC_COMPARISON_H__
+
+#include "comparison_keys.h"
+
+// Decides which entries of a remote directory listing need to be downloaded
+// to bring the local directory up to date. Sets changed to 1 for entries
+// missing locally, files differing in size and files newer than the local
+// ones by more than the threshold, and to 0 for all others.
+//
+// localNames are the names the remote entries get downloaded under.
+// Only which names match is of interest, not their order. Files and
+// directories are matched alike, a file in the way of a directory or the
+// other way around counts as changed. Directories present on both sides
+// don't.
+//
+// LocalEntry needs name, dir, size and time members, like CLocalFileData.
+template<typename LocalEntry>
+void FindChangedEntries(std::vector<LocalEntry> const& localFiles, CDirectoryListing const& listing, std::vector<wxString> const& localNames,
+	wxTimeSpan const& threshold, bool caseSensitive, std::vector<char>& changed)
+{
+	changed.assign(listing.GetCount(), 1);
+
+	CComparisonKeys localKeys;
+	CComparisonKeys remoteKeys;
+	localKeys.reset(CNameSortKeys::case_sensitive, caseSensitive, false);
+	remoteKeys.reset(CNameSortKeys::case_sensitive, caseSensitive, false);
+
+	for (auto const& file : localFiles)
+		localKeys.push_back(file.name.wc_str(), file.name.size(), file.dir);
+
+	for (unsigned int i = 0; i < listing.GetCount(); ++i)
+		remoteKeys.push_back(localNames[i].wc_str(), localNames[i].size(), listing[i].is_dir());
+
+	localKeys.prepare();
+	remoteKeys.prepare();
+
+	CComparisonKeys::match(localKeys, remoteKeys, [&](int left, int right)
+	{
+		if (left == -1 || right == -1)
+			return;
+
+		LocalEntry const& localFile = localFiles[left];
+		CDirentry const& entry = listing[right];
+		if (localFile.dir != entry.is_dir())
+			return;
+
+		if (entry.is_dir())
+		{
+			changed[right] = 0;
+			return;
+		}
+
+		if (entry.size != -1 && entry.size != localFile.size)
+			return;
+
+		// Only newer remote files count, within the threshold used by the
+		// directory comparison
+		if (entry.has_date() && localFile.time.IsValid())
+		{
+			CDateTime localTime = localFile.time;
+			if (localTime.Compare(entry.time) < 0)
+			{
+				localTime += threshold;
+				if (localTime.Compare(entry.time) < 0)
+					return;
+			}
+		}
+
+		changed[right] = 0;
+	});
+}
+
+#endif //__SYNC_COMPARISON_H__
@@ -295,11 +295,126 @@ static wxBitmap GetFileIcon(const wxString & /*fileName*/, const wxString & ext)
 	return bmp;
 }
 
+bool CSystemImageList::GetCacheKey(const wxString& fileName, bool physical, wxString& key)
+{
+#ifdef __WXMSW__
+	// Files like executables have icons of their own, only the type matters
+	// if the file isn't looked at
+	if (physical || fileName.empty())
+		return false;
+#else
+	(void)physical;
+#endif
+
+	// Cheaper than wxFileName, which would split the whole path
+	static wxString const separators = wxFileName::GetPathSeparators();
+
+	key.clear();
+	size_t const dot = fileName.rfind('.');
+	if (dot != wxString::npos) {
+		size_t const sep = fileName.find_last_of(separators);
+		size_t const start = (sep == wxString::npos) ? 0 : sep + 1;
+
+		// Leading dots don't start an extension
+		if (dot > start)
+			key = fileName.Mid(dot + 1);
+	}
+
+#ifdef __WXMSW__
+	key.MakeLower();
+	return true;
+#else
+	return !key.empty();
+#endif
+}
+
 int CSystemImageList::GetIconIndex(iconType type, const wxString& fileName /*=_T("")*/, bool physical /*=true*/, bool symlink /*=false*/)
 {
 	if (!m_pImageList)
 		return -1;
 
+	wxString key;
+	if (type != iconType::file || !GetCacheKey(fileName, physical, key))
+		return LookupIcon(type, fileName, physical, symlink);
+
+	auto& cache = symlink ? m_iconSymlinkCache : m_iconCache;
+	auto const it = cache.find(key);
+	if (it != cache.end() && it->second != pending_icon) {
+		++m_stats.hits;
+		return it->second;
+	}
+
+	// If queued, it is skipped once its turn comes
+	++m_stats.misses;
+	int const icon = LookupIcon(type, fileName, physical, symlink);
+	cache[key] = icon;
+	return icon;
+}
+
+int CSystemImageList::GetCachedIconIndex(const wxString& fileName, bool physical, bool symlink, bool& pending)
+{
+	pending = false;
+
+	wxString key;
+	if (!m_pImageList || !GetCacheKey(fileName, physical, key))
+		return GetIconIndex(iconType::file, fileName, physical, symlink);
+
+	auto& cache = symlink ? m_iconSymlinkCache : m_iconCache;
+	auto const it = cache.find(key);
+	if (it != cache.end()) {
+		if (it->second == pending_icon) {
+			pending = true;
+			return -1;
+		}
+
+		++m_stats.hits;
+		return it->second;
+	}
+
+	// Needed right now, ahead of those merely queued
+	cache[key] = pending_icon;
+	m_pendingIcons.push_front(t_pendingIcon{ fileName, key, physical, symlink });
+	pending = true;
+	return -1;
+}
+
+void CSystemImageList::QueueIconLookup(const wxString& fileName, bool physical)
+{
+	wxString key;
+	if (!m_pImageList || !GetCacheKey(fileName, physical, key))
+		return;
+
+	auto const res = m_iconCache.insert(std::make_pair(key, static_cast<int>(pending_icon)));
+	if (res.second)
+		m_pendingIcons.push_back(t_pendingIcon{ fileName, key, physical, false });
+}
+
+bool CSystemImageList::ResolvePendingIcons(int max)
+{
+	for (int i = 0; i < max && !m_pendingIcons.empty(); ++i) {
+		t_pendingIcon const pending = m_pendingIcons.front();
+		m_pendingIcons.pop_front();
+
+		int& icon = (pending.symlink ? m_iconSymlinkCache : m_iconCache)[pending.key];
+		if (icon != pending_icon)
+			continue;
+
+		++m_stats.resolved;
+		icon = LookupIcon(iconType::file, pending.fileName, pending.physical, pending.symlink);
+	}
+
+	return !m_pendingIcons.empty();
+}
+
+CSystemImageList::iconCacheStats CSystemImageList::GetIconCacheStats() const
+{
+	iconCacheStats stats = m_stats;
+	stats.extensions = m_iconCache.size() + m_iconSymlinkCache.size();
+	return stats;
+}
+
+int CSystemImageList::LookupIcon(iconType type, const wxString& fileName, bool physical, bool symlink)
+{
 #ifdef __WXMSW__
 	if (fileName.empty())
 		physical = false;
@@ -317,7 +432,9 @@ int CSystemImageList::GetIconIndex(iconType type, const wxString& fileName /*=_T
 		DestroyIcon(shFinfo.hIcon);
 		return icon;
 	}
+	(void)symlink;
 #else
+	(void)physical;
 	int icon;
 	switch (type)
 	{
@@ -331,24 +448,10 @@ int CSystemImageList::GetIconIndex(iconType type, const wxString& fileName /*=_T
 		return symlink ? 5 : 2;
 	}
 
-	wxFileName fn(fileName);
-	wxString ext = fn.GetExt();
-	if (ext.empty())
+	wxString ext;
+	if (!GetCacheKey(fileName, false, ext))
 		return icon;
 
-	if (symlink)
-	{
-		auto cacheIter = m_iconCache.find(ext);
-		if (cacheIter != m_iconCache.end())
-			return cacheIter->second;
-	}
-	else
-	{
-		auto cacheIter = m_iconSymlinkCache.find(ext);
-		if (cacheIter != m_iconSymlinkCache.end())
-			return cacheIter->second;
-	}
-
     wxBitmap bmp = GetNativeFileIcon(fileName, ext);
     if (!bmp.IsOk())
         bmp = GetFileIcon(fileName, ext);
@@ -360,10 +463,6 @@ int CSystemImageList::GetIconIndex(iconType type, const wxString& fileName /*=_T
 			icon = index;
 	}
 
-	if (symlink)
-		m_iconCache[ext] = icon;
-	else
-		m_iconSymlinkCache[ext] = icon;
 	return icon;
 #endif
 	return -1;
@@ -6,6 +6,8 @@
 #include <commctrl.h>
 #endif
 
+#include <deque>
+
 enum class iconType
 {
 	file,
@@ -43,17 +45,61 @@ public:
 
 	int GetIconIndex(iconType type, const wxString& fileName = _T(""), bool physical = true, bool symlink = false);
 
+	// Like GetIconIndex for files, but doesn't wait for icons that haven't
+	// been looked up yet. Sets pending for those instead, their lookup gets
+	// queued for ResolvePendingIcons.
+	int GetCachedIconIndex(const wxString& fileName, bool physical, bool symlink, bool& pending);
+
+	// Queues looking up the icon of the given file ahead of displaying it,
+	// unless the icon of its extension is known or queued already.
+	void QueueIconLookup(const wxString& fileName, bool physical);
+
+	// Looks up at most max of the queued icons. Returns true if there are
+	// more left.
+	bool ResolvePendingIcons(int max);
+
+	struct iconCacheStats
+	{
+		size_t extensions{};
+		size_t hits{};
+
+		// Icons that had to be looked up right when needed
+		size_t misses{};
+
+		// Icons looked up ahead
+		size_t resolved{};
+	};
+	iconCacheStats GetIconCacheStats() const;
+
 #ifdef __WXMSW__
 	int GetLinkOverlayIndex();
 #endif
 
 private:
+	int LookupIcon(iconType type, const wxString& fileName, bool physical, bool symlink);
+
+	// Icons of files are cached by their extension unless they can differ
+	// between files of the same type. Returns false if they can.
+	static bool GetCacheKey(const wxString& fileName, bool physical, wxString& key);
+
 	wxImageListEx *m_pImageList;
 
-#ifndef __WXMSW__
+	// Marks icons waiting in m_pendingIcons
+	enum { pending_icon = -2 };
+
 	std::map<wxString, int> m_iconCache;
 	std::map<wxString, int> m_iconSymlinkCache;
-#endif
+
+	struct t_pendingIcon
+	{
+		wxString fileName;
+		wxString key;
+		bool physical;
+		bool symlink;
+	};
+	std::deque<t_pendingIcon> m_pendingIcons;
+
+	iconCacheStats m_stats;
 };
 
 #endif //__SYSTEMIMAGELIST_H__
@@ -0,0 +1,148 @@
+#ifndef FZ_TRANSFER_POLICY_HEADER
+#define FZ_TRANSFER_POLICY_HEADER
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <type_traits>
+
+// How the queue picks the next file to transfer. Priorities are always
+// respected, the policies only differ in which of the idle files of the
+// highest priority gets started next. If none of them may be started, e.g.
+// only large files while the remaining slots are kept for small ones, no
+// file gets started.
+enum class TransferPolicy
+{
+	// Transfer files in queue order
+	queue_order,
+
+	// Keep some transfer slots for small files so that they don't get
+	// stuck behind large ones
+	reserve_small,
+
+	// Transfer the largest files first. Long transfers get started early,
+	// small files fill the gaps at the end, which minimizes the total time.
+	largest_first,
+
+	// Take turns between servers instead of processing them one at a time
+	round_robin,
+
+	count
+};
+
+namespace transfer_policy {
+
+// Files up to this size count as small. Files of unknown size don't.
+int64_t const small_file_size = 1024 * 1024;
+
+// Number of idle files per priority looked at by policies not
+// transferring in queue order
+int const lookahead = 100;
+
+inline TransferPolicy from_option(int value)
+{
+	if (value < 0 || value >= static_cast<int>(TransferPolicy::count))
+		return TransferPolicy::queue_order;
+	return static_cast<TransferPolicy>(value);
+}
+
+inline bool is_small(int64_t size)
+{
+	return size >= 0 && size <= small_file_size;
+}
+
+// Returns the number of transfer slots files which aren't small may occupy
+inline int large_slots(TransferPolicy policy, int slots)
+{
+	if (policy != TransferPolicy::reserve_small || slots < 2)
+		return slots;
+
+	return slots - std::max(1, slots / 4);
+}
+
+// Whether the policy needs to look at more than just the next idle file
+inline bool needs_lookahead(TransferPolicy policy, bool smallOnly)
+{
+	return smallOnly || policy == TransferPolicy::largest_first;
+}
+
+// Scores an idle file, the one with the highest score gets started first.
+// Files with a negative score must not be started.
+inline int64_t score(TransferPolicy policy, int64_t size, bool smallOnly)
+{
+	if (smallOnly && !is_small(size))
+		return -1;
+
+	if (policy == TransferPolicy::largest_first)
+		return std::max(size, int64_t(0));
+
+	return 0;
+}
+
+// Picks the idle item of the queue to start next, see CIdleQueue::pick.
+// size returns the size of an item, negative if unknown.
+template<typename Queue, typename Size>
+auto pick(Queue& queue, TransferPolicy policy, bool smallOnly, bool immediateOnly, bool download, bool upload, Size const& size)
+	-> decltype(queue.pick(immediateOnly, download, upload))
+{
+	if (!needs_lookahead(policy, smallOnly))
+		return queue.pick(immediateOnly, download, upload);
+
+	typedef typename std::remove_pointer<decltype(queue.pick(immediateOnly, download, upload))>::type item_type;
+	return queue.pick(immediateOnly, download, upload, lookahead, [&](item_type const& item) {
+		return score(policy, size(item), smallOnly);
+	});
+}
+
+// Throughput statistics of a run of the queue. Times are in milliseconds.
+class stats final
+{
+public:
+	void reset() { *this = stats(); }
+
+	void started(int64_t now)
+	{
+		if (!active_++)
+			busy_since_ = now;
+	}
+
+	void finished(int64_t now, int64_t size, bool success)
+	{
+		if (success) {
+			++files_;
+			if (size > 0)
+				bytes_ += size;
+		}
+		else
+			++failed_;
+
+		if (active_ > 0 && !--active_)
+			busy_ += now - busy_since_;
+	}
+
+	int files() const { return files_; }
+	int failed() const { return failed_; }
+	int64_t bytes() const { return bytes_; }
+
+	// Time spent with at least one transfer running
+	int64_t busy_time() const { return busy_; }
+
+	// In bytes per second
+	int64_t throughput() const
+	{
+		return busy_ > 0 ? (bytes_ * 1000 / busy_) : 0;
+	}
+
+private:
+	int files_{};
+	int failed_{};
+	int64_t bytes_{};
+
+	int active_{};
+	int64_t busy_since_{};
+	int64_t busy_{};
+};
+
+}
+
+#endif
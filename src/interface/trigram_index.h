@@ -0,0 +1,149 @@
+#ifndef FZ_TRIGRAM_INDEX_HEADER
+#define FZ_TRIGRAM_INDEX_HEADER
+
+#include <stdint.h>
+#include <wctype.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+An index to find the names containing a given substring without looking at
+all of them.
+
+Every name gets an id, counting up from zero. For each trigram, i.e. each
+run of three characters, the index keeps the ids of the names containing
+it. A name can only contain a substring if it contains all of the
+substring's trigrams, so intersecting their id lists yields a short list of
+candidates. The candidates still need to be checked, the trigrams of a
+substring may appear in a name without the substring itself.
+
+Names are indexed ignoring case, the candidates for a substring therefore
+include all names that contain it with or without matching case.
+
+Removed names are only marked as such. Once most of the ids belong to
+removed names, the owner should rebuild the index from scratch.
+*/
+
+class CTrigramIndex final
+{
+public:
+	CTrigramIndex() = default;
+
+	void clear()
+	{
+		postings_.clear();
+		removed_.clear();
+		removedCount_ = 0;
+	}
+
+	// Number of ids handed out, including those of removed names
+	size_t size() const { return removed_.size(); }
+
+	size_t removed() const { return removedCount_; }
+
+	// Returns the id of the name
+	size_t add(wchar_t const* name, size_t len)
+	{
+		size_t const id = removed_.size();
+		removed_.push_back(false);
+
+		for (size_t i = 0; i + 3 <= len; ++i) {
+			std::vector<uint32_t>& ids = postings_[trigram(name + i)];
+
+			// Listed once even if the trigram repeats
+			if (ids.empty() || ids.back() != id) {
+				ids.push_back(static_cast<uint32_t>(id));
+			}
+		}
+
+		return id;
+	}
+
+	size_t add(std::wstring const& name)
+	{
+		return add(name.c_str(), name.size());
+	}
+
+	void remove(size_t id)
+	{
+		if (id < removed_.size() && !removed_[id]) {
+			removed_[id] = true;
+			++removedCount_;
+		}
+	}
+
+	// Calls f(id) for all names that could contain the substring, in
+	// ascending order of their ids. All names are candidates for substrings
+	// shorter than a trigram.
+	template<typename F>
+	void find(wchar_t const* sub, size_t len, F && f) const
+	{
+		if (len < 3) {
+			for (size_t id = 0; id < removed_.size(); ++id) {
+				if (!removed_[id]) {
+					f(id);
+				}
+			}
+			return;
+		}
+
+		std::vector<std::vector<uint32_t> const*> lists;
+		for (size_t i = 0; i + 3 <= len; ++i) {
+			auto const it = postings_.find(trigram(sub + i));
+			if (it == postings_.end()) {
+				// No name contains this trigram
+				return;
+			}
+			lists.push_back(&it->second);
+		}
+
+		// Shortest list first, every candidate has to be in all of them
+		std::sort(lists.begin(), lists.end(), [](std::vector<uint32_t> const* a, std::vector<uint32_t> const* b) { return a->size() < b->size(); });
+		lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+		// Positions in the other lists only move forward as ids ascend
+		std::vector<size_t> pos(lists.size());
+		for (uint32_t const id : *lists[0]) {
+			if (removed_[id]) {
+				continue;
+			}
+
+			bool found = true;
+			for (size_t i = 1; i < lists.size() && found; ++i) {
+				std::vector<uint32_t> const& ids = *lists[i];
+				size_t& p = pos[i];
+				p = std::lower_bound(ids.begin() + p, ids.end(), id) - ids.begin();
+				found = p < ids.size() && ids[p] == id;
+			}
+			if (found) {
+				f(static_cast<size_t>(id));
+			}
+		}
+	}
+
+	template<typename F>
+	void find(std::wstring const& sub, F && f) const
+	{
+		find(sub.c_str(), sub.size(), f);
+	}
+
+private:
+	static uint64_t trigram(wchar_t const* p)
+	{
+		// 21 bits suffice for any Unicode code point
+		uint64_t t = 0;
+		for (size_t i = 0; i < 3; ++i) {
+			t = (t << 21) | (static_cast<uint32_t>(towlower(p[i])) & 0x1fffff);
+		}
+		return t;
+	}
+
+	std::unordered_map<uint64_t, std::vector<uint32_t>> postings_;
+	std::vector<bool> removed_;
+	size_t removedCount_{};
+};
+
+#endif
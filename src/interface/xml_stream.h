@@ -0,0 +1,395 @@
+#ifndef FZ_XML_STREAM_HEADER
+#define FZ_XML_STREAM_HEADER
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*
+Streaming reader and writer for large XML files such as exported queues.
+
+Unlike TinyXML, which always keeps the whole document in memory, these only
+look at one element at a time. The reader hands out start and end tags, the
+caller decides which elements to read completely, e.g. to parse them with
+TinyXML, and which to descend into. The writer writes start and end tags as
+well as serialized elements in document order.
+
+Only what's needed for the files FileZilla writes is supported. In
+particular, entities and text outside of elements read completely are
+skipped, not decoded.
+*/
+
+class CXmlStreamReader final
+{
+public:
+	enum class token
+	{
+		start,
+		end,
+		eof,
+		error
+	};
+
+	// Does not take ownership of the file
+	explicit CXmlStreamReader(FILE* f, size_t chunkSize = 65536)
+		: f_(f)
+		, chunkSize_(chunkSize ? chunkSize : 1)
+	{}
+
+	CXmlStreamReader(CXmlStreamReader const&) = delete;
+	CXmlStreamReader& operator=(CXmlStreamReader const&) = delete;
+
+	// Advances to the next start or end tag, skipping text, comments and
+	// declarations. Empty elements yield a start followed by an end token.
+	token next()
+	{
+		if (pendingEnd_) {
+			pendingEnd_ = false;
+			name_ = stack_.back();
+			stack_.pop_back();
+			return token::end;
+		}
+		if (!capturing_) {
+			mark_ = npos;
+		}
+
+		for (;;) {
+			size_t const open = find("<", 0);
+			if (open == npos) {
+				pos_ = buf_.size();
+				return stack_.empty() ? token::eof : token::error;
+			}
+			pos_ += open;
+
+			if (!ensure(2)) {
+				return token::error;
+			}
+
+			if (buf_[pos_ + 1] == '?') {
+				if (!skip_past("?>", 2)) {
+					return token::error;
+				}
+				continue;
+			}
+			if (buf_[pos_ + 1] == '!') {
+				bool ok;
+				if (ensure(4) && !buf_.compare(pos_, 4, "<!--")) {
+					ok = skip_past("-->", 4);
+				}
+				else if (ensure(9) && !buf_.compare(pos_, 9, "<![CDATA[")) {
+					ok = skip_past("]]>", 9);
+				}
+				else {
+					ok = skip_past(">", 2);
+				}
+				if (!ok) {
+					return token::error;
+				}
+				continue;
+			}
+
+			if (buf_[pos_ + 1] == '/') {
+				size_t const close = find(">", 2);
+				if (close == npos) {
+					return token::error;
+				}
+				name_ = trim(buf_.substr(pos_ + 2, close - 2));
+				pos_ += close + 1;
+				if (stack_.empty() || stack_.back() != name_) {
+					return token::error;
+				}
+				stack_.pop_back();
+				return token::end;
+			}
+
+			// Start tag, look for its end outside of attribute values
+			size_t i = 1;
+			char quote = 0;
+			for (;; ++i) {
+				if (!ensure(i + 1)) {
+					return token::error;
+				}
+				char const c = buf_[pos_ + i];
+				if (quote) {
+					if (c == quote) {
+						quote = 0;
+					}
+				}
+				else if (c == '"' || c == '\'') {
+					quote = c;
+				}
+				else if (c == '>') {
+					break;
+				}
+			}
+
+			size_t n = 1;
+			while (n < i && !strchr(" \t\r\n/>", buf_[pos_ + n])) {
+				++n;
+			}
+			name_ = buf_.substr(pos_ + 1, n - 1);
+			if (name_.empty()) {
+				return token::error;
+			}
+
+			if (!capturing_) {
+				mark_ = pos_;
+			}
+			pendingEnd_ = buf_[pos_ + i - 1] == '/';
+			pos_ += i + 1;
+			stack_.push_back(name_);
+			return token::start;
+		}
+	}
+
+	// Name of the element of the last tag
+	std::string const& name() const { return name_; }
+
+	// Number of currently open elements. After a start tag, this includes
+	// the new element. The root element has depth 1.
+	size_t depth() const { return stack_.size(); }
+
+	// Only valid right after a start tag. Reads the remainder of the element
+	// and returns all of it, including its start and end tags.
+	bool read_element(std::string& element)
+	{
+		if (mark_ == npos) {
+			return false;
+		}
+
+		if (!skip_rest()) {
+			return false;
+		}
+
+		// Reading more data might have moved the mark
+		element.assign(buf_, mark_, pos_ - mark_);
+		return true;
+	}
+
+	// Only valid right after a start tag. Skips the remainder of the element.
+	bool skip_element()
+	{
+		if (mark_ == npos) {
+			return false;
+		}
+		return skip_rest();
+	}
+
+private:
+	static size_t const npos = std::string::npos;
+
+	static std::string trim(std::string const& s)
+	{
+		size_t const first = s.find_first_not_of(" \t\r\n");
+		if (first == npos) {
+			return std::string();
+		}
+		return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+	}
+
+	bool skip_rest()
+	{
+		size_t const depth = stack_.size();
+
+		bool ok = false;
+		capturing_ = true;
+		for (;;) {
+			token const t = next();
+			if (t == token::end) {
+				if (stack_.size() < depth) {
+					ok = true;
+					break;
+				}
+			}
+			else if (t != token::start) {
+				break;
+			}
+		}
+		capturing_ = false;
+
+		return ok;
+	}
+
+	// Reads another chunk. Keeps everything from the mark or the current
+	// position on, whatever comes first, so that offsets relative to the
+	// current position stay valid.
+	bool more()
+	{
+		if (eof_) {
+			return false;
+		}
+
+		size_t const keep = (mark_ != npos && mark_ < pos_) ? mark_ : pos_;
+		if (keep && keep * 2 >= buf_.size()) {
+			buf_.erase(0, keep);
+			pos_ -= keep;
+			if (mark_ != npos) {
+				mark_ -= keep;
+			}
+		}
+
+		size_t const old = buf_.size();
+		buf_.resize(old + chunkSize_);
+		size_t const read = fread(&buf_[old], 1, chunkSize_, f_);
+		buf_.resize(old + read);
+		if (!read) {
+			eof_ = true;
+			return false;
+		}
+		return true;
+	}
+
+	// Makes sure there are at least n characters from the current position
+	bool ensure(size_t n)
+	{
+		while (buf_.size() - pos_ < n) {
+			if (!more()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Returns the offset of s relative to the current position
+	size_t find(char const* s, size_t from)
+	{
+		size_t const len = strlen(s);
+		for (;;) {
+			size_t const found = buf_.find(s, pos_ + from);
+			if (found != npos) {
+				return found - pos_;
+			}
+			if (buf_.size() - pos_ >= len) {
+				from = std::max(from, buf_.size() - pos_ - len + 1);
+			}
+			if (!more()) {
+				return npos;
+			}
+		}
+	}
+
+	bool skip_past(char const* s, size_t from)
+	{
+		size_t const found = find(s, from);
+		if (found == npos) {
+			return false;
+		}
+		pos_ += found + strlen(s);
+		return true;
+	}
+
+	FILE* const f_;
+	size_t const chunkSize_;
+
+	std::string buf_;
+	size_t pos_{};
+	bool eof_{};
+
+	// Start of the last start tag, kept in the buffer while reading the
+	// rest of its element
+	size_t mark_{npos};
+	bool capturing_{};
+
+	std::string name_;
+	std::vector<std::string> stack_;
+	bool pendingEnd_{};
+};
+
+class CXmlStreamWriter final
+{
+public:
+	// Does not take ownership of the file
+	explicit CXmlStreamWriter(FILE* f)
+		: f_(f)
+	{}
+
+	CXmlStreamWriter(CXmlStreamWriter const&) = delete;
+	CXmlStreamWriter& operator=(CXmlStreamWriter const&) = delete;
+
+	void declaration()
+	{
+		write("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\" ?>\n");
+	}
+
+	void start(char const* name)
+	{
+		indent();
+		write("<");
+		write(name);
+		write(">\n");
+		open_.push_back(name);
+	}
+
+	void end()
+	{
+		if (open_.empty()) {
+			return;
+		}
+		std::string const name = open_.back();
+		open_.pop_back();
+
+		indent();
+		write("</");
+		write(name.c_str());
+		write(">\n");
+	}
+
+	// Writes an already serialized element, indenting each of its lines to
+	// the current depth
+	void element(char const* xml)
+	{
+		bool lineStart = true;
+		for (char const* p = xml; *p; ) {
+			if (lineStart) {
+				indent();
+			}
+			char const* eol = strchr(p, '\n');
+			size_t const len = eol ? (eol - p + 1) : strlen(p);
+			write(p, len);
+			p += len;
+			lineStart = eol != 0;
+		}
+		if (!lineStart) {
+			write("\n");
+		}
+	}
+
+	// Closes all open elements
+	void finish()
+	{
+		while (!open_.empty()) {
+			end();
+		}
+	}
+
+	bool error() const { return error_ || ferror(f_); }
+
+private:
+	void indent()
+	{
+		for (size_t i = 0; i < open_.size(); ++i) {
+			write("    ");
+		}
+	}
+
+	void write(char const* s)
+	{
+		write(s, strlen(s));
+	}
+
+	void write(char const* s, size_t len)
+	{
+		if (len && fwrite(s, 1, len, f_) != len) {
+			error_ = true;
+		}
+	}
+
+	FILE* const f_;
+	std::vector<std::string> open_;
+	bool error_{};
+};
+
+#endif
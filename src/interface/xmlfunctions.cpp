@@ -1,6 +1,7 @@
 #include <filezilla.h>
 #include "xmlfunctions.h"
 #include "Options.h"
+#include "xml_stream.h"
 #include <wx/ffile.h>
 #include <wx/log.h>
 
@@ -799,3 +800,20 @@ bool CXmlFile::ParseData(char* data)
 
 	return true;
 }
+
+TiXmlElement* ParseElement(TiXmlDocument& document, std::string const& xml)
+{
+	document.SetCondenseWhiteSpace(false);
+	document.Parse(xml.c_str(), 0, TIXML_ENCODING_UTF8);
+	if (document.Error())
+		return 0;
+
+	return document.FirstChildElement();
+}
+
+void WriteElement(CXmlStreamWriter& writer, TiXmlElement const& element)
+{
+	TiXmlPrinter printer;
+	element.Accept(&printer);
+	writer.element(printer.CStr());
+}
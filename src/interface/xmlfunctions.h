@@ -12,6 +12,8 @@
 #include "../tinyxml/tinyxml.h"
 #endif
 
+class CXmlStreamWriter;
+
 class CXmlFile
 {
 public:
@@ -107,4 +109,11 @@ bool GetTextElementBool(TiXmlElement* node, const char* name, bool defValue = fa
 void SetServer(TiXmlElement *node, const CServer& server);
 bool GetServer(TiXmlElement *node, CServer& server);
 
+// Parses a single element, e.g. one read by CXmlStreamReader. The element is
+// owned by the passed document. Returns 0 on error.
+TiXmlElement* ParseElement(TiXmlDocument& document, std::string const& xml);
+
+// Writes the given element, including its children, to the stream
+void WriteElement(CXmlStreamWriter& writer, TiXmlElement const& element);
+
 #endif //__XMLFUNCTIONS_H__
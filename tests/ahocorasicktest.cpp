@@ -0,0 +1,95 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "aho_corasick.h"
+
+/*
+ * This testsuite asserts the correctness of the multi-pattern search used by
+ * the compiled filters and compares it against checking each pattern
+ * separately, the way the filter interpreter does.
+ */
+
+class CAhoCorasickTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CAhoCorasickTest);
+	CPPUNIT_TEST(testFind);
+	CPPUNIT_TEST(testRandom);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testFind();
+	void testRandom();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CAhoCorasickTest);
+
+namespace {
+std::vector<char> Find(CAhoCorasick<wchar_t> const& ac, std::wstring const& s)
+{
+	std::vector<char> found(ac.size());
+	ac.find(s.c_str(), s.size(), found);
+	return found;
+}
+}
+
+void CAhoCorasickTest::testFind()
+{
+	std::vector<std::wstring> const patterns = { L"he", L"she", L"his", L"hers", L"\x00e4\x00df", L"s\x00e4" };
+	CAhoCorasick<wchar_t> ac(patterns);
+	CPPUNIT_ASSERT_EQUAL(patterns.size(), ac.size());
+
+	std::vector<char> found = Find(ac, L"ushers");
+	CPPUNIT_ASSERT(found[0] && found[1] && !found[2] && found[3] && !found[4] && !found[5]);
+
+	found = Find(ac, L"s\x00e4\x00df");
+	CPPUNIT_ASSERT(!found[0] && !found[1] && !found[2] && !found[3] && found[4] && found[5]);
+
+	found = Find(ac, L"");
+	CPPUNIT_ASSERT(std::find(found.begin(), found.end(), 1) == found.end());
+
+	// The empty pattern is always found
+	CAhoCorasick<wchar_t> empty({ std::wstring(), L"x" });
+	found = Find(empty, L"abc");
+	CPPUNIT_ASSERT(found[0] && !found[1]);
+
+	CAhoCorasick<wchar_t> none;
+	CPPUNIT_ASSERT(none.empty());
+	found = Find(none, L"abc");
+	CPPUNIT_ASSERT(found.empty());
+}
+
+void CAhoCorasickTest::testRandom()
+{
+	unsigned int seed = 1;
+	auto random = [&seed]() {
+		seed = seed * 1103515245 + 12345;
+		return (seed >> 16) & 0x7fff;
+	};
+
+	// Small alphabet including non-ASCII characters for many overlaps
+	wchar_t const alphabet[] = { L'a', L'b', L'c', 0x00e4, 0x4e2d };
+	auto randomString = [&](size_t maxLen) {
+		std::wstring s;
+		size_t const len = random() % (maxLen + 1);
+		for (size_t i = 0; i < len; ++i)
+			s += alphabet[random() % 5];
+		return s;
+	};
+
+	for (int round = 0; round < 100; ++round) {
+		std::vector<std::wstring> patterns;
+		size_t const count = random() % 20 + 1;
+		for (size_t i = 0; i < count; ++i)
+			patterns.push_back(randomString(5));
+
+		CAhoCorasick<wchar_t> ac(patterns);
+		for (int i = 0; i < 20; ++i) {
+			std::wstring const s = randomString(40);
+			std::vector<char> const found = Find(ac, s);
+			for (size_t p = 0; p < patterns.size(); ++p)
+				CPPUNIT_ASSERT_EQUAL(s.find(patterns[p]) != std::wstring::npos, found[p] != 0);
+		}
+	}
+}
@@ -0,0 +1,146 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "comparison_keys.h"
+
+#include <map>
+#include <random>
+#include <set>
+
+/*
+ * This testsuite asserts that matching two listings through their comparison
+ * keys finds the same pairs as looking up each name in the other listing,
+ * in the expected order.
+ */
+
+class CComparisonKeysTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CComparisonKeysTest);
+	CPPUNIT_TEST(testMatch);
+	CPPUNIT_TEST(testOrder);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testMatch();
+	void testOrder();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CComparisonKeysTest);
+
+namespace {
+struct file
+{
+	std::wstring name;
+	bool dir;
+};
+
+std::wstring Lower(std::wstring s)
+{
+	for (auto& c : s) {
+		c = static_cast<wchar_t>(towlower(c));
+	}
+	return s;
+}
+
+// Random listing without names that would match each other
+std::vector<file> RandomListing(std::mt19937& gen, size_t count, bool caseSensitive)
+{
+	wchar_t const chars[] = L"aAbB1-";
+	std::set<std::wstring> seen;
+	std::vector<file> files;
+	while (files.size() < count) {
+		file f;
+		size_t const len = 1 + gen() % 4;
+		for (size_t i = 0; i < len; ++i) {
+			f.name += chars[gen() % 6];
+		}
+		f.dir = !(gen() % 4);
+		if (seen.insert(caseSensitive ? f.name : Lower(f.name)).second) {
+			files.push_back(f);
+		}
+	}
+	return files;
+}
+
+std::vector<std::pair<int, int>> Match(std::vector<file> const& left, std::vector<file> const& right, CNameSortKeys::mode sortMode, bool caseSensitive, bool dirsFirst)
+{
+	CComparisonKeys l;
+	CComparisonKeys r;
+	l.reset(sortMode, caseSensitive, dirsFirst);
+	r.reset(sortMode, caseSensitive, dirsFirst);
+	for (auto const& f : left) {
+		l.push_back(f.name, f.dir);
+	}
+	for (auto const& f : right) {
+		r.push_back(f.name, f.dir);
+	}
+	l.prepare();
+	r.prepare();
+
+	std::vector<std::pair<int, int>> pairs;
+	CComparisonKeys::match(l, r, [&](int a, int b) { pairs.push_back(std::make_pair(a, b)); });
+	return pairs;
+}
+}
+
+void CComparisonKeysTest::testMatch()
+{
+	std::mt19937 gen(1);
+	for (int caseSensitive = 0; caseSensitive < 2; ++caseSensitive) {
+		for (int dirsFirst = 0; dirsFirst < 2; ++dirsFirst) {
+			auto const left = RandomListing(gen, 300, caseSensitive != 0);
+			auto const right = RandomListing(gen, 300, caseSensitive != 0);
+
+			std::map<std::pair<std::wstring, bool>, int> lookup;
+			for (size_t i = 0; i < right.size(); ++i) {
+				lookup[std::make_pair(caseSensitive ? right[i].name : Lower(right[i].name), dirsFirst && right[i].dir)] = i;
+			}
+
+			auto const pairs = Match(left, right, CNameSortKeys::natural, caseSensitive != 0, dirsFirst != 0);
+
+			std::vector<int> seenLeft(left.size());
+			std::vector<int> seenRight(right.size());
+			for (auto const& p : pairs) {
+				if (p.first != -1) {
+					++seenLeft[p.first];
+				}
+				if (p.second != -1) {
+					++seenRight[p.second];
+				}
+				if (p.first == -1) {
+					continue;
+				}
+
+				file const& f = left[p.first];
+				auto const it = lookup.find(std::make_pair(caseSensitive ? f.name : Lower(f.name), dirsFirst && f.dir));
+				CPPUNIT_ASSERT_EQUAL(it == lookup.end() ? -1 : it->second, p.second);
+			}
+
+			// Every entry exactly once
+			CPPUNIT_ASSERT(std::count(seenLeft.begin(), seenLeft.end(), 1) == static_cast<int>(left.size()));
+			CPPUNIT_ASSERT(std::count(seenRight.begin(), seenRight.end(), 1) == static_cast<int>(right.size()));
+		}
+	}
+}
+
+void CComparisonKeysTest::testOrder()
+{
+	std::vector<file> const left = {
+		{ L"file10", false }, { L"B", true }, { L"..", true }, { L"file2", false }, { L"a", true }, { L"C", false }
+	};
+	std::vector<file> const right = {
+		{ L"file2", false }, { L"b", true }, { L"c", false }, { L"..", true }
+	};
+
+	// Matching ignoring case, in natural order
+	auto pairs = Match(left, right, CNameSortKeys::natural, false, true);
+	std::vector<std::pair<int, int>> expected = { { 2, 3 }, { 4, -1 }, { 1, 1 }, { 5, 2 }, { 3, 0 }, { 0, -1 } };
+	CPPUNIT_ASSERT(pairs == expected);
+
+	// Exact matching, directories inline
+	pairs = Match(left, right, CNameSortKeys::case_insensitive, true, false);
+	expected = { { 2, 3 }, { 4, -1 }, { 1, -1 }, { -1, 1 }, { 5, -1 }, { -1, 2 }, { 0, -1 }, { 3, 0 } };
+	CPPUNIT_ASSERT(pairs == expected);
+}
@@ -0,0 +1,243 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "dir_scanner.h"
+
+#include <map>
+
+/*
+ * This testsuite asserts that the directory scanner reads every directory
+ * only once: in the background if prefetched, on the calling thread
+ * otherwise, and that getting a directory while it is being read in the
+ * background waits for it.
+ */
+
+class CDirScannerTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDirScannerTest);
+	CPPUNIT_TEST(testNotPrefetched);
+	CPPUNIT_TEST(testPrefetched);
+	CPPUNIT_TEST(testInFlight);
+	CPPUNIT_TEST(testDropped);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testNotPrefetched();
+	void testPrefetched();
+	void testInFlight();
+	void testDropped();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDirScannerTest);
+
+namespace {
+CLocalPath Path(wxString const& name)
+{
+#ifdef __WXMSW__
+	CLocalPath path(_T("C:\\"));
+#else
+	CLocalPath path(_T("/"));
+#endif
+	path.AddSegment(name);
+	return path;
+}
+
+// Lists every directory as its own path and counts where it got read. Reading
+// the blocked directory doesn't finish before it gets unblocked.
+class CTestReader final
+{
+public:
+	CDirScanner<wxString>::reader Get()
+	{
+		return [this](CLocalPath const& path, std::vector<wxString>& entries, std::function<bool()> const& cancelled) {
+			return Read(path, entries, cancelled);
+		};
+	}
+
+	void Block(CLocalPath const& path)
+	{
+		scoped_lock l(m_sync);
+		m_blocked = path.GetPath();
+	}
+
+	void Unblock()
+	{
+		scoped_lock l(m_sync);
+		m_blocked.clear();
+		m_changed.signal(l);
+	}
+
+	// Waits for the background thread to start reading the blocked directory
+	// or to have read the given number of directories
+	void WaitForBlocked()
+	{
+		scoped_lock l(m_sync);
+		while (!m_inBlocked)
+			m_changed.wait(l);
+	}
+
+	void WaitForBackground(int count)
+	{
+		scoped_lock l(m_sync);
+		while (m_backgroundReads < count)
+			m_changed.wait(l);
+	}
+
+	int BackgroundReads(CLocalPath const& path)
+	{
+		scoped_lock l(m_sync);
+		return m_reads[path.GetPath()].first;
+	}
+
+	int ForegroundReads(CLocalPath const& path)
+	{
+		scoped_lock l(m_sync);
+		return m_reads[path.GetPath()].second;
+	}
+
+private:
+	bool Read(CLocalPath const& path, std::vector<wxString>& entries, std::function<bool()> const& cancelled)
+	{
+		bool const main = wxThread::IsMain();
+
+		scoped_lock l(m_sync);
+		if (!main && path.GetPath() == m_blocked) {
+			m_inBlocked = true;
+			m_changed.signal(l);
+			while (path.GetPath() == m_blocked && !cancelled())
+				m_changed.wait(l, 10);
+		}
+
+		if (main)
+			++m_reads[path.GetPath()].second;
+		else {
+			++m_reads[path.GetPath()].first;
+			++m_backgroundReads;
+			m_changed.signal(l);
+		}
+
+		entries.push_back(path.GetPath());
+		return true;
+	}
+
+	mutex m_sync{false};
+	condition m_changed;
+
+	wxString m_blocked;
+	bool m_inBlocked{};
+
+	int m_backgroundReads{};
+	std::map<wxString, std::pair<int, int>> m_reads;
+};
+}
+
+void CDirScannerTest::testNotPrefetched()
+{
+	CTestReader reader;
+	CDirScanner<wxString> scanner(reader.Get());
+
+	std::vector<wxString> entries;
+	CPPUNIT_ASSERT(scanner.Get(Path(_T("a")), entries));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), entries.size());
+	CPPUNIT_ASSERT(entries[0] == Path(_T("a")).GetPath());
+	CPPUNIT_ASSERT_EQUAL(1, reader.ForegroundReads(Path(_T("a"))));
+	CPPUNIT_ASSERT_EQUAL(0, reader.BackgroundReads(Path(_T("a"))));
+}
+
+void CDirScannerTest::testPrefetched()
+{
+	CTestReader reader;
+	CDirScanner<wxString> scanner(reader.Get());
+
+	scanner.Prefetch({ Path(_T("a")), Path(_T("b")) });
+	reader.WaitForBackground(2);
+
+	std::vector<wxString> entries;
+	CPPUNIT_ASSERT(scanner.Get(Path(_T("b")), entries));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), entries.size());
+	CPPUNIT_ASSERT(entries[0] == Path(_T("b")).GetPath());
+
+	CPPUNIT_ASSERT(scanner.Get(Path(_T("a")), entries));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), entries.size());
+	CPPUNIT_ASSERT(entries[0] == Path(_T("a")).GetPath());
+
+	CPPUNIT_ASSERT_EQUAL(1, reader.BackgroundReads(Path(_T("a"))));
+	CPPUNIT_ASSERT_EQUAL(0, reader.ForegroundReads(Path(_T("a"))));
+	CPPUNIT_ASSERT_EQUAL(1, reader.BackgroundReads(Path(_T("b"))));
+	CPPUNIT_ASSERT_EQUAL(0, reader.ForegroundReads(Path(_T("b"))));
+
+	// Handed out already, so read again
+	CPPUNIT_ASSERT(scanner.Get(Path(_T("a")), entries));
+	CPPUNIT_ASSERT_EQUAL(1, reader.ForegroundReads(Path(_T("a"))));
+}
+
+void CDirScannerTest::testInFlight()
+{
+	CTestReader reader;
+	CDirScanner<wxString> scanner(reader.Get());
+
+	reader.Block(Path(_T("a")));
+	scanner.Prefetch({ Path(_T("a")) });
+	reader.WaitForBlocked();
+
+	// Get has to wait for the read in progress, which it can only do if
+	// something else lets that read finish
+	class unblocker final : public wxThread
+	{
+	public:
+		explicit unblocker(CTestReader& reader)
+			: wxThread(wxTHREAD_JOINABLE)
+			, m_reader(reader)
+		{}
+
+	protected:
+		virtual ExitCode Entry()
+		{
+			wxMilliSleep(50);
+			m_reader.Unblock();
+			return 0;
+		}
+
+		CTestReader& m_reader;
+	};
+
+	unblocker thread(reader);
+	CPPUNIT_ASSERT(thread.Create() == wxTHREAD_NO_ERROR);
+	CPPUNIT_ASSERT(thread.Run() == wxTHREAD_NO_ERROR);
+
+	std::vector<wxString> entries;
+	CPPUNIT_ASSERT(scanner.Get(Path(_T("a")), entries));
+	thread.Wait();
+
+	CPPUNIT_ASSERT_EQUAL(size_t(1), entries.size());
+	CPPUNIT_ASSERT(entries[0] == Path(_T("a")).GetPath());
+	CPPUNIT_ASSERT_EQUAL(1, reader.BackgroundReads(Path(_T("a"))));
+	CPPUNIT_ASSERT_EQUAL(0, reader.ForegroundReads(Path(_T("a"))));
+}
+
+void CDirScannerTest::testDropped()
+{
+	CTestReader reader;
+	CDirScanner<wxString> scanner(reader.Get());
+
+	// Keeps the thread busy so that b doesn't get started before it is
+	// dropped
+	reader.Block(Path(_T("a")));
+	scanner.Prefetch({ Path(_T("a")), Path(_T("b")) });
+	reader.WaitForBlocked();
+	scanner.Prefetch({ Path(_T("a")), Path(_T("c")) });
+	reader.Unblock();
+	reader.WaitForBackground(2);
+
+	std::vector<wxString> entries;
+	CPPUNIT_ASSERT(scanner.Get(Path(_T("c")), entries));
+	CPPUNIT_ASSERT(scanner.Get(Path(_T("b")), entries));
+
+	CPPUNIT_ASSERT_EQUAL(1, reader.BackgroundReads(Path(_T("a"))));
+	CPPUNIT_ASSERT_EQUAL(0, reader.BackgroundReads(Path(_T("b"))));
+	CPPUNIT_ASSERT_EQUAL(1, reader.ForegroundReads(Path(_T("b"))));
+	CPPUNIT_ASSERT_EQUAL(1, reader.BackgroundReads(Path(_T("c"))));
+	CPPUNIT_ASSERT_EQUAL(0, reader.ForegroundReads(Path(_T("c"))));
+}
@@ -0,0 +1,110 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "fenwick_tree.h"
+
+/*
+ * This testsuite asserts the correctness of the binary indexed tree used
+ * by the queue to map between item indexes and items.
+ */
+
+class CFenwickTreeTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CFenwickTreeTest);
+	CPPUNIT_TEST(testPrefix);
+	CPPUNIT_TEST(testFind);
+	CPPUNIT_TEST(testRandom);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testPrefix();
+	void testFind();
+	void testRandom();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CFenwickTreeTest);
+
+void CFenwickTreeTest::testPrefix()
+{
+	CFenwickTree tree;
+	CPPUNIT_ASSERT(tree.empty());
+	CPPUNIT_ASSERT_EQUAL(0, tree.prefix(0));
+
+	for (int i = 1; i <= 10; ++i)
+		tree.push_back(i);
+
+	CPPUNIT_ASSERT_EQUAL(size_t(10), tree.size());
+	CPPUNIT_ASSERT_EQUAL(0, tree.prefix(0));
+	CPPUNIT_ASSERT_EQUAL(1, tree.prefix(1));
+	CPPUNIT_ASSERT_EQUAL(15, tree.prefix(5));
+	CPPUNIT_ASSERT_EQUAL(55, tree.prefix(10));
+
+	tree.add(2, -3);
+	CPPUNIT_ASSERT_EQUAL(3, tree.prefix(2));
+	CPPUNIT_ASSERT_EQUAL(3, tree.prefix(3));
+	CPPUNIT_ASSERT_EQUAL(52, tree.prefix(10));
+
+	tree.assign(std::vector<int>{ 2, 0, 1 });
+	CPPUNIT_ASSERT_EQUAL(size_t(3), tree.size());
+	CPPUNIT_ASSERT_EQUAL(3, tree.prefix(3));
+}
+
+void CFenwickTreeTest::testFind()
+{
+	CFenwickTree tree;
+	tree.assign(std::vector<int>{ 2, 0, 1, 3 });
+
+	int const expected[] = { 0, 0, 2, 3, 3, 3, 4 };
+	int const remainder[] = { 0, 1, 0, 0, 1, 2, 0 };
+	for (int i = 0; i < 7; ++i) {
+		int offset = i;
+		CPPUNIT_ASSERT_EQUAL(size_t(expected[i]), tree.find(offset));
+		CPPUNIT_ASSERT_EQUAL(remainder[i], offset);
+	}
+}
+
+void CFenwickTreeTest::testRandom()
+{
+	// Compare against plain sums while appending and changing counts
+	std::vector<int> counts;
+	CFenwickTree tree;
+
+	unsigned int seed = 1;
+	auto random = [&seed]() {
+		seed = seed * 1103515245 + 12345;
+		return (seed >> 16) & 0x7fff;
+	};
+
+	for (int i = 0; i < 2000; ++i) {
+		if (counts.empty() || random() % 3) {
+			counts.push_back(random() % 5);
+			tree.push_back(counts.back());
+		}
+		else {
+			size_t const index = random() % counts.size();
+			int const delta = static_cast<int>(random() % 5) - counts[index];
+			counts[index] += delta;
+			tree.add(index, delta);
+		}
+
+		size_t const n = random() % (counts.size() + 1);
+		int sum = 0;
+		for (size_t j = 0; j < n; ++j)
+			sum += counts[j];
+		CPPUNIT_ASSERT_EQUAL(sum, tree.prefix(n));
+	}
+
+	int total = 0;
+	for (size_t i = 0; i < counts.size(); ++i) {
+		for (int j = 0; j < counts[i]; ++j) {
+			int offset = total + j;
+			CPPUNIT_ASSERT_EQUAL(i, tree.find(offset));
+			CPPUNIT_ASSERT_EQUAL(j, offset);
+		}
+		total += counts[i];
+	}
+	int offset = total;
+	CPPUNIT_ASSERT_EQUAL(counts.size(), tree.find(offset));
+}
@@ -0,0 +1,77 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "hash.h"
+
+/*
+ * This testsuite asserts the correctness of the CHash class used for
+ * verifying transferred files.
+ */
+
+class CHashTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CHashTest);
+	CPPUNIT_TEST(testCrc32);
+	CPPUNIT_TEST(testSha256);
+	CPPUNIT_TEST(testIncremental);
+	CPPUNIT_TEST(testNames);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testCrc32();
+	void testSha256();
+	void testIncremental();
+	void testNames();
+
+protected:
+	static wxString Calculate(HashAlgorithm algorithm, char const* data)
+	{
+		CHash hash(algorithm);
+		hash.Update(data, strlen(data));
+		return hash.Finalize();
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CHashTest);
+
+void CHashTest::testCrc32()
+{
+	CPPUNIT_ASSERT_EQUAL(wxString(_T("00000000")), Calculate(HashAlgorithm::crc32, ""));
+	CPPUNIT_ASSERT_EQUAL(wxString(_T("cbf43926")), Calculate(HashAlgorithm::crc32, "123456789"));
+}
+
+void CHashTest::testSha256()
+{
+	CPPUNIT_ASSERT_EQUAL(wxString(_T("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855")), Calculate(HashAlgorithm::sha256, ""));
+	CPPUNIT_ASSERT_EQUAL(wxString(_T("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad")), Calculate(HashAlgorithm::sha256, "abc"));
+}
+
+void CHashTest::testIncremental()
+{
+	// Feeding data in odd-sized chunks must not affect the result
+	char const data[] = "The quick brown fox jumps over the lazy dog";
+	unsigned int const len = sizeof(data) - 1;
+
+	for (auto algorithm : { HashAlgorithm::crc32, HashAlgorithm::md5, HashAlgorithm::sha1 }) {
+		CHash hash(algorithm);
+		for (unsigned int i = 0; i < len; i += 7) {
+			hash.Update(data + i, std::min(7u, len - i));
+		}
+		CPPUNIT_ASSERT_EQUAL(Calculate(algorithm, data), hash.Finalize());
+	}
+
+	CPPUNIT_ASSERT_EQUAL(wxString(_T("414fa339")), Calculate(HashAlgorithm::crc32, data));
+	CPPUNIT_ASSERT_EQUAL(wxString(_T("9e107d9d372bb6826bd81d3542a419d6")), Calculate(HashAlgorithm::md5, data));
+	CPPUNIT_ASSERT_EQUAL(wxString(_T("2fd4e1c67a2d28fced849ee1bb76e7391b93eb12")), Calculate(HashAlgorithm::sha1, data));
+}
+
+void CHashTest::testNames()
+{
+	CPPUNIT_ASSERT(CHash::GetAlgorithm(_T("SHA-256")) == HashAlgorithm::sha256);
+	CPPUNIT_ASSERT(CHash::GetAlgorithm(_T("md5")) == HashAlgorithm::md5);
+	CPPUNIT_ASSERT(CHash::GetAlgorithm(_T("foo")) == HashAlgorithm::none);
+	CPPUNIT_ASSERT_EQUAL(wxString(_T("SHA-1")), CHash::GetName(HashAlgorithm::sha1));
+	CPPUNIT_ASSERT_EQUAL(64u, CHash::GetDigestLength(HashAlgorithm::sha256));
+}
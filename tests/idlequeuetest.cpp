@@ -0,0 +1,161 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "idlequeue.h"
+
+#include <vector>
+
+/*
+ * This testsuite asserts the correctness of the idle queue used by the
+ * transfer queue to find the next file to transfer.
+ */
+
+namespace {
+struct item
+{
+	int id{};
+	bool download{true};
+	CIdleQueueHook<item> hook;
+};
+
+typedef CIdleQueue<item, &item::hook, 3> queue_type;
+}
+
+class CIdleQueueTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CIdleQueueTest);
+	CPPUNIT_TEST(testOrder);
+	CPPUNIT_TEST(testDirection);
+	CPPUNIT_TEST(testRequeue);
+	CPPUNIT_TEST(testPriority);
+	CPPUNIT_TEST(testImmediate);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testOrder();
+	void testDirection();
+	void testRequeue();
+	void testPriority();
+	void testImmediate();
+
+protected:
+	static std::vector<item> MakeItems(int count)
+	{
+		std::vector<item> items(count);
+		for (int i = 0; i < count; ++i) {
+			items[i].id = i;
+			items[i].download = (i % 2) == 0;
+		}
+		return items;
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CIdleQueueTest);
+
+void CIdleQueueTest::testOrder()
+{
+	std::vector<item> items = MakeItems(4);
+	queue_type q;
+	q.push_back(items[0], false, 1, true);
+	q.push_back(items[1], false, 1, true);
+	q.push_back(items[2], false, 2, true);
+	q.push_front(items[3], false, 1, true);
+
+	// Highest priority first, then by position
+	int const expected[] = { 2, 3, 0, 1 };
+	for (int id : expected) {
+		item* next = q.pick(false, true, true);
+		CPPUNIT_ASSERT(next);
+		CPPUNIT_ASSERT_EQUAL(id, next->id);
+		q.remove(*next);
+		CPPUNIT_ASSERT(!next->hook.linked());
+	}
+	CPPUNIT_ASSERT(!q.pick(false, true, true));
+}
+
+void CIdleQueueTest::testDirection()
+{
+	std::vector<item> items = MakeItems(4);
+	queue_type q;
+	for (auto & i : items) {
+		q.push_back(i, false, 0, i.download);
+	}
+
+	CPPUNIT_ASSERT_EQUAL(0, q.pick(false, true, true)->id);
+	CPPUNIT_ASSERT_EQUAL(0, q.pick(false, true, false)->id);
+	CPPUNIT_ASSERT_EQUAL(1, q.pick(false, false, true)->id);
+	CPPUNIT_ASSERT(!q.pick(true, true, true));
+
+	q.remove(items[0]);
+	CPPUNIT_ASSERT_EQUAL(1, q.pick(false, true, true)->id);
+	CPPUNIT_ASSERT_EQUAL(2, q.pick(false, true, false)->id);
+}
+
+void CIdleQueueTest::testRequeue()
+{
+	std::vector<item> items = MakeItems(5);
+	queue_type q;
+	for (auto & i : items) {
+		q.push_back(i, false, 0, true);
+	}
+
+	// Items becoming idle again return to their old position
+	q.remove(items[1]);
+	q.remove(items[3]);
+	q.remove(items[0]);
+	q.requeue(items[3], false, 0, true);
+	q.requeue(items[0], false, 0, true);
+	q.requeue(items[1], false, 0, true);
+
+	for (int id = 0; id < 5; ++id) {
+		item* next = q.pick(false, true, true);
+		CPPUNIT_ASSERT_EQUAL(id, next->id);
+		q.remove(*next);
+	}
+}
+
+void CIdleQueueTest::testPriority()
+{
+	std::vector<item> items = MakeItems(4);
+	queue_type q;
+	q.push_back(items[0], false, 2, true);
+	q.push_back(items[1], false, 0, false);
+	q.push_back(items[2], false, 0, true);
+	q.push_back(items[3], false, 1, false);
+
+	q.set_priority(1);
+
+	// Items already having the new priority stay in front
+	int const expected[] = { 3, 1, 2, 0 };
+	for (int id : expected) {
+		item* next = q.pick(false, true, true);
+		CPPUNIT_ASSERT_EQUAL(id, next->id);
+		q.remove(*next);
+	}
+}
+
+void CIdleQueueTest::testImmediate()
+{
+	std::vector<item> items = MakeItems(4);
+	queue_type q;
+	q.push_back(items[0], false, 0, true);
+	q.push_back(items[1], true, 0, false);
+	q.push_back(items[2], true, 0, true);
+	q.push_back(items[3], false, 0, false);
+
+	CPPUNIT_ASSERT_EQUAL(1, q.pick(true, true, true)->id);
+
+	int queued = 0;
+	q.queue_immediate([&queued](item&) { ++queued; });
+	CPPUNIT_ASSERT_EQUAL(2, queued);
+	CPPUNIT_ASSERT(!q.pick(true, true, true));
+
+	int const expected[] = { 1, 2, 0, 3 };
+	for (int id : expected) {
+		item* next = q.pick(false, true, true);
+		CPPUNIT_ASSERT_EQUAL(id, next->id);
+		q.remove(*next);
+	}
+}
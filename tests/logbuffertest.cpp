@@ -0,0 +1,98 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "log_buffer.h"
+
+/*
+ * This testsuite asserts that the log buffer keeps the most recent lines
+ * within its limits and finds lines by their text.
+ */
+
+class CLogBufferTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CLogBufferTest);
+	CPPUNIT_TEST(testRing);
+	CPPUNIT_TEST(testCharLimit);
+	CPPUNIT_TEST(testFind);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testRing();
+	void testCharLimit();
+	void testFind();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CLogBufferTest);
+
+namespace {
+std::wstring Text(CLogBuffer const& buffer, size_t i)
+{
+	return std::wstring(buffer.text(i), buffer.length(i));
+}
+}
+
+void CLogBufferTest::testRing()
+{
+	CLogBuffer buffer(3, 1000000);
+	for (int i = 0; i < 5; ++i) {
+		buffer.push_back(i % 2, 1000 + i, L"line " + std::to_wstring(i));
+	}
+
+	CPPUNIT_ASSERT_EQUAL(size_t(3), buffer.size());
+	CPPUNIT_ASSERT_EQUAL(uint64_t(2), buffer.dropped());
+	CPPUNIT_ASSERT(Text(buffer, 0) == L"line 2");
+	CPPUNIT_ASSERT(Text(buffer, 2) == L"line 4");
+	CPPUNIT_ASSERT_EQUAL(1, buffer.type(1));
+	CPPUNIT_ASSERT_EQUAL(int64_t(1003), buffer.time(1));
+
+	// Texts stay intact while the arena gets compacted
+	for (int i = 5; i < 10000; ++i) {
+		buffer.push_back(0, i, L"line " + std::to_wstring(i));
+	}
+	CPPUNIT_ASSERT(Text(buffer, 0) == L"line 9997");
+	CPPUNIT_ASSERT(Text(buffer, 2) == L"line 9999");
+
+	buffer.clear();
+	CPPUNIT_ASSERT(buffer.empty());
+	CPPUNIT_ASSERT_EQUAL(uint64_t(10000), buffer.dropped());
+	buffer.push_back(0, 0, L"after");
+	CPPUNIT_ASSERT(Text(buffer, 0) == L"after");
+}
+
+void CLogBufferTest::testCharLimit()
+{
+	CLogBuffer buffer(100, 10);
+	buffer.push_back(0, 0, L"abcd");
+	buffer.push_back(0, 0, L"efgh");
+	CPPUNIT_ASSERT_EQUAL(size_t(2), buffer.size());
+
+	// Drops the oldest lines to make room
+	buffer.push_back(0, 0, L"ijkl");
+	CPPUNIT_ASSERT_EQUAL(size_t(2), buffer.size());
+	CPPUNIT_ASSERT(Text(buffer, 0) == L"efgh");
+
+	// Too long for the buffer on its own
+	buffer.push_back(0, 0, L"0123456789abc");
+	CPPUNIT_ASSERT_EQUAL(size_t(1), buffer.size());
+	CPPUNIT_ASSERT(Text(buffer, 0) == L"0123456789");
+}
+
+void CLogBufferTest::testFind()
+{
+	CLogBuffer buffer(10, 1000);
+	buffer.push_back(0, 0, L"Connecting to 192.0.2.1:21...");
+	buffer.push_back(0, 0, L"USER anonymous");
+	buffer.push_back(0, 0, L"331 Password required");
+	buffer.push_back(0, 0, L"Directory listing successful");
+
+	CPPUNIT_ASSERT_EQUAL(size_t(2), buffer.find(L"password", 0));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), buffer.find(L"LISTING", 0));
+	CPPUNIT_ASSERT_EQUAL(size_t(size_t(CLogBuffer::npos)), buffer.find(L"quit", 0));
+
+	// Wraps around in both directions
+	CPPUNIT_ASSERT_EQUAL(size_t(1), buffer.find(L"user", 2));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), buffer.find(L"directory", 0, false));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), buffer.find(L"connect", 3));
+}
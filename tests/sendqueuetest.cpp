@@ -0,0 +1,188 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "backend.h"
+#include "sendqueue.h"
+
+#include <algorithm>
+#include <string>
+
+/*
+ * This testsuite asserts that the send queue hands the data appended to it
+ * to the backend in order and completely, no matter how much of it the
+ * backend accepts at a time.
+ */
+
+class CSendQueueTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CSendQueueTest);
+	CPPUNIT_TEST(testEmpty);
+	CPPUNIT_TEST(testAppend);
+	CPPUNIT_TEST(testPartial);
+	CPPUNIT_TEST(testError);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testEmpty();
+	void testAppend();
+	void testPartial();
+	void testError();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CSendQueueTest);
+
+namespace {
+// Accepts as many bytes as allowed, failing with EAGAIN once they are used up
+class CTestBackend final : public CBackend
+{
+public:
+	CTestBackend()
+		: CBackend(0)
+	{}
+
+	virtual int Read(void *, unsigned int, int& error) { error = EAGAIN; return -1; }
+	virtual int Peek(void *, unsigned int, int& error) { error = EAGAIN; return -1; }
+
+	virtual int Write(const void *buffer, unsigned int size, int& error)
+	{
+		if (fail) {
+			error = ECONNRESET;
+			return -1;
+		}
+
+		unsigned int const n = std::min(size, accept);
+		if (!n) {
+			error = EAGAIN;
+			return -1;
+		}
+
+		written.append(static_cast<char const*>(buffer), n);
+		accept -= n;
+		return n;
+	}
+
+	virtual void OnRateAvailable(enum CRateLimiter::rate_direction) {}
+
+	unsigned int accept{};
+	bool fail{};
+	std::string written;
+};
+
+std::string Data(unsigned int size)
+{
+	std::string data;
+	for (unsigned int i = 0; i < size; ++i)
+		data += static_cast<char>(i * 31 % 251);
+	return data;
+}
+}
+
+void CSendQueueTest::testEmpty()
+{
+	CSendQueue queue;
+	CPPUNIT_ASSERT(queue.empty());
+	CPPUNIT_ASSERT_EQUAL(0u, queue.size());
+
+	queue.Append("", 0);
+	CPPUNIT_ASSERT(queue.empty());
+
+	CTestBackend backend;
+	backend.accept = 100;
+	int error = -1;
+	CPPUNIT_ASSERT_EQUAL(0, queue.Flush(backend, error));
+	CPPUNIT_ASSERT_EQUAL(0, error);
+	CPPUNIT_ASSERT(backend.written.empty());
+
+	queue.Append("abc", 3);
+	CPPUNIT_ASSERT(!queue.empty());
+	queue.clear();
+	CPPUNIT_ASSERT(queue.empty());
+	CPPUNIT_ASSERT_EQUAL(0, queue.Flush(backend, error));
+	CPPUNIT_ASSERT(backend.written.empty());
+}
+
+void CSendQueueTest::testAppend()
+{
+	// Spans several chunks
+	std::string const data = Data(40000);
+
+	CSendQueue queue;
+	queue.Append(data.c_str(), 10);
+	queue.Append(data.c_str() + 10, data.size() - 10);
+	CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(data.size()), queue.size());
+
+	CTestBackend backend;
+	backend.accept = 1000000;
+	int error = -1;
+	CPPUNIT_ASSERT_EQUAL(static_cast<int>(data.size()), queue.Flush(backend, error));
+	CPPUNIT_ASSERT_EQUAL(0, error);
+	CPPUNIT_ASSERT(queue.empty());
+	CPPUNIT_ASSERT(backend.written == data);
+
+	// Reuses drained chunks
+	queue.Append(data.c_str(), data.size());
+	backend.written.clear();
+	CPPUNIT_ASSERT_EQUAL(static_cast<int>(data.size()), queue.Flush(backend, error));
+	CPPUNIT_ASSERT(backend.written == data);
+}
+
+void CSendQueueTest::testPartial()
+{
+	std::string const data = Data(2 * 16 * 1024 + 100);
+
+	CSendQueue queue;
+	queue.Append(data.c_str(), data.size());
+
+	CTestBackend backend;
+	int error = -1;
+
+	// Nothing accepted isn't an error
+	CPPUNIT_ASSERT_EQUAL(0, queue.Flush(backend, error));
+	CPPUNIT_ASSERT_EQUAL(0, error);
+	CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(data.size()), queue.size());
+
+	// Up to just before the end of the first chunk, then across it
+	backend.accept = 16 * 1024 - 4;
+	CPPUNIT_ASSERT_EQUAL(16 * 1024 - 4, queue.Flush(backend, error));
+	backend.accept = 10;
+	CPPUNIT_ASSERT_EQUAL(10, queue.Flush(backend, error));
+	CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(data.size() - 16 * 1024 - 6), queue.size());
+
+	// More data while partially sent
+	std::string const more = Data(1000);
+	queue.Append(more.c_str(), more.size());
+
+	std::string const expected = data + more;
+	while (!queue.empty()) {
+		unsigned int const size = queue.size();
+		backend.accept = 7001;
+		int const written = queue.Flush(backend, error);
+		CPPUNIT_ASSERT_EQUAL(0, error);
+		CPPUNIT_ASSERT_EQUAL(static_cast<int>(std::min(size, 7001u)), written);
+		CPPUNIT_ASSERT_EQUAL(size - written, queue.size());
+	}
+	CPPUNIT_ASSERT(backend.written == expected);
+}
+
+void CSendQueueTest::testError()
+{
+	CSendQueue queue;
+	queue.Append("abcdef", 6);
+
+	CTestBackend backend;
+	backend.accept = 2;
+	int error = -1;
+	CPPUNIT_ASSERT_EQUAL(2, queue.Flush(backend, error));
+
+	backend.fail = true;
+	CPPUNIT_ASSERT_EQUAL(-1, queue.Flush(backend, error));
+	CPPUNIT_ASSERT_EQUAL(ECONNRESET, error);
+	CPPUNIT_ASSERT_EQUAL(4u, queue.size());
+
+	backend.fail = false;
+	backend.accept = 100;
+	CPPUNIT_ASSERT_EQUAL(4, queue.Flush(backend, error));
+	CPPUNIT_ASSERT(backend.written == "abcdef");
+}
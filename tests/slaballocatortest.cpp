@@ -0,0 +1,86 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "slab_allocator.h"
+
+#include <cstring>
+#include <set>
+#include <stdint.h>
+
+/*
+ * This testsuite asserts the correctness of the allocator used for the
+ * file items of the queue.
+ */
+
+class CSlabAllocatorTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CSlabAllocatorTest);
+	CPPUNIT_TEST(testAllocate);
+	CPPUNIT_TEST(testReuse);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testAllocate();
+	void testReuse();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CSlabAllocatorTest);
+
+void CSlabAllocatorTest::testAllocate()
+{
+	CSlabAllocator allocator(13, 4);
+	CPPUNIT_ASSERT(allocator.object_size() >= 13);
+	CPPUNIT_ASSERT_EQUAL(size_t(0), allocator.object_size() % alignof(std::max_align_t));
+
+	std::set<char*> objects;
+	for (int i = 0; i < 10; ++i) {
+		char* p = static_cast<char*>(allocator.allocate());
+		CPPUNIT_ASSERT_EQUAL(uintptr_t(0), reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t));
+
+		// Must not overlap any other object
+		auto next = objects.lower_bound(p);
+		if (next != objects.end())
+			CPPUNIT_ASSERT(p + allocator.object_size() <= *next);
+		if (next != objects.begin())
+			CPPUNIT_ASSERT(*--next + allocator.object_size() <= p);
+
+		memset(p, i, 13);
+		objects.insert(p);
+	}
+
+	CPPUNIT_ASSERT_EQUAL(size_t(10), allocator.used());
+	CPPUNIT_ASSERT_EQUAL(3 * 4 * allocator.object_size(), allocator.reserved());
+
+	for (auto p : objects)
+		allocator.deallocate(p);
+
+	// All but the first slab get released
+	CPPUNIT_ASSERT_EQUAL(size_t(0), allocator.used());
+	CPPUNIT_ASSERT_EQUAL(4 * allocator.object_size(), allocator.reserved());
+}
+
+void CSlabAllocatorTest::testReuse()
+{
+	CSlabAllocator allocator(32, 8);
+
+	void* a = allocator.allocate();
+	void* b = allocator.allocate();
+	allocator.deallocate(a);
+
+	// Freed objects get reused first
+	void* c = allocator.allocate();
+	CPPUNIT_ASSERT(a == c);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), allocator.used());
+	CPPUNIT_ASSERT_EQUAL(8 * allocator.object_size(), allocator.reserved());
+
+	allocator.deallocate(b);
+	allocator.deallocate(c);
+	allocator.deallocate(0);
+	CPPUNIT_ASSERT_EQUAL(size_t(0), allocator.used());
+
+	// Starts over at the beginning of the remaining slab
+	CPPUNIT_ASSERT(allocator.allocate() == a);
+	CPPUNIT_ASSERT(allocator.allocate() == b);
+}
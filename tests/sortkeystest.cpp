@@ -0,0 +1,135 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "sort_keys.h"
+
+#include <algorithm>
+#include <random>
+
+/*
+ * This testsuite asserts that sorting file names by their precomputed keys
+ * results in the same order as comparing the names directly.
+ */
+
+class CNameSortKeysTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CNameSortKeysTest);
+	CPPUNIT_TEST(testCase);
+	CPPUNIT_TEST(testNatural);
+	CPPUNIT_TEST(testErase);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testCase();
+	void testNatural();
+	void testErase();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CNameSortKeysTest);
+
+namespace {
+int sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+
+// Same as CFileListCtrlSortBase::CmpNoCase
+int CmpNoCase(std::wstring const& a, std::wstring const& b)
+{
+	size_t const len = std::min(a.size(), b.size());
+	for (size_t i = 0; i < len; ++i) {
+		int const diff = static_cast<int>(towlower(a[i])) - static_cast<int>(towlower(b[i]));
+		if (diff) {
+			return diff;
+		}
+	}
+	if (a.size() != b.size()) {
+		return a.size() < b.size() ? -1 : 1;
+	}
+	return a.compare(b);
+}
+
+std::vector<std::wstring> RandomNames(size_t count, wchar_t const* chars, size_t maxLength, unsigned int seed)
+{
+	std::mt19937 gen(seed);
+	size_t const n = wcslen(chars);
+	std::vector<std::wstring> names(count);
+	for (auto& name : names) {
+		size_t const len = 1 + gen() % maxLength;
+		for (size_t i = 0; i < len; ++i) {
+			name += chars[gen() % n];
+		}
+	}
+	return names;
+}
+}
+
+void CNameSortKeysTest::testCase()
+{
+	auto const names = RandomNames(2000, L"aAbB.-_äÄ\U0001F600", 6, 1);
+
+	CNameSortKeys insensitive(CNameSortKeys::case_insensitive);
+	CNameSortKeys sensitive(CNameSortKeys::case_sensitive);
+	for (auto const& name : names) {
+		insensitive.push_back(name);
+		sensitive.push_back(name);
+	}
+	CPPUNIT_ASSERT_EQUAL(names.size(), insensitive.size());
+
+	for (size_t i = 0; i < names.size(); ++i) {
+		for (size_t j = 0; j < names.size(); j += 7) {
+			CPPUNIT_ASSERT_EQUAL(sign(CmpNoCase(names[i], names[j])), sign(insensitive.compare(i, j)));
+			CPPUNIT_ASSERT_EQUAL(sign(names[i].compare(names[j])), sign(sensitive.compare(i, j)));
+		}
+	}
+}
+
+void CNameSortKeysTest::testNatural()
+{
+	std::vector<std::wstring> const sorted = {
+		L"-1", L"0", L"00", L"1", L"01", L"2", L"9", L"10", L"99999999999999999999", L"100000000000000000000", L"A", L"a",
+		L"a1", L"a1b", L"a2", L"a10", L"a10.1", L"a10.02", L"a10.10", L"a10b", L"a010b", L"ab", L"b-1", L"B1", L"b1"
+	};
+
+	CNameSortKeys keys(CNameSortKeys::natural);
+	for (auto const& name : sorted) {
+		keys.push_back(name);
+	}
+
+	for (size_t i = 0; i < sorted.size(); ++i) {
+		for (size_t j = 0; j < sorted.size(); ++j) {
+			if (sign(keys.compare(i, j)) != sign(static_cast<int>(i) - static_cast<int>(j))) {
+				CPPUNIT_FAIL("Wrong order of " + std::string(sorted[i].begin(), sorted[i].end()) + " and " + std::string(sorted[j].begin(), sorted[j].end()));
+			}
+		}
+	}
+}
+
+void CNameSortKeysTest::testErase()
+{
+	CNameSortKeys keys;
+	keys.push_back(L"c");
+	keys.push_back(L"b");
+	keys.push_back(L"a");
+
+	keys.erase(1);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), keys.size());
+	CPPUNIT_ASSERT(keys.compare(0, 1) > 0);
+
+	keys.push_back(L"B");
+	CPPUNIT_ASSERT(keys.compare(2, 0) < 0);
+	CPPUNIT_ASSERT(keys.compare(2, 1) > 0);
+
+	keys.push_back(L"d");
+	keys.erase(std::vector<size_t>({ 0, 2 }));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), keys.size());
+	CPPUNIT_ASSERT(keys.compare(0, 1) < 0);
+
+	keys.clear(CNameSortKeys::case_sensitive);
+	CPPUNIT_ASSERT_EQUAL(size_t(0), keys.size());
+	keys.push_back(L"a");
+	keys.push_back(L"B");
+	CPPUNIT_ASSERT(keys.compare(0, 1) > 0);
+}
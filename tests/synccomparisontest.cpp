@@ -0,0 +1,141 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "sync_comparison.h"
+
+/*
+ * This testsuite asserts that downloading the changed files of a remote
+ * directory picks exactly the entries missing locally, differing in size or
+ * newer than the local files beyond the threshold.
+ */
+
+class CSyncComparisonTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CSyncComparisonTest);
+	CPPUNIT_TEST(testMissing);
+	CPPUNIT_TEST(testSize);
+	CPPUNIT_TEST(testThreshold);
+	CPPUNIT_TEST(testType);
+	CPPUNIT_TEST(testNames);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testMissing();
+	void testSize();
+	void testThreshold();
+	void testType();
+	void testNames();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CSyncComparisonTest);
+
+namespace {
+struct local_entry
+{
+	wxString name;
+	bool dir;
+	wxLongLong size;
+	CDateTime time;
+};
+
+local_entry Local(wxString const& name, bool dir, wxLongLong size = 10, CDateTime const& time = CDateTime(2015, 6, 1, 12, 0, 0))
+{
+	local_entry entry;
+	entry.name = name;
+	entry.dir = dir;
+	entry.size = dir ? -1 : size;
+	entry.time = time;
+	return entry;
+}
+
+CDirentry Remote(wxString const& name, bool dir, wxLongLong size = 10, CDateTime const& time = CDateTime(2015, 6, 1, 12, 0, 0))
+{
+	CDirentry entry;
+	entry.name = name;
+	entry.flags = dir ? CDirentry::flag_dir : 0;
+	entry.size = dir ? -1 : size;
+	entry.time = time;
+	return entry;
+}
+
+// Returns the changed flags as a string of 0 and 1, one per remote entry
+std::string Compare(std::vector<local_entry> const& local, std::vector<CDirentry> const& remote,
+	std::vector<wxString> names = std::vector<wxString>(), bool caseSensitive = true)
+{
+	std::deque<CRefcountObject<CDirentry>> entries;
+	for (auto const& entry : remote) {
+		entries.push_back(CRefcountObject<CDirentry>(entry));
+		if (names.size() < entries.size())
+			names.push_back(entry.name);
+	}
+
+	CDirectoryListing listing;
+	listing.Assign(entries);
+
+	std::vector<char> changed;
+	FindChangedEntries(local, listing, names, wxTimeSpan::Minutes(1), caseSensitive, changed);
+
+	std::string ret;
+	for (auto const& c : changed)
+		ret += c ? '1' : '0';
+	return ret;
+}
+}
+
+void CSyncComparisonTest::testMissing()
+{
+	CPPUNIT_ASSERT_EQUAL(std::string(), Compare({ Local(_T("a"), false) }, {}));
+	CPPUNIT_ASSERT_EQUAL(std::string("11"), Compare({}, { Remote(_T("a"), false), Remote(_T("d"), true) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("0100"),
+		Compare({ Local(_T("a"), false), Local(_T("c"), false), Local(_T("d"), true), Local(_T("e"), false) },
+			{ Remote(_T("a"), false), Remote(_T("b"), false), Remote(_T("c"), false), Remote(_T("d"), true) }));
+}
+
+void CSyncComparisonTest::testSize()
+{
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare({ Local(_T("a"), false, 10) }, { Remote(_T("a"), false, 10) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), Compare({ Local(_T("a"), false, 10) }, { Remote(_T("a"), false, 11) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), Compare({ Local(_T("a"), false, 10) }, { Remote(_T("a"), false, 0) }));
+
+	// Unknown sizes don't count as different, older files of a different
+	// size do
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare({ Local(_T("a"), false, 10) }, { Remote(_T("a"), false, -1) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), Compare({ Local(_T("a"), false, 10) }, { Remote(_T("a"), false, 5, CDateTime(2014, 1, 1, 0, 0, 0)) }));
+}
+
+void CSyncComparisonTest::testThreshold()
+{
+	std::vector<local_entry> const local = { Local(_T("a"), false) };
+
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare(local, { Remote(_T("a"), false, 10, CDateTime(2015, 6, 1, 11, 0, 0)) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare(local, { Remote(_T("a"), false, 10, CDateTime(2015, 6, 1, 12, 0, 0)) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare(local, { Remote(_T("a"), false, 10, CDateTime(2015, 6, 1, 12, 1, 0)) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), Compare(local, { Remote(_T("a"), false, 10, CDateTime(2015, 6, 1, 12, 1, 1)) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), Compare(local, { Remote(_T("a"), false, 10, CDateTime(2015, 6, 2)) }));
+
+	// Without both times, only the size is compared
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare(local, { Remote(_T("a"), false, 10, CDateTime()) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare({ Local(_T("a"), false, 10, CDateTime()) }, { Remote(_T("a"), false, 10, CDateTime(2015, 6, 2)) }));
+}
+
+void CSyncComparisonTest::testType()
+{
+	// A file in the way of a directory and the other way around
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), Compare({ Local(_T("a"), true) }, { Remote(_T("a"), false) }));
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), Compare({ Local(_T("a"), false) }, { Remote(_T("a"), true) }));
+
+	// Directories only get compared by their contents
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare({ Local(_T("a"), true, -1, CDateTime(2000, 1, 1)) }, { Remote(_T("a"), true, -1, CDateTime(2015, 1, 1)) }));
+}
+
+void CSyncComparisonTest::testNames()
+{
+	// Matched by the names files get downloaded under
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare({ Local(_T("a_b"), false) }, { Remote(_T("a:b"), false) }, { _T("a_b") }));
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), Compare({ Local(_T("a:b"), false) }, { Remote(_T("a:b"), false) }, { _T("a_b") }));
+
+	CPPUNIT_ASSERT_EQUAL(std::string("1"), Compare({ Local(_T("A"), false) }, { Remote(_T("a"), false) }, {}, true));
+	CPPUNIT_ASSERT_EQUAL(std::string("0"), Compare({ Local(_T("A"), false) }, { Remote(_T("a"), false) }, {}, false));
+}
@@ -0,0 +1,197 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "idlequeue.h"
+#include "transfer_policy.h"
+
+#include <vector>
+
+/*
+ * This testsuite asserts which idle file the transfer queue starts next
+ * under each of the transfer policies, and the statistics kept about
+ * finished transfers.
+ */
+
+namespace {
+struct file
+{
+	int id{};
+	int64_t size{};
+	CIdleQueueHook<file> hook;
+};
+
+typedef CIdleQueue<file, &file::hook, 3> queue_type;
+
+int64_t const small = 1000;
+int64_t const large = 100 * 1024 * 1024;
+
+std::vector<file> MakeFiles(std::vector<int64_t> const& sizes)
+{
+	std::vector<file> files(sizes.size());
+	for (size_t i = 0; i < sizes.size(); ++i) {
+		files[i].id = static_cast<int>(i);
+		files[i].size = sizes[i];
+	}
+	return files;
+}
+
+// Returns the id of the picked file, -1 if none
+int Pick(queue_type& q, TransferPolicy policy, bool smallOnly, bool immediateOnly = false)
+{
+	file* f = transfer_policy::pick(q, policy, smallOnly, immediateOnly, true, true, [](file const& f) { return f.size; });
+	return f ? f->id : -1;
+}
+}
+
+class CTransferPolicyTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CTransferPolicyTest);
+	CPPUNIT_TEST(testSlots);
+	CPPUNIT_TEST(testStats);
+	CPPUNIT_TEST(testQueueOrder);
+	CPPUNIT_TEST(testReserveSmall);
+	CPPUNIT_TEST(testLargestFirst);
+	CPPUNIT_TEST(testPriorities);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testSlots();
+	void testStats();
+	void testQueueOrder();
+	void testReserveSmall();
+	void testLargestFirst();
+	void testPriorities();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CTransferPolicyTest);
+
+void CTransferPolicyTest::testSlots()
+{
+	CPPUNIT_ASSERT_EQUAL(1, transfer_policy::large_slots(TransferPolicy::reserve_small, 1));
+	CPPUNIT_ASSERT_EQUAL(1, transfer_policy::large_slots(TransferPolicy::reserve_small, 2));
+	CPPUNIT_ASSERT_EQUAL(6, transfer_policy::large_slots(TransferPolicy::reserve_small, 8));
+	CPPUNIT_ASSERT_EQUAL(8, transfer_policy::large_slots(TransferPolicy::largest_first, 8));
+
+	CPPUNIT_ASSERT(transfer_policy::score(TransferPolicy::reserve_small, -1, true) < 0);
+	CPPUNIT_ASSERT(transfer_policy::score(TransferPolicy::reserve_small, 100, true) >= 0);
+	CPPUNIT_ASSERT(transfer_policy::score(TransferPolicy::largest_first, 200, false) > transfer_policy::score(TransferPolicy::largest_first, 100, false));
+
+	CPPUNIT_ASSERT(transfer_policy::from_option(42) == TransferPolicy::queue_order);
+}
+
+void CTransferPolicyTest::testStats()
+{
+	transfer_policy::stats stats;
+	stats.started(0);
+	stats.started(500);
+	stats.finished(1000, 2000, true);
+	stats.finished(2000, 1000, false);
+	stats.started(3000);
+	stats.finished(4000, 2000, true);
+
+	CPPUNIT_ASSERT_EQUAL(2, stats.files());
+	CPPUNIT_ASSERT_EQUAL(1, stats.failed());
+	CPPUNIT_ASSERT_EQUAL(int64_t(4000), stats.bytes());
+	CPPUNIT_ASSERT_EQUAL(int64_t(3000), stats.busy_time());
+	CPPUNIT_ASSERT_EQUAL(int64_t(1333), stats.throughput());
+}
+
+void CTransferPolicyTest::testQueueOrder()
+{
+	std::vector<file> files = MakeFiles({ large, small, large });
+	queue_type q;
+	for (auto& f : files)
+		q.push_back(f, false, 1, true);
+
+	CPPUNIT_ASSERT_EQUAL(0, Pick(q, TransferPolicy::queue_order, false));
+	CPPUNIT_ASSERT_EQUAL(0, Pick(q, TransferPolicy::reserve_small, false));
+	CPPUNIT_ASSERT_EQUAL(0, Pick(q, TransferPolicy::round_robin, false));
+
+	q.remove(files[0]);
+	CPPUNIT_ASSERT_EQUAL(1, Pick(q, TransferPolicy::queue_order, false));
+}
+
+void CTransferPolicyTest::testReserveSmall()
+{
+	// Files of unknown size don't count as small
+	std::vector<file> files = MakeFiles({ large, -1, small, small });
+	queue_type q;
+	for (auto& f : files)
+		q.push_back(f, false, 1, true);
+
+	CPPUNIT_ASSERT_EQUAL(2, Pick(q, TransferPolicy::reserve_small, true));
+	q.remove(files[2]);
+	CPPUNIT_ASSERT_EQUAL(3, Pick(q, TransferPolicy::reserve_small, true));
+	q.remove(files[3]);
+	CPPUNIT_ASSERT_EQUAL(-1, Pick(q, TransferPolicy::reserve_small, true));
+
+	// Small files beyond the lookahead are not found
+	std::vector<file> many(transfer_policy::lookahead + 1);
+	many.back().id = 42;
+	many.back().size = small;
+	queue_type q2;
+	for (size_t i = 0; i < many.size(); ++i) {
+		if (i + 1 < many.size())
+			many[i].size = large;
+		q2.push_back(many[i], false, 1, true);
+	}
+	CPPUNIT_ASSERT_EQUAL(-1, Pick(q2, TransferPolicy::reserve_small, true));
+	q2.remove(many[0]);
+	CPPUNIT_ASSERT_EQUAL(42, Pick(q2, TransferPolicy::reserve_small, true));
+}
+
+void CTransferPolicyTest::testLargestFirst()
+{
+	std::vector<file> files = MakeFiles({ small, -1, large, large * 2, small, large * 2 });
+	queue_type q;
+	for (auto& f : files)
+		q.push_back(f, false, 1, true);
+
+	// The earliest of the largest ones, files of unknown size last
+	int const expected[] = { 3, 5, 2, 0, 4, 1 };
+	for (int id : expected) {
+		CPPUNIT_ASSERT_EQUAL(id, Pick(q, TransferPolicy::largest_first, false));
+		q.remove(files[id]);
+	}
+	CPPUNIT_ASSERT_EQUAL(-1, Pick(q, TransferPolicy::largest_first, false));
+
+	// Only small ones while the remaining slots are kept for them
+	files = MakeFiles({ large, small, small * 2 });
+	for (auto& f : files)
+		q.push_back(f, false, 1, true);
+	CPPUNIT_ASSERT_EQUAL(0, Pick(q, TransferPolicy::largest_first, false));
+	CPPUNIT_ASSERT_EQUAL(2, Pick(q, TransferPolicy::largest_first, true));
+}
+
+void CTransferPolicyTest::testPriorities()
+{
+	// Files of a lower priority never get started ahead of those of a higher
+	// one, even if the policy would prefer them
+	std::vector<file> files = MakeFiles({ large, large, small, large * 2 });
+	queue_type q;
+	q.push_back(files[0], false, 2, true);
+	q.push_back(files[1], false, 2, true);
+	q.push_back(files[2], false, 1, true);
+	q.push_back(files[3], false, 0, true);
+
+	for (int i = 0; i < static_cast<int>(TransferPolicy::count); ++i)
+		CPPUNIT_ASSERT_EQUAL(0, Pick(q, static_cast<TransferPolicy>(i), false));
+	CPPUNIT_ASSERT_EQUAL(-1, Pick(q, TransferPolicy::reserve_small, true));
+	CPPUNIT_ASSERT_EQUAL(-1, Pick(q, TransferPolicy::largest_first, true));
+
+	q.remove(files[0]);
+	q.remove(files[1]);
+	CPPUNIT_ASSERT_EQUAL(2, Pick(q, TransferPolicy::largest_first, false));
+	CPPUNIT_ASSERT_EQUAL(2, Pick(q, TransferPolicy::reserve_small, true));
+
+	// Immediate files take precedence over queued ones
+	std::vector<file> immediate = MakeFiles({ small });
+	immediate[0].id = 10;
+	q.push_back(immediate[0], true, 0, true);
+	CPPUNIT_ASSERT_EQUAL(10, Pick(q, TransferPolicy::largest_first, false));
+	CPPUNIT_ASSERT_EQUAL(10, Pick(q, TransferPolicy::largest_first, false, true));
+	q.remove(immediate[0]);
+	CPPUNIT_ASSERT_EQUAL(-1, Pick(q, TransferPolicy::largest_first, false, true));
+}
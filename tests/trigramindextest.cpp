@@ -0,0 +1,109 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "trigram_index.h"
+
+#include <random>
+
+/*
+ * This testsuite asserts that the trigram index finds every name containing
+ * a substring, ignoring case.
+ */
+
+class CTrigramIndexTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CTrigramIndexTest);
+	CPPUNIT_TEST(testFind);
+	CPPUNIT_TEST(testRemove);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testFind();
+	void testRemove();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CTrigramIndexTest);
+
+namespace {
+std::wstring Lower(std::wstring s)
+{
+	for (auto& c : s) {
+		c = static_cast<wchar_t>(towlower(c));
+	}
+	return s;
+}
+
+std::vector<size_t> Find(CTrigramIndex const& index, std::wstring const& sub)
+{
+	std::vector<size_t> ids;
+	index.find(sub, [&](size_t id) { ids.push_back(id); });
+	return ids;
+}
+}
+
+void CTrigramIndexTest::testFind()
+{
+	std::mt19937 gen(1);
+	wchar_t const chars[] = L"aAbBc.";
+
+	std::vector<std::wstring> names;
+	CTrigramIndex index;
+	for (size_t i = 0; i < 2000; ++i) {
+		std::wstring name;
+		size_t const len = gen() % 10;
+		for (size_t j = 0; j < len; ++j) {
+			name += chars[gen() % 6];
+		}
+		names.push_back(name);
+		CPPUNIT_ASSERT_EQUAL(i, index.add(name));
+	}
+
+	for (size_t i = 0; i < 200; ++i) {
+		std::wstring sub;
+		size_t const len = 1 + gen() % 5;
+		for (size_t j = 0; j < len; ++j) {
+			sub += chars[gen() % 6];
+		}
+
+		auto const ids = Find(index, sub);
+		CPPUNIT_ASSERT(std::is_sorted(ids.begin(), ids.end()));
+
+		// Every name containing the substring is among the candidates
+		for (size_t id = 0; id < names.size(); ++id) {
+			if (Lower(names[id]).find(Lower(sub)) != std::wstring::npos) {
+				CPPUNIT_ASSERT(std::binary_search(ids.begin(), ids.end(), id));
+			}
+		}
+	}
+
+	// Names without a trigram of the substring are no candidates
+	CTrigramIndex small;
+	small.add(L"Report.TXT");
+	small.add(L"image.png");
+	small.add(L"xt");
+	CPPUNIT_ASSERT(Find(small, L"t.tx") == std::vector<size_t>({ 0 }));
+	CPPUNIT_ASSERT(Find(small, L"PNG") == std::vector<size_t>({ 1 }));
+	CPPUNIT_ASSERT(Find(small, L"zip").empty());
+	CPPUNIT_ASSERT(Find(small, L"xt") == std::vector<size_t>({ 0, 1, 2 }));
+}
+
+void CTrigramIndexTest::testRemove()
+{
+	CTrigramIndex index;
+	index.add(L"file1");
+	index.add(L"file2");
+	index.add(L"file3");
+
+	index.remove(1);
+	index.remove(1);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), index.size());
+	CPPUNIT_ASSERT_EQUAL(size_t(1), index.removed());
+	CPPUNIT_ASSERT(Find(index, L"file") == std::vector<size_t>({ 0, 2 }));
+	CPPUNIT_ASSERT(Find(index, L"") == std::vector<size_t>({ 0, 2 }));
+
+	index.clear();
+	CPPUNIT_ASSERT_EQUAL(size_t(0), index.size());
+	CPPUNIT_ASSERT(Find(index, L"file").empty());
+}
@@ -0,0 +1,182 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "xml_stream.h"
+
+#include <memory>
+
+/*
+ * This testsuite asserts the correctness of the streaming XML reader and
+ * writer used to export and import the queue, including a round trip of a
+ * queue through them.
+ */
+
+class CXmlStreamTest : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CXmlStreamTest);
+	CPPUNIT_TEST(testRead);
+	CPPUNIT_TEST(testRoundTrip);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testRead();
+	void testRoundTrip();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CXmlStreamTest);
+
+namespace {
+struct file_closer
+{
+	void operator()(FILE* f) const { fclose(f); }
+};
+typedef std::unique_ptr<FILE, file_closer> file_ptr;
+
+file_ptr TempFile(char const* content)
+{
+	file_ptr f(tmpfile());
+	fputs(content, f.get());
+	rewind(f.get());
+	return f;
+}
+
+// Without line breaks and indentation, which the writer adjusts
+std::string Unindent(std::string const& s)
+{
+	std::string ret;
+	bool lineStart = false;
+	for (char c : s) {
+		if (c == '\n')
+			lineStart = true;
+		else if (!lineStart || c != ' ') {
+			lineStart = false;
+			ret += c;
+		}
+	}
+	return ret;
+}
+}
+
+void CXmlStreamTest::testRead()
+{
+	char const* const xml =
+		"<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\" ?>\n"
+		"<!-- A comment with <tags> -->\n"
+		"<FileZilla3 version=\"3.x > 2\">\n"
+		"    <Settings><Setting name=\"a\">1</Setting><Empty /></Settings>\n"
+		"    <Queue>\n"
+		"        <Server><Host>example.com</Host>\n"
+		"            <File><LocalFile>/tmp/a &amp; b</LocalFile><Data><![CDATA[</File>]]></Data></File>\n"
+		"        </Server>\n"
+		"    </Queue>\n"
+		"</FileZilla3>\n";
+
+	// Tiny chunks to have tokens span multiple reads
+	for (size_t chunk : { size_t(1), size_t(7), size_t(65536) }) {
+		file_ptr f = TempFile(xml);
+		CXmlStreamReader reader(f.get(), chunk);
+
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::start);
+		CPPUNIT_ASSERT_EQUAL(std::string("FileZilla3"), reader.name());
+		CPPUNIT_ASSERT_EQUAL(size_t(1), reader.depth());
+
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::start);
+		CPPUNIT_ASSERT_EQUAL(std::string("Settings"), reader.name());
+		std::string element;
+		CPPUNIT_ASSERT(reader.read_element(element));
+		CPPUNIT_ASSERT_EQUAL(std::string("<Settings><Setting name=\"a\">1</Setting><Empty /></Settings>"), element);
+		CPPUNIT_ASSERT_EQUAL(size_t(1), reader.depth());
+
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::start);
+		CPPUNIT_ASSERT_EQUAL(std::string("Queue"), reader.name());
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::start);
+		CPPUNIT_ASSERT_EQUAL(std::string("Server"), reader.name());
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::start);
+		CPPUNIT_ASSERT_EQUAL(std::string("Host"), reader.name());
+		CPPUNIT_ASSERT(reader.skip_element());
+
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::start);
+		CPPUNIT_ASSERT_EQUAL(std::string("File"), reader.name());
+		CPPUNIT_ASSERT_EQUAL(size_t(4), reader.depth());
+		CPPUNIT_ASSERT(reader.read_element(element));
+		CPPUNIT_ASSERT_EQUAL(std::string("<File><LocalFile>/tmp/a &amp; b</LocalFile><Data><![CDATA[</File>]]></Data></File>"), element);
+
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::end);
+		CPPUNIT_ASSERT_EQUAL(std::string("Server"), reader.name());
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::end);
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::end);
+		CPPUNIT_ASSERT_EQUAL(std::string("FileZilla3"), reader.name());
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::eof);
+	}
+
+	// Mismatched and unterminated tags
+	{
+		file_ptr f = TempFile("<a><b></a>");
+		CXmlStreamReader reader(f.get());
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::start);
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::start);
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::error);
+	}
+	{
+		file_ptr f = TempFile("<a><b>");
+		CXmlStreamReader reader(f.get());
+		CPPUNIT_ASSERT(reader.next() == CXmlStreamReader::token::start);
+		CPPUNIT_ASSERT(!reader.skip_element());
+	}
+}
+
+void CXmlStreamTest::testRoundTrip()
+{
+	int const count = 300;
+
+	auto fileElement = [](int i) {
+		std::string file = "<File>\n    <LocalFile>/home/user/dir" + std::to_string(i / 100) + "/file" + std::to_string(i) + " &amp; more</LocalFile>\n";
+		file += "    <RemoteFile>file" + std::to_string(i) + "</RemoteFile>\n    <RemotePath>1 0 3 dir</RemotePath>\n";
+		file += "    <Download>0</Download>\n    <Size>" + std::to_string(i * 100) + "</Size>\n    <DataType>1</DataType>\n</File>";
+		return file;
+	};
+
+	file_ptr f(tmpfile());
+	{
+		CXmlStreamWriter writer(f.get());
+		writer.declaration();
+		writer.start("FileZilla3");
+		writer.start("Queue");
+		writer.start("Server");
+		writer.element("<Host>example.com</Host>");
+		for (int i = 0; i < count; ++i)
+			writer.element(fileElement(i).c_str());
+		writer.finish();
+		CPPUNIT_ASSERT(!writer.error());
+	}
+
+	// Tiny chunks to have tokens span multiple reads
+	for (size_t chunk : { size_t(1), size_t(7), size_t(65536) }) {
+		rewind(f.get());
+		CXmlStreamReader reader(f.get(), chunk);
+
+		int files = 0;
+		bool host = false;
+		std::string element;
+		CXmlStreamReader::token t;
+		while ((t = reader.next()) != CXmlStreamReader::token::eof) {
+			CPPUNIT_ASSERT(t != CXmlStreamReader::token::error);
+			if (t == CXmlStreamReader::token::start && reader.depth() == 4) {
+				std::string const name = reader.name();
+				CPPUNIT_ASSERT(reader.read_element(element));
+				if (name == "File") {
+					CPPUNIT_ASSERT_EQUAL(Unindent(fileElement(files)), Unindent(element));
+					++files;
+				}
+				else {
+					CPPUNIT_ASSERT_EQUAL(std::string("<Host>example.com</Host>"), element);
+					host = true;
+				}
+			}
+		}
+		CPPUNIT_ASSERT(host);
+		CPPUNIT_ASSERT_EQUAL(count, files);
+	}
+}